@@ -0,0 +1,142 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ */
+
+/* Compares a settings lookup through the typed table against asking a
+ * backend for the value text and parsing it, which is what every
+ * gdm_settings_direct_get_*() call used to do.
+ *
+ *   bench-settings --iterations=1000000
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "gdm-settings.h"
+#include "gdm-settings-desktop-backend.h"
+#include "gdm-settings-direct.h"
+#include "gdm-settings-keys.h"
+#include "gdm-settings-utils.h"
+
+static int      iterations = 1000000;
+
+static GOptionEntry entries[] = {
+        { "iterations", 0, 0, G_OPTION_ARG_INT, &iterations, "Lookups to time per method", "N" },
+        { NULL }
+};
+
+static const char config[] =
+        "[daemon]\n"
+        "AutomaticLoginEnable=true\n"
+        "TimedLoginDelay=15\n"
+        "FallbackSession=gnome\n";
+
+/* Each iteration looks up two settings */
+static void
+report (const char *method,
+        gint64      elapsed)
+{
+        g_print ("%-10s %8.1f ns/lookup\n", method, elapsed * 1000.0 / (2.0 * iterations));
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+        g_autoptr (GOptionContext) context = NULL;
+        g_autoptr (GError) error = NULL;
+        g_autoptr (GdmSettingsBackend) backend = NULL;
+        g_autoptr (GdmSettings) settings = NULL;
+        g_autofree char *path = NULL;
+        gint64 start;
+        int checksum = 0;
+        int fd;
+        int i;
+
+        context = g_option_context_new (NULL);
+        g_option_context_add_main_entries (context, entries, NULL);
+        if (!g_option_context_parse (context, &argc, &argv, &error)) {
+                g_printerr ("%s\n", error->message);
+                return EXIT_FAILURE;
+        }
+
+        if (iterations < 1) {
+                g_printerr ("--iterations must be at least 1\n");
+                return EXIT_FAILURE;
+        }
+
+        fd = g_file_open_tmp ("bench-settings-XXXXXX.conf", &path, &error);
+        if (fd < 0) {
+                g_printerr ("%s\n", error->message);
+                return EXIT_FAILURE;
+        }
+        close (fd);
+
+        if (!g_file_set_contents (path, config, -1, &error)) {
+                g_printerr ("%s\n", error->message);
+                return EXIT_FAILURE;
+        }
+
+        backend = gdm_settings_desktop_backend_new (path);
+
+        settings = gdm_settings_new ();
+        gdm_settings_direct_init (settings);
+
+        start = g_get_monotonic_time ();
+        for (i = 0; i < iterations; i++) {
+                g_autofree char *text = NULL;
+                gboolean enabled = FALSE;
+                int delay = 0;
+
+                if (gdm_settings_backend_get_value (backend, "daemon/AutomaticLoginEnable", &text, NULL))
+                        gdm_settings_parse_value_as_boolean (text, &enabled);
+                g_clear_pointer (&text, g_free);
+
+                if (gdm_settings_backend_get_value (backend, "daemon/TimedLoginDelay", &text, NULL))
+                        gdm_settings_parse_value_as_integer (text, &delay);
+
+                checksum += enabled + delay;
+        }
+        report ("parsed", g_get_monotonic_time () - start);
+
+        start = g_get_monotonic_time ();
+        for (i = 0; i < iterations; i++) {
+                gboolean enabled = FALSE;
+                int delay = 0;
+
+                gdm_settings_direct_get_boolean (GDM_KEY_AUTO_LOGIN_ENABLE, &enabled);
+                gdm_settings_direct_get_int (GDM_KEY_TIMED_LOGIN_DELAY, &delay);
+
+                checksum += enabled + delay;
+        }
+        report ("table", g_get_monotonic_time () - start);
+
+        /* Keep the compiler from dropping the loops */
+        if (checksum == 42)
+                g_print ("\n");
+
+        g_unlink (path);
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,170 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ */
+
+/* Compares the latency of starting a child with fork () against
+ * gdm_spawn ()'s posix_spawn () path, while this process holds as much
+ * resident memory as a running daemon.
+ *
+ *   bench-spawn --pid=$(pidof gdm)   # match the daemon's VmRSS
+ *   bench-spawn --rss=256            # or pick a size in MiB
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+
+#include "gdm-spawn.h"
+
+static int      pid_to_match = 0;
+static int      rss_mib = 64;
+static int      iterations = 200;
+
+static GOptionEntry entries[] = {
+        { "pid", 0, 0, G_OPTION_ARG_INT, &pid_to_match, "Use the resident set size of this process", "PID" },
+        { "rss", 0, 0, G_OPTION_ARG_INT, &rss_mib, "Resident memory to hold, in MiB", "MIB" },
+        { "iterations", 0, 0, G_OPTION_ARG_INT, &iterations, "Children to start per method", "N" },
+        { NULL }
+};
+
+static int
+get_rss_mib_for_pid (int pid)
+{
+        g_autofree char *path = NULL;
+        g_autofree char *contents = NULL;
+        const char *line;
+
+        path = g_strdup_printf ("/proc/%d/status", pid);
+        if (!g_file_get_contents (path, &contents, NULL, NULL))
+                return -1;
+
+        line = strstr (contents, "VmRSS:");
+        if (line == NULL)
+                return -1;
+
+        return (int) (g_ascii_strtoll (line + strlen ("VmRSS:"), NULL, 10) / 1024);
+}
+
+static void
+noop_child_setup (gpointer user_data)
+{
+}
+
+static int
+compare_times (gconstpointer a,
+               gconstpointer b)
+{
+        gint64 time_a = *(const gint64 *) a;
+        gint64 time_b = *(const gint64 *) b;
+
+        return (time_a > time_b) - (time_a < time_b);
+}
+
+static void
+run (const char           *label,
+     GSpawnChildSetupFunc  child_setup)
+{
+        const char * const argv[] = { "true", NULL };
+        g_autoptr(GArray) times = NULL;
+        gint64 total = 0;
+        int i;
+
+        times = g_array_sized_new (FALSE, FALSE, sizeof (gint64), iterations);
+
+        for (i = 0; i < iterations; i++) {
+                g_autoptr(GError) error = NULL;
+                GPid pid;
+                gint64 start, elapsed;
+                int status;
+
+                start = g_get_monotonic_time ();
+                if (!gdm_spawn ("true", argv, NULL, -1, -1, -1,
+                                GDM_SPAWN_SEARCH_PATH,
+                                child_setup, NULL,
+                                &pid, &error)) {
+                        g_printerr ("%s: %s\n", label, error->message);
+                        exit (EXIT_FAILURE);
+                }
+                /* time to get control back in the parent, which is
+                 * what the daemon's main loop waits for */
+                elapsed = g_get_monotonic_time () - start;
+
+                waitpid (pid, &status, 0);
+
+                g_array_append_val (times, elapsed);
+                total += elapsed;
+        }
+
+        g_array_sort (times, compare_times);
+
+        g_print ("%-12s mean %6" G_GINT64_FORMAT " us  median %6" G_GINT64_FORMAT " us  p99 %6" G_GINT64_FORMAT " us\n",
+                 label,
+                 total / iterations,
+                 g_array_index (times, gint64, iterations / 2),
+                 g_array_index (times, gint64, (iterations * 99) / 100));
+}
+
+int
+main (int argc, char **argv)
+{
+        g_autoptr(GOptionContext) context = NULL;
+        g_autoptr(GError) error = NULL;
+        g_autofree char *ballast = NULL;
+        gsize size;
+
+        context = g_option_context_new (NULL);
+        g_option_context_add_main_entries (context, entries, NULL);
+        if (!g_option_context_parse (context, &argc, &argv, &error)) {
+                g_printerr ("%s\n", error->message);
+                return EXIT_FAILURE;
+        }
+
+        if (pid_to_match > 0) {
+                rss_mib = get_rss_mib_for_pid (pid_to_match);
+                if (rss_mib < 0) {
+                        g_printerr ("Could not read the resident set size of pid %d\n", pid_to_match);
+                        return EXIT_FAILURE;
+                }
+        }
+
+        if (iterations <= 0) {
+                g_printerr ("Need at least one iteration\n");
+                return EXIT_FAILURE;
+        }
+
+        /* Touch every page so it's actually resident and fork () has
+         * to copy the page tables for it */
+        size = (gsize) rss_mib * 1024 * 1024;
+        ballast = g_malloc (size);
+        memset (ballast, 0x5a, size);
+
+        g_print ("Holding %d MiB resident, %d children per method\n", rss_mib, iterations);
+#ifndef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+        g_print ("posix_spawn_file_actions_addclosefrom_np () is missing, so both methods fork\n");
+#endif
+
+        run ("fork", noop_child_setup);
+        run ("posix_spawn", NULL);
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,329 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include <glib.h>
+#include <glib-unix.h>
+
+#include "gdm-child-watch.h"
+
+/* How often children are polled for when no pidfd is available */
+#define FALLBACK_POLL_INTERVAL_MSEC 100
+
+typedef struct
+{
+        GPid               pid;
+        int                pidfd;
+        GdmChildWatchFunc  func;
+        gpointer           user_data;
+} GdmChildWatch;
+
+static void
+log_child_exit (GPid                 pid,
+                int                  status,
+                const struct rusage *rusage)
+{
+        g_debug ("GdmChildWatch: process (pid:%d) done (%s:%d)",
+                 (int) pid,
+                 WIFEXITED (status) ? "status"
+                 : WIFSIGNALED (status) ? "signal"
+                 : "unknown",
+                 WIFEXITED (status) ? WEXITSTATUS (status)
+                 : WIFSIGNALED (status) ? WTERMSIG (status)
+                 : -1);
+
+        if (rusage == NULL)
+                return;
+
+        g_debug ("GdmChildWatch: process (pid:%d) used %ld.%06lds user, %ld.%06lds system, %ld kB max rss",
+                 (int) pid,
+                 (long) rusage->ru_utime.tv_sec, (long) rusage->ru_utime.tv_usec,
+                 (long) rusage->ru_stime.tv_sec, (long) rusage->ru_stime.tv_usec,
+                 rusage->ru_maxrss);
+}
+
+/* Returns TRUE once @pid is gone, either reaped here or earlier */
+static gboolean
+try_reap_child (GPid  pid,
+                int  *status)
+{
+        struct rusage rusage;
+        int ret;
+
+        do {
+                ret = wait4 (pid, status, WNOHANG, &rusage);
+        } while (ret < 0 && errno == EINTR);
+
+        if (ret == 0)
+                return FALSE;
+
+        if (ret < 0) {
+                if (errno == ECHILD) {
+                        g_debug ("GdmChildWatch: process (pid:%d) was reaped earlier", (int) pid);
+                } else {
+                        g_debug ("GdmChildWatch: wait4 () should not fail: %s", g_strerror (errno));
+                }
+                *status = 0;
+                return TRUE;
+        }
+
+        log_child_exit (pid, *status, &rusage);
+
+        return TRUE;
+}
+
+int
+gdm_child_pidfd_open (GPid pid)
+{
+#ifdef SYS_pidfd_open
+        return syscall (SYS_pidfd_open, pid, 0);
+#else
+        errno = ENOSYS;
+        return -1;
+#endif
+}
+
+static gboolean
+on_child_pidfd_readable (int            fd,
+                         GIOCondition   condition,
+                         GdmChildWatch *watch)
+{
+        struct rusage rusage;
+        int status = 0;
+        int ret;
+
+        do {
+                ret = wait4 (watch->pid, &status, WNOHANG, &rusage);
+        } while (ret < 0 && errno == EINTR);
+
+        if (ret == 0)
+                return G_SOURCE_CONTINUE;
+
+        if (ret < 0) {
+                g_debug ("GdmChildWatch: could not reap process (pid:%d): %s",
+                         (int) watch->pid, g_strerror (errno));
+                watch->func (watch->pid, 0, NULL, watch->user_data);
+                return G_SOURCE_REMOVE;
+        }
+
+        log_child_exit (watch->pid, status, &rusage);
+        watch->func (watch->pid, status, &rusage, watch->user_data);
+
+        return G_SOURCE_REMOVE;
+}
+
+static void
+on_child_exited (GPid           pid,
+                 int            status,
+                 GdmChildWatch *watch)
+{
+        log_child_exit (pid, status, NULL);
+        watch->func (pid, status, NULL, watch->user_data);
+}
+
+static void
+free_child_watch (GdmChildWatch *watch)
+{
+        if (watch->pidfd >= 0)
+                close (watch->pidfd);
+        g_free (watch);
+}
+
+/**
+ * gdm_child_watch_add:
+ *
+ * Like g_child_watch_add(), but polls a pidfd for @pid in the main loop
+ * so the exit status and resource usage are collected together, without
+ * going through SIGCHLD. Falls back to g_child_watch_add() on kernels
+ * without pidfd support.
+ *
+ * The returned source id can be removed with g_source_remove().
+ */
+guint
+gdm_child_watch_add (GPid              pid,
+                     GdmChildWatchFunc func,
+                     gpointer          user_data)
+{
+        GdmChildWatch *watch;
+        GSource *source;
+        guint id;
+
+        g_return_val_if_fail (pid > 0, 0);
+        g_return_val_if_fail (func != NULL, 0);
+
+        watch = g_new0 (GdmChildWatch, 1);
+        watch->pid = pid;
+        watch->func = func;
+        watch->user_data = user_data;
+
+        /* @pid is our unreaped child, so it can't have been recycled yet */
+        watch->pidfd = gdm_child_pidfd_open (pid);
+
+        if (watch->pidfd < 0) {
+                g_debug ("GdmChildWatch: no pidfd for process (pid:%d): %s, using a child watch",
+                         (int) pid, g_strerror (errno));
+                return g_child_watch_add_full (G_PRIORITY_DEFAULT,
+                                               pid,
+                                               (GChildWatchFunc) on_child_exited,
+                                               watch,
+                                               (GDestroyNotify) free_child_watch);
+        }
+
+        source = g_unix_fd_source_new (watch->pidfd, G_IO_IN);
+        g_source_set_callback (source,
+                               (GSourceFunc) on_child_pidfd_readable,
+                               watch,
+                               (GDestroyNotify) free_child_watch);
+        g_source_set_name (source, "[gdm] child watch");
+
+        id = g_source_attach (source, NULL);
+        g_source_unref (source);
+
+        return id;
+}
+
+static void
+warn_child_not_dying (GPid pid,
+                      int  timeout)
+{
+        g_autofree char *path = NULL;
+        g_autofree char *command = NULL;
+
+        path = g_strdup_printf ("/proc/%ld/cmdline", (long) pid);
+        if (g_file_get_contents (path, &command, NULL, NULL)) {
+                g_warning ("GdmChildWatch: process (pid:%d, command '%s') isn't dying after %d seconds, now ignoring it.",
+                           (int) pid, command, timeout);
+        } else {
+                g_warning ("GdmChildWatch: process (pid:%d) isn't dying after %d seconds, now ignoring it.",
+                           (int) pid, timeout);
+        }
+}
+
+/**
+ * gdm_child_wait_all:
+ * @pids: children to wait for
+ * @statuses: (out): wait statuses, one per pid
+ * @n_pids: number of children
+ * @timeout: seconds to wait in total, or 0 to wait forever
+ *
+ * Blocks until every child in @pids has exited and reaps it. All
+ * children are waited for at once by polling their pidfds, so stopping
+ * several of them costs one timeout rather than one each. Children that
+ * are still running when @timeout expires are left alone, and get a
+ * status of 0.
+ *
+ * Returns: %TRUE if every child was reaped
+ */
+gboolean
+gdm_child_wait_all (const GPid *pids,
+                    int        *statuses,
+                    guint       n_pids,
+                    int         timeout)
+{
+        g_autofree struct pollfd *fds = NULL;
+        gint64 deadline = -1;
+        gboolean has_fallback = FALSE;
+        guint n_pending = 0;
+        guint i;
+
+        fds = g_new0 (struct pollfd, n_pids);
+
+        if (timeout > 0)
+                deadline = g_get_monotonic_time () + timeout * G_USEC_PER_SEC;
+
+        for (i = 0; i < n_pids; i++) {
+                statuses[i] = 0;
+                fds[i].fd = -1;
+                fds[i].events = POLLIN;
+
+                /* Only open a pidfd for children that are still ours and
+                 * unreaped, since a reaped pid may already be recycled */
+                if (try_reap_child (pids[i], &statuses[i]))
+                        continue;
+
+                fds[i].fd = gdm_child_pidfd_open (pids[i]);
+                if (fds[i].fd < 0) {
+                        /* poll () skips negative descriptors; -2 marks
+                         * a child that still needs to be waited for */
+                        fds[i].fd = -2;
+                        has_fallback = TRUE;
+                }
+                n_pending++;
+        }
+
+        while (n_pending > 0) {
+                int poll_timeout = -1;
+                int ret;
+
+                if (deadline >= 0) {
+                        gint64 remaining = deadline - g_get_monotonic_time ();
+
+                        if (remaining <= 0)
+                                break;
+
+                        poll_timeout = (int) ((remaining + 999) / 1000);
+                }
+
+                if (has_fallback && (poll_timeout < 0 || poll_timeout > FALLBACK_POLL_INTERVAL_MSEC))
+                        poll_timeout = FALLBACK_POLL_INTERVAL_MSEC;
+
+                ret = poll (fds, n_pids, poll_timeout);
+
+                if (ret < 0 && errno != EINTR) {
+                        g_debug ("GdmChildWatch: poll () should not fail: %s", g_strerror (errno));
+                        break;
+                }
+
+                for (i = 0; i < n_pids; i++) {
+                        if (fds[i].fd == -1)
+                                continue;
+
+                        if (fds[i].fd >= 0 && fds[i].revents == 0)
+                                continue;
+
+                        if (!try_reap_child (pids[i], &statuses[i]))
+                                continue;
+
+                        if (fds[i].fd >= 0)
+                                close (fds[i].fd);
+                        fds[i].fd = -1;
+                        n_pending--;
+                }
+        }
+
+        for (i = 0; i < n_pids; i++) {
+                if (fds[i].fd == -1)
+                        continue;
+
+                if (fds[i].fd >= 0)
+                        close (fds[i].fd);
+
+                warn_child_not_dying (pids[i], timeout);
+        }
+
+        return n_pending == 0;
+}
@@ -0,0 +1,45 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* @rusage is NULL when the child couldn't be reaped through a pidfd */
+typedef void (*GdmChildWatchFunc) (GPid                 pid,
+                                   int                  status,
+                                   const struct rusage *rusage,
+                                   gpointer             user_data);
+
+int      gdm_child_pidfd_open (GPid               pid);
+
+guint    gdm_child_watch_add  (GPid               pid,
+                               GdmChildWatchFunc  func,
+                               gpointer           user_data);
+
+gboolean gdm_child_wait_all   (const GPid        *pids,
+                               int               *statuses,
+                               guint              n_pids,
+                               int                timeout);
+
+G_END_DECLS
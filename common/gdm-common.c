@@ -35,6 +35,7 @@
 #include <gio/gio.h>
 
 #include "gdm-common.h"
+#include "gdm-child-watch.h"
 
 #include <systemd/sd-login.h>
 
@@ -128,66 +129,10 @@ int
 gdm_wait_on_and_disown_pid (int pid,
                             int timeout)
 {
+        GPid child = pid;
         int status;
-        int ret;
-        int num_tries;
-        int flags;
-        gboolean already_reaped;
-
-        if (timeout > 0) {
-                flags = WNOHANG;
-                num_tries = 10 * timeout;
-        } else {
-                flags = 0;
-                num_tries = 0;
-        }
- wait_again:
-        errno = 0;
-        already_reaped = FALSE;
-        ret = waitpid (pid, &status, flags);
-        if (ret < 0) {
-                if (errno == EINTR) {
-                        goto wait_again;
-                } else if (errno == ECHILD) {
-                        already_reaped = TRUE;
-                } else {
-                        g_debug ("GdmCommon: waitpid () should not fail");
-                }
-        } else if (ret == 0) {
-                num_tries--;
-
-                if (num_tries > 0) {
-                        g_usleep (G_USEC_PER_SEC / 10);
-                } else {
-                        char *path;
-                        char *command;
-
-                        path = g_strdup_printf ("/proc/%ld/cmdline", (long) pid);
-                        if (g_file_get_contents (path, &command, NULL, NULL)) {
-                                g_warning ("GdmCommon: process (pid:%d, command '%s') isn't dying after %d seconds, now ignoring it.",
-                                         (int) pid, command, timeout);
-                                g_free (command);
-                        } else {
-                                g_warning ("GdmCommon: process (pid:%d) isn't dying after %d seconds, now ignoring it.",
-                                         (int) pid, timeout);
-                        }
-                        g_free (path);
 
-                        return 0;
-                }
-                goto wait_again;
-        }
-
-        g_debug ("GdmCommon: process (pid:%d) done (%s:%d)",
-                 (int) pid,
-                 already_reaped? "reaped earlier" :
-                 WIFEXITED (status) ? "status"
-                 : WIFSIGNALED (status) ? "signal"
-                 : "unknown",
-                 already_reaped? 1 :
-                 WIFEXITED (status) ? WEXITSTATUS (status)
-                 : WIFSIGNALED (status) ? WTERMSIG (status)
-                 : -1);
+        gdm_child_wait_all (&child, &status, 1, timeout);
 
         return status;
 }
@@ -18,7 +18,12 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "gdm-file-utils.h"
 
@@ -113,6 +118,242 @@ gdm_rm_recursively (GFile   *dir,
         return gdm_walk_dir_recursively (dir, rm_file, NULL, error);
 }
 
+static gboolean
+set_error_from_errno_at (GError     **error,
+                         int          errsv,
+                         const char  *action,
+                         const char  *name)
+{
+        g_set_error (error,
+                     G_IO_ERROR,
+                     g_io_error_from_errno (errsv),
+                     "Failed to %s '%s': %s",
+                     action,
+                     name,
+                     g_strerror (errsv));
+        return FALSE;
+}
+
+typedef struct {
+        char     *name;
+        dev_t     dev;
+        ino_t     ino;
+        blkcnt_t  blocks;
+} RmTreeLevel;
+
+static void
+rm_tree_level_clear (RmTreeLevel *level)
+{
+        g_free (level->name);
+}
+
+/* Opens @name in @parent_fd as a directory, making sure it is the one
+ * that was looked at before and that it's on the same file system */
+static int
+open_tree_dir (int          parent_fd,
+               const char  *name,
+               dev_t        dev,
+               ino_t        ino,
+               GError     **error)
+{
+        struct stat st;
+        int errsv;
+        int fd;
+
+        fd = openat (parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0) {
+                set_error_from_errno_at (error, errno, "open", name);
+                return -1;
+        }
+
+        if (fstat (fd, &st) < 0)
+                errsv = errno;
+        else if (st.st_dev != dev || st.st_ino != ino)
+                errsv = ESTALE;
+        else
+                return fd;
+
+        close (fd);
+        set_error_from_errno_at (error, errsv, "open", name);
+        return -1;
+}
+
+/* Walks the tree depth first without recursing, so that only one
+ * directory is open at any time however deep the tree is. The levels
+ * above the current directory are remembered by name, and returned to
+ * through "..", which has to be the directory that was left. */
+static gboolean
+rm_tree_at (int          parent_fd,
+            const char  *name,
+            guint64     *reclaimed_bytes,
+            GError     **error)
+{
+        g_autoptr (GArray) levels = NULL;
+        RmTreeLevel level;
+        struct stat st;
+        DIR *dir = NULL;
+        dev_t root_dev;
+        int fd;
+
+        if (fstatat (parent_fd, name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+                if (errno == ENOENT)
+                        return TRUE;
+                return set_error_from_errno_at (error, errno, "stat", name);
+        }
+
+        if (!S_ISDIR (st.st_mode)) {
+                if (unlinkat (parent_fd, name, 0) < 0 && errno != ENOENT)
+                        return set_error_from_errno_at (error, errno, "remove", name);
+
+                if (reclaimed_bytes != NULL)
+                        *reclaimed_bytes += (guint64) st.st_blocks * 512;
+
+                return TRUE;
+        }
+
+        root_dev = st.st_dev;
+
+        levels = g_array_new (FALSE, FALSE, sizeof (RmTreeLevel));
+        g_array_set_clear_func (levels, (GDestroyNotify) rm_tree_level_clear);
+
+        level.name = g_strdup (name);
+        level.dev = st.st_dev;
+        level.ino = st.st_ino;
+        level.blocks = st.st_blocks;
+        g_array_append_val (levels, level);
+
+        fd = open_tree_dir (parent_fd, name, st.st_dev, st.st_ino, error);
+        if (fd < 0)
+                return FALSE;
+
+        while (TRUE) {
+                RmTreeLevel *current;
+                struct dirent *entry;
+                gboolean descended = FALSE;
+
+                current = &g_array_index (levels, RmTreeLevel, levels->len - 1);
+
+                dir = fdopendir (fd);
+                if (dir == NULL) {
+                        int errsv = errno;
+                        close (fd);
+                        return set_error_from_errno_at (error, errsv, "open", current->name);
+                }
+
+                /* Entries get removed as they're seen, so coming back up
+                 * to a directory and reading it from the start again only
+                 * finds what's left to do */
+                while (TRUE) {
+                        errno = 0;
+                        entry = readdir (dir);
+                        if (entry == NULL)
+                                break;
+
+                        if (strcmp (entry->d_name, ".") == 0 ||
+                            strcmp (entry->d_name, "..") == 0)
+                                continue;
+
+                        if (fstatat (dirfd (dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+                                if (errno == ENOENT)
+                                        continue;
+                                set_error_from_errno_at (error, errno, "stat", entry->d_name);
+                                goto fail;
+                        }
+
+                        if (S_ISDIR (st.st_mode)) {
+                                /* Never follow a mount point out of the tree */
+                                if (st.st_dev != root_dev) {
+                                        set_error_from_errno_at (error, EXDEV, "remove", entry->d_name);
+                                        goto fail;
+                                }
+
+                                fd = open_tree_dir (dirfd (dir), entry->d_name, st.st_dev, st.st_ino, error);
+                                if (fd < 0)
+                                        goto fail;
+
+                                level.name = g_strdup (entry->d_name);
+                                level.dev = st.st_dev;
+                                level.ino = st.st_ino;
+                                level.blocks = st.st_blocks;
+                                g_array_append_val (levels, level);
+
+                                closedir (dir);
+                                descended = TRUE;
+                                break;
+                        }
+
+                        if (unlinkat (dirfd (dir), entry->d_name, 0) < 0 && errno != ENOENT) {
+                                set_error_from_errno_at (error, errno, "remove", entry->d_name);
+                                goto fail;
+                        }
+
+                        if (reclaimed_bytes != NULL)
+                                *reclaimed_bytes += (guint64) st.st_blocks * 512;
+                }
+
+                if (descended)
+                        continue;
+
+                if (errno != 0) {
+                        set_error_from_errno_at (error, errno, "read", current->name);
+                        goto fail;
+                }
+
+                /* The directory is empty now, remove it from its parent */
+                if (levels->len == 1) {
+                        closedir (dir);
+
+                        if (unlinkat (parent_fd, current->name, AT_REMOVEDIR) < 0 && errno != ENOENT)
+                                return set_error_from_errno_at (error, errno, "remove", current->name);
+
+                        if (reclaimed_bytes != NULL)
+                                *reclaimed_bytes += (guint64) current->blocks * 512;
+
+                        return TRUE;
+                } else {
+                        RmTreeLevel *parent;
+
+                        parent = &g_array_index (levels, RmTreeLevel, levels->len - 2);
+
+                        fd = open_tree_dir (dirfd (dir), "..", parent->dev, parent->ino, error);
+                        if (fd < 0)
+                                goto fail;
+
+                        closedir (dir);
+                        dir = NULL;
+
+                        if (unlinkat (fd, current->name, AT_REMOVEDIR) < 0 && errno != ENOENT) {
+                                set_error_from_errno_at (error, errno, "remove", current->name);
+                                close (fd);
+                                return FALSE;
+                        }
+
+                        if (reclaimed_bytes != NULL)
+                                *reclaimed_bytes += (guint64) current->blocks * 512;
+
+                        g_array_set_size (levels, levels->len - 1);
+                }
+        }
+
+ fail:
+        closedir (dir);
+        return FALSE;
+}
+
+/* Like gdm_rm_recursively(), but works on file descriptors rather than
+ * GFiles, so it's cheap enough for trees with many thousands of
+ * entries. It never follows symlinks or crosses into another file
+ * system. The disk space freed is added to @reclaimed_bytes.
+ */
+gboolean
+gdm_rm_recursively_at (int          dir_fd,
+                       const char  *name,
+                       guint64     *reclaimed_bytes,
+                       GError     **error)
+{
+        return rm_tree_at (dir_fd, name, reclaimed_bytes, error);
+}
+
 gboolean
 gdm_ensure_dir (const char  *path,
                 uid_t        uid,
@@ -40,6 +40,10 @@ gboolean gdm_chown_recursively (GFile   *dir,
                                 GError **error);
 gboolean gdm_rm_recursively (GFile   *dir,
                              GError **error);
+gboolean gdm_rm_recursively_at (int          dir_fd,
+                                const char  *name,
+                                guint64     *reclaimed_bytes,
+                                GError     **error);
 
 gboolean gdm_ensure_dir (const char  *path,
                          uid_t        uid,
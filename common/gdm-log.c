@@ -28,18 +28,88 @@
 #include <signal.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 #include <syslog.h>
 #include <systemd/sd-daemon.h>
+#ifdef HAVE_SYSTEMD_SD_JOURNAL_H
+#include <systemd/sd-journal.h>
+#endif
 
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <gio/gio.h>
 
 #include "gdm-log.h"
 
+/* Each log domain, or source file when the message says which one it
+ * came from, may log this many messages per interval. Critical messages
+ * and errors are never dropped. */
+#define RATE_LIMIT_INTERVAL (10 * G_USEC_PER_SEC)
+#define RATE_LIMIT_BURST    2000
+
+/* Debug and info messages get dropped instead of queued once this many
+ * are waiting for the journal thread */
+#define MAX_QUEUED_ENTRIES  4096
+
+typedef struct
+{
+        gint64 interval_start;
+        guint  count;
+        guint  suppressed;
+} RateLimit;
+
 static gboolean initialized = FALSE;
+static gboolean writer_installed = FALSE;
 static gboolean is_sd_booted = FALSE;
 static gboolean debug_enabled = FALSE;
+static pid_t    owner_pid = 0;
+
+guint _gdm_log_enabled_categories = 0;
+
+static GdmLogDebugCategoriesFunc categories_notify_func = NULL;
+static gpointer                  categories_notify_data = NULL;
+
+static const GDebugKey debug_categories[] = {
+        { "manager", GDM_LOG_CATEGORY_MANAGER },
+        { "session", GDM_LOG_CATEGORY_SESSION },
+        { "worker", GDM_LOG_CATEGORY_WORKER },
+        { "pam", GDM_LOG_CATEGORY_PAM },
+        { "display-factory", GDM_LOG_CATEGORY_DISPLAY_FACTORY },
+        { "userdb", GDM_LOG_CATEGORY_USERDB },
+        { "settings", GDM_LOG_CATEGORY_SETTINGS },
+};
+
+G_LOCK_DEFINE_STATIC (rate_limits);
+static GHashTable *rate_limits = NULL;
+
+/* Fields added to every journal entry, like GDM_SEAT */
+G_LOCK_DEFINE_STATIC (context_fields);
+static GHashTable *context_fields = NULL;
+
+#ifdef HAVE_SYSTEMD_SD_JOURNAL_H
+typedef struct
+{
+        GMutex   mutex;
+        GCond    cond;
+        gboolean done;
+} FlushRequest;
+
+typedef struct
+{
+        struct iovec *iov;
+        gsize         n_iov;
+
+        /* Set on the entries that only exist to sync with the thread */
+        FlushRequest *flush;
+} LogEntry;
+
+static gboolean     use_journal = FALSE;
+static GAsyncQueue *journal_queue = NULL;
+static GThread     *journal_thread = NULL;
+static guint        dropped_entries = 0;
+#endif
 
 static gint
 get_syslog_priority_from_log_level (GLogLevelFlags log_level)
@@ -64,21 +134,97 @@ get_syslog_priority_from_log_level (GLogLevelFlags log_level)
         }
 }
 
-static void
-gdm_log_default_handler (const gchar    *log_domain,
-                         GLogLevelFlags  log_level,
-                         const gchar    *message,
-                         gpointer        unused_data)
+static const char *
+find_field (const GLogField *fields,
+            gsize            n_fields,
+            const char      *key)
 {
-        int priority;
+        gsize i;
 
-        gdm_log_init ();
+        for (i = 0; i < n_fields; i++) {
+                if (g_strcmp0 (fields[i].key, key) == 0)
+                        return fields[i].length < 0 ? fields[i].value : NULL;
+        }
 
-        if ((log_level & G_LOG_LEVEL_MASK) == G_LOG_LEVEL_DEBUG &&
-            !debug_enabled) {
-                return;
+        return NULL;
+}
+
+/* A lock held by another thread at fork time is never released in the
+ * child, so a forked child stays away from the shared tables */
+static gboolean
+is_forked_child (void)
+{
+        return owner_pid != 0 && owner_pid != getpid ();
+}
+
+static gboolean
+is_droppable (GLogLevelFlags log_level)
+{
+        return (log_level & (G_LOG_FLAG_FATAL | G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL)) == 0;
+}
+
+/* Returns FALSE if the message should be dropped. When a new interval
+ * starts after messages were dropped, their number is returned in
+ * @ret_suppressed so it can be reported */
+static gboolean
+check_rate_limit (const char     *domain,
+                  const char     *code_file,
+                  GLogLevelFlags  log_level,
+                  guint          *ret_suppressed)
+{
+        char key[256];
+        RateLimit *limit;
+        gint64 now;
+        gboolean allowed;
+
+        *ret_suppressed = 0;
+
+        if (!is_droppable (log_level) || is_forked_child ())
+                return TRUE;
+
+        g_snprintf (key, sizeof (key), "%s:%s",
+                    domain != NULL ? domain : "",
+                    code_file != NULL ? code_file : "");
+
+        now = g_get_monotonic_time ();
+
+        G_LOCK (rate_limits);
+
+        if (rate_limits == NULL)
+                rate_limits = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+        limit = g_hash_table_lookup (rate_limits, key);
+        if (limit == NULL) {
+                limit = g_new0 (RateLimit, 1);
+                limit->interval_start = now;
+                g_hash_table_insert (rate_limits, g_strdup (key), limit);
+        }
+
+        if (now - limit->interval_start > RATE_LIMIT_INTERVAL) {
+                *ret_suppressed = limit->suppressed;
+                limit->interval_start = now;
+                limit->count = 0;
+                limit->suppressed = 0;
         }
 
+        allowed = limit->count < RATE_LIMIT_BURST;
+        if (allowed)
+                limit->count++;
+        else
+                limit->suppressed++;
+
+        G_UNLOCK (rate_limits);
+
+        return allowed;
+}
+
+static void
+write_to_stderr_or_syslog (GLogLevelFlags  log_level,
+                           const char     *log_domain,
+                           const char     *message)
+{
+        int priority;
+
         /* Process the message prefix and priority */
         priority = get_syslog_priority_from_log_level (log_level);
 
@@ -99,6 +245,344 @@ gdm_log_default_handler (const gchar    *log_domain,
         }
 }
 
+#ifdef HAVE_SYSTEMD_SD_JOURNAL_H
+static void
+set_iovec (struct iovec *iov,
+           const char   *key,
+           gconstpointer value,
+           gssize        length)
+{
+        gsize key_length = strlen (key);
+        char *data;
+
+        if (length < 0)
+                length = strlen (value);
+
+        data = g_malloc (key_length + 1 + length);
+        memcpy (data, key, key_length);
+        data[key_length] = '=';
+        memcpy (data + key_length + 1, value, length);
+
+        iov->iov_base = data;
+        iov->iov_len = key_length + 1 + length;
+}
+
+static void
+log_entry_free (LogEntry *entry)
+{
+        gsize i;
+
+        for (i = 0; i < entry->n_iov; i++)
+                g_free (entry->iov[i].iov_base);
+        g_free (entry->iov);
+        g_free (entry);
+}
+
+static LogEntry *
+log_entry_new (GLogLevelFlags  log_level,
+               const GLogField *fields,
+               gsize           n_fields)
+{
+        LogEntry *entry;
+        const char *identifier;
+        char priority[4];
+        gboolean with_context;
+        gsize i;
+
+        entry = g_new0 (LogEntry, 1);
+
+        with_context = !is_forked_child ();
+        if (with_context)
+                G_LOCK (context_fields);
+
+        entry->iov = g_new (struct iovec,
+                            n_fields + 2 + (with_context && context_fields != NULL ? g_hash_table_size (context_fields) : 0));
+
+        g_snprintf (priority, sizeof (priority), "%d", get_syslog_priority_from_log_level (log_level));
+        set_iovec (&entry->iov[entry->n_iov++], "PRIORITY", priority, -1);
+
+        identifier = g_get_prgname ();
+        if (identifier != NULL && find_field (fields, n_fields, "SYSLOG_IDENTIFIER") == NULL)
+                set_iovec (&entry->iov[entry->n_iov++], "SYSLOG_IDENTIFIER", identifier, -1);
+
+        for (i = 0; i < n_fields; i++) {
+                /* Ours, with the same mapping syslog gets */
+                if (g_strcmp0 (fields[i].key, "PRIORITY") == 0)
+                        continue;
+
+                set_iovec (&entry->iov[entry->n_iov++], fields[i].key, fields[i].value, fields[i].length);
+        }
+
+        if (with_context && context_fields != NULL) {
+                GHashTableIter iter;
+                gpointer key, value;
+
+                g_hash_table_iter_init (&iter, context_fields);
+                while (g_hash_table_iter_next (&iter, &key, &value)) {
+                        if (find_field (fields, n_fields, key) == NULL)
+                                set_iovec (&entry->iov[entry->n_iov++], key, value, -1);
+                }
+        }
+
+        if (with_context)
+                G_UNLOCK (context_fields);
+
+        return entry;
+}
+
+static void
+send_entry (LogEntry *entry)
+{
+        sd_journal_sendv (entry->iov, entry->n_iov);
+}
+
+static void
+send_notice (const char *format,
+             ...) G_GNUC_PRINTF (1, 2);
+
+static void
+send_notice (const char *format,
+             ...)
+{
+        g_autofree char *message = NULL;
+        GLogField fields[2];
+        LogEntry *entry;
+        va_list args;
+
+        va_start (args, format);
+        message = g_strdup_vprintf (format, args);
+        va_end (args);
+
+        fields[0].key = "MESSAGE";
+        fields[0].value = message;
+        fields[0].length = -1;
+        fields[1].key = "GLIB_DOMAIN";
+        fields[1].value = G_LOG_DOMAIN;
+        fields[1].length = -1;
+
+        entry = log_entry_new (G_LOG_LEVEL_WARNING, fields, G_N_ELEMENTS (fields));
+        send_entry (entry);
+        log_entry_free (entry);
+}
+
+static gboolean
+journal_thread_is_ours (void)
+{
+        /* The thread doesn't survive a fork, so a child logs directly */
+        return journal_thread != NULL && !is_forked_child ();
+}
+
+static gpointer
+journal_thread_func (gpointer data)
+{
+        while (TRUE) {
+                LogEntry *entry;
+                guint dropped;
+
+                /* Block for the first entry, then write out everything
+                 * that piled up in the meantime before sleeping again */
+                entry = g_async_queue_pop (journal_queue);
+                do {
+                        if (entry->iov != NULL) {
+                                send_entry (entry);
+                                log_entry_free (entry);
+                        } else if (entry->flush != NULL) {
+                                g_mutex_lock (&entry->flush->mutex);
+                                entry->flush->done = TRUE;
+                                g_cond_signal (&entry->flush->cond);
+                                g_mutex_unlock (&entry->flush->mutex);
+                                g_free (entry);
+                        } else {
+                                g_free (entry);
+                                return NULL;
+                        }
+                } while ((entry = g_async_queue_try_pop (journal_queue)) != NULL);
+
+                dropped = g_atomic_int_exchange (&dropped_entries, 0);
+                if (dropped > 0)
+                        send_notice ("Dropped %u debug messages, the journal could not keep up", dropped);
+        }
+}
+
+/* Waits until everything queued so far has been written */
+static void
+flush_journal_queue (void)
+{
+        FlushRequest request;
+        LogEntry *entry;
+
+        if (!journal_thread_is_ours () || g_thread_self () == journal_thread)
+                return;
+
+        g_mutex_init (&request.mutex);
+        g_cond_init (&request.cond);
+        request.done = FALSE;
+
+        entry = g_new0 (LogEntry, 1);
+        entry->flush = &request;
+        g_async_queue_push (journal_queue, entry);
+
+        g_mutex_lock (&request.mutex);
+        while (!request.done)
+                g_cond_wait (&request.cond, &request.mutex);
+        g_mutex_unlock (&request.mutex);
+
+        g_mutex_clear (&request.mutex);
+        g_cond_clear (&request.cond);
+}
+
+static void
+write_to_journal (GLogLevelFlags   log_level,
+                  const GLogField *fields,
+                  gsize            n_fields)
+{
+        LogEntry *entry;
+
+        if (!journal_thread_is_ours ()) {
+                entry = log_entry_new (log_level, fields, n_fields);
+                send_entry (entry);
+                log_entry_free (entry);
+                return;
+        }
+
+        if (!is_droppable (log_level)) {
+                /* Whatever comes before a critical message or a crash
+                 * should be in the journal before it */
+                flush_journal_queue ();
+                entry = log_entry_new (log_level, fields, n_fields);
+                send_entry (entry);
+                log_entry_free (entry);
+                return;
+        }
+
+        if ((log_level & (G_LOG_LEVEL_DEBUG | G_LOG_LEVEL_INFO)) != 0 &&
+            g_async_queue_length (journal_queue) >= MAX_QUEUED_ENTRIES) {
+                g_atomic_int_inc (&dropped_entries);
+                return;
+        }
+
+        g_async_queue_push (journal_queue, log_entry_new (log_level, fields, n_fields));
+}
+#endif
+
+static GLogWriterOutput
+gdm_log_writer (GLogLevelFlags   log_level,
+                const GLogField *fields,
+                gsize            n_fields,
+                gpointer         user_data)
+{
+        const char *log_domain;
+        const char *message;
+        guint suppressed;
+
+        /* gdm_debug() already checked its category */
+        if ((log_level & G_LOG_LEVEL_MASK) == G_LOG_LEVEL_DEBUG &&
+            !debug_enabled &&
+            find_field (fields, n_fields, "GDM_DEBUG_CATEGORY") == NULL) {
+                return G_LOG_WRITER_HANDLED;
+        }
+
+        log_domain = find_field (fields, n_fields, "GLIB_DOMAIN");
+
+        if (!check_rate_limit (log_domain,
+                               find_field (fields, n_fields, "CODE_FILE"),
+                               log_level,
+                               &suppressed))
+                return G_LOG_WRITER_HANDLED;
+
+#ifdef HAVE_SYSTEMD_SD_JOURNAL_H
+        if (use_journal) {
+                if (suppressed > 0)
+                        send_notice ("Suppressed %u messages from %s", suppressed,
+                                     find_field (fields, n_fields, "CODE_FILE") ?: log_domain ?: "(none)");
+
+                write_to_journal (log_level, fields, n_fields);
+                return G_LOG_WRITER_HANDLED;
+        }
+#endif
+
+        if (suppressed > 0) {
+                g_autofree char *notice = NULL;
+
+                notice = g_strdup_printf ("Suppressed %u messages", suppressed);
+                write_to_stderr_or_syslog (G_LOG_LEVEL_WARNING, log_domain, notice);
+        }
+
+        message = find_field (fields, n_fields, "MESSAGE");
+        write_to_stderr_or_syslog (log_level, log_domain, message != NULL ? message : "(no message)");
+
+        return G_LOG_WRITER_HANDLED;
+}
+
+/**
+ * gdm_log_set_context:
+ * @key: a journal field name, like %GDM_LOG_FIELD_SEAT
+ * @value: (nullable): its value, or %NULL to stop adding it
+ *
+ * Adds @key to every message this process sends to the journal from
+ * now on. Meant for processes that only ever deal with one seat or
+ * session, like the session worker.
+ */
+void
+gdm_log_set_context (const char *key,
+                     const char *value)
+{
+        G_LOCK (context_fields);
+
+        if (context_fields == NULL)
+                context_fields = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+        if (value != NULL)
+                g_hash_table_replace (context_fields, g_strdup (key), g_strdup (value));
+        else
+                g_hash_table_remove (context_fields, key);
+
+        G_UNLOCK (context_fields);
+}
+
+void
+_gdm_log_category_debug (GdmLogCategory  category,
+                         const char     *file,
+                         const char     *line,
+                         const char     *func,
+                         const char     *format,
+                         ...)
+{
+        g_autofree char *message = NULL;
+        const char *category_name = NULL;
+        GLogField fields[7];
+        va_list args;
+        gsize i;
+
+        va_start (args, format);
+        message = g_strdup_vprintf (format, args);
+        va_end (args);
+
+        for (i = 0; i < G_N_ELEMENTS (debug_categories); i++) {
+                if (debug_categories[i].value == category) {
+                        category_name = debug_categories[i].key;
+                        break;
+                }
+        }
+
+        fields[0] = (GLogField) { "PRIORITY", "7", -1 };
+        fields[1] = (GLogField) { "GLIB_DOMAIN", G_LOG_DOMAIN, -1 };
+        fields[2] = (GLogField) { "GDM_DEBUG_CATEGORY", category_name != NULL ? category_name : "", -1 };
+        fields[3] = (GLogField) { "CODE_FILE", file, -1 };
+        fields[4] = (GLogField) { "CODE_LINE", line, -1 };
+        fields[5] = (GLogField) { "CODE_FUNC", func, -1 };
+        fields[6] = (GLogField) { "MESSAGE", message, -1 };
+
+        g_log_structured_array (G_LOG_LEVEL_DEBUG, fields, G_N_ELEMENTS (fields));
+}
+
+static void
+notify_debug_categories (void)
+{
+        if (categories_notify_func != NULL)
+                categories_notify_func (_gdm_log_enabled_categories, categories_notify_data);
+}
+
 void
 gdm_log_toggle_debug (void)
 {
@@ -115,22 +599,167 @@ gdm_log_set_debug (gboolean debug)
 
         if (debug) {
                 debug_enabled = debug;
+                _gdm_log_enabled_categories = GDM_LOG_CATEGORY_ALL;
                 g_debug ("Enabling debugging");
         } else {
                 g_debug ("Disabling debugging");
                 debug_enabled = debug;
+                _gdm_log_enabled_categories = 0;
         }
+
+        notify_debug_categories ();
+}
+
+/**
+ * gdm_log_set_debug_categories:
+ * @categories: a mask of #GdmLogCategory values
+ *
+ * Turns on debug messages from @categories only. Plain g_debug() calls
+ * still follow gdm_log_set_debug().
+ */
+void
+gdm_log_set_debug_categories (guint categories)
+{
+        g_auto (GStrv) names = NULL;
+        g_autofree char *list = NULL;
+
+        categories &= GDM_LOG_CATEGORY_ALL;
+
+        if (_gdm_log_enabled_categories == categories)
+                return;
+
+        _gdm_log_enabled_categories = categories;
+
+        names = gdm_log_get_debug_category_names (categories);
+        list = g_strjoinv (", ", names);
+        g_message ("Debug categories: %s", list[0] != '\0' ? list : "none");
+
+        notify_debug_categories ();
+}
+
+/**
+ * gdm_log_set_debug_categories_notify:
+ * @func: (nullable): called with the new mask whenever it changes
+ * @user_data: data for @func
+ *
+ * Lets the owner of a D-Bus view of the categories follow every way
+ * of changing them, including gdm_log_toggle_debug() from SIGUSR1.
+ */
+void
+gdm_log_set_debug_categories_notify (GdmLogDebugCategoriesFunc func,
+                                     gpointer                  user_data)
+{
+        categories_notify_func = func;
+        categories_notify_data = user_data;
+}
+
+guint
+gdm_log_get_debug_categories (void)
+{
+        return _gdm_log_enabled_categories;
+}
+
+/**
+ * gdm_log_parse_debug_categories:
+ * @names: category names, or "all"
+ * @categories: (out): the matching #GdmLogCategory mask
+ *
+ * Returns: %FALSE if one of @names isn't a known category
+ */
+gboolean
+gdm_log_parse_debug_categories (const char * const  *names,
+                                guint               *categories,
+                                GError             **error)
+{
+        guint mask = 0;
+        gsize i, j;
+
+        for (i = 0; names != NULL && names[i] != NULL; i++) {
+                gboolean found = FALSE;
+
+                if (g_strcmp0 (names[i], "all") == 0) {
+                        mask |= GDM_LOG_CATEGORY_ALL;
+                        continue;
+                }
+
+                for (j = 0; j < G_N_ELEMENTS (debug_categories); j++) {
+                        if (g_strcmp0 (names[i], debug_categories[j].key) == 0) {
+                                mask |= debug_categories[j].value;
+                                found = TRUE;
+                                break;
+                        }
+                }
+
+                if (!found) {
+                        g_set_error (error,
+                                     G_IO_ERROR,
+                                     G_IO_ERROR_INVALID_ARGUMENT,
+                                     "Unknown debug category “%s”",
+                                     names[i]);
+                        return FALSE;
+                }
+        }
+
+        *categories = mask;
+        return TRUE;
+}
+
+char **
+gdm_log_get_debug_category_names (guint categories)
+{
+        GPtrArray *names;
+        gsize i;
+
+        names = g_ptr_array_new ();
+        for (i = 0; i < G_N_ELEMENTS (debug_categories); i++) {
+                if (categories & debug_categories[i].value)
+                        g_ptr_array_add (names, g_strdup (debug_categories[i].key));
+        }
+        g_ptr_array_add (names, NULL);
+
+        return (char **) g_ptr_array_free (names, FALSE);
 }
 
 void
 gdm_log_init (void)
 {
+        const char *categories;
+
         if (initialized)
                 return;
 
         initialized = TRUE;
 
-        g_log_set_default_handler (gdm_log_default_handler, NULL);
+        is_sd_booted = sd_booted () > 0;
+
+        /* Set by the daemon for the workers it spawns */
+        categories = g_getenv (GDM_DEBUG_CATEGORIES_ENV);
+        if (categories != NULL)
+                _gdm_log_enabled_categories = g_parse_debug_string (categories,
+                                                                    debug_categories,
+                                                                    G_N_ELEMENTS (debug_categories));
+
+        if (owner_pid == 0)
+                owner_pid = getpid ();
+
+#ifdef HAVE_SYSTEMD_SD_JOURNAL_H
+        use_journal = is_sd_booted;
+
+        /* Forked children, which log little before they exec, don't get
+         * a thread of their own */
+        if (use_journal && !is_forked_child ()) {
+                if (journal_queue == NULL)
+                        journal_queue = g_async_queue_new ();
+                journal_thread = g_thread_new ("gdm-log", journal_thread_func, NULL);
+        }
+#endif
+
+        /* GLib only lets the writer be set once per process, and a forked
+         * child that calls gdm_log_init() again inherits it */
+        if (!writer_installed) {
+                g_log_set_writer_func (gdm_log_writer, NULL, NULL);
+                writer_installed = TRUE;
+        }
 }
 
 void
@@ -138,8 +767,19 @@ gdm_log_shutdown (void)
 {
         if (!initialized)
                 return;
+
+#ifdef HAVE_SYSTEMD_SD_JOURNAL_H
+        if (journal_thread_is_ours ()) {
+                LogEntry *stop;
+
+                stop = g_new0 (LogEntry, 1);
+                g_async_queue_push (journal_queue, stop);
+                g_thread_join (journal_thread);
+        }
+        journal_thread = NULL;
+#endif
+
         if (!is_sd_booted)
                 closelog ();
         initialized = FALSE;
 }
-
@@ -28,11 +28,75 @@
 
 G_BEGIN_DECLS
 
+/* Debug messages can be turned on for each of these separately, at
+ * runtime, with the manager's SetDebugCategories() method */
+typedef enum
+{
+        GDM_LOG_CATEGORY_MANAGER         = 1 << 0,
+        GDM_LOG_CATEGORY_SESSION         = 1 << 1,
+        GDM_LOG_CATEGORY_WORKER          = 1 << 2,
+        GDM_LOG_CATEGORY_PAM             = 1 << 3,
+        GDM_LOG_CATEGORY_DISPLAY_FACTORY = 1 << 4,
+        GDM_LOG_CATEGORY_USERDB          = 1 << 5,
+        GDM_LOG_CATEGORY_SETTINGS        = 1 << 6,
+} GdmLogCategory;
+
+#define GDM_LOG_CATEGORY_ALL ((1 << 7) - 1)
+
+/* Environment variable that hands the enabled categories to workers */
+#define GDM_DEBUG_CATEGORIES_ENV "GDM_DEBUG_CATEGORIES"
+
+extern guint _gdm_log_enabled_categories;
+
+static inline gboolean
+gdm_log_category_is_enabled (GdmLogCategory category)
+{
+        return (_gdm_log_enabled_categories & category) != 0;
+}
+
+/* Like g_debug(), but the arguments aren't even evaluated unless the
+ * category is enabled: gdm_debug (SESSION, "...", ...) */
+#define gdm_debug(category, ...)                                                                \
+        G_STMT_START {                                                                          \
+                if (G_UNLIKELY (gdm_log_category_is_enabled (GDM_LOG_CATEGORY_##category)))    \
+                        _gdm_log_category_debug (GDM_LOG_CATEGORY_##category,                  \
+                                                 __FILE__,                                      \
+                                                 G_STRINGIFY (__LINE__),                        \
+                                                 G_STRFUNC,                                     \
+                                                 __VA_ARGS__);                                  \
+        } G_STMT_END
+
+void      _gdm_log_category_debug (GdmLogCategory  category,
+                                   const char     *file,
+                                   const char     *line,
+                                   const char     *func,
+                                   const char     *format,
+                                   ...) G_GNUC_PRINTF (5, 6);
+
+/* Journal fields for gdm_log_set_context() and g_log_structured() */
+#define GDM_LOG_FIELD_SEAT       "GDM_SEAT"
+#define GDM_LOG_FIELD_SESSION_ID "GDM_SESSION_ID"
+#define GDM_LOG_FIELD_DISPLAY    "GDM_DISPLAY"
+
 void      gdm_log_set_debug       (gboolean       debug);
 void      gdm_log_toggle_debug    (void);
+void      gdm_log_set_context     (const char    *key,
+                                   const char    *value);
 void      gdm_log_init            (void);
 void      gdm_log_shutdown        (void);
 
+typedef void (*GdmLogDebugCategoriesFunc) (guint    categories,
+                                           gpointer user_data);
+
+void      gdm_log_set_debug_categories     (guint                categories);
+void      gdm_log_set_debug_categories_notify (GdmLogDebugCategoriesFunc func,
+                                               gpointer                  user_data);
+guint     gdm_log_get_debug_categories     (void);
+gboolean  gdm_log_parse_debug_categories   (const char * const  *names,
+                                            guint               *categories,
+                                            GError             **error);
+char    **gdm_log_get_debug_category_names (guint                categories);
+
 G_END_DECLS
 
 #endif /* __GDM_LOG_H */
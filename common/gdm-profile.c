@@ -28,45 +28,269 @@
 #include <signal.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/syscall.h>
 
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <glib-unix.h>
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#endif
 
 #include "gdm-profile.h"
 
+#ifdef ENABLE_PROFILING
+
+/* Marks are kept in a fixed ring in memory, so recording one costs a
+ * clock read, an atomic increment and formatting the message in place.
+ * Nothing gets written out until someone asks for a dump.
+ */
+#define RING_SIZE 4096
+
+typedef struct
+{
+        guint64     seq;     /* index + 1 once the event is complete */
+        gint64      time;    /* CLOCK_MONOTONIC, in nanoseconds */
+        const char *func;
+        const char *note;
+        guint       thread;
+        char        message[80];
+} ProfileEvent;
+
+static ProfileEvent ring[RING_SIZE];
+static guint64      ring_head;
+
+static __thread guint current_thread_id;
+
+static gint64
+get_time_ns (void)
+{
+        struct timespec ts;
+
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (gint64) ts.tv_sec * G_GINT64_CONSTANT (1000000000) + ts.tv_nsec;
+}
+
+static guint
+get_thread_id (void)
+{
+        if (G_UNLIKELY (current_thread_id == 0))
+                current_thread_id = (guint) syscall (SYS_gettid);
+
+        return current_thread_id;
+}
+
+static void
+fire_probe (const char *func,
+            const char *note,
+            const char *message)
+{
+#ifdef HAVE_SYS_SDT_H
+        /* perf probe -x gdm sdt_gdm:profile_start, or
+         * bpftrace -e 'usdt:/usr/sbin/gdm:gdm:profile_end { ... }' */
+        if (g_strcmp0 (note, "start") == 0)
+                DTRACE_PROBE2 (gdm, profile_start, func, message);
+        else if (g_strcmp0 (note, "end") == 0)
+                DTRACE_PROBE2 (gdm, profile_end, func, message);
+        else
+                DTRACE_PROBE3 (gdm, profile_mark, func, note, message);
+#endif
+}
+
 void
 _gdm_profile_log (const char *func,
                   const char *note,
                   const char *format,
                   ...)
 {
+        ProfileEvent *event;
+        guint64 index;
         va_list args;
-        g_autofree char *str = NULL;
-        g_autofree char *formatted = NULL;
-        const char *prgname;
 
-        if (format == NULL) {
-                formatted = g_strdup ("");
-        } else {
+        index = __atomic_fetch_add (&ring_head, 1, __ATOMIC_RELAXED);
+        event = &ring[index % RING_SIZE];
+
+        __atomic_store_n (&event->seq, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence (__ATOMIC_RELEASE);
+
+        event->time = get_time_ns ();
+        event->func = func;
+        event->note = note;
+        event->thread = get_thread_id ();
+
+        if (format != NULL) {
                 va_start (args, format);
-                formatted = g_strdup_vprintf (format, args);
+                g_vsnprintf (event->message, sizeof (event->message), format, args);
                 va_end (args);
+        } else {
+                event->message[0] = '\0';
         }
 
-        prgname = g_get_prgname();
+        __atomic_store_n (&event->seq, index + 1, __ATOMIC_RELEASE);
 
-        if (func != NULL) {
-                str = g_strdup_printf ("MARK: %s %s: %s %s",
-                                       prgname ? prgname : "(null)",
-                                       func,
-                                       note ? note : "",
-                                       formatted);
-        } else {
-                str = g_strdup_printf ("MARK: %s: %s %s",
-                                       prgname ? prgname : "(null)",
-                                       note ? note : "",
-                                       formatted);
+        fire_probe (func, note, event->message);
+}
+
+/* Copies out an event, unless it's being overwritten at the same time */
+static gboolean
+read_event (guint64       index,
+            ProfileEvent *copy)
+{
+        const ProfileEvent *event = &ring[index % RING_SIZE];
+
+        if (__atomic_load_n (&event->seq, __ATOMIC_ACQUIRE) != index + 1)
+                return FALSE;
+
+        memcpy (copy, event, sizeof (ProfileEvent));
+        __atomic_thread_fence (__ATOMIC_ACQUIRE);
+
+        return __atomic_load_n (&event->seq, __ATOMIC_RELAXED) == index + 1;
+}
+
+static char *
+make_pair_key (const ProfileEvent *event)
+{
+        return g_strdup_printf ("%u\x1f%s\x1f%s",
+                                event->thread,
+                                event->func != NULL ? event->func : "",
+                                event->message);
+}
+
+/**
+ * gdm_profile_dump:
+ *
+ * Formats the marks still in the ring, oldest first, one per line:
+ * time in ms, thread, function, note and message. An "end" that
+ * follows a "start" with the same function and message on the same
+ * thread also gets the time between the two.
+ */
+char *
+gdm_profile_dump (void)
+{
+        g_autoptr (GHashTable) open_starts = NULL;
+        GString *dump;
+        guint64 head, first, index;
+        gint64 base = -1;
+
+        open_starts = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                             g_free, (GDestroyNotify) g_array_unref);
+        dump = g_string_new (NULL);
+
+        head = __atomic_load_n (&ring_head, __ATOMIC_ACQUIRE);
+        first = head > RING_SIZE ? head - RING_SIZE : 0;
+
+        g_string_append_printf (dump, "# %s[%d]: %" G_GUINT64_FORMAT " marks, %" G_GUINT64_FORMAT " dropped\n",
+                                g_get_prgname () ? g_get_prgname () : "(null)",
+                                (int) getpid (),
+                                head, first);
+
+        for (index = first; index < head; index++) {
+                ProfileEvent event;
+                g_autofree char *key = NULL;
+                GArray *starts;
+
+                if (!read_event (index, &event))
+                        continue;
+
+                if (base < 0)
+                        base = event.time;
+
+                g_string_append_printf (dump, "%12.3f %6u %s %s %s",
+                                        (event.time - base) / 1e6,
+                                        event.thread,
+                                        event.func != NULL ? event.func : "-",
+                                        event.note != NULL ? event.note : "-",
+                                        event.message);
+
+                if (g_strcmp0 (event.note, "start") == 0) {
+                        key = make_pair_key (&event);
+                        starts = g_hash_table_lookup (open_starts, key);
+                        if (starts == NULL) {
+                                starts = g_array_new (FALSE, FALSE, sizeof (gint64));
+                                g_hash_table_insert (open_starts, g_steal_pointer (&key), starts);
+                        }
+                        g_array_append_val (starts, event.time);
+                } else if (g_strcmp0 (event.note, "end") == 0) {
+                        key = make_pair_key (&event);
+                        starts = g_hash_table_lookup (open_starts, key);
+                        if (starts != NULL && starts->len > 0) {
+                                gint64 start = g_array_index (starts, gint64, starts->len - 1);
+
+                                g_array_set_size (starts, starts->len - 1);
+                                g_string_append_printf (dump, " (%.3f ms)", (event.time - start) / 1e6);
+                        }
+                }
+
+                g_string_append_c (dump, '\n');
         }
 
-        g_access (str, F_OK);
+        return g_string_free (dump, FALSE);
+}
+
+static gboolean
+on_dump_signal (gpointer user_data)
+{
+        g_autoptr (GError) error = NULL;
+        g_autofree char *path = NULL;
+
+        path = g_strdup_printf ("%s/gdm-profile-%s-%d.txt",
+                                g_get_tmp_dir (),
+                                g_get_prgname () ? g_get_prgname () : "unknown",
+                                (int) getpid ());
+
+        if (gdm_profile_dump_to_file (path, &error))
+                g_message ("Wrote profiling marks to %s", path);
+        else
+                g_warning ("Failed to write profiling marks: %s", error->message);
+
+        return G_SOURCE_CONTINUE;
+}
+
+/**
+ * gdm_profile_install_dump_handler:
+ *
+ * Makes SIGUSR2 write the current marks to
+ * $TMPDIR/gdm-profile-PRGNAME-PID.txt. Needs a running main loop.
+ */
+void
+gdm_profile_install_dump_handler (void)
+{
+        g_unix_signal_add (SIGUSR2, on_dump_signal, NULL);
+}
+
+#else /* ENABLE_PROFILING */
+
+void
+_gdm_profile_log (const char *func,
+                  const char *note,
+                  const char *format,
+                  ...)
+{
+}
+
+char *
+gdm_profile_dump (void)
+{
+        return g_strdup ("");
+}
+
+void
+gdm_profile_install_dump_handler (void)
+{
+}
+
+#endif /* ENABLE_PROFILING */
+
+gboolean
+gdm_profile_dump_to_file (const char  *path,
+                          GError     **error)
+{
+        g_autofree char *dump = NULL;
+
+        dump = gdm_profile_dump ();
+
+        return g_file_set_contents_full (path, dump, -1,
+                                         G_FILE_SET_CONTENTS_CONSISTENT,
+                                         0600, error);
 }
@@ -48,6 +48,11 @@ void            _gdm_profile_log    (const char *func,
                                      const char *format,
                                      ...) G_GNUC_PRINTF (3, 4);
 
+char *          gdm_profile_dump    (void);
+gboolean        gdm_profile_dump_to_file (const char  *path,
+                                          GError     **error);
+void            gdm_profile_install_dump_handler (void);
+
 G_END_DECLS
 
 #endif /* __GDM_PROFILE_H */
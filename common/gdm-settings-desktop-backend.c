@@ -25,7 +25,9 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
 #include <signal.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -33,8 +35,10 @@
 #include <glib/gi18n.h>
 #include <glib/gstdio.h>
 #include <glib-object.h>
+#include <gio/gio.h>
 
 #include "gdm-settings-desktop-backend.h"
+#include "gdm-log.h"
 
 struct _GdmSettingsDesktopBackend
 {
@@ -42,8 +46,16 @@ struct _GdmSettingsDesktopBackend
 
         char       *filename;
         GKeyFile   *key_file;
-        gboolean    dirty;
         guint       save_id;
+
+        /* Our changes that haven't been written out yet, kept apart so
+         * they can be replayed onto the file if someone else edits it */
+        GKeyFile   *pending;
+        gboolean    dirty;
+
+        /* What the file looked like when key_file was read from it */
+        struct stat file_info;
+        gboolean    have_file_info;
 };
 
 enum {
@@ -57,20 +69,50 @@ static void     gdm_settings_desktop_backend_finalize   (GObject
 
 G_DEFINE_TYPE (GdmSettingsDesktopBackend, gdm_settings_desktop_backend, GDM_TYPE_SETTINGS_BACKEND)
 
+static char *lock_file = NULL;
+
 static void
-_gdm_settings_desktop_backend_set_file_name (GdmSettingsDesktopBackend *backend,
-                                             const char                *filename)
+update_file_info (GdmSettingsDesktopBackend *backend)
+{
+        backend->have_file_info = stat (backend->filename, &backend->file_info) == 0;
+}
+
+/* Cheap enough to do on every reload request: a single stat() */
+static gboolean
+file_changed (GdmSettingsDesktopBackend *backend)
 {
+        struct stat file_info;
+
+        if (stat (backend->filename, &file_info) < 0)
+                return backend->have_file_info;
+
+        if (!backend->have_file_info)
+                return TRUE;
+
+        return file_info.st_dev != backend->file_info.st_dev ||
+               file_info.st_ino != backend->file_info.st_ino ||
+               file_info.st_size != backend->file_info.st_size ||
+               file_info.st_mtim.tv_sec != backend->file_info.st_mtim.tv_sec ||
+               file_info.st_mtim.tv_nsec != backend->file_info.st_mtim.tv_nsec ||
+               file_info.st_ctim.tv_sec != backend->file_info.st_ctim.tv_sec ||
+               file_info.st_ctim.tv_nsec != backend->file_info.st_ctim.tv_nsec;
+}
+
+static GKeyFile *
+load_key_file (GdmSettingsDesktopBackend *backend)
+{
+        GKeyFile *key_file;
         gboolean res;
         g_autoptr(GError) error = NULL;
         g_autofree char *contents = NULL;
 
-        g_free (backend->filename);
-        backend->filename = g_strdup (filename);
+        /* Before reading, so that a write racing with us is picked up
+         * by the next reload */
+        update_file_info (backend);
 
-        backend->key_file = g_key_file_new ();
+        key_file = g_key_file_new ();
 
-        res = g_key_file_load_from_file (backend->key_file,
+        res = g_key_file_load_from_file (key_file,
                                          backend->filename,
                                          G_KEY_FILE_KEEP_COMMENTS | G_KEY_FILE_KEEP_TRANSLATIONS,
                                          &error);
@@ -78,12 +120,23 @@ _gdm_settings_desktop_backend_set_file_name (GdmSettingsDesktopBackend *backend,
                 g_warning ("Unable to load file '%s': %s", backend->filename, error->message);
         }
 
-        contents = g_key_file_to_data (backend->key_file, NULL, NULL);
+        contents = g_key_file_to_data (key_file, NULL, NULL);
 
         if (contents != NULL) {
-                g_debug ("GdmSettings: %s is:\n%s\n", backend->filename, contents);
+                gdm_debug (SETTINGS, "GdmSettings: %s is:\n%s\n", backend->filename, contents);
         }
 
+        return key_file;
+}
+
+static void
+_gdm_settings_desktop_backend_set_file_name (GdmSettingsDesktopBackend *backend,
+                                             const char                *filename)
+{
+        g_free (backend->filename);
+        backend->filename = g_strdup (filename);
+
+        backend->key_file = load_key_file (backend);
 }
 
 static void
@@ -244,42 +297,147 @@ gdm_settings_desktop_backend_get_value (GdmSettingsBackend *backend,
         return TRUE;
 }
 
+static void emit_changes (GdmSettingsDesktopBackend *backend,
+                          GKeyFile                  *old_key_file,
+                          GKeyFile                  *new_key_file);
+
+/* Serializes writers of the settings files, gdm-runtime-config
+ * included. The files get replaced on every write, so the lock is a
+ * separate file, only accessible to root so that nobody else can hold
+ * it and stall the daemon */
+static int
+lock_settings (GError **error)
+{
+        const char *path = lock_file != NULL ? lock_file : GDM_SETTINGS_LOCK_FILE;
+        int fd;
+
+        fd = open (path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+        if (fd < 0) {
+                int errsv = errno;
+                g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                             "Unable to open %s: %s", path, g_strerror (errsv));
+                return -1;
+        }
+
+        while (flock (fd, LOCK_EX) < 0) {
+                int errsv = errno;
+
+                if (errsv == EINTR)
+                        continue;
+
+                g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                             "Unable to lock %s: %s", path, g_strerror (errsv));
+                close (fd);
+                return -1;
+        }
+
+        return fd;
+}
+
+/* For the tests, which can't write to GDM_RUN_DIR */
+void
+gdm_settings_desktop_backend_set_lock_file (const char *path)
+{
+        g_free (lock_file);
+        lock_file = g_strdup (path);
+}
+
+/* Someone else wrote the file since we read it: start over from what's
+ * on disk and put our own changes back on top, rather than writing out
+ * a stale copy over theirs */
 static void
-save_settings (GdmSettingsDesktopBackend *backend)
+merge_external_changes (GdmSettingsDesktopBackend *backend)
+{
+        g_autoptr(GKeyFile) old_key_file = NULL;
+        g_auto(GStrv) groups = NULL;
+        guint i;
+
+        gdm_debug (SETTINGS, "GdmSettings: %s changed on disk, merging", backend->filename);
+
+        old_key_file = g_steal_pointer (&backend->key_file);
+        backend->key_file = load_key_file (backend);
+
+        groups = g_key_file_get_groups (backend->pending, NULL);
+        for (i = 0; groups[i] != NULL; i++) {
+                g_auto(GStrv) keys = NULL;
+                guint j;
+
+                keys = g_key_file_get_keys (backend->pending, groups[i], NULL, NULL);
+                for (j = 0; keys != NULL && keys[j] != NULL; j++) {
+                        g_autofree char *value = NULL;
+
+                        value = g_key_file_get_value (backend->pending, groups[i], keys[j], NULL);
+                        g_key_file_set_value (backend->key_file, groups[i], keys[j], value);
+                }
+        }
+
+        /* Only what the other writer changed shows up here */
+        emit_changes (backend, old_key_file, backend->key_file);
+}
+
+static gboolean
+save_settings (GdmSettingsDesktopBackend  *backend,
+               GError                    **error)
 {
         g_autoptr(GError) local_error = NULL;
         g_autofree char *contents = NULL;
         gsize     length;
+        mode_t    mode;
+        int       lock_fd;
 
         if (! backend->dirty) {
-                return;
+                return TRUE;
         }
 
-        g_debug ("Saving settings to %s", backend->filename);
+        gdm_debug (SETTINGS, "Saving settings to %s", backend->filename);
 
-        contents = g_key_file_to_data (backend->key_file, &length, &local_error);
-        if (local_error != NULL) {
-                g_warning ("Unable to save settings: %s", local_error->message);
-                return;
+        lock_fd = lock_settings (error);
+        if (lock_fd < 0) {
+                return FALSE;
         }
 
-        g_file_set_contents (backend->filename,
-                             contents,
-                             length,
-                             &local_error);
-        if (local_error != NULL) {
-                g_warning ("Unable to save settings: %s", local_error->message);
-                return;
+        if (file_changed (backend)) {
+                merge_external_changes (backend);
+        }
+
+        mode = backend->have_file_info ? backend->file_info.st_mode & 07777 : 0644;
+
+        contents = g_key_file_to_data (backend->key_file, &length, NULL);
+
+        /* Written to a temporary file, synced, then renamed over the old
+         * one, so a crash leaves either the old or the new contents */
+        if (!g_file_set_contents_full (backend->filename,
+                                       contents,
+                                       length,
+                                       G_FILE_SET_CONTENTS_CONSISTENT | G_FILE_SET_CONTENTS_DURABLE,
+                                       mode,
+                                       error)) {
+                close (lock_fd);
+                return FALSE;
         }
 
+        /* Don't take our own write for a change made by someone else */
+        update_file_info (backend);
+
+        close (lock_fd);
+
+        g_key_file_free (backend->pending);
+        backend->pending = g_key_file_new ();
         backend->dirty = FALSE;
+
+        return TRUE;
 }
 
 static gboolean
 save_settings_timer (GdmSettingsDesktopBackend *backend)
 {
-        save_settings (backend);
+        g_autoptr(GError) error = NULL;
+
         backend->save_id = 0;
+
+        if (!save_settings (backend, &error))
+                g_warning ("Unable to save settings: %s", error->message);
+
         return FALSE;
 }
 
@@ -291,13 +449,30 @@ queue_save (GdmSettingsDesktopBackend *backend)
         }
 
         if (backend->save_id != 0) {
-                /* already pending */
+                /* already pending, this change goes out with the others */
                 return;
         }
 
         backend->save_id = g_timeout_add_seconds (5, (GSourceFunc)save_settings_timer, backend);
 }
 
+/**
+ * gdm_settings_desktop_backend_flush:
+ *
+ * Writes out pending changes now instead of when the save timer fires.
+ * Once this returns %TRUE, every value set before the call is on disk.
+ */
+gboolean
+gdm_settings_desktop_backend_flush (GdmSettingsDesktopBackend  *backend,
+                                    GError                    **error)
+{
+        g_return_val_if_fail (GDM_IS_SETTINGS_DESKTOP_BACKEND (backend), FALSE);
+
+        g_clear_handle_id (&backend->save_id, g_source_remove);
+
+        return save_settings (backend, error);
+}
+
 static gboolean
 gdm_settings_desktop_backend_set_value (GdmSettingsBackend *backend,
                                         const char         *key,
@@ -329,6 +504,10 @@ gdm_settings_desktop_backend_set_value (GdmSettingsBackend *backend,
                               g,
                               k,
                               value);
+        g_key_file_set_value (GDM_SETTINGS_DESKTOP_BACKEND (backend)->pending,
+                              g,
+                              k,
+                              value);
 
         GDM_SETTINGS_DESKTOP_BACKEND (backend)->dirty = TRUE;
         queue_save (GDM_SETTINGS_DESKTOP_BACKEND (backend));
@@ -338,6 +517,108 @@ gdm_settings_desktop_backend_set_value (GdmSettingsBackend *backend,
         return TRUE;
 }
 
+/* Emits value-changed for every key whose value differs between the two
+ * key files, a missing key counting as NULL */
+static void
+emit_changes (GdmSettingsDesktopBackend *backend,
+              GKeyFile                  *old_key_file,
+              GKeyFile                  *new_key_file)
+{
+        GKeyFile *key_files[] = { old_key_file, new_key_file };
+        guint i;
+
+        for (i = 0; i < G_N_ELEMENTS (key_files); i++) {
+                g_auto(GStrv) groups = NULL;
+                guint j;
+
+                groups = g_key_file_get_groups (key_files[i], NULL);
+
+                for (j = 0; groups[j] != NULL; j++) {
+                        g_auto(GStrv) keys = NULL;
+                        guint k;
+
+                        keys = g_key_file_get_keys (key_files[i], groups[j], NULL, NULL);
+                        if (keys == NULL)
+                                continue;
+
+                        for (k = 0; keys[k] != NULL; k++) {
+                                g_autofree char *old_value = NULL;
+                                g_autofree char *new_value = NULL;
+                                g_autofree char *key = NULL;
+
+                                /* Keys in both files were handled on the first pass */
+                                if (i == 1 && g_key_file_has_key (old_key_file, groups[j], keys[k], NULL))
+                                        continue;
+
+                                old_value = g_key_file_get_value (old_key_file, groups[j], keys[k], NULL);
+                                new_value = g_key_file_get_value (new_key_file, groups[j], keys[k], NULL);
+
+                                if (g_strcmp0 (old_value, new_value) == 0)
+                                        continue;
+
+                                key = g_strdup_printf ("%s/%s", groups[j], keys[k]);
+                                gdm_settings_backend_value_changed (GDM_SETTINGS_BACKEND (backend),
+                                                                    key,
+                                                                    old_value,
+                                                                    new_value);
+                        }
+                }
+        }
+}
+
+const char *
+gdm_settings_desktop_backend_get_filename (GdmSettingsDesktopBackend *backend)
+{
+        g_return_val_if_fail (GDM_IS_SETTINGS_DESKTOP_BACKEND (backend), NULL);
+
+        return backend->filename;
+}
+
+/**
+ * gdm_settings_desktop_backend_reload:
+ *
+ * Rereads the file if it was replaced or modified since it was last
+ * read, and emits value-changed for each key that got a different
+ * value. Pending changes of our own are written out first.
+ *
+ * Returns: %TRUE if the file had changed
+ */
+gboolean
+gdm_settings_desktop_backend_reload (GdmSettingsDesktopBackend *backend)
+{
+        g_autoptr(GKeyFile) old_key_file = NULL;
+        g_autoptr(GError) error = NULL;
+
+        g_return_val_if_fail (GDM_IS_SETTINGS_DESKTOP_BACKEND (backend), FALSE);
+
+        if (!gdm_settings_desktop_backend_flush (backend, &error))
+                g_warning ("Unable to save settings: %s", error->message);
+
+        if (!file_changed (backend))
+                return FALSE;
+
+        gdm_debug (SETTINGS, "GdmSettings: %s changed on disk, reloading", backend->filename);
+
+        old_key_file = g_steal_pointer (&backend->key_file);
+        backend->key_file = load_key_file (backend);
+
+        emit_changes (backend, old_key_file, backend->key_file);
+
+        return TRUE;
+}
+
+/* For a file that just appeared: every key in it is new */
+void
+gdm_settings_desktop_backend_announce_values (GdmSettingsDesktopBackend *backend)
+{
+        g_autoptr(GKeyFile) empty_key_file = NULL;
+
+        g_return_if_fail (GDM_IS_SETTINGS_DESKTOP_BACKEND (backend));
+
+        empty_key_file = g_key_file_new ();
+        emit_changes (backend, empty_key_file, backend->key_file);
+}
+
 static void
 gdm_settings_desktop_backend_class_init (GdmSettingsDesktopBackendClass *klass)
 {
@@ -363,20 +644,25 @@ gdm_settings_desktop_backend_class_init (GdmSettingsDesktopBackendClass *klass)
 static void
 gdm_settings_desktop_backend_init (GdmSettingsDesktopBackend *backend)
 {
+        backend->pending = g_key_file_new ();
 }
 
 static void
 gdm_settings_desktop_backend_finalize (GObject *object)
 {
         GdmSettingsDesktopBackend *backend;
+        g_autoptr(GError) error = NULL;
 
         g_return_if_fail (object != NULL);
         g_return_if_fail (GDM_IS_SETTINGS_DESKTOP_BACKEND (object));
 
         backend = GDM_SETTINGS_DESKTOP_BACKEND (object);
 
-        save_settings (backend);
+        if (!gdm_settings_desktop_backend_flush (backend, &error))
+                g_warning ("Unable to save settings: %s", error->message);
+
         g_key_file_free (backend->key_file);
+        g_key_file_free (backend->pending);
         g_free (backend->filename);
 
         G_OBJECT_CLASS (gdm_settings_desktop_backend_parent_class)->finalize (object);
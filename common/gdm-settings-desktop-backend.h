@@ -32,6 +32,14 @@ G_DECLARE_FINAL_TYPE (GdmSettingsDesktopBackend, gdm_settings_desktop_backend, G
 
 GdmSettingsBackend        *gdm_settings_desktop_backend_new             (const char* filename);
 
+const char                *gdm_settings_desktop_backend_get_filename    (GdmSettingsDesktopBackend *backend);
+gboolean                   gdm_settings_desktop_backend_reload          (GdmSettingsDesktopBackend *backend);
+gboolean                   gdm_settings_desktop_backend_flush           (GdmSettingsDesktopBackend  *backend,
+                                                                         GError                    **error);
+void                       gdm_settings_desktop_backend_announce_values (GdmSettingsDesktopBackend *backend);
+
+void                       gdm_settings_desktop_backend_set_lock_file   (const char                *path);
+
 G_END_DECLS
 
 #endif /* __GDM_SETTINGS_DESKTOP_BACKEND_H */
@@ -37,92 +37,115 @@
 #include "gdm-settings.h"
 #include "gdm-settings-utils.h"
 #include "gdm-settings-direct.h"
+#include "gdm-log.h"
 
-static GHashTable      *schemas;
+/* The effective value of every setting, parsed, indexed by GdmSettingId.
+ * Refreshed one slot at a time when GdmSettings reports a change */
+typedef union
+{
+        gboolean  boolean;
+        int       integer;
+        char     *string;
+} SettingValue;
+
+static SettingValue     values[GDM_SETTING_COUNT];
+static gboolean         have_values;
+static GHashTable      *ids_by_key;
 static GdmSettings     *settings_object;
 
-static GdmSettingsEntry *
-get_entry_for_key (const char *key)
-{
-        GdmSettingsEntry *entry;
+/* Where the daemon publishes the values for its helpers */
+static char            *snapshot_path;
+static guint            snapshot_id;
 
-        entry = g_hash_table_lookup (schemas, key);
+#define SNAPSHOT_TYPE "(sav)"
 
-        return entry;
-}
+static gboolean write_snapshot (gpointer data);
 
 static void
-assert_signature (GdmSettingsEntry *entry,
-                  const char       *signature)
+load_value (GdmSettingId id)
 {
-        const char *sig;
-
-        sig = gdm_settings_entry_get_signature (entry);
+        const GdmSettingInfo *info = &gdm_settings_table[id];
+        g_autofree char *str = NULL;
+        gboolean res;
 
-        g_assert (sig != NULL);
-        g_assert (signature != NULL);
-        g_assert (strcmp (signature, sig) == 0);
+        res = gdm_settings_get_value (settings_object, info->key, &str, NULL);
+
+        switch (info->type) {
+        case GDM_SETTING_TYPE_BOOLEAN:
+                if (!res || !gdm_settings_parse_value_as_boolean (str, &values[id].boolean)) {
+                        if (res)
+                                g_warning ("Invalid value '%s' for %s, using the default", str, info->key);
+                        values[id].boolean = info->default_value.boolean;
+                }
+                break;
+        case GDM_SETTING_TYPE_INT:
+                if (!res || !gdm_settings_parse_value_as_integer (str, &values[id].integer)) {
+                        if (res)
+                                g_warning ("Invalid value '%s' for %s, using the default", str, info->key);
+                        values[id].integer = info->default_value.integer;
+                }
+                break;
+        case GDM_SETTING_TYPE_STRING:
+                g_free (values[id].string);
+                values[id].string = g_strdup (res ? str : info->default_value.string);
+                break;
+        default:
+                g_assert_not_reached ();
+        }
 }
 
-static gboolean
-get_value (const char *key,
-           char      **value)
+static void
+on_value_changed (GdmSettings *settings,
+                  const char  *key,
+                  const char  *old_value,
+                  const char  *new_value)
 {
-        g_autofree char *str = NULL;
-        gboolean res;
+        gpointer id;
 
-        res = gdm_settings_get_value (settings_object, key, &str, NULL);
-        if (! res) {
-                return FALSE;
-        }
+        if (!g_hash_table_lookup_extended (ids_by_key, key, NULL, &id))
+                return;
 
-        if (value != NULL) {
-                *value = g_strdup (str);
-        }
+        gdm_debug (SETTINGS, "Settings Direct: %s changed", key);
 
-        return TRUE;
+        load_value (GPOINTER_TO_UINT (id));
+
+        /* A reload usually changes several keys at once */
+        if (snapshot_path != NULL && snapshot_id == 0)
+                snapshot_id = g_idle_add (write_snapshot, NULL);
+}
+
+static inline void
+check_type (GdmSettingId   id,
+            GdmSettingType type)
+{
+        g_assert (id < GDM_SETTING_COUNT);
+        g_assert (gdm_settings_table[id].type == type);
 }
 
 gboolean
-gdm_settings_direct_get_int (const char        *key,
+gdm_settings_direct_get_int (GdmSettingId       id,
                              int               *value)
 {
-        GdmSettingsEntry *entry;
-        gboolean          ret;
-        gboolean          res;
-        g_autofree char *str = NULL;
-
-        g_return_val_if_fail (key != NULL, FALSE);
+        g_return_val_if_fail (have_values, FALSE);
         g_return_val_if_fail (value != NULL, FALSE);
 
-        entry = get_entry_for_key (key);
-        g_assert (entry != NULL);
-
-        assert_signature (entry, "i");
+        check_type (id, GDM_SETTING_TYPE_INT);
 
-        res = get_value (key, &str);
+        *value = values[id].integer;
 
-        if (! res) {
-                /* use the default */
-                str = g_strdup (gdm_settings_entry_get_default_value (entry));
-        }
-
-        ret = gdm_settings_parse_value_as_integer (str, value);
-
-        return ret;
+        return TRUE;
 }
 
 gboolean
-gdm_settings_direct_get_uint (const char        *key,
+gdm_settings_direct_get_uint (GdmSettingId       id,
                               uint              *value)
 {
         gboolean          ret;
         int               intvalue;
 
-        g_return_val_if_fail (key != NULL, FALSE);
         g_return_val_if_fail (value != NULL, FALSE);
 
-        ret = gdm_settings_direct_get_int (key, &intvalue);
+        ret = gdm_settings_direct_get_int (id, &intvalue);
 
         if (ret && intvalue >= 0) {
                 *value = intvalue;
@@ -134,97 +157,256 @@ gdm_settings_direct_get_uint (const char        *key,
 }
 
 gboolean
-gdm_settings_direct_get_boolean (const char        *key,
+gdm_settings_direct_get_boolean (GdmSettingId       id,
                                  gboolean          *value)
 {
-        GdmSettingsEntry *entry;
-        gboolean          ret;
-        gboolean          res;
-        g_autofree char *str = NULL;
-
-        g_return_val_if_fail (key != NULL, FALSE);
+        g_return_val_if_fail (have_values, FALSE);
         g_return_val_if_fail (value != NULL, FALSE);
 
-        entry = get_entry_for_key (key);
-        g_assert (entry != NULL);
+        check_type (id, GDM_SETTING_TYPE_BOOLEAN);
 
-        assert_signature (entry, "b");
+        *value = values[id].boolean;
 
-        res = get_value (key, &str);
+        return TRUE;
+}
 
-        if (! res) {
-                /* use the default */
-                str = g_strdup (gdm_settings_entry_get_default_value (entry));
-        }
+gboolean
+gdm_settings_direct_get_string (GdmSettingId       id,
+                                char             **value)
+{
+        g_return_val_if_fail (have_values, FALSE);
+        g_return_val_if_fail (value != NULL, FALSE);
 
-        ret = gdm_settings_parse_value_as_boolean  (str, value);
+        check_type (id, GDM_SETTING_TYPE_STRING);
 
-        return ret;
+        *value = g_strdup (values[id].string);
+
+        return TRUE;
 }
 
+/**
+ * gdm_settings_direct_init:
+ *
+ * Reads every setting listed in gdm.schemas, which is compiled into
+ * gdm_settings_table at build time, from @settings and keeps the parsed
+ * values up to date as @settings reports changes.
+ */
 gboolean
-gdm_settings_direct_get_string (const char        *key,
-                                char             **value)
+gdm_settings_direct_init (GdmSettings *settings)
 {
-        GdmSettingsEntry *entry;
-        gboolean          ret;
-        gboolean          res;
-        g_autofree char *str = NULL;
+        guint i;
 
-        g_return_val_if_fail (key != NULL, FALSE);
-        g_return_val_if_fail (value != NULL, FALSE);
+        g_return_val_if_fail (GDM_IS_SETTINGS (settings), FALSE);
 
-        entry = get_entry_for_key (key);
-        g_assert (entry != NULL);
+        gdm_debug (SETTINGS, "Settings Direct Init");
 
-        assert_signature (entry, "s");
+        if (settings_object != NULL)
+                g_signal_handlers_disconnect_by_func (settings_object, on_value_changed, NULL);
 
-        ret = TRUE;
+        if (ids_by_key == NULL) {
+                ids_by_key = g_hash_table_new (g_str_hash, g_str_equal);
+                for (i = 0; i < GDM_SETTING_COUNT; i++)
+                        g_hash_table_insert (ids_by_key,
+                                             (gpointer) gdm_settings_table[i].key,
+                                             GUINT_TO_POINTER (i));
+        }
+
+        settings_object = settings;
 
-        res = get_value (key, &str);
+        for (i = 0; i < GDM_SETTING_COUNT; i++)
+                load_value (i);
+        have_values = TRUE;
+
+        g_signal_connect (settings_object,
+                          "value-changed",
+                          G_CALLBACK (on_value_changed),
+                          NULL);
+
+        return TRUE;
+}
 
-        if (! res) {
-                /* use the default */
-                str = g_strdup (gdm_settings_entry_get_default_value (entry));
+static GVariant *
+build_snapshot (void)
+{
+        GVariantBuilder builder;
+        guint i;
+
+        g_variant_builder_init (&builder, G_VARIANT_TYPE ("av"));
+
+        for (i = 0; i < GDM_SETTING_COUNT; i++) {
+                switch (gdm_settings_table[i].type) {
+                case GDM_SETTING_TYPE_BOOLEAN:
+                        g_variant_builder_add (&builder, "v", g_variant_new_boolean (values[i].boolean));
+                        break;
+                case GDM_SETTING_TYPE_INT:
+                        g_variant_builder_add (&builder, "v", g_variant_new_int32 (values[i].integer));
+                        break;
+                case GDM_SETTING_TYPE_STRING:
+                        g_variant_builder_add (&builder, "v", g_variant_new_string (values[i].string));
+                        break;
+                default:
+                        g_assert_not_reached ();
+                }
         }
 
-        *value = g_strdup (str);
+        return g_variant_ref_sink (g_variant_new ("(s@av)",
+                                                  GDM_SETTINGS_TABLE_CHECKSUM,
+                                                  g_variant_builder_end (&builder)));
+}
 
-        return ret;
+static gboolean
+write_snapshot (gpointer data)
+{
+        g_autoptr(GVariant) snapshot = NULL;
+        g_autoptr(GError) error = NULL;
+
+        snapshot_id = 0;
+
+        snapshot = build_snapshot ();
+
+        /* Replaced atomically, processes that have the old one mapped
+         * keep seeing consistent data */
+        if (!g_file_set_contents_full (snapshot_path,
+                                       g_variant_get_data (snapshot),
+                                       g_variant_get_size (snapshot),
+                                       G_FILE_SET_CONTENTS_CONSISTENT,
+                                       0644,
+                                       &error)) {
+                g_warning ("Unable to publish settings to %s: %s", snapshot_path, error->message);
+                return G_SOURCE_REMOVE;
+        }
+
+        gdm_debug (SETTINGS, "Settings Direct: published settings to %s", snapshot_path);
+
+        return G_SOURCE_REMOVE;
 }
 
-static void
-hashify_list (GdmSettingsEntry *entry,
-              gpointer          data)
+/**
+ * gdm_settings_direct_publish:
+ *
+ * Writes the resolved value of every setting to @path, and keeps it up
+ * to date, so that helper processes can pick them up with
+ * gdm_settings_direct_init_from_snapshot() instead of reading the
+ * configuration files themselves.
+ */
+void
+gdm_settings_direct_publish (const char *path)
+{
+        g_return_if_fail (have_values);
+        g_return_if_fail (path != NULL);
+
+        g_free (snapshot_path);
+        snapshot_path = g_strdup (path);
+
+        g_clear_handle_id (&snapshot_id, g_source_remove);
+        write_snapshot (NULL);
+}
+
+static gboolean
+load_snapshot (GVariant *snapshot)
 {
-        g_hash_table_insert (schemas, g_strdup (gdm_settings_entry_get_key (entry)), entry);
+        g_autoptr(GVariant) snapshot_values = NULL;
+        const char *checksum;
+        guint i;
+
+        g_variant_get_child (snapshot, 0, "&s", &checksum);
+        if (g_strcmp0 (checksum, GDM_SETTINGS_TABLE_CHECKSUM) != 0) {
+                gdm_debug (SETTINGS, "Settings Direct: snapshot is for a different set of settings");
+                return FALSE;
+        }
+
+        snapshot_values = g_variant_get_child_value (snapshot, 1);
+        if (g_variant_n_children (snapshot_values) != GDM_SETTING_COUNT)
+                return FALSE;
+
+        for (i = 0; i < GDM_SETTING_COUNT; i++) {
+                g_autoptr(GVariant) value = NULL;
+
+                g_variant_get_child (snapshot_values, i, "v", &value);
+
+                switch (gdm_settings_table[i].type) {
+                case GDM_SETTING_TYPE_BOOLEAN:
+                        if (!g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN))
+                                return FALSE;
+                        values[i].boolean = g_variant_get_boolean (value);
+                        break;
+                case GDM_SETTING_TYPE_INT:
+                        if (!g_variant_is_of_type (value, G_VARIANT_TYPE_INT32))
+                                return FALSE;
+                        values[i].integer = g_variant_get_int32 (value);
+                        break;
+                case GDM_SETTING_TYPE_STRING:
+                        if (!g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
+                                return FALSE;
+                        g_free (values[i].string);
+                        values[i].string = g_variant_dup_string (value, NULL);
+                        break;
+                default:
+                        g_assert_not_reached ();
+                }
+        }
+
+        return TRUE;
 }
 
+/**
+ * gdm_settings_direct_init_from_snapshot:
+ *
+ * Takes the settings from the snapshot the daemon published at @path,
+ * which is only mapped and read, not parsed. The values don't follow
+ * later changes to the configuration.
+ *
+ * Returns: %FALSE if there is no usable snapshot, in which case the
+ *   caller should fall back to gdm_settings_direct_init()
+ */
 gboolean
-gdm_settings_direct_init (GdmSettings *settings,
-                          const char  *file,
-                          const char  *root)
+gdm_settings_direct_init_from_snapshot (const char *path)
 {
-        GSList  *list;
+        g_autoptr(GMappedFile) mapped_file = NULL;
+        g_autoptr(GBytes) bytes = NULL;
+        g_autoptr(GVariant) snapshot = NULL;
+        g_autoptr(GError) error = NULL;
+        struct stat file_info;
+        int fd;
+
+        g_return_val_if_fail (path != NULL, FALSE);
+
+        fd = open (path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (fd < 0) {
+                gdm_debug (SETTINGS, "Settings Direct: no snapshot at %s: %m", path);
+                return FALSE;
+        }
 
-        g_return_val_if_fail (file != NULL, FALSE);
-        g_return_val_if_fail (root != NULL, FALSE);
+        /* Only the daemon gets to tell us what the settings are, or
+         * whoever we run as already, which gains them nothing */
+        if (fstat (fd, &file_info) < 0 ||
+            (file_info.st_uid != 0 && file_info.st_uid != geteuid ()) ||
+            !S_ISREG (file_info.st_mode)) {
+                g_warning ("Ignoring settings snapshot %s not owned by root", path);
+                close (fd);
+                return FALSE;
+        }
 
-        g_debug ("Settings Direct Init");
-        if (schemas != NULL) {
-                g_hash_table_unref (schemas);
-                schemas = NULL;
+        mapped_file = g_mapped_file_new_from_fd (fd, FALSE, &error);
+        close (fd);
+
+        if (mapped_file == NULL) {
+                g_warning ("Unable to map settings snapshot %s: %s", path, error->message);
+                return FALSE;
         }
 
-        if (! gdm_settings_parse_schemas (file, root, &list)) {
-                g_warning ("Unable to parse schemas");
+        bytes = g_mapped_file_get_bytes (mapped_file);
+        snapshot = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (SNAPSHOT_TYPE), bytes, FALSE));
+
+        if (!load_snapshot (snapshot)) {
+                /* Don't leave half of the values behind */
+                have_values = FALSE;
                 return FALSE;
         }
 
-        schemas = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)gdm_settings_entry_free);
-        g_slist_foreach (list, (GFunc)hashify_list, NULL);
+        have_values = TRUE;
 
-        settings_object = settings;
+        gdm_debug (SETTINGS, "Settings Direct: using snapshot %s", path);
 
         return TRUE;
 }
@@ -241,5 +423,6 @@ gdm_settings_direct_reload (void)
 void
 gdm_settings_direct_shutdown (void)
 {
-
+        g_clear_handle_id (&snapshot_id, g_source_remove);
+        g_clear_pointer (&snapshot_path, g_free);
 }
@@ -24,23 +24,28 @@
 
 #include <glib-object.h>
 #include "gdm-settings.h"
+#include "gdm-settings-table.h"
 
 G_BEGIN_DECLS
 
-gboolean              gdm_settings_direct_init                       (GdmSettings       *settings,
-                                                                      const char        *schemas_file,
-                                                                      const char        *root);
+/* Resolved settings, published by the daemon for its helpers */
+#define GDM_SETTINGS_SNAPSHOT GDM_RUN_DIR "/settings.snapshot"
+
+
+gboolean              gdm_settings_direct_init                       (GdmSettings       *settings);
+gboolean              gdm_settings_direct_init_from_snapshot         (const char        *path);
+void                  gdm_settings_direct_publish                    (const char        *path);
 
 void                  gdm_settings_direct_reload                     (void);
 void                  gdm_settings_direct_shutdown                   (void);
 
-gboolean              gdm_settings_direct_get_int                    (const char        *key,
+gboolean              gdm_settings_direct_get_int                    (GdmSettingId       id,
                                                                       int               *value);
-gboolean              gdm_settings_direct_get_uint                   (const char        *key,
+gboolean              gdm_settings_direct_get_uint                   (GdmSettingId       id,
                                                                       uint              *value);
-gboolean              gdm_settings_direct_get_boolean                (const char        *key,
+gboolean              gdm_settings_direct_get_boolean                (GdmSettingId       id,
                                                                       gboolean          *value);
-gboolean              gdm_settings_direct_get_string                 (const char        *key,
+gboolean              gdm_settings_direct_get_string                 (GdmSettingId       id,
                                                                       char             **value);
 
 G_END_DECLS
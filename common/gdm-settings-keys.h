@@ -23,24 +23,34 @@
 
 #include <glib.h>
 
+#include "gdm-settings-table.h"
+
 G_BEGIN_DECLS
 
-#define GDM_KEY_AUTO_LOGIN_ENABLE "daemon/AutomaticLoginEnable"
-#define GDM_KEY_AUTO_LOGIN_USER "daemon/AutomaticLogin"
-#define GDM_KEY_TIMED_LOGIN_ENABLE "daemon/TimedLoginEnable"
-#define GDM_KEY_TIMED_LOGIN_USER "daemon/TimedLogin"
-#define GDM_KEY_TIMED_LOGIN_DELAY "daemon/TimedLoginDelay"
-#define GDM_KEY_INITIAL_SETUP_ENABLE "daemon/InitialSetupEnable"
+/* Settings are looked up by GdmSettingId, see gdm-settings-table.h,
+ * which is generated from gdm.schemas */
+
+#define GDM_KEY_AUTO_LOGIN_ENABLE GDM_SETTING_DAEMON_AUTOMATIC_LOGIN_ENABLE
+#define GDM_KEY_AUTO_LOGIN_USER GDM_SETTING_DAEMON_AUTOMATIC_LOGIN
+#define GDM_KEY_TIMED_LOGIN_ENABLE GDM_SETTING_DAEMON_TIMED_LOGIN_ENABLE
+#define GDM_KEY_TIMED_LOGIN_USER GDM_SETTING_DAEMON_TIMED_LOGIN
+#define GDM_KEY_TIMED_LOGIN_DELAY GDM_SETTING_DAEMON_TIMED_LOGIN_DELAY
+#define GDM_KEY_INITIAL_SETUP_ENABLE GDM_SETTING_DAEMON_INITIAL_SETUP_ENABLE
 #ifdef ENABLE_X11_SUPPORT
-#define GDM_KEY_XORG_ENABLE "daemon/XorgEnable"
+#define GDM_KEY_XORG_ENABLE GDM_SETTING_DAEMON_XORG_ENABLE
 #endif
-#define GDM_KEY_REMOTE_LOGIN_ENABLE "daemon/RemoteLoginEnable"
-#define GDM_KEY_FALLBACK_SESSION "daemon/FallbackSession"
-
-#define GDM_KEY_DEBUG "debug/Enable"
-
-#define GDM_KEY_DISALLOW_TCP "security/DisallowTCP"
-#define GDM_KEY_ALLOW_REMOTE_AUTOLOGIN "security/AllowRemoteAutoLogin"
+#define GDM_KEY_REMOTE_LOGIN_ENABLE GDM_SETTING_DAEMON_REMOTE_LOGIN_ENABLE
+#define GDM_KEY_FALLBACK_SESSION GDM_SETTING_DAEMON_FALLBACK_SESSION
+#define GDM_KEY_WORKER_POOL_SIZE GDM_SETTING_DAEMON_WORKER_POOL_SIZE
+#define GDM_KEY_GREETER_USER_RESERVE GDM_SETTING_DAEMON_GREETER_USER_RESERVE
+#define GDM_KEY_USERDB_WORKERS GDM_SETTING_DAEMON_USERDB_WORKERS
+#define GDM_KEY_SESSION_LOG_MAX_SIZE GDM_SETTING_DAEMON_SESSION_LOG_MAX_SIZE
+#define GDM_KEY_SESSION_LOG_COMPRESS GDM_SETTING_DAEMON_SESSION_LOG_COMPRESS
+
+#define GDM_KEY_DEBUG GDM_SETTING_DEBUG_ENABLE
+
+#define GDM_KEY_DISALLOW_TCP GDM_SETTING_SECURITY_DISALLOW_TCP
+#define GDM_KEY_ALLOW_REMOTE_AUTOLOGIN GDM_SETTING_SECURITY_ALLOW_REMOTE_AUTO_LOGIN
 
 G_END_DECLS
 
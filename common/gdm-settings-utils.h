@@ -26,23 +26,6 @@
 
 G_BEGIN_DECLS
 
-typedef struct _GdmSettingsEntry GdmSettingsEntry;
-
-GdmSettingsEntry *        gdm_settings_entry_new               (void);
-void                      gdm_settings_entry_free              (GdmSettingsEntry *entry);
-
-const char *              gdm_settings_entry_get_key           (GdmSettingsEntry *entry);
-const char *              gdm_settings_entry_get_signature     (GdmSettingsEntry *entry);
-const char *              gdm_settings_entry_get_default_value (GdmSettingsEntry *entry);
-const char *              gdm_settings_entry_get_value         (GdmSettingsEntry *entry);
-
-void                      gdm_settings_entry_set_value         (GdmSettingsEntry *entry,
-                                                                const char       *value);
-
-gboolean                  gdm_settings_parse_schemas           (const char  *file,
-                                                                const char  *root,
-                                                                GSList     **list);
-
 gboolean                  gdm_settings_parse_value_as_boolean  (const char *value,
                                                                 gboolean   *boolval);
 gboolean                  gdm_settings_parse_value_as_integer  (const char *value,
@@ -38,12 +38,14 @@
 #include "gdm-settings.h"
 
 #include "gdm-settings-desktop-backend.h"
+#include "gdm-log.h"
 
 struct _GdmSettings
 {
         GObject   parent;
 
         GList    *backends;
+        gboolean  loaded;
 };
 
 enum {
@@ -83,9 +85,14 @@ gdm_settings_get_value (GdmSettings *settings,
         GList   *l;
 
         g_return_val_if_fail (GDM_IS_SETTINGS (settings), FALSE);
-        g_return_val_if_fail (settings->backends != NULL, FALSE);
         g_return_val_if_fail (key != NULL, FALSE);
 
+        /* No configuration files, everything is at its default */
+        if (settings->backends == NULL) {
+                g_set_error (error, GDM_SETTINGS_ERROR, GDM_SETTINGS_ERROR_KEY_NOT_FOUND, "Key not found");
+                return FALSE;
+        }
+
         local_error = NULL;
 
         for (l = settings->backends; l; l = g_list_next (l)) {
@@ -125,7 +132,7 @@ gdm_settings_set_value (GdmSettings *settings,
         g_return_val_if_fail (key != NULL, FALSE);
         g_return_val_if_fail (value != NULL, FALSE);
 
-        g_debug ("Setting value %s", key);
+        gdm_debug (SETTINGS, "Setting value %s", key);
 
         local_error = NULL;
 
@@ -152,6 +159,31 @@ gdm_settings_set_value (GdmSettings *settings,
         return res;
 }
 
+/**
+ * gdm_settings_flush:
+ *
+ * Writes every value set so far to disk, for callers that can't wait
+ * for the batched save, e.g. before handing over to another process
+ * that reads the files.
+ */
+gboolean
+gdm_settings_flush (GdmSettings *settings,
+                    GError     **error)
+{
+        GList *l;
+
+        g_return_val_if_fail (GDM_IS_SETTINGS (settings), FALSE);
+
+        for (l = settings->backends; l; l = g_list_next (l)) {
+                GdmSettingsDesktopBackend *backend = l->data;
+
+                if (!gdm_settings_desktop_backend_flush (backend, error))
+                        return FALSE;
+        }
+
+        return TRUE;
+}
+
 static void
 gdm_settings_class_init (GdmSettingsClass *klass)
 {
@@ -181,40 +213,98 @@ backend_value_changed (GdmSettingsBackend *backend,
                        const char         *new_value,
                        GdmSettings        *settings)
 {
-        g_debug ("Emitting value-changed %s %s %s", key, old_value, new_value);
+        gdm_debug (SETTINGS, "Emitting value-changed %s %s %s", key, old_value, new_value);
 
         /* proxy it to internal listeners */
         g_signal_emit (settings, signals [VALUE_CHANGED], 0, key, old_value, new_value);
 }
 
+static GdmSettingsBackend *
+find_backend (GdmSettings *settings,
+              const char  *filename)
+{
+        GList *l;
+
+        for (l = settings->backends; l; l = g_list_next (l)) {
+                GdmSettingsDesktopBackend *backend = l->data;
+
+                if (g_strcmp0 (gdm_settings_desktop_backend_get_filename (backend), filename) == 0)
+                        return l->data;
+        }
+
+        return NULL;
+}
+
+/**
+ * gdm_settings_reload:
+ *
+ * Rereads the configuration files that changed since they were last
+ * read, emitting value-changed for the keys that changed with them.
+ * Files that didn't change cost a stat() each, so it's fine to call
+ * this often.
+ */
 void
 gdm_settings_reload (GdmSettings *settings)
 {
+        /* In order of precedence */
+        const char *filenames[] = { GDM_RUNTIME_CONF, GDM_CUSTOM_CONF };
+        g_autoptr(GPtrArray) added = NULL;
+        GList *backends = NULL;
         GList *l;
-        GdmSettingsBackend *backend;
+        guint i;
 
         g_return_if_fail (GDM_IS_SETTINGS (settings));
 
-        g_list_foreach (settings->backends, (GFunc) g_object_unref, NULL);
-        g_list_free (settings->backends);
-        settings->backends = NULL;
+        added = g_ptr_array_new ();
 
-        backend = gdm_settings_desktop_backend_new (GDM_CUSTOM_CONF);
-        if (backend)
-                settings->backends = g_list_prepend (NULL, backend);
+        for (i = 0; i < G_N_ELEMENTS (filenames); i++) {
+                GdmSettingsBackend *backend;
 
-        backend = gdm_settings_desktop_backend_new (GDM_RUNTIME_CONF);
-        if (backend)
-                settings->backends = g_list_prepend (settings->backends, backend);
+                backend = find_backend (settings, filenames[i]);
 
-        for (l = settings->backends; l; l = g_list_next (l)) {
-                backend = l->data;
+                if (backend != NULL) {
+                        settings->backends = g_list_remove (settings->backends, backend);
+                } else {
+                        backend = gdm_settings_desktop_backend_new (filenames[i]);
+                        if (backend == NULL)
+                                continue;
+
+                        gdm_debug (SETTINGS, "GdmSettings: using %s", filenames[i]);
 
-                g_signal_connect (backend,
-                                  "value-changed",
-                                  G_CALLBACK (backend_value_changed),
-                                  settings);
+                        g_signal_connect (backend,
+                                          "value-changed",
+                                          G_CALLBACK (backend_value_changed),
+                                          settings);
+                        g_ptr_array_add (added, backend);
+                }
+
+                backends = g_list_append (backends, backend);
         }
+
+        g_list_free_full (settings->backends, g_object_unref);
+        settings->backends = backends;
+
+        for (l = settings->backends; l != NULL; ) {
+                GdmSettingsDesktopBackend *backend = l->data;
+                GList *next = l->next;
+
+                if (g_ptr_array_find (added, backend, NULL)) {
+                        if (settings->loaded)
+                                gdm_settings_desktop_backend_announce_values (backend);
+                } else {
+                        gdm_settings_desktop_backend_reload (backend);
+                }
+
+                /* Its keys went away with it, and were announced as such */
+                if (!g_file_test (gdm_settings_desktop_backend_get_filename (backend), G_FILE_TEST_IS_REGULAR)) {
+                        settings->backends = g_list_delete_link (settings->backends, l);
+                        g_object_unref (backend);
+                }
+
+                l = next;
+        }
+
+        settings->loaded = TRUE;
 }
 
 static void
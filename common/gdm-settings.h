@@ -52,6 +52,8 @@ gboolean            gdm_settings_set_value                      (GdmSettings *se
                                                                  const char  *key,
                                                                  const char  *value,
                                                                  GError     **error);
+gboolean            gdm_settings_flush                          (GdmSettings *settings,
+                                                                 GError     **error);
 
 G_END_DECLS
 
@@ -0,0 +1,414 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "gdm-spawn.h"
+
+extern char **environ;
+
+typedef struct
+{
+        GdmSpawnFlags        flags;
+        GSpawnChildSetupFunc child_setup;
+        gpointer             user_data;
+} FallbackChildSetup;
+
+static void
+set_spawn_error (GError     **error,
+                 const char  *file,
+                 int          errnum)
+{
+        GSpawnError code;
+
+        switch (errnum) {
+        case ENOENT:
+        case ENOTDIR:
+                code = G_SPAWN_ERROR_NOENT;
+                break;
+        case EACCES:
+                code = G_SPAWN_ERROR_ACCES;
+                break;
+        case ENOEXEC:
+                code = G_SPAWN_ERROR_NOEXEC;
+                break;
+        case ENOMEM:
+                code = G_SPAWN_ERROR_NOMEM;
+                break;
+        default:
+                code = G_SPAWN_ERROR_FAILED;
+                break;
+        }
+
+        g_set_error (error,
+                     G_SPAWN_ERROR,
+                     code,
+                     "Failed to execute child process “%s” (%s)",
+                     file,
+                     g_strerror (errnum));
+}
+
+static gboolean
+can_use_posix_spawn (GdmSpawnFlags        flags,
+                     GSpawnChildSetupFunc child_setup)
+{
+        if (child_setup != NULL)
+                return FALSE;
+
+#ifndef POSIX_SPAWN_SETSID
+        if (flags & GDM_SPAWN_NEW_SESSION)
+                return FALSE;
+#endif
+
+        /* Without closefrom the child would inherit every descriptor
+         * that isn't close-on-exec, which g_spawn () never allows */
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+        return TRUE;
+#else
+        return FALSE;
+#endif
+}
+
+static gboolean
+spawn_with_posix_spawn (const char           *file,
+                        const char * const   *argv,
+                        const char * const   *envp,
+                        int                   stdin_fd,
+                        int                   stdout_fd,
+                        int                   stderr_fd,
+                        GdmSpawnFlags         flags,
+                        GPid                 *child_pid,
+                        GError              **error)
+{
+        posix_spawn_file_actions_t file_actions;
+        posix_spawnattr_t attr;
+        short spawn_flags = 0;
+        pid_t pid;
+        int ret;
+
+        posix_spawn_file_actions_init (&file_actions);
+        posix_spawnattr_init (&attr);
+
+        if (stdin_fd >= 0)
+                posix_spawn_file_actions_adddup2 (&file_actions, stdin_fd, STDIN_FILENO);
+        if (stdout_fd >= 0)
+                posix_spawn_file_actions_adddup2 (&file_actions, stdout_fd, STDOUT_FILENO);
+        if (stderr_fd >= 0)
+                posix_spawn_file_actions_adddup2 (&file_actions, stderr_fd, STDERR_FILENO);
+
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+        posix_spawn_file_actions_addclosefrom_np (&file_actions, STDERR_FILENO + 1);
+#endif
+
+        if (flags & GDM_SPAWN_RESET_SIGNAL_MASK) {
+                sigset_t mask;
+
+                sigemptyset (&mask);
+                posix_spawnattr_setsigmask (&attr, &mask);
+                spawn_flags |= POSIX_SPAWN_SETSIGMASK;
+        }
+
+#ifdef POSIX_SPAWN_SETSID
+        if (flags & GDM_SPAWN_NEW_SESSION)
+                spawn_flags |= POSIX_SPAWN_SETSID;
+#endif
+
+        posix_spawnattr_setflags (&attr, spawn_flags);
+
+        if (flags & GDM_SPAWN_SEARCH_PATH) {
+                ret = posix_spawnp (&pid, file, &file_actions, &attr,
+                                    (char * const *) argv,
+                                    envp != NULL ? (char * const *) envp : environ);
+        } else {
+                ret = posix_spawn (&pid, file, &file_actions, &attr,
+                                   (char * const *) argv,
+                                   envp != NULL ? (char * const *) envp : environ);
+        }
+
+        posix_spawnattr_destroy (&attr);
+        posix_spawn_file_actions_destroy (&file_actions);
+
+        if (ret != 0) {
+                set_spawn_error (error, file, ret);
+                return FALSE;
+        }
+
+        if (child_pid != NULL)
+                *child_pid = pid;
+
+        return TRUE;
+}
+
+static void
+fallback_child_setup (FallbackChildSetup *setup)
+{
+        if (setup->flags & GDM_SPAWN_RESET_SIGNAL_MASK) {
+                sigset_t mask;
+
+                sigemptyset (&mask);
+                sigprocmask (SIG_SETMASK, &mask, NULL);
+        }
+
+        if (setup->flags & GDM_SPAWN_NEW_SESSION)
+                setsid ();
+
+        if (setup->child_setup != NULL)
+                setup->child_setup (setup->user_data);
+}
+
+static gboolean
+spawn_with_fork (const char           *file,
+                 const char * const   *argv,
+                 const char * const   *envp,
+                 int                   stdin_fd,
+                 int                   stdout_fd,
+                 int                   stderr_fd,
+                 GdmSpawnFlags         flags,
+                 GSpawnChildSetupFunc  child_setup,
+                 gpointer              user_data,
+                 GPid                 *child_pid,
+                 GError              **error)
+{
+        g_autoptr(GPtrArray) args = NULL;
+        FallbackChildSetup setup = { flags, child_setup, user_data };
+        GSpawnFlags spawn_flags;
+        guint i;
+
+        /* G_SPAWN_FILE_AND_ARGV_ZERO takes the file to run in argv[0] */
+        args = g_ptr_array_new ();
+        g_ptr_array_add (args, (gpointer) file);
+        for (i = 0; argv[i] != NULL; i++)
+                g_ptr_array_add (args, (gpointer) argv[i]);
+        g_ptr_array_add (args, NULL);
+
+        spawn_flags = G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_FILE_AND_ARGV_ZERO;
+        if (flags & GDM_SPAWN_SEARCH_PATH)
+                spawn_flags |= G_SPAWN_SEARCH_PATH;
+
+        return g_spawn_async_with_pipes_and_fds (NULL,
+                                                 (const char * const *) args->pdata,
+                                                 envp,
+                                                 spawn_flags,
+                                                 (GSpawnChildSetupFunc) fallback_child_setup,
+                                                 &setup,
+                                                 stdin_fd,
+                                                 stdout_fd,
+                                                 stderr_fd,
+                                                 NULL,
+                                                 NULL,
+                                                 0,
+                                                 child_pid,
+                                                 NULL,
+                                                 NULL,
+                                                 NULL,
+                                                 error);
+}
+
+/**
+ * gdm_spawn:
+ * @file: program to run
+ * @argv: argument vector, including argv[0]
+ * @envp: (nullable): environment, or %NULL to inherit ours
+ * @stdin_fd: descriptor for the child's stdin, or -1 to inherit ours
+ * @stdout_fd: descriptor for the child's stdout, or -1 to inherit ours
+ * @stderr_fd: descriptor for the child's stderr, or -1 to inherit ours
+ * @flags: #GdmSpawnFlags
+ * @child_setup: (nullable): function to run in the child before exec
+ * @user_data: data for @child_setup
+ * @child_pid: (out): the child, which must be reaped by the caller
+ * @error: return location for a #GError
+ *
+ * Starts a child without copying the caller's address space where
+ * possible. Everything the child needs is prepared up front and handed
+ * to posix_spawn (), which glibc implements with CLONE_VFORK, so the
+ * cost doesn't grow with the caller's RSS the way fork () does.
+ *
+ * Only when @child_setup is set, or the C library can't express
+ * @flags, does this fall back to g_spawn_async_with_pipes_and_fds ()
+ * and a full fork.
+ */
+gboolean
+gdm_spawn (const char           *file,
+           const char * const   *argv,
+           const char * const   *envp,
+           int                   stdin_fd,
+           int                   stdout_fd,
+           int                   stderr_fd,
+           GdmSpawnFlags         flags,
+           GSpawnChildSetupFunc  child_setup,
+           gpointer              user_data,
+           GPid                 *child_pid,
+           GError              **error)
+{
+        g_return_val_if_fail (file != NULL, FALSE);
+        g_return_val_if_fail (argv != NULL, FALSE);
+
+        if (can_use_posix_spawn (flags, child_setup)) {
+                return spawn_with_posix_spawn (file, argv, envp,
+                                               stdin_fd, stdout_fd, stderr_fd,
+                                               flags, child_pid, error);
+        }
+
+        return spawn_with_fork (file, argv, envp,
+                                stdin_fd, stdout_fd, stderr_fd,
+                                flags, child_setup, user_data,
+                                child_pid, error);
+}
+
+static void
+exec_file (const char   *path,
+           char * const *argv,
+           char * const *envp)
+{
+        int argc = 0;
+        int i;
+
+        if (envp != NULL) {
+                execve (path, argv, envp);
+        } else {
+                execv (path, argv);
+        }
+
+        if (errno != ENOEXEC)
+                return;
+
+        /* A script without an interpreter line */
+        while (argv[argc] != NULL)
+                argc++;
+
+        {
+                const char *script_argv[argc + 3];
+
+                script_argv[0] = "/bin/sh";
+                script_argv[1] = path;
+                for (i = 1; i < argc; i++)
+                        script_argv[i + 1] = argv[i];
+                script_argv[MAX (argc, 1) + 1] = NULL;
+
+                if (envp != NULL) {
+                        execve (script_argv[0], (char * const *) script_argv, envp);
+                } else {
+                        execv (script_argv[0], (char * const *) script_argv);
+                }
+        }
+}
+
+/**
+ * gdm_spawn_exec:
+ * @file: program name or path
+ * @argv: argument vector
+ * @envp: (nullable): environment, or %NULL to keep ours
+ *
+ * Replaces the process image with @file, looking it up in our PATH
+ * like execvp () when it has no slash, and running it through /bin/sh
+ * if it turns out to be a script without an interpreter line.
+ *
+ * Meant for a child forked from a threaded parent, after it switched
+ * to the user's credentials and working directory: candidates are
+ * tried as that user, a PATH entry the user can't execute from is
+ * skipped in favour of later ones, and relative entries are relative
+ * to the user's directory. Nothing is taken from the heap, path names
+ * are built in buffers on the stack.
+ *
+ * Only returns on failure, with errno set.
+ */
+void
+gdm_spawn_exec (const char   *file,
+                char * const *argv,
+                char * const *envp)
+{
+        gboolean got_eacces = FALSE;
+        const char *path;
+        const char *p;
+        size_t file_length;
+
+        if (file[0] == '\0') {
+                errno = ENOENT;
+                return;
+        }
+
+        if (strchr (file, '/') != NULL) {
+                exec_file (file, argv, envp);
+                return;
+        }
+
+        /* Same default as GLib: current directory last */
+        path = getenv ("PATH");
+        if (path == NULL)
+                path = "/bin:/usr/bin:.";
+
+        file_length = strlen (file);
+
+        for (p = path; ; p++) {
+                const char *end;
+                size_t dir_length;
+
+                end = strchr (p, ':');
+                if (end == NULL)
+                        end = p + strlen (p);
+
+                dir_length = end - p;
+
+                {
+                        char name[dir_length + file_length + 3];
+
+                        /* An empty entry means the current directory */
+                        if (dir_length == 0) {
+                                memcpy (name, "./", 2);
+                                dir_length = 2;
+                        } else {
+                                memcpy (name, p, dir_length);
+                                name[dir_length++] = '/';
+                        }
+                        memcpy (name + dir_length, file, file_length + 1);
+
+                        exec_file (name, argv, envp);
+                }
+
+                switch (errno) {
+                case EACCES:
+                        /* Keep looking, but report this if nothing else works */
+                        got_eacces = TRUE;
+                        break;
+                case ENOENT:
+                case ESTALE:
+                case ENOTDIR:
+                case ENODEV:
+                case ETIMEDOUT:
+                        break;
+                default:
+                        return;
+                }
+
+                if (*end == '\0')
+                        break;
+
+                p = end;
+        }
+
+        errno = got_eacces ? EACCES : ENOENT;
+}
@@ -0,0 +1,49 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+        GDM_SPAWN_FLAGS_NONE        = 0,
+        GDM_SPAWN_SEARCH_PATH       = 1 << 0,
+        GDM_SPAWN_RESET_SIGNAL_MASK = 1 << 1,
+        GDM_SPAWN_NEW_SESSION       = 1 << 2,
+} GdmSpawnFlags;
+
+gboolean  gdm_spawn                   (const char           *file,
+                                       const char * const   *argv,
+                                       const char * const   *envp,
+                                       int                   stdin_fd,
+                                       int                   stdout_fd,
+                                       int                   stderr_fd,
+                                       GdmSpawnFlags         flags,
+                                       GSpawnChildSetupFunc  child_setup,
+                                       gpointer              user_data,
+                                       GPid                 *child_pid,
+                                       GError              **error);
+
+void      gdm_spawn_exec              (const char           *file,
+                                       char * const         *argv,
+                                       char * const         *envp);
+
+G_END_DECLS
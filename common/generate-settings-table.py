@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+#
+# Compiles data/gdm.schemas into a C table, so that settings lookups don't
+# have to parse key names or default values at runtime.
+#
+#   generate-settings-table.py gdm.schemas gdm-settings-table.h gdm-settings-table.c
+
+import hashlib
+import re
+import sys
+import xml.etree.ElementTree as ElementTree
+
+TYPES = {
+    'b': 'GDM_SETTING_TYPE_BOOLEAN',
+    'i': 'GDM_SETTING_TYPE_INT',
+    's': 'GDM_SETTING_TYPE_STRING',
+}
+
+
+def enum_name(key):
+    name = key.replace('/', '_')
+    name = re.sub(r'([A-Z]+)([A-Z][a-z])', r'\1_\2', name)
+    name = re.sub(r'([a-z0-9])([A-Z])', r'\1_\2', name)
+    return 'GDM_SETTING_' + name.upper()
+
+
+def c_string(value):
+    return '"' + value.replace('\\', '\\\\').replace('"', '\\"') + '"'
+
+
+def parse_boolean(key, value):
+    # Same spellings gdm_settings_parse_value_as_boolean() accepts
+    if value.lower() == 'true' or value == '1':
+        return 'TRUE'
+    if value.lower() == 'false' or value == '0':
+        return 'FALSE'
+    sys.exit('%s: invalid boolean default %r' % (key, value))
+
+
+def parse_int(key, value):
+    try:
+        return str(int(value))
+    except ValueError:
+        sys.exit('%s: invalid integer default %r' % (key, value))
+
+
+def read_schemas(path):
+    settings = []
+    for schema in ElementTree.parse(path).getroot().iter('schema'):
+        key = schema.findtext('key')
+        signature = schema.findtext('signature')
+        default = schema.findtext('default') or ''
+
+        if signature not in TYPES:
+            sys.exit('%s: unsupported signature %r' % (key, signature))
+
+        if '/' not in key:
+            sys.exit('%s: key is not of the form group/name' % key)
+
+        settings.append((key, signature, default))
+    return settings
+
+
+def checksum(settings):
+    # Changes whenever a setting is added, removed, moved or retyped, so
+    # processes from different builds don't misread each other's snapshots
+    layout = ''.join('%s:%s\n' % (key, signature) for key, signature, _ in settings)
+    return hashlib.sha256(layout.encode('utf-8')).hexdigest()[:16]
+
+
+def write_header(path, settings):
+    with open(path, 'w') as f:
+        f.write('/* Generated by generate-settings-table.py from gdm.schemas, do not edit */\n\n')
+        f.write('#pragma once\n\n')
+        f.write('#include <glib.h>\n\n')
+        f.write('G_BEGIN_DECLS\n\n')
+        f.write('#define GDM_SETTINGS_TABLE_CHECKSUM "%s"\n\n' % checksum(settings))
+        f.write('typedef enum\n{\n')
+        for key, *_ in settings:
+            f.write('        %s,\n' % enum_name(key))
+        f.write('        GDM_SETTING_COUNT\n} GdmSettingId;\n\n')
+        f.write('typedef enum\n{\n')
+        for signature in TYPES:
+            f.write('        %s,\n' % TYPES[signature])
+        f.write('} GdmSettingType;\n\n')
+        f.write('typedef struct\n{\n')
+        f.write('        const char     *key;\n')
+        f.write('        GdmSettingType  type;\n')
+        f.write('        union {\n')
+        f.write('                gboolean    boolean;\n')
+        f.write('                int         integer;\n')
+        f.write('                const char *string;\n')
+        f.write('        } default_value;\n')
+        f.write('} GdmSettingInfo;\n\n')
+        f.write('extern const GdmSettingInfo gdm_settings_table[GDM_SETTING_COUNT];\n\n')
+        f.write('G_END_DECLS\n')
+
+
+def write_source(path, header, settings):
+    with open(path, 'w') as f:
+        f.write('/* Generated by generate-settings-table.py from gdm.schemas, do not edit */\n\n')
+        f.write('#include "%s"\n\n' % header)
+        f.write('const GdmSettingInfo gdm_settings_table[GDM_SETTING_COUNT] = {\n')
+        for key, signature, default in settings:
+            if signature == 'b':
+                value = '.boolean = %s' % parse_boolean(key, default)
+            elif signature == 'i':
+                value = '.integer = %s' % parse_int(key, default)
+            else:
+                value = '.string = %s' % c_string(default)
+
+            f.write('        [%s] = { %s, %s, { %s } },\n' %
+                    (enum_name(key), c_string(key), TYPES[signature], value))
+        f.write('};\n')
+
+
+def main():
+    if len(sys.argv) != 4:
+        sys.exit('usage: %s SCHEMAS HEADER SOURCE' % sys.argv[0])
+
+    schemas, header, source = sys.argv[1:]
+    settings = read_schemas(schemas)
+
+    write_header(header, settings)
+    write_source(source, header.rsplit('/', 1)[-1], settings)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,216 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ */
+
+/* Measures how long picking a greeter UID takes as the number of live
+ * greeters grows, for GdmUidAllocator and for the linear scan it
+ * replaced. NSS is simulated: a share of the range belongs to other
+ * accounts, and every lookup costs a fixed delay.
+ *
+ *   bench-uid-allocator --range=1024 --nss-latency=200 --nss-taken=10
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <glib.h>
+
+#include "gdm-uid-allocator.h"
+
+#define UID_BASE 60578
+
+static int      range = 1024;
+static int      nss_latency = 100;
+static int      nss_taken_percent = 10;
+static int      iterations = 200;
+
+static GOptionEntry entries[] = {
+        { "range", 0, 0, G_OPTION_ARG_INT, &range, "Number of UIDs in the greeter range", "N" },
+        { "nss-latency", 0, 0, G_OPTION_ARG_INT, &nss_latency, "Cost of one NSS lookup, in microseconds", "USEC" },
+        { "nss-taken", 0, 0, G_OPTION_ARG_INT, &nss_taken_percent, "Share of the range owned by other accounts", "PERCENT" },
+        { "iterations", 0, 0, G_OPTION_ARG_INT, &iterations, "Allocations to time per data point", "N" },
+        { NULL }
+};
+
+typedef struct
+{
+        gboolean *nss_taken;
+        guint     n_lookups;
+} FakeNss;
+
+static gboolean
+fake_nss_lookup (uid_t    uid,
+                 gpointer user_data)
+{
+        FakeNss *nss = user_data;
+
+        nss->n_lookups++;
+        if (nss_latency > 0)
+                g_usleep (nss_latency);
+
+        return nss->nss_taken[uid - UID_BASE];
+}
+
+/* The allocator GdmDynamicUserStore used before: walk from the last
+ * position, asking NSS about every UID we don't hold ourselves */
+typedef struct
+{
+        gboolean *live;
+        uid_t     next;
+} LinearAllocator;
+
+static gboolean
+linear_allocate (LinearAllocator *linear,
+                 FakeNss         *nss,
+                 uid_t           *ret_uid)
+{
+        uid_t start = linear->next;
+
+        do {
+                uid_t uid = linear->next;
+                gboolean used;
+
+                used = linear->live[uid - UID_BASE] || fake_nss_lookup (uid, nss);
+
+                linear->next = uid + 1 < UID_BASE + (uid_t) range ? uid + 1 : UID_BASE;
+
+                if (!used) {
+                        linear->live[uid - UID_BASE] = TRUE;
+                        *ret_uid = uid;
+                        return TRUE;
+                }
+        } while (linear->next != start);
+
+        return FALSE;
+}
+
+static void
+run_point (FakeNss *nss,
+           int      n_live)
+{
+        g_autoptr (GdmUidAllocator) bitmap = NULL;
+        g_autofree gboolean *linear_live = NULL;
+        g_autofree uid_t *bitmap_uids = NULL;
+        g_autofree uid_t *linear_uids = NULL;
+        LinearAllocator linear;
+        guint bitmap_lookups, linear_lookups;
+        gint64 start, bitmap_time, linear_time;
+        uid_t uid;
+        int i;
+
+        bitmap = gdm_uid_allocator_new (UID_BASE, UID_BASE + range - 1, fake_nss_lookup, nss);
+        linear_live = g_new0 (gboolean, range);
+        linear.live = linear_live;
+        linear.next = UID_BASE;
+
+        bitmap_uids = g_new0 (uid_t, n_live);
+        linear_uids = g_new0 (uid_t, n_live);
+
+        /* Fill up to the number of live greeters without timing it */
+        for (i = 0; i < n_live; i++) {
+                if (!gdm_uid_allocator_allocate (bitmap, &bitmap_uids[i]) ||
+                    !linear_allocate (&linear, nss, &linear_uids[i])) {
+                        g_print ("%8d  range exhausted\n", n_live);
+                        return;
+                }
+        }
+
+        /* Then churn: one greeter goes away, a new one comes up */
+        nss->n_lookups = 0;
+        start = g_get_monotonic_time ();
+        for (i = 0; i < iterations; i++) {
+                int victim = g_random_int_range (0, n_live);
+
+                gdm_uid_allocator_release (bitmap, bitmap_uids[victim]);
+                if (!gdm_uid_allocator_allocate (bitmap, &uid))
+                        g_error ("Bitmap allocator ran out of UIDs");
+                bitmap_uids[victim] = uid;
+        }
+        bitmap_time = g_get_monotonic_time () - start;
+        bitmap_lookups = nss->n_lookups;
+
+        nss->n_lookups = 0;
+        start = g_get_monotonic_time ();
+        for (i = 0; i < iterations; i++) {
+                int victim = g_random_int_range (0, n_live);
+
+                linear_live[linear_uids[victim] - UID_BASE] = FALSE;
+                if (!linear_allocate (&linear, nss, &uid))
+                        g_error ("Linear allocator ran out of UIDs");
+                linear_uids[victim] = uid;
+        }
+        linear_time = g_get_monotonic_time () - start;
+        linear_lookups = nss->n_lookups;
+
+        g_print ("%8d  %10.1f  %8.2f  %10.1f  %8.2f\n",
+                 n_live,
+                 (double) bitmap_time / iterations,
+                 (double) bitmap_lookups / iterations,
+                 (double) linear_time / iterations,
+                 (double) linear_lookups / iterations);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+        g_autoptr (GOptionContext) context = NULL;
+        g_autoptr (GError) error = NULL;
+        g_autofree gboolean *nss_taken = NULL;
+        FakeNss nss;
+        int n_free;
+        int n_live;
+        int i;
+
+        context = g_option_context_new (NULL);
+        g_option_context_add_main_entries (context, entries, NULL);
+        if (!g_option_context_parse (context, &argc, &argv, &error)) {
+                g_printerr ("%s\n", error->message);
+                return EXIT_FAILURE;
+        }
+
+        if (range < 2 || iterations < 1) {
+                g_printerr ("--range must be at least 2 and --iterations at least 1\n");
+                return EXIT_FAILURE;
+        }
+
+        g_random_set_seed (0);
+
+        nss_taken = g_new0 (gboolean, range);
+        n_free = range;
+        for (i = 0; i < range; i++) {
+                nss_taken[i] = g_random_int_range (0, 100) < nss_taken_percent;
+                if (nss_taken[i])
+                        n_free--;
+        }
+        nss.nss_taken = nss_taken;
+        nss.n_lookups = 0;
+
+        g_print ("%d UIDs, %d owned by other accounts, %d µs per NSS lookup\n\n",
+                 range, range - n_free, nss_latency);
+        g_print ("%8s  %10s  %8s  %10s  %8s\n",
+                 "greeters", "bitmap µs", "lookups", "linear µs", "lookups");
+
+        for (n_live = 1; n_live < n_free; n_live *= 2)
+                run_point (&nss, n_live);
+        run_point (&nss, n_free - 1);
+
+        return EXIT_SUCCESS;
+}
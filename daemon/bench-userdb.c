@@ -0,0 +1,210 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ */
+
+/* Floods GDM's userdb service with GetUserRecord calls from several
+ * connections at once and reports the latency distribution, to compare
+ * different daemon/UserdbWorkers settings.
+ *
+ *   bench-userdb --clients=32 --requests=2000 --user-name=gdm-greeter
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <systemd/sd-varlink.h>
+
+#define GDM_SERVICE_ID "org.gnome.DisplayManager"
+#define USERDB_SOCKET_DIR "/run/systemd/userdb"
+#define USERDB_SOCKET USERDB_SOCKET_DIR "/" GDM_SERVICE_ID
+
+static int      n_clients = 8;
+static int      n_requests = 1000;
+static char    *user_name = NULL;
+static int      uid = -1;
+
+static GOptionEntry entries[] = {
+        { "clients", 0, 0, G_OPTION_ARG_INT, &n_clients, "Concurrent connections", "N" },
+        { "requests", 0, 0, G_OPTION_ARG_INT, &n_requests, "Calls per connection", "N" },
+        { "user-name", 0, 0, G_OPTION_ARG_STRING, &user_name, "Look up this user (default: gdm-greeter)", "NAME" },
+        { "uid", 0, 0, G_OPTION_ARG_INT, &uid, "Look up this UID instead", "UID" },
+        { NULL }
+};
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (sd_varlink, sd_varlink_unref)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (sd_json_variant, sd_json_variant_unref)
+
+typedef struct
+{
+        gint64          *latencies;
+        guint            n_errors;
+        gboolean         failed;
+} Client;
+
+/* sd_json_variant refcounting isn't thread safe, so every client
+ * builds its own request */
+static int
+build_parameters (sd_json_variant **ret)
+{
+        if (uid >= 0)
+                return sd_json_buildo (ret,
+                                       SD_JSON_BUILD_PAIR_UNSIGNED ("uid", uid),
+                                       SD_JSON_BUILD_PAIR_STRING ("service", GDM_SERVICE_ID));
+
+        return sd_json_buildo (ret,
+                               SD_JSON_BUILD_PAIR_STRING ("userName", user_name ?: "gdm-greeter"),
+                               SD_JSON_BUILD_PAIR_STRING ("service", GDM_SERVICE_ID));
+}
+
+static gpointer
+run_client (gpointer data)
+{
+        Client *client = data;
+        g_autoptr (sd_varlink) link = NULL;
+        g_autoptr (sd_json_variant) parameters = NULL;
+        int i, r;
+
+        r = build_parameters (&parameters);
+        if (r < 0) {
+                g_printerr ("Failed to build request: %s\n", g_strerror (-r));
+                client->failed = TRUE;
+                return NULL;
+        }
+
+        r = sd_varlink_connect_address (&link, USERDB_SOCKET);
+        if (r < 0) {
+                g_printerr ("Failed to connect to %s: %s\n", USERDB_SOCKET, g_strerror (-r));
+                client->failed = TRUE;
+                return NULL;
+        }
+
+        for (i = 0; i < n_requests; i++) {
+                sd_json_variant *reply = NULL;
+                const char *error_id = NULL;
+                gint64 start;
+
+                start = g_get_monotonic_time ();
+                r = sd_varlink_call (link,
+                                     "io.systemd.UserDatabase.GetUserRecord",
+                                     parameters,
+                                     &reply,
+                                     &error_id);
+                client->latencies[i] = g_get_monotonic_time () - start;
+
+                if (r < 0) {
+                        g_printerr ("Call failed: %s\n", g_strerror (-r));
+                        client->failed = TRUE;
+                        return NULL;
+                }
+
+                if (error_id != NULL)
+                        client->n_errors++;
+        }
+
+        return NULL;
+}
+
+static int
+compare_latencies (gconstpointer a,
+                   gconstpointer b)
+{
+        gint64 latency_a = *(const gint64 *) a;
+        gint64 latency_b = *(const gint64 *) b;
+
+        return (latency_a > latency_b) - (latency_a < latency_b);
+}
+
+static gint64
+percentile (const gint64 *sorted,
+            gsize         n,
+            double        p)
+{
+        gsize index = (gsize) (p * (n - 1) + 0.5);
+
+        return sorted[MIN (index, n - 1)];
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+        g_autoptr (GOptionContext) context = NULL;
+        g_autoptr (GError) error = NULL;
+        g_autofree Client *clients = NULL;
+        g_autofree GThread **threads = NULL;
+        g_autofree gint64 *all = NULL;
+        gsize n_total = 0;
+        guint n_errors = 0;
+        gint64 start, elapsed;
+        int i;
+
+        context = g_option_context_new (NULL);
+        g_option_context_add_main_entries (context, entries, NULL);
+        if (!g_option_context_parse (context, &argc, &argv, &error)) {
+                g_printerr ("%s\n", error->message);
+                return EXIT_FAILURE;
+        }
+
+        if (n_clients < 1 || n_requests < 1) {
+                g_printerr ("--clients and --requests must be at least 1\n");
+                return EXIT_FAILURE;
+        }
+
+        clients = g_new0 (Client, n_clients);
+        threads = g_new0 (GThread *, n_clients);
+
+        start = g_get_monotonic_time ();
+        for (i = 0; i < n_clients; i++) {
+                clients[i].latencies = g_new0 (gint64, n_requests);
+                threads[i] = g_thread_new ("bench-userdb client", run_client, &clients[i]);
+        }
+
+        for (i = 0; i < n_clients; i++)
+                g_thread_join (threads[i]);
+        elapsed = g_get_monotonic_time () - start;
+
+        all = g_new (gint64, (gsize) n_clients * n_requests);
+        for (i = 0; i < n_clients; i++) {
+                if (!clients[i].failed) {
+                        memcpy (all + n_total, clients[i].latencies, n_requests * sizeof (gint64));
+                        n_total += n_requests;
+                        n_errors += clients[i].n_errors;
+                }
+                g_free (clients[i].latencies);
+        }
+
+        if (n_total == 0) {
+                g_printerr ("No client finished\n");
+                return EXIT_FAILURE;
+        }
+
+        qsort (all, n_total, sizeof (gint64), compare_latencies);
+
+        g_print ("%" G_GSIZE_FORMAT " calls over %d connections in %.2f s (%.0f calls/s), %u error replies\n",
+                 n_total, n_clients, elapsed / 1e6, n_total / (elapsed / 1e6), n_errors);
+        g_print ("p50 %" G_GINT64_FORMAT " µs, p99 %" G_GINT64_FORMAT " µs, max %" G_GINT64_FORMAT " µs\n",
+                 percentile (all, n_total, 0.50),
+                 percentile (all, n_total, 0.99),
+                 all[n_total - 1]);
+
+        return EXIT_SUCCESS;
+}
@@ -113,6 +113,208 @@ gdm_dbus_setup_private_server (GDBusAuthObserver  *observer,
         return g_steal_pointer (&server);
 }
 
+/* The shared server is a single private server for the whole process.
+ * Connections to it are handed to whichever route claims the peer's
+ * credentials, so users of it don't need a socket of their own.
+ *
+ * Peers are authorized from the server's worker thread, so that step
+ * only turns away users no route allows at all.  The match functions
+ * run on the main thread, and a connection is only handed to a route
+ * that allows the peer's user, so one route's user can't reach another.
+ */
+typedef struct
+{
+        guint                        id;
+        uid_t                        allowed_user;
+        GdmDBusServerMatchFunc       match_func;
+        GdmDBusServerConnectionFunc  connection_func;
+        gpointer                     user_data;
+} GdmDBusServerRoute;
+
+static GDBusServer *shared_server = NULL;
+static GList       *shared_server_routes = NULL;
+static guint        shared_server_next_route_id = 1;
+G_LOCK_DEFINE_STATIC (shared_server_routes);
+
+static GdmDBusServerRoute *
+find_shared_server_route (GCredentials *credentials)
+{
+        GdmDBusServerRoute *found = NULL;
+        GList *node;
+        uid_t connecting_user;
+
+        if (credentials == NULL) {
+                return NULL;
+        }
+
+        connecting_user = g_credentials_get_unix_user (credentials, NULL);
+
+        G_LOCK (shared_server_routes);
+        for (node = shared_server_routes; node != NULL; node = node->next) {
+                GdmDBusServerRoute *route = node->data;
+
+                if (connecting_user != 0 && connecting_user != route->allowed_user) {
+                        continue;
+                }
+
+                if (route->match_func (credentials, route->user_data)) {
+                        found = route;
+                        break;
+                }
+        }
+        G_UNLOCK (shared_server_routes);
+
+        return found;
+}
+
+static gboolean
+allow_shared_server_peer (GDBusAuthObserver *observer,
+                          GIOStream         *stream,
+                          GCredentials      *credentials,
+                          gpointer           user_data)
+{
+        gboolean allowed = FALSE;
+        uid_t connecting_user;
+        GList *node;
+
+        if (credentials == NULL) {
+                return FALSE;
+        }
+
+        connecting_user = g_credentials_get_unix_user (credentials, NULL);
+
+        if (connecting_user == 0) {
+                return TRUE;
+        }
+
+        G_LOCK (shared_server_routes);
+        for (node = shared_server_routes; node != NULL; node = node->next) {
+                GdmDBusServerRoute *route = node->data;
+
+                if (route->allowed_user == connecting_user) {
+                        allowed = TRUE;
+                        break;
+                }
+        }
+        G_UNLOCK (shared_server_routes);
+
+        if (!allowed) {
+                g_debug ("GdmDBusServer: User not allowed");
+        }
+
+        return allowed;
+}
+
+static gboolean
+handle_shared_server_connection (GDBusServer     *server,
+                                 GDBusConnection *connection,
+                                 gpointer         user_data)
+{
+        GdmDBusServerRoute *route;
+
+        /* The route may have gone away since the peer was authorized */
+        route = find_shared_server_route (g_dbus_connection_get_peer_credentials (connection));
+        if (route == NULL) {
+                g_debug ("GdmDBusServer: no route for connection %p, dropping it", connection);
+                return FALSE;
+        }
+
+        route->connection_func (connection, route->user_data);
+
+        return TRUE;
+}
+
+static gboolean
+ensure_shared_server (GError **error)
+{
+        g_autoptr(GDBusAuthObserver) observer = NULL;
+
+        if (shared_server != NULL) {
+                return TRUE;
+        }
+
+        observer = g_dbus_auth_observer_new ();
+        g_signal_connect (observer,
+                          "authorize-authenticated-peer",
+                          G_CALLBACK (allow_shared_server_peer),
+                          NULL);
+
+        shared_server = gdm_dbus_setup_private_server (observer, error);
+        if (shared_server == NULL) {
+                return FALSE;
+        }
+
+        g_signal_connect (shared_server,
+                          "new-connection",
+                          G_CALLBACK (handle_shared_server_connection),
+                          NULL);
+
+        g_dbus_server_start (shared_server);
+
+        g_debug ("GdmDBusServer: shared server listening on %s",
+                 g_dbus_server_get_client_address (shared_server));
+
+        return TRUE;
+}
+
+guint
+gdm_dbus_add_shared_server_route (uid_t                        allowed_user,
+                                  GdmDBusServerMatchFunc       match_func,
+                                  GdmDBusServerConnectionFunc  connection_func,
+                                  gpointer                     user_data,
+                                  GError                     **error)
+{
+        GdmDBusServerRoute *route;
+
+        g_return_val_if_fail (match_func != NULL, 0);
+        g_return_val_if_fail (connection_func != NULL, 0);
+
+        if (!ensure_shared_server (error)) {
+                return 0;
+        }
+
+        route = g_new0 (GdmDBusServerRoute, 1);
+        route->id = shared_server_next_route_id++;
+        route->allowed_user = allowed_user;
+        route->match_func = match_func;
+        route->connection_func = connection_func;
+        route->user_data = user_data;
+
+        G_LOCK (shared_server_routes);
+        shared_server_routes = g_list_prepend (shared_server_routes, route);
+        G_UNLOCK (shared_server_routes);
+
+        return route->id;
+}
+
+void
+gdm_dbus_remove_shared_server_route (guint route_id)
+{
+        GList *node;
+
+        G_LOCK (shared_server_routes);
+        for (node = shared_server_routes; node != NULL; node = node->next) {
+                GdmDBusServerRoute *route = node->data;
+
+                if (route->id == route_id) {
+                        shared_server_routes = g_list_delete_link (shared_server_routes, node);
+                        g_free (route);
+                        break;
+                }
+        }
+        G_UNLOCK (shared_server_routes);
+}
+
+const char *
+gdm_dbus_get_shared_server_address (void)
+{
+        if (shared_server == NULL) {
+                return NULL;
+        }
+
+        return g_dbus_server_get_client_address (shared_server);
+}
+
 gboolean
 gdm_dbus_get_pid_for_name (const char  *system_bus_name,
                            pid_t       *out_pid,
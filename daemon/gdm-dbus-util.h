@@ -28,6 +28,19 @@
 GDBusServer *gdm_dbus_setup_private_server (GDBusAuthObserver  *observer,
                                             GError            **error);
 
+typedef gboolean (* GdmDBusServerMatchFunc)      (GCredentials    *credentials,
+                                                  gpointer         user_data);
+typedef void     (* GdmDBusServerConnectionFunc) (GDBusConnection *connection,
+                                                  gpointer         user_data);
+
+guint        gdm_dbus_add_shared_server_route    (uid_t                        allowed_user,
+                                                  GdmDBusServerMatchFunc       match_func,
+                                                  GdmDBusServerConnectionFunc  connection_func,
+                                                  gpointer                     user_data,
+                                                  GError                     **error);
+void         gdm_dbus_remove_shared_server_route (guint                        route_id);
+const char  *gdm_dbus_get_shared_server_address  (void);
+
 gboolean gdm_dbus_get_pid_for_name (const char  *system_bus_name,
                                     pid_t       *out_pid,
                                     GError     **error);
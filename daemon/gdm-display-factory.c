@@ -31,9 +31,17 @@
 #include "gdm-display-factory.h"
 #include "gdm-common.h"
 #include "gdm-display-store.h"
+#include "gdm-log.h"
 
 #define GDM_DISPLAY_FACTORY_MANAGE_DISPLAYS_POLKIT_ACTION "org.gnome.displaymanager.displayfactory.manage-user-displays"
 
+/* How long a caller stays authorized for a user once polkit said yes */
+#define AUTHORIZATION_CACHE_USEC (30 * G_USEC_PER_SEC)
+
+/* Beyond this many authorization checks waiting on polkit, or on an
+ * authentication agent, further requests are turned away */
+#define MAX_AUTHORIZATIONS_IN_FLIGHT 16
+
 typedef struct _GdmDisplayFactoryPrivate
 {
         GdmDisplayStore *display_store;
@@ -41,9 +49,20 @@ typedef struct _GdmDisplayFactoryPrivate
 
         GHashTable      *display_creation_users;
 
-       PolkitAuthority  *authority;
+        PolkitAuthority *authority;
+
+        /* "sender\nuser" -> expiry time of the positive decision */
+        GHashTable      *authorizations;
+        guint            n_authorizations_in_flight;
 } GdmDisplayFactoryPrivate;
 
+typedef struct
+{
+        PolkitSubject *subject;
+        PolkitDetails *details;
+        char          *cache_key;
+} AuthorizeData;
+
 enum {
         PROP_0,
         PROP_DISPLAY_STORE,
@@ -150,82 +169,232 @@ gdm_display_factory_stop (GdmDisplayFactory *factory)
         return ret;
 }
 
+static void
+authorize_data_free (AuthorizeData *data)
+{
+        g_clear_object (&data->subject);
+        g_clear_object (&data->details);
+        g_free (data->cache_key);
+        g_free (data);
+}
+
 static gboolean
-ensure_polkit_authority (GdmDisplayFactory  *factory,
-                         GError            **error)
+authorization_expired (gpointer key,
+                       gpointer value,
+                       gpointer user_data)
+{
+        gint64 now = *(gint64 *) user_data;
+
+        return *(gint64 *) value <= now;
+}
+
+static gboolean
+lookup_cached_authorization (GdmDisplayFactory *factory,
+                             const char        *cache_key)
 {
         GdmDisplayFactoryPrivate *priv;
+        gint64 now;
 
         priv = gdm_display_factory_get_instance_private (factory);
 
-        if (priv->authority)
-                return TRUE;
+        now = g_get_monotonic_time ();
+        g_hash_table_foreach_remove (priv->authorizations, authorization_expired, &now);
 
-        priv->authority = polkit_authority_get_sync (NULL, error);
+        return g_hash_table_contains (priv->authorizations, cache_key);
+}
 
-        return priv->authority != NULL;
+static void
+cache_authorization (GdmDisplayFactory *factory,
+                     const char        *cache_key)
+{
+        GdmDisplayFactoryPrivate *priv;
+        gint64 *expiry;
+
+        priv = gdm_display_factory_get_instance_private (factory);
+
+        expiry = g_new (gint64, 1);
+        *expiry = g_get_monotonic_time () + AUTHORIZATION_CACHE_USEC;
+        g_hash_table_replace (priv->authorizations, g_strdup (cache_key), expiry);
 }
 
-gboolean
+static void
+finish_authorization_check (GTask *task)
+{
+        GdmDisplayFactory *factory = g_task_get_source_object (task);
+        GdmDisplayFactoryPrivate *priv;
+
+        priv = gdm_display_factory_get_instance_private (factory);
+        priv->n_authorizations_in_flight--;
+}
+
+static void
+on_check_authorization_ready (GObject      *source,
+                              GAsyncResult *result,
+                              gpointer      user_data)
+{
+        g_autoptr (GTask) task = user_data;
+        g_autoptr (PolkitAuthorizationResult) authorization = NULL;
+        g_autoptr (GError) error = NULL;
+        GdmDisplayFactory *factory = g_task_get_source_object (task);
+        AuthorizeData *data = g_task_get_task_data (task);
+
+        finish_authorization_check (task);
+
+        authorization = polkit_authority_check_authorization_finish (POLKIT_AUTHORITY (source),
+                                                                     result,
+                                                                     &error);
+        if (!authorization) {
+                g_task_return_new_error (task, GDM_DISPLAY_ERROR, GDM_DISPLAY_ERROR_GENERAL,
+                                         "Failed to check authorization: %s",
+                                         error->message);
+                return;
+        }
+
+        if (!polkit_authorization_result_get_is_authorized (authorization)) {
+                g_task_return_new_error (task, GDM_DISPLAY_ERROR, GDM_DISPLAY_ERROR_GENERAL,
+                                         "Not authorized for action %s",
+                                         GDM_DISPLAY_FACTORY_MANAGE_DISPLAYS_POLKIT_ACTION);
+                return;
+        }
+
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplayFactory: authorized %s", data->cache_key);
+        cache_authorization (factory, data->cache_key);
+
+        g_task_return_boolean (task, TRUE);
+}
+
+static void
+check_authorization (GTask *task)
+{
+        GdmDisplayFactory *factory = g_task_get_source_object (task);
+        AuthorizeData *data = g_task_get_task_data (task);
+        GdmDisplayFactoryPrivate *priv;
+
+        priv = gdm_display_factory_get_instance_private (factory);
+
+        polkit_authority_check_authorization (priv->authority,
+                                              data->subject,
+                                              GDM_DISPLAY_FACTORY_MANAGE_DISPLAYS_POLKIT_ACTION,
+                                              data->details,
+                                              POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION,
+                                              g_task_get_cancellable (task),
+                                              on_check_authorization_ready,
+                                              task);
+}
+
+static void
+on_authority_ready (GObject      *source,
+                    GAsyncResult *result,
+                    gpointer      user_data)
+{
+        g_autoptr (GTask) task = user_data;
+        g_autoptr (PolkitAuthority) authority = NULL;
+        g_autoptr (GError) error = NULL;
+        GdmDisplayFactory *factory = g_task_get_source_object (task);
+        GdmDisplayFactoryPrivate *priv;
+
+        priv = gdm_display_factory_get_instance_private (factory);
+
+        authority = polkit_authority_get_finish (result, &error);
+        if (!authority) {
+                finish_authorization_check (task);
+                g_task_return_new_error (task, GDM_DISPLAY_ERROR, GDM_DISPLAY_ERROR_GENERAL,
+                                         "Error getting polkit authority: %s",
+                                         error->message);
+                return;
+        }
+
+        /* Another check may have got there first */
+        if (priv->authority == NULL)
+                priv->authority = g_steal_pointer (&authority);
+
+        check_authorization (g_steal_pointer (&task));
+}
+
+/**
+ * gdm_display_factory_authorize_manage_user_displays:
+ *
+ * Checks with polkit whether the caller of @invocation may create or
+ * destroy displays for the user it names, without blocking the main
+ * loop while polkit, or an authentication agent, makes up its mind.
+ * Other methods are always allowed. Callers should only complete
+ * @invocation once @callback reports the outcome.
+ */
+void
 gdm_display_factory_authorize_manage_user_displays (GdmDisplayFactory      *factory,
                                                     GDBusMethodInvocation  *invocation,
-                                                    GError                **error)
+                                                    GCancellable           *cancellable,
+                                                    GAsyncReadyCallback     callback,
+                                                    gpointer                user_data)
 {
-        g_autoptr (PolkitAuthorizationResult) result = NULL;
-        g_autoptr (PolkitSubject) subject = NULL;
-        g_autoptr (PolkitDetails) details = NULL;
-        g_autoptr (GError) local_error = NULL;
+        g_autoptr (GTask) task = NULL;
+        AuthorizeData *data;
         const char *user = NULL;
-        const char *action;
         const char *method;
         const char *sender;
         GVariant *parameters;
-        PolkitCheckAuthorizationFlags flags;
         GdmDisplayFactoryPrivate *priv;
 
-        g_return_val_if_fail (GDM_IS_DISPLAY_FACTORY (factory), FALSE);
+        g_return_if_fail (GDM_IS_DISPLAY_FACTORY (factory));
+
+        priv = gdm_display_factory_get_instance_private (factory);
+
+        task = g_task_new (factory, cancellable, callback, user_data);
+        g_task_set_source_tag (task, gdm_display_factory_authorize_manage_user_displays);
 
         method = g_dbus_method_invocation_get_method_name (invocation);
         if (g_strcmp0 (method, "CreateUserDisplay") != 0 &&
-            g_strcmp0 (method, "DestroyUserDisplay") != 0)
-                return TRUE;
-
-        if (!ensure_polkit_authority (factory, &local_error)) {
-                g_set_error (error, GDM_DISPLAY_ERROR, GDM_DISPLAY_ERROR_GENERAL,
-                             "Error getting polkit authority: %s",
-                             local_error->message);
-                return FALSE;
+            g_strcmp0 (method, "DestroyUserDisplay") != 0) {
+                g_task_return_boolean (task, TRUE);
+                return;
         }
 
-        priv = gdm_display_factory_get_instance_private (factory);
-
         parameters = g_dbus_method_invocation_get_parameters (invocation);
-        g_variant_get (parameters, "(s)", &user);
-        details = polkit_details_new ();
-        polkit_details_insert (details, "user", user);
-
+        g_variant_get (parameters, "(&s)", &user);
         sender = g_dbus_method_invocation_get_sender (invocation);
-        subject = polkit_system_bus_name_new (sender);
-        action = GDM_DISPLAY_FACTORY_MANAGE_DISPLAYS_POLKIT_ACTION;
-        flags = POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION;
-        result = polkit_authority_check_authorization_sync (priv->authority,
-                                                            subject, action,
-                                                            details, flags, NULL,
-                                                            &local_error);
-        if (!result) {
-                g_set_error (error, GDM_DISPLAY_ERROR, GDM_DISPLAY_ERROR_GENERAL,
-                             "Failed to check authorization: %s",
-                             local_error->message);
-                return FALSE;
+
+        data = g_new0 (AuthorizeData, 1);
+        data->cache_key = g_strdup_printf ("%s\n%s", sender, user);
+        g_task_set_task_data (task, data, (GDestroyNotify) authorize_data_free);
+
+        /* Bus names aren't reused, so a cached answer can't carry over
+         * to a different process */
+        if (lookup_cached_authorization (factory, data->cache_key)) {
+                gdm_debug (DISPLAY_FACTORY, "GdmDisplayFactory: using cached authorization for %s", data->cache_key);
+                g_task_return_boolean (task, TRUE);
+                return;
         }
 
-        if (!polkit_authorization_result_get_is_authorized (result)) {
-                g_set_error (error, GDM_DISPLAY_ERROR, GDM_DISPLAY_ERROR_GENERAL,
-                             "Not authorized for action %s", action);
-                return FALSE;
+        if (priv->n_authorizations_in_flight >= MAX_AUTHORIZATIONS_IN_FLIGHT) {
+                g_task_return_new_error (task, GDM_DISPLAY_ERROR, GDM_DISPLAY_ERROR_GENERAL,
+                                         "Too many authorization requests in progress");
+                return;
         }
 
-        return TRUE;
+        priv->n_authorizations_in_flight++;
+
+        data->details = polkit_details_new ();
+        polkit_details_insert (data->details, "user", user);
+        data->subject = polkit_system_bus_name_new (sender);
+
+        if (priv->authority == NULL) {
+                polkit_authority_get_async (cancellable,
+                                            on_authority_ready,
+                                            g_steal_pointer (&task));
+                return;
+        }
+
+        check_authorization (g_steal_pointer (&task));
+}
+
+gboolean
+gdm_display_factory_authorize_manage_user_displays_finish (GdmDisplayFactory  *factory,
+                                                           GAsyncResult       *result,
+                                                           GError            **error)
+{
+        g_return_val_if_fail (g_task_is_valid (result, factory), FALSE);
+
+        return g_task_propagate_boolean (G_TASK (result), error);
 }
 
 gboolean
@@ -394,6 +563,10 @@ gdm_display_factory_init (GdmDisplayFactory *factory)
                                                               g_str_equal,
                                                               (GDestroyNotify) g_free,
                                                               NULL);
+        priv->authorizations = g_hash_table_new_full (g_str_hash,
+                                                      g_str_equal,
+                                                      (GDestroyNotify) g_free,
+                                                      (GDestroyNotify) g_free);
 }
 
 static void
@@ -411,6 +584,7 @@ gdm_display_factory_finalize (GObject *object)
         g_return_if_fail (priv != NULL);
 
         g_clear_pointer (&priv->display_creation_users, g_hash_table_destroy);
+        g_clear_pointer (&priv->authorizations, g_hash_table_destroy);
 
         g_clear_handle_id (&priv->purge_displays_id, g_source_remove);
 
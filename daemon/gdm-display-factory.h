@@ -53,9 +53,14 @@ gboolean                   gdm_display_factory_start                   (GdmDispl
 gboolean                   gdm_display_factory_stop                    (GdmDisplayFactory *manager);
 GdmDisplayStore *          gdm_display_factory_get_display_store       (GdmDisplayFactory *manager);
 void                       gdm_display_factory_queue_purge_displays    (GdmDisplayFactory *manager);
-gboolean                   gdm_display_factory_authorize_manage_user_displays (GdmDisplayFactory      *factory,
+void                       gdm_display_factory_authorize_manage_user_displays (GdmDisplayFactory      *factory,
                                                                                GDBusMethodInvocation  *invocation,
-                                                                               GError                **error);
+                                                                               GCancellable           *cancellable,
+                                                                               GAsyncReadyCallback     callback,
+                                                                               gpointer                user_data);
+gboolean                   gdm_display_factory_authorize_manage_user_displays_finish (GdmDisplayFactory  *factory,
+                                                                                      GAsyncResult       *result,
+                                                                                      GError            **error);
 gboolean                   gdm_display_factory_on_user_display_creation (GdmDisplayFactory  *factory,
                                                                          const char         *user,
                                                                          GError            **error);
@@ -32,6 +32,7 @@
 
 #include "gdm-display-store.h"
 #include "gdm-display.h"
+#include "gdm-log.h"
 
 struct _GdmDisplayStore
 {
@@ -80,8 +81,8 @@ stored_display_free (StoredDisplay *stored_display)
                        0,
                        stored_display->display);
 
-        g_debug ("GdmDisplayStore: Unreffing display: %p",
-                 stored_display->display);
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplayStore: Unreffing display: %p",
+                                    stored_display->display);
         g_object_unref (stored_display->display);
 
         g_slice_free (StoredDisplay, stored_display);
@@ -102,7 +103,7 @@ void
 gdm_display_store_clear (GdmDisplayStore    *store)
 {
         g_return_if_fail (GDM_IS_DISPLAY_STORE (store));
-        g_debug ("GdmDisplayStore: Clearing display store");
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplayStore: Clearing display store");
         g_hash_table_remove_all (store->displays);
 }
 
@@ -249,7 +250,7 @@ gdm_display_store_add (GdmDisplayStore *store,
 
         gdm_display_get_id (display, &id, NULL);
 
-        g_debug ("GdmDisplayStore: Adding display %s to store", id);
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplayStore: Adding display %s to store", id);
 
         stored_display = stored_display_new (store, display);
         g_hash_table_insert (store->displays,
@@ -38,6 +38,8 @@
 #include "gdm-display.h"
 #include "gdm-display-glue.h"
 #include "gdm-launch-environment.h"
+#include "gdm-login-trace.h"
+#include "gdm-log.h"
 #include "gdm-remote-display.h"
 
 #include "gdm-settings-direct.h"
@@ -75,6 +77,9 @@ typedef struct _GdmDisplayPrivate
         /* this spawns and controls the greeter session */
         GdmLaunchEnvironment *launch_environment;
 
+        /* timeline of the login happening on this display */
+        GdmLoginTrace        *login_trace;
+
         guint                 is_local : 1;
         guint                 is_initial : 1;
         guint                 allow_timed_login : 1;
@@ -102,6 +107,7 @@ enum {
         PROP_DOING_INITIAL_SETUP,
         PROP_SESSION_REGISTERED,
         PROP_SUPPORTED_SESSION_TYPES,
+        PROP_LOGIN_TRACE,
 };
 
 static void     gdm_display_class_init  (GdmDisplayClass *klass);
@@ -111,6 +117,8 @@ static void     queue_finish            (GdmDisplay      *self);
 static void     _gdm_display_set_status (GdmDisplay *self,
                                          int         status);
 static gboolean wants_initial_setup (GdmDisplay *self);
+static void     _gdm_display_set_login_trace (GdmDisplay    *self,
+                                              GdmLoginTrace *login_trace);
 G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE (GdmDisplay, gdm_display, G_TYPE_OBJECT)
 
 GQuark
@@ -249,7 +257,7 @@ gdm_display_real_prepare (GdmDisplay *self)
 {
         g_return_val_if_fail (GDM_IS_DISPLAY (self), FALSE);
 
-        g_debug ("GdmDisplay: prepare display");
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: prepare display");
 
         _gdm_display_set_status (self, GDM_DISPLAY_PREPARED);
 
@@ -307,7 +315,7 @@ gdm_display_prepare (GdmDisplay *self)
 
         priv = gdm_display_get_instance_private (self);
 
-        g_debug ("GdmDisplay: Preparing display: %s", priv->id);
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: Preparing display: %s", priv->id);
 
         /* FIXME: we should probably do this in a more global place,
          * asynchronously
@@ -318,6 +326,13 @@ gdm_display_prepare (GdmDisplay *self)
 
         priv->doing_initial_setup = wants_initial_setup (self);
 
+        if (priv->login_trace == NULL) {
+                g_autoptr (GdmLoginTrace) login_trace = gdm_login_trace_new ();
+
+                _gdm_display_set_login_trace (self, login_trace);
+        }
+        gdm_login_trace_mark (priv->login_trace, "display-prepared");
+
         g_object_ref (self);
         ret = GDM_DISPLAY_GET_CLASS (self)->prepare (self);
         g_object_unref (self);
@@ -338,7 +353,7 @@ gdm_display_finish (GdmDisplay *self)
 
         _gdm_display_set_status (self, GDM_DISPLAY_FINISHED);
 
-        g_debug ("GdmDisplay: finish display");
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: finish display");
 
         return TRUE;
 }
@@ -403,7 +418,7 @@ _gdm_display_set_id (GdmDisplay     *self,
         GdmDisplayPrivate *priv;
 
         priv = gdm_display_get_instance_private (self);
-        g_debug ("GdmDisplay: id: %s", id);
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: id: %s", id);
         g_free (priv->id);
         priv->id = g_strdup (id);
 }
@@ -415,7 +430,7 @@ _gdm_display_set_seat_id (GdmDisplay     *self,
         GdmDisplayPrivate *priv;
 
         priv = gdm_display_get_instance_private (self);
-        g_debug ("GdmDisplay: seat id: %s", seat_id);
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: seat id: %s", seat_id);
         g_free (priv->seat_id);
         priv->seat_id = g_strdup (seat_id);
 }
@@ -427,7 +442,7 @@ _gdm_display_set_session_id (GdmDisplay     *self,
         GdmDisplayPrivate *priv;
 
         priv = gdm_display_get_instance_private (self);
-        g_debug ("GdmDisplay: session id: %s", session_id);
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: session id: %s", session_id);
         g_free (priv->session_id);
         priv->session_id = g_strdup (session_id);
 }
@@ -439,7 +454,7 @@ _gdm_display_set_session_class (GdmDisplay *self,
         GdmDisplayPrivate *priv;
 
         priv = gdm_display_get_instance_private (self);
-        g_debug ("GdmDisplay: session class: %s", session_class);
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: session class: %s", session_class);
         g_free (priv->session_class);
         priv->session_class = g_strdup (session_class);
 }
@@ -462,7 +477,7 @@ _gdm_display_set_is_local (GdmDisplay     *self,
         GdmDisplayPrivate *priv;
 
         priv = gdm_display_get_instance_private (self);
-        g_debug ("GdmDisplay: local: %s", is_local? "yes" : "no");
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: local: %s", is_local? "yes" : "no");
         priv->is_local = is_local;
 }
 
@@ -473,7 +488,7 @@ _gdm_display_set_autologin_user (GdmDisplay *self,
         GdmDisplayPrivate *priv;
 
         priv = gdm_display_get_instance_private (self);
-        g_debug ("GdmDisplay: autologin user: %s", user);
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: autologin user: %s", user);
         g_set_str (&priv->autologin_user, user);
 }
 
@@ -484,7 +499,7 @@ _gdm_display_set_session_registered (GdmDisplay     *self,
         GdmDisplayPrivate *priv;
 
         priv = gdm_display_get_instance_private (self);
-        g_debug ("GdmDisplay: session registered: %s", registered? "yes" : "no");
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: session registered: %s", registered? "yes" : "no");
         priv->session_registered = registered;
 }
 
@@ -501,6 +516,56 @@ _gdm_display_set_launch_environment (GdmDisplay           *self,
         priv->launch_environment = g_object_ref (launch_environment);
 }
 
+static void
+update_login_timeline (GdmDisplay *self)
+{
+        GdmDisplayPrivate *priv;
+        GVariant *timeline;
+
+        priv = gdm_display_get_instance_private (self);
+
+        if (priv->display_skeleton == NULL)
+                return;
+
+        if (priv->login_trace != NULL)
+                timeline = gdm_login_trace_to_variant (priv->login_trace);
+        else
+                timeline = g_variant_new_array (G_VARIANT_TYPE ("(st)"), NULL, 0);
+
+        gdm_dbus_display_set_login_timeline (priv->display_skeleton, timeline);
+}
+
+static void
+_gdm_display_set_login_trace (GdmDisplay    *self,
+                              GdmLoginTrace *login_trace)
+{
+        GdmDisplayPrivate *priv;
+
+        priv = gdm_display_get_instance_private (self);
+
+        if (priv->login_trace == login_trace)
+                return;
+
+        if (priv->login_trace != NULL) {
+                g_signal_handlers_disconnect_by_func (priv->login_trace,
+                                                      G_CALLBACK (update_login_timeline),
+                                                      self);
+                g_clear_object (&priv->login_trace);
+        }
+
+        if (login_trace != NULL) {
+                gdm_debug (DISPLAY_FACTORY, "GdmDisplay: login trace: %s", gdm_login_trace_get_id (login_trace));
+                priv->login_trace = g_object_ref (login_trace);
+                g_signal_connect_object (priv->login_trace,
+                                         "changed",
+                                         G_CALLBACK (update_login_timeline),
+                                         self,
+                                         G_CONNECT_SWAPPED);
+        }
+
+        update_login_timeline (self);
+}
+
 static void
 _gdm_display_set_is_initial (GdmDisplay     *self,
                              gboolean        initial)
@@ -508,7 +573,7 @@ _gdm_display_set_is_initial (GdmDisplay     *self,
         GdmDisplayPrivate *priv;
 
         priv = gdm_display_get_instance_private (self);
-        g_debug ("GdmDisplay: initial: %s", initial? "yes" : "no");
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: initial: %s", initial? "yes" : "no");
         priv->is_initial = initial;
 }
 
@@ -519,7 +584,7 @@ _gdm_display_set_allow_timed_login (GdmDisplay     *self,
         GdmDisplayPrivate *priv;
 
         priv = gdm_display_get_instance_private (self);
-        g_debug ("GdmDisplay: allow timed login: %s", allow_timed_login? "yes" : "no");
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: allow timed login: %s", allow_timed_login? "yes" : "no");
         priv->allow_timed_login = allow_timed_login;
 }
 
@@ -535,7 +600,7 @@ _gdm_display_set_supported_session_types (GdmDisplay         *self,
           supported_session_types_string = g_strjoinv (":", (GStrv) supported_session_types);
 
         priv = gdm_display_get_instance_private (self);
-        g_debug ("GdmDisplay: supported session types: %s", supported_session_types_string);
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: supported session types: %s", supported_session_types_string);
         g_strfreev (priv->supported_session_types);
         priv->supported_session_types = g_strdupv ((GStrv) supported_session_types);
 }
@@ -590,6 +655,9 @@ gdm_display_set_property (GObject        *object,
         case PROP_SUPPORTED_SESSION_TYPES:
                 _gdm_display_set_supported_session_types (self, g_value_get_boxed (value));
                 break;
+        case PROP_LOGIN_TRACE:
+                _gdm_display_set_login_trace (self, g_value_get_object (value));
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
                 break;
@@ -654,6 +722,9 @@ gdm_display_get_property (GObject        *object,
         case PROP_SUPPORTED_SESSION_TYPES:
                 g_value_set_boxed (value, priv->supported_session_types);
                 break;
+        case PROP_LOGIN_TRACE:
+                g_value_set_object (value, priv->login_trace);
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
                 break;
@@ -780,6 +851,8 @@ register_display (GdmDisplay *self)
         g_signal_connect_object (priv->display_skeleton, "handle-is-initial",
                                  G_CALLBACK (handle_is_initial), self, 0);
 
+        update_login_timeline (self);
+
         g_dbus_object_skeleton_add_interface (priv->object_skeleton,
                                               G_DBUS_INTERFACE_SKELETON (priv->display_skeleton));
 
@@ -826,10 +899,11 @@ gdm_display_dispose (GObject *object)
         self = GDM_DISPLAY (object);
         priv = gdm_display_get_instance_private (self);
 
-        g_debug ("GdmDisplay: Disposing display");
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: Disposing display");
 
         g_clear_handle_id (&priv->finish_idle_id, g_source_remove);
         g_clear_object (&priv->launch_environment);
+        _gdm_display_set_login_trace (self, NULL);
         g_clear_pointer (&priv->supported_session_types, g_strfreev);
         g_clear_pointer (&priv->autologin_user, g_free);
 
@@ -960,6 +1034,14 @@ gdm_display_class_init (GdmDisplayClass *klass)
                                                              "supported session types",
                                                              G_TYPE_STRV,
                                                              G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS));
+
+        g_object_class_install_property (object_class,
+                                         PROP_LOGIN_TRACE,
+                                         g_param_spec_object ("login-trace",
+                                                              NULL,
+                                                              NULL,
+                                                              GDM_TYPE_LOGIN_TRACE,
+                                                              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -986,7 +1068,7 @@ gdm_display_finalize (GObject *object)
 
         g_return_if_fail (priv != NULL);
 
-        g_debug ("GdmDisplay: Finalizing display: %s", priv->id);
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: Finalizing display: %s", priv->id);
         g_free (priv->id);
         g_free (priv->seat_id);
         g_free (priv->session_class);
@@ -1011,13 +1093,24 @@ gdm_display_get_object_skeleton (GdmDisplay *self)
         return priv->object_skeleton;
 }
 
+GdmLoginTrace *
+gdm_display_get_login_trace (GdmDisplay *self)
+{
+        GdmDisplayPrivate *priv;
+
+        g_return_val_if_fail (GDM_IS_DISPLAY (self), NULL);
+
+        priv = gdm_display_get_instance_private (self);
+        return priv->login_trace;
+}
+
 static void
 on_launch_environment_session_opened (GdmLaunchEnvironment *launch_environment,
                                       GdmDisplay           *self)
 {
         g_autofree char *session_id = NULL;
 
-        g_debug ("GdmDisplay: Greeter session opened");
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: Greeter session opened");
         session_id = gdm_launch_environment_get_session_id (launch_environment);
         g_object_set (G_OBJECT (self), "session-id", session_id, NULL);
 }
@@ -1026,7 +1119,13 @@ static void
 on_launch_environment_session_started (GdmLaunchEnvironment *launch_environment,
                                        GdmDisplay           *self)
 {
-        g_debug ("GdmDisplay: Greeter started");
+        GdmDisplayPrivate *priv;
+
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: Greeter started");
+
+        priv = gdm_display_get_instance_private (self);
+        if (priv->login_trace != NULL)
+                gdm_login_trace_mark (priv->login_trace, "greeter-started");
 }
 
 static void
@@ -1034,7 +1133,7 @@ self_destruct (GdmDisplay *self)
 {
         g_object_ref (self);
 
-        g_debug ("GdmDisplay: initiating display self-destruct");
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: initiating display self-destruct");
         gdm_display_unmanage (self);
 
         if (gdm_display_get_status (self) != GDM_DISPLAY_FINISHED) {
@@ -1047,7 +1146,7 @@ static void
 on_launch_environment_session_stopped (GdmLaunchEnvironment *launch_environment,
                                        GdmDisplay           *self)
 {
-        g_debug ("GdmDisplay: Greeter stopped");
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: Greeter stopped");
         self_destruct (self);
 }
 
@@ -1056,7 +1155,7 @@ on_launch_environment_session_exited (GdmLaunchEnvironment *launch_environment,
                                       int                   code,
                                       GdmDisplay           *self)
 {
-        g_debug ("GdmDisplay: Greeter exited: %d", code);
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: Greeter exited: %d", code);
         self_destruct (self);
 }
 
@@ -1065,7 +1164,7 @@ on_launch_environment_session_died (GdmLaunchEnvironment *launch_environment,
                                     int                   signal,
                                     GdmDisplay           *self)
 {
-        g_debug ("GdmDisplay: Greeter died: %d", signal);
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: Greeter died: %d", signal);
         self_destruct (self);
 }
 
@@ -1141,15 +1240,15 @@ kernel_cmdline_initial_setup_force_state (gboolean *force_state)
         g_return_val_if_fail (force_state != NULL, FALSE);
 
         if (!g_file_get_contents ("/proc/cmdline", &contents, NULL, &error)) {
-                g_debug ("GdmDisplay: Could not check kernel parameters, not forcing initial setup: %s",
-                          error->message);
+                gdm_debug (DISPLAY_FACTORY, "GdmDisplay: Could not check kernel parameters, not forcing initial setup: %s",
+                                             error->message);
                 return FALSE;
         }
 
-        g_debug ("GdmDisplay: Checking kernel command buffer %s", contents);
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: Checking kernel command buffer %s", contents);
 
         if (!kernel_cmdline_initial_setup_argument (contents, &setup_argument, &error)) {
-                g_debug ("GdmDisplay: Failed to read kernel commandline: %s", error->message);
+                gdm_debug (DISPLAY_FACTORY, "GdmDisplay: Failed to read kernel commandline: %s", error->message);
                 return FALSE;
         }
 
@@ -1174,11 +1273,11 @@ wants_initial_setup (GdmDisplay *self)
 
         if (kernel_cmdline_initial_setup_force_state (&forced)) {
                 if (forced) {
-                        g_debug ("GdmDisplay: Forcing gnome-initial-setup");
+                        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: Forcing gnome-initial-setup");
                         return TRUE;
                 }
 
-                g_debug ("GdmDisplay: Forcing no gnome-initial-setup");
+                gdm_debug (DISPLAY_FACTORY, "GdmDisplay: Forcing no gnome-initial-setup");
                 return FALSE;
         }
 
@@ -1244,15 +1343,15 @@ gdm_display_start_greeter_session (GdmDisplay *self)
         priv = gdm_display_get_instance_private (self);
         g_return_if_fail (g_strcmp0 (priv->session_class, "greeter") == 0);
 
-        g_debug ("GdmDisplay: Running greeter");
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: Running greeter");
 
         g_object_get (self,
                       "seat-id", &seat_id,
                       "remote-hostname", &hostname,
                       NULL);
 
-        g_debug ("GdmDisplay: Creating greeter for %s",
-                 hostname != NULL ? hostname : seat_id);
+        gdm_debug (DISPLAY_FACTORY, "GdmDisplay: Creating greeter for %s",
+                                    hostname != NULL ? hostname : seat_id);
 
         g_signal_connect_object (priv->launch_environment,
                                  "opened",
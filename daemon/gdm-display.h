@@ -26,6 +26,7 @@
 #include <gio/gio.h>
 
 #include "gdm-dynamic-user-store.h"
+#include "gdm-login-trace.h"
 
 G_BEGIN_DECLS
 
@@ -68,6 +69,7 @@ gboolean            gdm_display_finish                         (GdmDisplay *disp
 gboolean            gdm_display_unmanage                       (GdmDisplay *display);
 
 GDBusObjectSkeleton *gdm_display_get_object_skeleton           (GdmDisplay *display);
+GdmLoginTrace *     gdm_display_get_login_trace                (GdmDisplay *display);
 
 /* exported to bus */
 gboolean            gdm_display_get_id                         (GdmDisplay *display,
@@ -19,16 +19,26 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <grp.h>
 #include <shadow.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
 #ifdef HAVE_USERDB
 #include <systemd/sd-varlink.h>
 #endif
 
 #include "gdm-common.h"
 #include "gdm-file-utils.h"
+#include "gdm-log.h"
 #include "gdm-dynamic-user-store.h"
+#include "gdm-uid-allocator.h"
 
 G_STATIC_ASSERT (sizeof(uid_t) == sizeof(guint));
 
@@ -39,22 +49,49 @@ G_STATIC_ASSERT (sizeof(uid_t) == sizeof(guint));
 
 #define USERDB_SOCKET_DIR "/run/systemd/userdb"
 
+/* Homes of deallocated users get renamed to this prefix in
+ * GDM_DYN_HOME_DIR, followed by the UID, before being deleted */
+#define TOMBSTONE_PREFIX ".tombstone-"
+
+/* Seconds before deleting a tombstone is tried again after a failure,
+ * doubling with every attempt up to the maximum */
+#define TOMBSTONE_RETRY_INTERVAL     10
+#define TOMBSTONE_RETRY_INTERVAL_MAX 3600
+
 #ifndef SD_VARLINK_SERVER_MODE_MKDIR_0755
 #define SD_VARLINK_SERVER_MODE_MKDIR_0755 0
 #endif
 
+typedef struct _UserdbSnapshot UserdbSnapshot;
+
 struct _GdmDynamicUserStore
 {
         GObject parent;
 
-        GThread *worker;
+        GPtrArray *workers;
+        guint n_workers;
         GCancellable *worker_cancellable;
+        int listen_fd;
 
-        GMutex mutex;
+        /* Main thread only; the worker reads from the snapshot */
         GHashTable *by_name; /* Owns the DynamicUser objects */
         GHashTable *by_uid;  /* Just an index to look up quickly by UID */
 
-        uid_t next_alloc;
+        GMutex mutex;        /* Only held to swap or take a ref on a snapshot */
+        UserdbSnapshot **snapshots; /* One per worker */
+
+        /* Users allocated ahead of time for one kind of launch
+         * environment, handed out by _create() without any waiting */
+        GQueue reserve;      /* Borrowed from by_name */
+        guint reserve_size;
+        char *reserve_username;
+        char *reserve_display_name;
+        char *reserve_member_of;
+        guint replenish_id;
+
+        /* UIDs of live users, and of users whose old home is still
+         * being deleted. Main thread only */
+        GdmUidAllocator *uids;
 };
 
 typedef struct
@@ -71,8 +108,20 @@ typedef struct
 {
         GWeakRef  store;
         gint      cancel_fd;
+        gint      listen_fd;
+        guint     index;
 } WorkerContext;
 
+typedef struct
+{
+        GWeakRef  store;
+        char     *path;
+        uid_t     uid;
+        guint     attempts;
+        guint64   reclaimed_bytes;
+        gint64    duration;
+} Tombstone;
+
 typedef struct
 {
         uid_t uid;
@@ -87,18 +136,19 @@ typedef struct
         const char *service;
 } GetMembershipsParams;
 
-typedef enum
-{
-  VARLINK_REPLY_FINAL,
-  VARLINK_REPLY_MORE_FOLLOW,
-} VarlinkReplyMode;
-
 static void     gdm_dynamic_user_store_class_init       (GdmDynamicUserStoreClass *klass);
 static void     gdm_dynamic_user_store_init             (GdmDynamicUserStore *store);
 static gpointer gdm_dynamic_user_varlink_worker         (gpointer data);
+static int      open_userdb_socket                      (void);
+static void     publish_userdb_snapshot                 (GdmDynamicUserStore *store);
 static void     gdm_dynamic_user_store_dispose          (GObject *object);
 static void     gdm_dynamic_user_store_finalize         (GObject *object);
 
+enum {
+        PROP_0,
+        PROP_N_WORKERS,
+};
+
 G_DEFINE_TYPE (GdmDynamicUserStore, gdm_dynamic_user_store, G_TYPE_OBJECT)
 
 static DynamicUser *
@@ -124,23 +174,6 @@ dynamic_user_new (const char   *username,
 static void
 dynamic_user_free (DynamicUser *user)
 {
-        g_autoptr (GError) error = NULL;
-        g_autoptr (GFile) home = NULL;
-
-        g_debug ("GdmDynUserStore: Deallocating user '%s' (uid: %d)",
-                 user->username, user->uid);
-
-        /* Sanity checks, let's not nuke the system by accident */
-        if (g_strcmp0 (user->home, "/") == 0 ||
-            g_str_has_prefix (user->home, "/home")) {
-                g_error ("GdmDynUserStore: Dynamic user home '%s' is in /home or is root! Aborting.", user->home);
-        }
-
-        home = g_file_new_for_path (user->home);
-        if (!gdm_rm_recursively (home, &error))
-                g_warning ("Failed to delete '%s', continuing: %s",
-                           user->home, error->message);
-
         g_free (user->username);
         g_free (user->display_name);
         g_free (user->home);
@@ -155,11 +188,220 @@ worker_context_free (WorkerContext *ctx)
 {
         g_weak_ref_clear (&ctx->store);
         g_close (ctx->cancel_fd, NULL);
+        if (ctx->listen_fd >= 0)
+                g_close (ctx->listen_fd, NULL);
         g_free (ctx);
 }
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (WorkerContext, worker_context_free)
 
+static Tombstone *
+tombstone_new (GdmDynamicUserStore *store,
+               const char          *path,
+               uid_t                uid)
+{
+        Tombstone *tombstone;
+
+        tombstone = g_new0 (Tombstone, 1);
+        g_weak_ref_init (&tombstone->store, store);
+        tombstone->path = g_strdup (path);
+        tombstone->uid = uid;
+
+        return tombstone;
+}
+
+static void
+tombstone_free (Tombstone *tombstone)
+{
+        g_weak_ref_clear (&tombstone->store);
+        g_free (tombstone->path);
+        g_free (tombstone);
+}
+
+static void
+delete_tombstone_in_thread (GTask        *task,
+                            gpointer      source_object,
+                            gpointer      task_data,
+                            GCancellable *cancellable)
+{
+        Tombstone *tombstone = task_data;
+        GError *error = NULL;
+        gint64 start;
+
+        start = g_get_monotonic_time ();
+
+        if (!gdm_rm_recursively_at (AT_FDCWD, tombstone->path,
+                                    &tombstone->reclaimed_bytes, &error)) {
+                g_task_return_error (task, error);
+                return;
+        }
+
+        tombstone->duration = g_get_monotonic_time () - start;
+        g_task_return_boolean (task, TRUE);
+}
+
+static void start_tombstone_deletion (Tombstone *tombstone);
+
+static gboolean
+on_tombstone_retry_timeout (gpointer user_data)
+{
+        Tombstone *tombstone = user_data;
+        g_autoptr (GdmDynamicUserStore) store = NULL;
+
+        store = g_weak_ref_get (&tombstone->store);
+        if (store == NULL) {
+                tombstone_free (tombstone);
+                return G_SOURCE_REMOVE;
+        }
+
+        start_tombstone_deletion (tombstone);
+        return G_SOURCE_REMOVE;
+}
+
+static void
+on_tombstone_deleted (GObject      *source_object,
+                      GAsyncResult *result,
+                      gpointer      user_data)
+{
+        Tombstone *tombstone = g_task_get_task_data (G_TASK (result));
+        g_autoptr (GdmDynamicUserStore) store = NULL;
+        g_autoptr (GError) error = NULL;
+        g_autofree char *size = NULL;
+
+        store = g_weak_ref_get (&tombstone->store);
+
+        if (!g_task_propagate_boolean (G_TASK (result), &error)) {
+                Tombstone *retry;
+                guint delay;
+
+                /* Keep the UID reserved, its files may still be around */
+                if (store == NULL)
+                        return;
+
+                retry = tombstone_new (store, tombstone->path, tombstone->uid);
+                retry->attempts = tombstone->attempts + 1;
+
+                delay = TOMBSTONE_RETRY_INTERVAL << MIN (tombstone->attempts, 10);
+                delay = MIN (delay, TOMBSTONE_RETRY_INTERVAL_MAX);
+
+                g_warning ("GdmDynUserStore: Failed to delete '%s', trying again in %u s: %s",
+                           tombstone->path, delay, error->message);
+
+                g_timeout_add_seconds (delay, on_tombstone_retry_timeout, retry);
+                return;
+        }
+
+        size = g_format_size (tombstone->reclaimed_bytes);
+        gdm_debug (USERDB, "GdmDynUserStore: Reclaimed %s from '%s' in %" G_GINT64_FORMAT " ms",
+                           size,
+                           tombstone->path,
+                           tombstone->duration / 1000);
+
+        if (store != NULL)
+                gdm_uid_allocator_release (store->uids, tombstone->uid);
+}
+
+static void
+start_tombstone_deletion (Tombstone *tombstone)
+{
+        g_autoptr (GTask) task = NULL;
+
+        task = g_task_new (NULL, NULL, on_tombstone_deleted, NULL);
+        g_task_set_source_tag (task, start_tombstone_deletion);
+        g_task_set_task_data (task, tombstone, (GDestroyNotify) tombstone_free);
+        g_task_run_in_thread (task, delete_tombstone_in_thread);
+}
+
+static void
+queue_tombstone_deletion (GdmDynamicUserStore *store,
+                          const char          *path,
+                          uid_t                uid)
+{
+        gdm_uid_allocator_reserve (store->uids, uid);
+
+        start_tombstone_deletion (tombstone_new (store, path, uid));
+}
+
+/* Unlinking a greeter's caches can take a long time, so the home is
+ * only renamed out of the way here, and deleted on a worker thread.
+ * The UID isn't handed out again until the home is gone; if it can't
+ * be deleted at all, the UID stays reserved.
+ */
+static void
+dynamic_user_retire (GdmDynamicUserStore *store,
+                     DynamicUser         *user)
+{
+        g_autofree char *tombstone = NULL;
+
+        gdm_debug (USERDB, "GdmDynUserStore: Deallocating user '%s' (uid: %d)",
+                           user->username, user->uid);
+
+        /* Sanity checks, let's not nuke the system by accident */
+        if (g_strcmp0 (user->home, "/") == 0 ||
+            g_str_has_prefix (user->home, "/home")) {
+                g_error ("GdmDynUserStore: Dynamic user home '%s' is in /home or is root! Aborting.", user->home);
+        }
+
+        tombstone = g_strdup_printf ("%s/" TOMBSTONE_PREFIX "%u-%s-%" G_GINT64_FORMAT,
+                                     GDM_DYN_HOME_DIR,
+                                     (guint) user->uid,
+                                     user->username,
+                                     g_get_monotonic_time ());
+
+        if (rename (user->home, tombstone) < 0) {
+                g_autoptr (GError) error = NULL;
+                int errsv = errno;
+
+                if (errsv == ENOENT) {
+                        gdm_uid_allocator_release (store->uids, user->uid);
+                        return;
+                }
+
+                g_warning ("GdmDynUserStore: Failed to move '%s' aside, deleting it in place: %s",
+                           user->home, g_strerror (errsv));
+
+                if (!gdm_rm_recursively_at (AT_FDCWD, user->home, NULL, &error)) {
+                        g_warning ("GdmDynUserStore: Failed to delete '%s', not reusing uid %d: %s",
+                                   user->home, user->uid, error->message);
+                        return;
+                }
+
+                gdm_uid_allocator_release (store->uids, user->uid);
+                return;
+        }
+
+        queue_tombstone_deletion (store, tombstone, user->uid);
+}
+
+/* Picks up tombstones left behind by a previous instance that didn't
+ * get to finish deleting them */
+static void
+queue_stale_tombstones (GdmDynamicUserStore *store)
+{
+        g_autoptr (GDir) dir = NULL;
+        const char *name;
+
+        dir = g_dir_open (GDM_DYN_HOME_DIR, 0, NULL);
+        if (dir == NULL)
+                return;
+
+        while ((name = g_dir_read_name (dir)) != NULL) {
+                g_autofree char *path = NULL;
+                guint64 uid;
+                char *end;
+
+                if (!g_str_has_prefix (name, TOMBSTONE_PREFIX))
+                        continue;
+
+                uid = g_ascii_strtoull (name + strlen (TOMBSTONE_PREFIX), &end, 10);
+                if (*end != '-' || uid > G_MAXUINT32)
+                        continue;
+
+                path = g_build_filename (GDM_DYN_HOME_DIR, name, NULL);
+                queue_tombstone_deletion (store, path, (uid_t) uid);
+        }
+}
+
 typedef gboolean PwdLock;
 
 static PwdLock
@@ -199,6 +441,13 @@ gdm_dynamic_user_store_error_quark (void)
         return ret;
 }
 
+static gboolean
+is_uid_known_to_nss (uid_t    uid,
+                     gpointer user_data)
+{
+        return gdm_get_pwent_for_uid (uid, NULL);
+}
+
 #ifdef HAVE_USERDB
 
 static gboolean
@@ -207,27 +456,8 @@ pick_uid (GdmDynamicUserStore  *store,
           uid_t                *ret_uid,
           GError              **error)
 {
-        gboolean already_used;
-        uid_t start;
-
-        start = store->next_alloc;
-
-        do {
-                already_used = g_hash_table_contains (store->by_uid, &store->next_alloc) ||
-                               gdm_get_pwent_for_uid (store->next_alloc, NULL);
-
-                if (!already_used)
-                        *ret_uid = store->next_alloc;
-
-                if (store->next_alloc < GREETER_UID_MAX)
-                        store->next_alloc += 1;
-                else
-                        store->next_alloc = GREETER_UID_MIN;
-
-                if (!already_used)
-                        return TRUE;
-
-        } while (store->next_alloc != start);
+        if (gdm_uid_allocator_allocate (store->uids, ret_uid))
+                return TRUE;
 
         g_set_error (error,
                      GDM_DYNAMIC_USER_STORE_ERROR,
@@ -284,15 +514,12 @@ pick_username (GdmDynamicUserStore *store,
         g_assert_not_reached ();
 }
 
-gboolean
-gdm_dynamic_user_store_create (GdmDynamicUserStore  *store,
-                               const char           *preferred_username,
-                               const char           *display_name,
-                               const char           *member_of,
-                               char                **ret_username,
-                               uid_t                *ret_uid,
-                               char                **ret_home,
-                               GError              **error)
+static DynamicUser *
+allocate_user (GdmDynamicUserStore  *store,
+               const char           *preferred_username,
+               const char           *display_name,
+               const char           *member_of,
+               GError              **error)
 {
         g_autofree char *username = NULL;
         g_auto (PwdLock) pwd_lock = FALSE;
@@ -303,8 +530,8 @@ gdm_dynamic_user_store_create (GdmDynamicUserStore  *store,
 
         username = pick_username (store, preferred_username);
 
-        g_debug ("GdmDynUserStore: Allocating dynamic user %s (%s)",
-                 username, display_name);
+        gdm_debug (USERDB, "GdmDynUserStore: Allocating dynamic user %s (%s)",
+                           username, display_name);
 
         /* We take a system-wide lock on the user database here to eliminate
          * race conditions when checking for used UIDs. Otherwise: someone might
@@ -313,7 +540,7 @@ gdm_dynamic_user_store_create (GdmDynamicUserStore  *store,
         pwd_lock = lock_pwd_db ();
 
         if (!pick_uid (store, username, &uid, error))
-                return FALSE;
+                return NULL;
 
         if (!gdm_get_grent_for_name (member_of, &grp)) {
                 g_set_error (error,
@@ -321,26 +548,168 @@ gdm_dynamic_user_store_create (GdmDynamicUserStore  *store,
                              GDM_DYNAMIC_USER_STORE_ERROR_NO_SUCH_GROUP,
                              "Group '%s' doesn't exist",
                              member_of);
-                return FALSE;
+                gdm_uid_allocator_release (store->uids, uid);
+                return NULL;
         }
 
         home = g_build_filename (GDM_DYN_HOME_DIR, username, NULL);
-        if (!gdm_ensure_dir (home, uid, GID_NOBODY, 0700, FALSE, error))
-                return FALSE;
+        if (!gdm_ensure_dir (home, uid, GID_NOBODY, 0700, FALSE, error)) {
+                gdm_uid_allocator_release (store->uids, uid);
+                return NULL;
+        }
 
         user = dynamic_user_new (username, display_name, home, uid, grp);
 
-        g_mutex_lock (&store->mutex);
         g_hash_table_insert (store->by_name, user->username, user);
         g_hash_table_insert (store->by_uid, &user->uid, user);
-        g_mutex_unlock (&store->mutex);
+        publish_userdb_snapshot (store);
+
+        gdm_debug (USERDB, "GdmDynUserStore: Allocated dynamic user '%s' (uid: %d, home: %s)",
+                           user->username, uid, home);
+
+        return user;
+}
+
+static gboolean
+replenish_reserve (gpointer data)
+{
+        GdmDynamicUserStore *store = data;
+        g_autoptr (GError) error = NULL;
+        DynamicUser *user;
+
+        if (store->reserve.length >= store->reserve_size) {
+                store->replenish_id = 0;
+                return G_SOURCE_REMOVE;
+        }
+
+        user = allocate_user (store,
+                              store->reserve_username,
+                              store->reserve_display_name,
+                              store->reserve_member_of,
+                              &error);
+        if (user == NULL) {
+                /* Try again when the next user gets handed out */
+                g_warning ("GdmDynUserStore: Failed to pre-allocate dynamic user: %s",
+                           error->message);
+                store->replenish_id = 0;
+                return G_SOURCE_REMOVE;
+        }
 
-        g_debug ("GdmDynUserStore: Allocated dynamic user '%s' (uid: %d, home: %s)",
-                 user->username, uid, home);
+        g_queue_push_tail (&store->reserve, user);
+        return G_SOURCE_CONTINUE;
+}
+
+static void
+queue_replenish_reserve (GdmDynamicUserStore *store)
+{
+        if (store->replenish_id != 0 || store->reserve.length >= store->reserve_size)
+                return;
+
+        /* One user per dispatch, and only when nothing else is going on,
+         * so refilling never gets in the way of a greeter starting up */
+        store->replenish_id = g_idle_add_full (G_PRIORITY_LOW,
+                                               replenish_reserve,
+                                               store,
+                                               NULL);
+}
 
-        *ret_username = g_steal_pointer (&username);
-        *ret_uid = uid;
-        *ret_home = g_steal_pointer (&home);
+static void
+clear_reserve (GdmDynamicUserStore *store)
+{
+        DynamicUser *user;
+
+        g_clear_handle_id (&store->replenish_id, g_source_remove);
+
+        while ((user = g_queue_pop_head (&store->reserve)) != NULL)
+                gdm_dynamic_user_store_remove (store, user->uid);
+}
+
+/**
+ * gdm_dynamic_user_store_set_reserve:
+ * @store: the store
+ * @preferred_username: the username launch environments ask for
+ * @display_name: their display name
+ * @member_of: their group
+ * @reserve_size: how many users to keep allocated ahead of time
+ *
+ * Keeps @reserve_size users matching the given identity allocated, with
+ * their homes created, so that gdm_dynamic_user_store_create() can hand
+ * them out straight away. The reserve gets topped up again from an idle
+ * callback. Pass 0 to turn it off.
+ */
+void
+gdm_dynamic_user_store_set_reserve (GdmDynamicUserStore *store,
+                                    const char          *preferred_username,
+                                    const char          *display_name,
+                                    const char          *member_of,
+                                    guint                reserve_size)
+{
+        g_return_if_fail (GDM_IS_DYNAMIC_USER_STORE (store));
+
+#ifndef HAVE_USERDB
+        /* Without userdb every user is preallocated by the system, so
+         * there's nothing to be gained */
+        reserve_size = 0;
+#endif
+
+        clear_reserve (store);
+
+        g_free (store->reserve_username);
+        g_free (store->reserve_display_name);
+        g_free (store->reserve_member_of);
+        store->reserve_username = g_strdup (preferred_username);
+        store->reserve_display_name = g_strdup (display_name);
+        store->reserve_member_of = g_strdup (member_of);
+        store->reserve_size = reserve_size;
+
+        gdm_debug (USERDB, "GdmDynUserStore: Keeping %u '%s' users in reserve",
+                           reserve_size, preferred_username);
+
+        queue_replenish_reserve (store);
+}
+
+static DynamicUser *
+take_reserved_user (GdmDynamicUserStore *store,
+                    const char          *preferred_username,
+                    const char          *display_name,
+                    const char          *member_of)
+{
+        if (store->reserve_size == 0 ||
+            g_strcmp0 (preferred_username, store->reserve_username) != 0 ||
+            g_strcmp0 (display_name, store->reserve_display_name) != 0 ||
+            g_strcmp0 (member_of, store->reserve_member_of) != 0)
+                return NULL;
+
+        return g_queue_pop_head (&store->reserve);
+}
+
+gboolean
+gdm_dynamic_user_store_create (GdmDynamicUserStore  *store,
+                               const char           *preferred_username,
+                               const char           *display_name,
+                               const char           *member_of,
+                               char                **ret_username,
+                               uid_t                *ret_uid,
+                               char                **ret_home,
+                               GError              **error)
+{
+        DynamicUser *user;
+
+        user = take_reserved_user (store, preferred_username, display_name, member_of);
+        if (user != NULL) {
+                gdm_debug (USERDB, "GdmDynUserStore: Handing out pre-allocated user '%s' (uid: %d)",
+                                   user->username, user->uid);
+        } else {
+                user = allocate_user (store, preferred_username, display_name, member_of, error);
+                if (user == NULL)
+                        return FALSE;
+        }
+
+        queue_replenish_reserve (store);
+
+        *ret_username = g_strdup (user->username);
+        *ret_uid = user->uid;
+        *ret_home = g_strdup (user->home);
         return TRUE;
 }
 
@@ -354,25 +723,125 @@ gdm_dynamic_user_store_remove (GdmDynamicUserStore *store,
         if (user == NULL)
                 return;
 
-        g_mutex_lock (&store->mutex);
+        g_queue_remove (&store->reserve, user);
         g_hash_table_remove (store->by_uid, &uid);
-        g_hash_table_remove (store->by_name, user->username);
-        g_mutex_unlock (&store->mutex);
+        g_hash_table_steal (store->by_name, user->username);
+        publish_userdb_snapshot (store);
+
+        dynamic_user_retire (store, user);
+        dynamic_user_free (user);
+}
+
+static void
+gdm_dynamic_user_store_set_property (GObject      *object,
+                                     guint         prop_id,
+                                     const GValue *value,
+                                     GParamSpec   *pspec)
+{
+        GdmDynamicUserStore *store = GDM_DYNAMIC_USER_STORE (object);
+
+        switch (prop_id) {
+        case PROP_N_WORKERS:
+                store->n_workers = g_value_get_uint (value);
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+                break;
+        }
+}
+
+static void
+gdm_dynamic_user_store_get_property (GObject    *object,
+                                     guint       prop_id,
+                                     GValue     *value,
+                                     GParamSpec *pspec)
+{
+        GdmDynamicUserStore *store = GDM_DYNAMIC_USER_STORE (object);
+
+        switch (prop_id) {
+        case PROP_N_WORKERS:
+                g_value_set_uint (value, store->n_workers);
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+                break;
+        }
+}
+
+static void
+start_workers (GdmDynamicUserStore *store)
+{
+        int cancel_fd;
+        guint i;
+
+        store->worker_cancellable = g_cancellable_new ();
+        cancel_fd = g_cancellable_get_fd (store->worker_cancellable);
+
+        /* All workers accept on the same socket; whichever wakes up
+         * first gets the connection */
+        store->listen_fd = open_userdb_socket ();
+
+        store->workers = g_ptr_array_new ();
+
+        store->snapshots = g_new0 (UserdbSnapshot *, store->n_workers);
+        publish_userdb_snapshot (store);
+
+        for (i = 0; i < store->n_workers; i++) {
+                WorkerContext *worker_ctx;
+                g_autofree char *name = NULL;
+
+                worker_ctx = g_new0 (WorkerContext, 1);
+                g_weak_ref_init (&worker_ctx->store, store);
+                worker_ctx->index = i;
+                worker_ctx->cancel_fd = fcntl (cancel_fd, F_DUPFD_CLOEXEC, 3);
+                worker_ctx->listen_fd = store->listen_fd >= 0 ?
+                                        fcntl (store->listen_fd, F_DUPFD_CLOEXEC, 3) : -1;
+
+                name = store->n_workers > 1 ?
+                       g_strdup_printf ("GDM userdb worker %u", i + 1) :
+                       g_strdup ("GDM userdb worker");
+
+                g_ptr_array_add (store->workers,
+                                 g_thread_new (name,
+                                               gdm_dynamic_user_varlink_worker,
+                                               worker_ctx));
+        }
+
+        g_cancellable_release_fd (store->worker_cancellable);
+}
+
+static void
+gdm_dynamic_user_store_constructed (GObject *object)
+{
+        GdmDynamicUserStore *store = GDM_DYNAMIC_USER_STORE (object);
+
+        G_OBJECT_CLASS (gdm_dynamic_user_store_parent_class)->constructed (object);
+
+        start_workers (store);
 }
 
 static void
 gdm_dynamic_user_store_class_init (GdmDynamicUserStoreClass *klass)
 {
         GObjectClass *object_class = G_OBJECT_CLASS (klass);
+        object_class->get_property = gdm_dynamic_user_store_get_property;
+        object_class->set_property = gdm_dynamic_user_store_set_property;
+        object_class->constructed = gdm_dynamic_user_store_constructed;
         object_class->dispose = gdm_dynamic_user_store_dispose;
         object_class->finalize = gdm_dynamic_user_store_finalize;
+
+        g_object_class_install_property (object_class,
+                                         PROP_N_WORKERS,
+                                         g_param_spec_uint ("n-workers",
+                                                            "n-workers",
+                                                            "Number of threads serving userdb queries",
+                                                            1, 64, 1,
+                                                            G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
 }
 
 static void
 gdm_dynamic_user_store_init (GdmDynamicUserStore *store)
 {
-        WorkerContext *worker_ctx = NULL;
-
         g_mutex_init (&store->mutex);
 
         store->by_name = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
@@ -380,15 +849,15 @@ gdm_dynamic_user_store_init (GdmDynamicUserStore *store)
 
         store->by_uid = g_hash_table_new (g_int_hash, g_int_equal);
 
-        store->next_alloc = GREETER_UID_MIN;
+        g_queue_init (&store->reserve);
 
-        worker_ctx = g_new0 (WorkerContext, 1);
-        g_weak_ref_init (&worker_ctx->store, store);
-        store->worker_cancellable = g_cancellable_new ();
-        worker_ctx->cancel_fd = g_cancellable_get_fd (store->worker_cancellable);
-        store->worker = g_thread_new ("GDM userdb worker",
-                                      gdm_dynamic_user_varlink_worker,
-                                      worker_ctx);
+        store->uids = gdm_uid_allocator_new (GREETER_UID_MIN, GREETER_UID_MAX,
+                                             is_uid_known_to_nss, NULL);
+
+        queue_stale_tombstones (store);
+
+        store->n_workers = 1;
+        store->listen_fd = -1;
 }
 
 static void
@@ -399,10 +868,32 @@ gdm_dynamic_user_store_dispose (GObject *object)
         store = GDM_DYNAMIC_USER_STORE (object);
 
         g_cancellable_cancel (store->worker_cancellable);
-        if (store->worker != NULL)
-                g_clear_pointer (&store->worker, g_thread_join);
+        if (store->workers != NULL) {
+                g_ptr_array_foreach (store->workers, (GFunc) g_thread_join, NULL);
+                g_clear_pointer (&store->workers, g_ptr_array_unref);
+        }
         g_clear_object (&store->worker_cancellable);
 
+        if (store->listen_fd >= 0) {
+                g_close (store->listen_fd, NULL);
+                store->listen_fd = -1;
+        }
+
+        g_clear_handle_id (&store->replenish_id, g_source_remove);
+        g_queue_clear (&store->reserve);
+
+        if (store->by_name != NULL) {
+                GHashTableIter iter;
+                gpointer value;
+
+                g_hash_table_iter_init (&iter, store->by_name);
+                while (g_hash_table_iter_next (&iter, NULL, &value))
+                        dynamic_user_retire (store, value);
+
+                g_hash_table_remove_all (store->by_uid);
+                g_hash_table_remove_all (store->by_name);
+        }
+
         G_OBJECT_CLASS (gdm_dynamic_user_store_parent_class)->dispose (object);
 }
 
@@ -415,18 +906,32 @@ gdm_dynamic_user_store_finalize (GObject *object)
         store = GDM_DYNAMIC_USER_STORE (object);
 
         g_mutex_clear (&store->mutex);
+        g_free (store->reserve_username);
+        g_free (store->reserve_display_name);
+        g_free (store->reserve_member_of);
+#ifdef HAVE_USERDB
+        if (store->snapshots != NULL) {
+                guint i;
+
+                for (i = 0; i < store->n_workers; i++)
+                        g_clear_pointer (&store->snapshots[i], userdb_snapshot_unref);
+        }
+#endif
+        g_free (store->snapshots);
         g_hash_table_destroy (store->by_uid);
         g_hash_table_destroy (store->by_name);
+        gdm_uid_allocator_free (store->uids);
 
         G_OBJECT_CLASS (gdm_dynamic_user_store_parent_class)->finalize (object);
 }
 
 GdmDynamicUserStore *
-gdm_dynamic_user_store_new (void)
+gdm_dynamic_user_store_new (guint n_workers)
 {
         GObject *object;
 
         object = g_object_new (GDM_TYPE_DYNAMIC_USER_STORE,
+                               "n-workers", MAX (n_workers, 1),
                                NULL);
 
         return GDM_DYNAMIC_USER_STORE (object);
@@ -449,6 +954,212 @@ dynamic_user_build_record (DynamicUser      *user,
                 SD_JSON_BUILD_PAIR_STRING ("disposition", "dynamic")));
 }
 
+static int
+dynamic_user_build_membership (DynamicUser      *user,
+                               sd_json_variant **ret)
+{
+        return sd_json_buildo (ret,
+                               SD_JSON_BUILD_PAIR_STRING ("userName", user->username),
+                               SD_JSON_BUILD_PAIR_STRING ("groupName", user->group));
+}
+
+/* An immutable copy of the users, indexed the ways the varlink methods
+ * need, with each reply already built. The main thread publishes a new
+ * one whenever a user comes or goes; the worker only takes a reference,
+ * so it never waits for the main thread and vice versa.
+ *
+ * The reply variants' refcounts aren't thread safe, and sd-varlink
+ * takes references while replying. So every worker gets a snapshot of
+ * its own, and the main thread only touches one again to free it after
+ * the worker has let go of it.
+ */
+typedef struct
+{
+        char            *username;
+        char            *group;
+        uid_t            uid;
+        sd_json_variant *record;
+        sd_json_variant *membership;
+} UserdbEntry;
+
+struct _UserdbSnapshot
+{
+        gatomicrefcount  ref_count;
+        GPtrArray       *entries;  /* Owns the UserdbEntry, sorted by name */
+        GHashTable      *by_name;
+        GHashTable      *by_uid;
+        GHashTable      *by_group; /* Group name to a GPtrArray of entries */
+};
+
+static void
+userdb_entry_free (UserdbEntry *entry)
+{
+        g_free (entry->username);
+        g_free (entry->group);
+        sd_json_variant_unref (entry->record);
+        sd_json_variant_unref (entry->membership);
+        g_free (entry);
+}
+
+static UserdbSnapshot *
+userdb_snapshot_ref (UserdbSnapshot *snapshot)
+{
+        g_atomic_ref_count_inc (&snapshot->ref_count);
+        return snapshot;
+}
+
+static void
+userdb_snapshot_unref (UserdbSnapshot *snapshot)
+{
+        if (!g_atomic_ref_count_dec (&snapshot->ref_count))
+                return;
+
+        g_hash_table_destroy (snapshot->by_group);
+        g_hash_table_destroy (snapshot->by_uid);
+        g_hash_table_destroy (snapshot->by_name);
+        g_ptr_array_unref (snapshot->entries);
+        g_free (snapshot);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (UserdbSnapshot, userdb_snapshot_unref)
+
+static int
+compare_entries_by_name (gconstpointer a,
+                         gconstpointer b)
+{
+        const UserdbEntry *entry_a = *(const UserdbEntry **) a;
+        const UserdbEntry *entry_b = *(const UserdbEntry **) b;
+
+        return strcmp (entry_a->username, entry_b->username);
+}
+
+static UserdbSnapshot *
+userdb_snapshot_new (GHashTable *users)
+{
+        UserdbSnapshot *snapshot;
+        GHashTableIter iter;
+        gpointer value;
+        guint i;
+
+        snapshot = g_new0 (UserdbSnapshot, 1);
+        g_atomic_ref_count_init (&snapshot->ref_count);
+        snapshot->entries = g_ptr_array_new_full (g_hash_table_size (users),
+                                                  (GDestroyNotify) userdb_entry_free);
+        snapshot->by_name = g_hash_table_new (g_str_hash, g_str_equal);
+        snapshot->by_uid = g_hash_table_new (g_int_hash, g_int_equal);
+        snapshot->by_group = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                    NULL, (GDestroyNotify) g_ptr_array_unref);
+
+        g_hash_table_iter_init (&iter, users);
+        while (g_hash_table_iter_next (&iter, NULL, &value)) {
+                DynamicUser *user = value;
+                UserdbEntry *entry;
+                int r;
+
+                entry = g_new0 (UserdbEntry, 1);
+                entry->username = g_strdup (user->username);
+                entry->group = g_strdup (user->group);
+                entry->uid = user->uid;
+
+                r = dynamic_user_build_record (user, &entry->record);
+                if (r >= 0)
+                        r = dynamic_user_build_membership (user, &entry->membership);
+                if (r < 0) {
+                        g_warning ("GdmDynUserStore: Failed to build userdb record for '%s': %s",
+                                   user->username, g_strerror (-r));
+                        userdb_entry_free (entry);
+                        continue;
+                }
+
+                g_ptr_array_add (snapshot->entries, entry);
+        }
+
+        g_ptr_array_sort (snapshot->entries, compare_entries_by_name);
+
+        for (i = 0; i < snapshot->entries->len; i++) {
+                UserdbEntry *entry = g_ptr_array_index (snapshot->entries, i);
+                GPtrArray *members;
+
+                g_hash_table_insert (snapshot->by_name, entry->username, entry);
+                g_hash_table_insert (snapshot->by_uid, &entry->uid, entry);
+
+                members = g_hash_table_lookup (snapshot->by_group, entry->group);
+                if (members == NULL) {
+                        members = g_ptr_array_new ();
+                        g_hash_table_insert (snapshot->by_group, entry->group, members);
+                }
+                g_ptr_array_add (members, entry);
+        }
+
+        return snapshot;
+}
+
+static void
+publish_userdb_snapshot (GdmDynamicUserStore *store)
+{
+        guint i;
+
+        /* Workers haven't been started yet */
+        if (store->snapshots == NULL)
+                return;
+
+        for (i = 0; i < store->n_workers; i++) {
+                UserdbSnapshot *snapshot, *old_snapshot;
+
+                snapshot = userdb_snapshot_new (store->by_name);
+
+                g_mutex_lock (&store->mutex);
+                old_snapshot = store->snapshots[i];
+                store->snapshots[i] = snapshot;
+                g_mutex_unlock (&store->mutex);
+
+                g_clear_pointer (&old_snapshot, userdb_snapshot_unref);
+        }
+}
+
+static UserdbSnapshot *
+acquire_userdb_snapshot (WorkerContext *ctx)
+{
+        g_autoptr (GdmDynamicUserStore) store = NULL;
+
+        store = GDM_DYNAMIC_USER_STORE (g_weak_ref_get (&ctx->store));
+        if (store == NULL)
+                return NULL;
+
+        G_MUTEX_AUTO_LOCK (&store->mutex, locker);
+        return userdb_snapshot_ref (store->snapshots[ctx->index]);
+}
+
+static int
+reply_entries (sd_varlink      *call,
+               GPtrArray       *entries,
+               gsize            reply_offset)
+{
+        guint i;
+        int r;
+
+        if (entries == NULL || entries->len == 0)
+                return sd_varlink_error (call,
+                                         "io.systemd.UserDatabase.NoRecordFound",
+                                         NULL);
+
+        /* When listing out our dynamic users, we stream all but the
+         * last with more=true */
+        for (i = 0; i < entries->len; i++) {
+                UserdbEntry *entry = g_ptr_array_index (entries, i);
+                sd_json_variant *reply = G_STRUCT_MEMBER (sd_json_variant *, entry, reply_offset);
+
+                if (i + 1 < entries->len)
+                        r = sd_varlink_notify (call, reply);
+                else
+                        r = sd_varlink_reply (call, reply);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
 static int
 vl_get_user_record (sd_varlink                *call,
                     sd_json_variant           *json,
@@ -462,13 +1173,11 @@ vl_get_user_record (sd_varlink                *call,
                 {}
         };
 
-        GWeakRef *weak_store = userdata;
-        g_autoptr (GdmDynamicUserStore) store = NULL;
+        g_autoptr (UserdbSnapshot) snapshot = NULL;
         GetUserRecordParams params = {
                 .uid = UID_INVALID,
         };
-        g_autoptr (sd_json_variant) ret = NULL;
-        DynamicUser *found = NULL;
+        UserdbEntry *found = NULL;
         int r;
 
         r = sd_varlink_dispatch (call, json, dispatch, &params);
@@ -480,40 +1189,17 @@ vl_get_user_record (sd_varlink                *call,
                                          "io.systemd.UserDatabase.BadService",
                                          NULL);
 
-        store = GDM_DYNAMIC_USER_STORE (g_weak_ref_get (weak_store));
-        if (store == NULL)
+        snapshot = acquire_userdb_snapshot (userdata);
+        if (snapshot == NULL)
                 return -ECANCELED;
 
-        G_MUTEX_AUTO_LOCK (&store->mutex, locker);
-
         if (params.uid != UID_INVALID)
-                found = g_hash_table_lookup (store->by_uid, &params.uid);
+                found = g_hash_table_lookup (snapshot->by_uid, &params.uid);
         else if (params.username != NULL)
-                found = g_hash_table_lookup (store->by_name, params.username);
-        else {
-                GHashTableIter iter;
-                gpointer value;
-
-                g_hash_table_iter_init (&iter, store->by_name);
-
-                while (g_hash_table_iter_next (&iter, NULL, &value)) {
-                        if (found != NULL) {
-                                g_autoptr (sd_json_variant) notify = NULL;
-
-                                r = dynamic_user_build_record (found, &notify);
-                                if (r < 0)
-                                        return r;
-
-                                /* When listing out our dynamic users, we stream
-                                 * all but the last with more=true */
-                                r = sd_varlink_notify (call, notify);
-                                if (r < 0)
-                                        return r;
-                        }
-
-                        found = value;
-                }
-        }
+                found = g_hash_table_lookup (snapshot->by_name, params.username);
+        else
+                return reply_entries (call, snapshot->entries,
+                                      G_STRUCT_OFFSET (UserdbEntry, record));
 
         if (found == NULL)
                 return sd_varlink_error (call,
@@ -526,11 +1212,7 @@ vl_get_user_record (sd_varlink                *call,
                                          "io.systemd.UserDatabase.ConflictingRecordFound",
                                          NULL);
 
-        r = dynamic_user_build_record (found, &ret);
-        if (r < 0)
-                return r;
-
-        return sd_varlink_reply (call, ret);
+        return sd_varlink_reply (call, found->record);
 }
 
 static int
@@ -552,39 +1234,6 @@ vl_get_group_record (sd_varlink                *call,
                                  NULL);
 }
 
-static int
-reply_user_group (sd_varlink       *call,
-                  VarlinkReplyMode  reply_mode,
-                  DynamicUser      *user)
-{
-        g_autoptr (sd_json_variant) ret = NULL;
-        int r;
-
-        r = sd_json_buildo (&ret,
-                            SD_JSON_BUILD_PAIR_STRING ("userName", user->username),
-                            SD_JSON_BUILD_PAIR_STRING ("groupName", user->group));
-        if (r < 0)
-                return r;
-
-        if (reply_mode == VARLINK_REPLY_MORE_FOLLOW)
-                return sd_varlink_notify (call, ret);
-        else
-                return sd_varlink_reply (call, ret);
-}
-
-static gboolean
-test_group_membership (DynamicUser *user,
-                       const char  *group)
-{
-        if (user == NULL)
-                return FALSE;
-
-        if (group != NULL && g_strcmp0 (user->group, group) != 0)
-                return FALSE;
-
-        return TRUE;
-}
-
 static int
 vl_get_memberships (sd_varlink                *call,
                     sd_json_variant           *json,
@@ -598,10 +1247,9 @@ vl_get_memberships (sd_varlink                *call,
                 {}
         };
 
-        GWeakRef *weak_store = userdata;
-        g_autoptr (GdmDynamicUserStore) store = NULL;
+        g_autoptr (UserdbSnapshot) snapshot = NULL;
         GetMembershipsParams params = {};
-        DynamicUser *user = NULL;
+        UserdbEntry *entry;
         int r;
 
         r = sd_varlink_dispatch (call, json, dispatch, &params);
@@ -613,43 +1261,60 @@ vl_get_memberships (sd_varlink                *call,
                                          "io.systemd.UserDatabase.BadService",
                                          NULL);
 
-        store = GDM_DYNAMIC_USER_STORE (g_weak_ref_get (weak_store));
-        if (store == NULL)
+        snapshot = acquire_userdb_snapshot (userdata);
+        if (snapshot == NULL)
                 return -ECANCELED;
 
-        G_MUTEX_AUTO_LOCK (&store->mutex, locker);
+        if (params.username != NULL) {
+                entry = g_hash_table_lookup (snapshot->by_name, params.username);
+                if (entry != NULL &&
+                    (params.groupname == NULL || g_strcmp0 (entry->group, params.groupname) == 0))
+                        return sd_varlink_reply (call, entry->membership);
 
-        if (params.username) {
-                user = g_hash_table_lookup (store->by_name, params.username);
-                if (test_group_membership (user, params.groupname))
-                        return reply_user_group (call, VARLINK_REPLY_FINAL, user);
-        } else {
-                GHashTableIter iter;
-                gpointer value;
+                return sd_varlink_error (call,
+                                         "io.systemd.UserDatabase.NoRecordFound",
+                                         NULL);
+        }
 
-                g_hash_table_iter_init (&iter, store->by_name);
+        if (params.groupname != NULL)
+                return reply_entries (call,
+                                      g_hash_table_lookup (snapshot->by_group, params.groupname),
+                                      G_STRUCT_OFFSET (UserdbEntry, membership));
 
-                while (g_hash_table_iter_next (&iter, NULL, &value)) {
-                        DynamicUser *next = value;
+        return reply_entries (call, snapshot->entries,
+                              G_STRUCT_OFFSET (UserdbEntry, membership));
+}
 
-                        if (test_group_membership (next, params.groupname)) {
-                                if (user != NULL) {
-                                        r = reply_user_group (call, VARLINK_REPLY_MORE_FOLLOW, user);
-                                        if (r < 0)
-                                                return r;
-                                }
+static int
+open_userdb_socket (void)
+{
+        struct sockaddr_un address = { .sun_family = AF_UNIX };
+        int fd;
 
-                                user = next;
-                        }
-                }
+        if (g_mkdir_with_parents (USERDB_SOCKET_DIR, 0755) < 0) {
+                g_warning ("Failed to create %s: %m", USERDB_SOCKET_DIR);
+                return -1;
+        }
 
-                if (user != NULL)
-                        return reply_user_group (call, VARLINK_REPLY_FINAL, user);
+        fd = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+                g_warning ("Failed to create userdb socket: %m");
+                return -1;
         }
 
-        return sd_varlink_error (call,
-                                 "io.systemd.UserDatabase.NoRecordFound",
-                                 NULL);
+        g_strlcpy (address.sun_path, USERDB_SOCKET_DIR "/" GDM_SERVICE_ID,
+                   sizeof (address.sun_path));
+        unlink (address.sun_path);
+
+        if (bind (fd, (struct sockaddr *) &address, sizeof (address)) < 0 ||
+            chmod (address.sun_path, 0666) < 0 ||
+            listen (fd, SOMAXCONN) < 0) {
+                g_warning ("Failed to set up userdb socket: %m");
+                g_close (fd, NULL);
+                return -1;
+        }
+
+        return fd;
 }
 
 static gpointer
@@ -669,7 +1334,7 @@ gdm_dynamic_user_varlink_worker (gpointer data)
 
         /* The default callback quits the event loop, which is exactly what we
          * want to happen. Also, by default sd_event doesn't take ownership of
-         * the FD, which is again correct (it's owned by the Cancellable) */
+         * the FD, which is again correct (it's owned by the WorkerContext) */
         r = sd_event_add_io (event, NULL, ctx->cancel_fd, EPOLLIN, NULL, NULL);
         if (r < 0) {
                 g_warning ("Failed to subscribe to cancel signal: %s",
@@ -684,7 +1349,7 @@ gdm_dynamic_user_varlink_worker (gpointer data)
                 return NULL;
         }
 
-        sd_varlink_server_set_userdata (server, &ctx->store);
+        sd_varlink_server_set_userdata (server, ctx);
 
         sd_varlink_server_set_info (server,
                                     "The GNOME Project",
@@ -699,9 +1364,15 @@ gdm_dynamic_user_varlink_worker (gpointer data)
                 return NULL;
         }
 
-        r = sd_varlink_server_listen_address (server,
-                                              USERDB_SOCKET_DIR "/" GDM_SERVICE_ID,
-                                              0666 | SD_VARLINK_SERVER_MODE_MKDIR_0755);
+        if (ctx->listen_fd >= 0) {
+                r = sd_varlink_server_listen_fd (server, ctx->listen_fd);
+                if (r >= 0)
+                        ctx->listen_fd = -1;
+        } else {
+                r = sd_varlink_server_listen_address (server,
+                                                      USERDB_SOCKET_DIR "/" GDM_SERVICE_ID,
+                                                      0666 | SD_VARLINK_SERVER_MODE_MKDIR_0755);
+        }
         if (r < 0) {
                 g_warning ("Failed to listen on userdb socket: %s",
                            g_strerror (-r));
@@ -727,6 +1398,17 @@ gdm_dynamic_user_varlink_worker (gpointer data)
 
 #else /* HAVE_USERDB */
 
+static void
+publish_userdb_snapshot (GdmDynamicUserStore *store)
+{
+}
+
+static int
+open_userdb_socket (void)
+{
+        return -1;
+}
+
 static gpointer
 gdm_dynamic_user_varlink_worker (gpointer data)
 {
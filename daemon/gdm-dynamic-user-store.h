@@ -39,7 +39,7 @@ typedef enum
 
 GQuark               gdm_dynamic_user_store_error_quark (void);
 
-GdmDynamicUserStore *gdm_dynamic_user_store_new         (void);
+GdmDynamicUserStore *gdm_dynamic_user_store_new         (guint                n_workers);
 
 gboolean             gdm_dynamic_user_store_create      (GdmDynamicUserStore  *store,
                                                          const char           *preferred_username,
@@ -53,4 +53,10 @@ gboolean             gdm_dynamic_user_store_create      (GdmDynamicUserStore  *s
 void                 gdm_dynamic_user_store_remove      (GdmDynamicUserStore *store,
                                                          uid_t                uid);
 
+void                 gdm_dynamic_user_store_set_reserve (GdmDynamicUserStore *store,
+                                                         const char          *preferred_username,
+                                                         const char          *display_name,
+                                                         const char          *member_of,
+                                                         guint                reserve_size);
+
 G_END_DECLS
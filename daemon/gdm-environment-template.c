@@ -0,0 +1,222 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "gdm-environment-template.h"
+
+struct _GdmEnvironmentTemplate
+{
+        gatomicrefcount   ref_count;
+
+        /* "KEY=VALUE" strings, all in one block with the array */
+        char            **entries;
+        gsize             n_entries;
+
+        /* The entry pointers the template was built from, so a change
+         * to a live environment like environ can be spotted without
+         * comparing any strings */
+        const char      **source;
+        gsize             n_source;
+};
+
+static gboolean
+is_last_entry_for_key (GPtrArray  *keys,
+                       GHashTable *last_index,
+                       gsize       i)
+{
+        const char *key = g_ptr_array_index (keys, i);
+
+        if (key == NULL)
+                return FALSE;
+
+        return GPOINTER_TO_SIZE (g_hash_table_lookup (last_index, key)) == i;
+}
+
+/**
+ * gdm_environment_template_new:
+ * @environment: "KEY=VALUE" strings
+ * @excluded_keys: (nullable): keys to leave out, usually the ones that
+ *   get passed as overlays to gdm_environment_template_build()
+ *
+ * Copies @environment into an immutable template. If a key appears
+ * more than once, the last value wins. Entries without a '=' are
+ * dropped.
+ */
+GdmEnvironmentTemplate *
+gdm_environment_template_new (const char * const *environment,
+                              const char * const *excluded_keys)
+{
+        g_autoptr(GPtrArray) keys = NULL;
+        g_autoptr(GHashTable) last_index = NULL;
+        GdmEnvironmentTemplate *template;
+        gsize n_source;
+        gsize n_bytes = 0;
+        gsize i;
+        char *p;
+
+        n_source = environment != NULL ? g_strv_length ((char **) environment) : 0;
+
+        template = g_new0 (GdmEnvironmentTemplate, 1);
+        g_atomic_ref_count_init (&template->ref_count);
+        template->source = g_memdup2 (environment, n_source * sizeof (char *));
+        template->n_source = n_source;
+
+        /* keys[i] is the key of environment[i], or NULL if it's skipped */
+        keys = g_ptr_array_new_full (n_source, g_free);
+        last_index = g_hash_table_new (g_str_hash, g_str_equal);
+
+        for (i = 0; i < n_source; i++) {
+                const char *separator;
+                char *key = NULL;
+
+                separator = strchr (environment[i], '=');
+                if (separator != NULL) {
+                        key = g_strndup (environment[i], separator - environment[i]);
+
+                        if (excluded_keys != NULL && g_strv_contains (excluded_keys, key))
+                                g_clear_pointer (&key, g_free);
+                }
+
+                g_ptr_array_add (keys, key);
+
+                if (key != NULL)
+                        g_hash_table_insert (last_index, key, GSIZE_TO_POINTER (i));
+        }
+
+        for (i = 0; i < n_source; i++) {
+                if (!is_last_entry_for_key (keys, last_index, i))
+                        continue;
+
+                template->n_entries++;
+                n_bytes += strlen (environment[i]) + 1;
+        }
+
+        template->entries = g_malloc ((template->n_entries + 1) * sizeof (char *) + n_bytes);
+        p = (char *) (template->entries + template->n_entries + 1);
+
+        template->n_entries = 0;
+        for (i = 0; i < n_source; i++) {
+                if (!is_last_entry_for_key (keys, last_index, i))
+                        continue;
+
+                template->entries[template->n_entries++] = p;
+                p = g_stpcpy (p, environment[i]) + 1;
+        }
+        template->entries[template->n_entries] = NULL;
+
+        return template;
+}
+
+GdmEnvironmentTemplate *
+gdm_environment_template_ref (GdmEnvironmentTemplate *template)
+{
+        g_return_val_if_fail (template != NULL, NULL);
+
+        g_atomic_ref_count_inc (&template->ref_count);
+
+        return template;
+}
+
+void
+gdm_environment_template_unref (GdmEnvironmentTemplate *template)
+{
+        g_return_if_fail (template != NULL);
+
+        if (!g_atomic_ref_count_dec (&template->ref_count))
+                return;
+
+        g_free (template->entries);
+        g_free (template->source);
+        g_free (template);
+}
+
+/**
+ * gdm_environment_template_matches:
+ *
+ * Checks whether @environment still holds exactly the entries
+ * @template was built from. Only pointers are compared, which is
+ * enough for environ: setenv () always installs a new string.
+ */
+gboolean
+gdm_environment_template_matches (GdmEnvironmentTemplate *template,
+                                  const char * const     *environment)
+{
+        gsize i;
+
+        g_return_val_if_fail (template != NULL, FALSE);
+
+        for (i = 0; i < template->n_source; i++) {
+                if (environment == NULL || environment[i] != template->source[i])
+                        return FALSE;
+        }
+
+        return environment == NULL || environment[i] == NULL;
+}
+
+/**
+ * gdm_environment_template_build:
+ * @template: a #GdmEnvironmentTemplate
+ * @overlay: variables to add, whose keys must have been excluded from
+ *   @template
+ * @n_overlay: number of elements in @overlay
+ *
+ * Builds an envp array in a single allocation, without any hashing.
+ * The template's entries are shared rather than copied, so the result
+ * must not outlive @template.
+ *
+ * Returns: (transfer full): envp array, to be freed with g_free()
+ */
+char **
+gdm_environment_template_build (GdmEnvironmentTemplate      *template,
+                                const GdmEnvironmentOverlay *overlay,
+                                gsize                        n_overlay)
+{
+        gsize overlay_bytes = 0;
+        gsize n = 0;
+        gsize i;
+        char **envp;
+        char *p;
+
+        g_return_val_if_fail (template != NULL, NULL);
+
+        for (i = 0; i < n_overlay; i++) {
+                overlay_bytes += strlen (overlay[i].key) + 1;
+                overlay_bytes += (overlay[i].value != NULL ? strlen (overlay[i].value) : 0) + 1;
+        }
+
+        envp = g_malloc ((template->n_entries + n_overlay + 1) * sizeof (char *) + overlay_bytes);
+        p = (char *) (envp + template->n_entries + n_overlay + 1);
+
+        for (i = 0; i < template->n_entries; i++)
+                envp[n++] = template->entries[i];
+
+        for (i = 0; i < n_overlay; i++) {
+                envp[n++] = p;
+                p = g_stpcpy (p, overlay[i].key);
+                *p++ = '=';
+                p = g_stpcpy (p, overlay[i].value != NULL ? overlay[i].value : "") + 1;
+        }
+
+        envp[n] = NULL;
+
+        return envp;
+}
@@ -0,0 +1,48 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* An immutable, deduplicated copy of an environment that any number of
+ * envp arrays can be stamped out from, each with a few extra variables.
+ */
+typedef struct _GdmEnvironmentTemplate GdmEnvironmentTemplate;
+
+typedef struct
+{
+        const char *key;
+        const char *value;
+} GdmEnvironmentOverlay;
+
+GdmEnvironmentTemplate *gdm_environment_template_new     (const char * const          *environment,
+                                                          const char * const          *excluded_keys);
+GdmEnvironmentTemplate *gdm_environment_template_ref     (GdmEnvironmentTemplate      *template);
+void                    gdm_environment_template_unref   (GdmEnvironmentTemplate      *template);
+
+gboolean                gdm_environment_template_matches (GdmEnvironmentTemplate      *template,
+                                                          const char * const          *environment);
+char                  **gdm_environment_template_build   (GdmEnvironmentTemplate      *template,
+                                                          const GdmEnvironmentOverlay *overlay,
+                                                          gsize                        n_overlay);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GdmEnvironmentTemplate, gdm_environment_template_unref)
+
+G_END_DECLS
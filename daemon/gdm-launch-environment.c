@@ -44,6 +44,7 @@
 
 #include "gdm-common.h"
 #include "gdm-file-utils.h"
+#include "gdm-log.h"
 
 #include "gdm-session-enum-types.h"
 #include "gdm-launch-environment.h"
@@ -515,7 +516,7 @@ on_conversation_stopped (GdmSession           *session,
 
         conversation_session = g_steal_pointer (&launch_environment->session);
 
-        g_debug ("GdmLaunchEnvironment: conversation stopped");
+        gdm_debug (SESSION, "GdmLaunchEnvironment: conversation stopped");
 
         if (launch_environment->pid > 1) {
                 gdm_signal_pid (-launch_environment->pid, SIGTERM);
@@ -569,7 +570,7 @@ gdm_launch_environment_start (GdmLaunchEnvironment *launch_environment)
         g_return_val_if_fail (GDM_IS_LAUNCH_ENVIRONMENT (launch_environment), FALSE);
         g_return_val_if_fail (launch_environment->dyn_uid != 0, FALSE);
 
-        g_debug ("GdmLaunchEnvironment: Starting...");
+        gdm_debug (SESSION, "GdmLaunchEnvironment: Starting...");
 
         launch_environment->session = gdm_session_new (GDM_SESSION_VERIFICATION_MODE_LOGIN,
                                                        launch_environment->dyn_uid,
@@ -986,6 +987,17 @@ gdm_create_greeter_launch_environment (const char *seat_id,
                              NULL);
 }
 
+void
+gdm_reserve_greeter_users (GdmDynamicUserStore *dyn_user_store,
+                           guint                n_users)
+{
+        gdm_dynamic_user_store_set_reserve (dyn_user_store,
+                                            GDM_GREETER_USERNAME,
+                                            GDM_GREETER_DISP_NAME,
+                                            GDM_GROUPNAME,
+                                            n_users);
+}
+
 GdmLaunchEnvironment *
 gdm_create_initial_setup_launch_environment (const char *seat_id,
                                              const char *display_hostname,
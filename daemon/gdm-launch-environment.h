@@ -44,6 +44,8 @@ char *                gdm_launch_environment_get_session_id     (GdmLaunchEnviro
 GdmLaunchEnvironment *gdm_create_greeter_launch_environment (const char *seat_id,
                                                              const char *display_hostname,
                                                              gboolean    display_is_local);
+void                  gdm_reserve_greeter_users (GdmDynamicUserStore *dyn_user_store,
+                                                 guint                n_users);
 
 GdmLaunchEnvironment *gdm_create_initial_setup_launch_environment (const char *seat_id,
                                                                    const char *display_hostname,
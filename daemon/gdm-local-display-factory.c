@@ -44,6 +44,8 @@
 #include "gdm-settings-direct.h"
 #include "gdm-display-store.h"
 #include "gdm-local-display.h"
+#include "gdm-log.h"
+#include "gdm-login-trace.h"
 
 #define GDM_DBUS_PATH                       "/org/gnome/DisplayManager"
 #define GDM_LOCAL_DISPLAY_FACTORY_DBUS_PATH GDM_DBUS_PATH "/LocalDisplayFactory"
@@ -132,7 +134,7 @@ static void
 on_display_disposed (GdmLocalDisplayFactory *factory,
                      GdmDisplay             *display)
 {
-        g_debug ("GdmLocalDisplayFactory: Display %p disposed", display);
+        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: Display %p disposed", display);
 }
 
 static void
@@ -180,7 +182,7 @@ gdm_local_display_factory_create_display (GdmLocalDisplayFactory  *factory,
         g_auto(GStrv) session_types = NULL;
         g_autoptr (GdmDisplay) display = NULL;
 
-        g_debug ("GdmLocalDisplayFactory: Creating local display");
+        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: Creating local display");
 
         session_types = gdm_local_display_factory_get_session_types (factory);
 
@@ -224,7 +226,7 @@ finish_display_on_seat_if_waiting (GdmDisplayStore *display_store,
         if (gdm_display_get_status (display) != GDM_DISPLAY_WAITING_TO_FINISH)
                 return;
 
-        g_debug ("GdmLocalDisplayFactory: finish background display\n");
+        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: finish background display\n");
         gdm_display_stop_greeter_session (display);
         gdm_display_unmanage (display);
         gdm_display_finish (display);
@@ -247,7 +249,7 @@ finish_waiting_displays_on_seat (GdmLocalDisplayFactory *factory,
 static gboolean
 on_finish_waiting_for_seat0_displays_timeout (GdmLocalDisplayFactory *factory)
 {
-        g_debug ("GdmLocalDisplayFactory: timeout following VT switch to registered session complete, looking for any background displays to kill");
+        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: timeout following VT switch to registered session complete, looking for any background displays to kill");
         finish_waiting_displays_on_seat (factory, "seat0");
         return G_SOURCE_REMOVE;
 }
@@ -280,7 +282,7 @@ on_display_status_changed (GdmDisplay             *display,
 
         status = gdm_display_get_status (display);
 
-        g_debug ("GdmLocalDisplayFactory: display status changed: %d", status);
+        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: display status changed: %d", status);
         switch (status) {
         case GDM_DISPLAY_FINISHED:
                 gdm_display_factory_queue_purge_displays (GDM_DISPLAY_FACTORY (factory));
@@ -392,22 +394,22 @@ udev_is_settled (GdmLocalDisplayFactory *factory)
         gboolean is_settled = FALSE;
 
         if (factory->seat0_has_platform_graphics) {
-                g_debug ("GdmLocalDisplayFactory: udev settled, platform graphics enabled.");
+                gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: udev settled, platform graphics enabled.");
                 return TRUE;
         }
 
         if (factory->seat0_has_boot_up_graphics) {
-                g_debug ("GdmLocalDisplayFactory: udev settled, boot up graphics available.");
+                gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: udev settled, boot up graphics available.");
                 return TRUE;
         }
 
         if (factory->seat0_graphics_check_timed_out) {
-                g_debug ("GdmLocalDisplayFactory: udev timed out, proceeding anyway.");
+                gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: udev timed out, proceeding anyway.");
                 g_clear_signal_handler (&factory->uevent_handler_id, factory->gudev_client);
                 return TRUE;
         }
 
-        g_debug ("GdmLocalDisplayFactory: Checking if udev has settled enough to support graphics.");
+        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: Checking if udev has settled enough to support graphics.");
 
         enumerator = g_udev_enumerator_new (factory->gudev_client);
 
@@ -417,7 +419,7 @@ udev_is_settled (GdmLocalDisplayFactory *factory)
 
         devices = g_udev_enumerator_execute (enumerator);
         if (!devices) {
-                g_debug ("GdmLocalDisplayFactory: udev has no candidate graphics devices available yet.");
+                gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: udev has no candidate graphics devices available yet.");
                 return FALSE;
         }
 
@@ -438,7 +440,7 @@ udev_is_settled (GdmLocalDisplayFactory *factory)
                 platform_device = g_udev_device_get_parent_with_subsystem (device, "platform", NULL);
 
                 if (platform_device != NULL) {
-                        g_debug ("GdmLocalDisplayFactory: Found embedded platform graphics, proceeding.");
+                        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: Found embedded platform graphics, proceeding.");
                         factory->seat0_has_platform_graphics = TRUE;
                         is_settled = TRUE;
                         break;
@@ -452,7 +454,7 @@ udev_is_settled (GdmLocalDisplayFactory *factory)
                         boot_vga = g_udev_device_get_sysfs_attr_as_int (pci_device, "boot_vga");
 
                         if (boot_vga == 1) {
-                                 g_debug ("GdmLocalDisplayFactory: Found primary PCI graphics adapter, proceeding.");
+                                 gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: Found primary PCI graphics adapter, proceeding.");
                                  factory->seat0_has_boot_up_graphics = TRUE;
                                  is_settled = TRUE;
                                  break;
@@ -467,7 +469,7 @@ udev_is_settled (GdmLocalDisplayFactory *factory)
                         boot_display = g_udev_device_get_sysfs_attr_as_int (drm_device, "boot_display");
 
                         if (boot_display == 1) {
-                                 g_debug ("GdmLocalDisplayFactory: Found primary PCI graphics adapter, proceeding.");
+                                 gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: Found primary PCI graphics adapter, proceeding.");
                                  factory->seat0_has_boot_up_graphics = TRUE;
                                  is_settled = TRUE;
                                  break;
@@ -475,13 +477,13 @@ udev_is_settled (GdmLocalDisplayFactory *factory)
                 }
 
                 if (pci_device != NULL || drm_device != NULL) {
-                        g_debug ("GdmLocalDisplayFactory: Found secondary PCI graphics adapter, not proceeding yet.");
+                        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: Found secondary PCI graphics adapter, not proceeding yet.");
                 }
 
                 node = next_node;
         }
 
-        g_debug ("GdmLocalDisplayFactory: udev has %ssettled enough for graphics.", is_settled? "" : "not ");
+        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: udev has %ssettled enough for graphics.", is_settled? "" : "not ");
         g_list_free_full (devices, g_object_unref);
 
         if (is_settled)
@@ -535,10 +537,14 @@ ensure_display_for_seat (GdmLocalDisplayFactory *factory,
         gboolean is_seat0;
         g_auto (GStrv) session_types = NULL;
         g_autoptr (GdmDisplay) display = NULL;
+        g_autoptr (GdmLoginTrace) login_trace = NULL;
         g_autofree char *login_session_id = NULL;
         int ret;
 
-        g_debug ("GdmLocalDisplayFactory: display for seat %s requested", seat_id);
+        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: display for seat %s requested", seat_id);
+
+        /* Time the login from the moment the seat shows up */
+        login_trace = gdm_login_trace_new ();
 
         /* If we already have a login window, switch to it */
         if (gdm_get_login_window_session_id (seat_id, &login_session_id)) {
@@ -553,8 +559,8 @@ ensure_display_for_seat (GdmLocalDisplayFactory *factory,
                     (gdm_display_get_status (display) == GDM_DISPLAY_MANAGED ||
                      gdm_display_get_status (display) == GDM_DISPLAY_WAITING_TO_FINISH)) {
                         g_object_set (G_OBJECT (display), "status", GDM_DISPLAY_MANAGED, NULL);
-                        g_debug ("GdmLocalDisplayFactory: session %s found, activating.",
-                                 login_session_id);
+                        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: session %s found, activating.",
+                                                    login_session_id);
                         gdm_activate_session_by_id (factory->connection, NULL, seat_id, login_session_id);
                         return;
                 }
@@ -564,11 +570,11 @@ ensure_display_for_seat (GdmLocalDisplayFactory *factory,
 
 #ifdef HAVE_UDEV
         if (!udev_is_settled (factory)) {
-                g_debug ("GdmLocalDisplayFactory: udev is still settling, so not creating display yet");
+                gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: udev is still settling, so not creating display yet");
 
                 if (is_seat0 && factory->seat0_graphics_check_timeout_id == 0) {
-                        g_debug("GdmLocalDisplayFactory: Waiting for up to %d seconds for a primary GPU to appear",
-                                SEAT0_GRAPHICS_CHECK_TIMEOUT);
+                        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: Waiting for up to %d seconds for a primary GPU to appear",
+                                                    SEAT0_GRAPHICS_CHECK_TIMEOUT);
                         factory->seat0_graphics_check_timeout_id = g_timeout_add_seconds (SEAT0_GRAPHICS_CHECK_TIMEOUT,
                                                                                           on_seat0_graphics_check_timeout,
                                                                                           factory);
@@ -588,33 +594,36 @@ ensure_display_for_seat (GdmLocalDisplayFactory *factory,
         }
 
         if (ret == 0) {
-                g_debug ("GdmLocalDisplayFactory: System doesn't currently support graphics");
+                gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: System doesn't currently support graphics");
                 if (is_seat0)
                         g_signal_emit (factory, signals[GRAPHICS_UNSUPPORTED], 0);
                 return;
         }
 
-        g_debug ("GdmLocalDisplayFactory: System supports graphics");
+        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: System supports graphics");
 
         session_types = gdm_local_display_factory_get_session_types (factory);
 
-        g_debug ("GdmLocalDisplayFactory: %s login display for seat %s requested",
-                 session_types[0], seat_id);
+        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: %s login display for seat %s requested",
+                                    session_types[0], seat_id);
 
         /* Ensure we don't create the same display more than once */
         display = get_display_for_seat (factory, seat_id);
         if (display != NULL) {
-                g_debug ("GdmLocalDisplayFactory: display for %s already created", seat_id);
+                gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: display for %s already created", seat_id);
                 return;
         }
 
-        g_debug ("GdmLocalDisplayFactory: Adding display on seat %s", seat_id);
+        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: Adding display on seat %s", seat_id);
+
+        gdm_login_trace_mark (login_trace, "seat-added");
 
         display = gdm_local_display_new ();
         g_object_set (G_OBJECT (display),
                       "supported-session-types", session_types,
                       "seat-id", seat_id,
                       "is-initial", is_seat0,
+                      "login-trace", login_trace,
                       NULL);
 
         store_display (factory, display);
@@ -629,7 +638,7 @@ delete_display (GdmLocalDisplayFactory *factory,
 
         GdmDisplayStore *store;
 
-        g_debug ("GdmLocalDisplayFactory: Removing displays on seat %s", seat_id);
+        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: Removing displays on seat %s", seat_id);
 
         store = gdm_display_factory_get_display_store (GDM_DISPLAY_FACTORY (factory));
         gdm_display_store_foreach_remove (store, lookup_by_seat_id, (gpointer) seat_id);
@@ -644,7 +653,7 @@ gdm_local_display_factory_sync_seats (GdmLocalDisplayFactory *factory)
         GVariantIter iter;
         const char *seat;
 
-        g_debug ("GdmLocalDisplayFactory: enumerating seats from logind");
+        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: enumerating seats from logind");
         result = g_dbus_connection_call_sync (factory->connection,
                                               "org.freedesktop.login1",
                                               "/org/freedesktop/login1",
@@ -737,7 +746,7 @@ on_seat_properties_changed (GDBusConnection *connection,
                                              -1, NULL, &error);
 
         if (reply == NULL) {
-                g_debug ("could not acquire seat name: %s", error->message);
+                gdm_debug (DISPLAY_FACTORY, "could not acquire seat name: %s", error->message);
                 return;
         }
 
@@ -746,7 +755,7 @@ on_seat_properties_changed (GDBusConnection *connection,
         seat = g_variant_get_string (reply_value, NULL);
 
         if (seat == NULL) {
-                g_debug ("seat name is not string");
+                gdm_debug (DISPLAY_FACTORY, "seat name is not string");
                 return;
         }
 
@@ -815,7 +824,7 @@ maybe_stop_greeter_in_background (GdmLocalDisplayFactory *factory,
         gboolean doing_initial_setup = FALSE;
 
         if (gdm_display_get_status (display) != GDM_DISPLAY_MANAGED) {
-                g_debug ("GdmLocalDisplayFactory: login window not in managed state, so ignoring");
+                gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: login window not in managed state, so ignoring");
                 return;
         }
 
@@ -825,11 +834,11 @@ maybe_stop_greeter_in_background (GdmLocalDisplayFactory *factory,
 
         /* we don't ever stop initial-setup implicitly */
         if (doing_initial_setup) {
-                g_debug ("GdmLocalDisplayFactory: login window is performing initial-setup, so ignoring");
+                gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: login window is performing initial-setup, so ignoring");
                 return;
         }
 
-        g_debug ("GdmLocalDisplayFactory: killing login window once its unused");
+        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: killing login window once its unused");
 
         g_object_set (G_OBJECT (display), "status", GDM_DISPLAY_WAITING_TO_FINISH, NULL);
 }
@@ -845,7 +854,7 @@ on_vt_changed (GIOChannel    *source,
         unsigned int previous_vt, new_vt, login_window_vt = 0;
         int n_returned;
 
-        g_debug ("GdmLocalDisplayFactory: received VT change event");
+        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: received VT change event");
         g_io_channel_seek_position (source, 0, G_SEEK_SET, NULL);
 
         if (condition & G_IO_PRI) {
@@ -870,12 +879,12 @@ on_vt_changed (GIOChannel    *source,
         }
 
         if ((condition & G_IO_ERR) || (condition & G_IO_HUP)) {
-                g_debug ("GdmLocalDisplayFactory: kernel hung up active vt watch");
+                gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: kernel hung up active vt watch");
                 return G_SOURCE_REMOVE;
         }
 
         if (tty_of_active_vt == NULL) {
-                g_debug ("GdmLocalDisplayFactory: unable to read active VT from kernel");
+                gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: unable to read active VT from kernel");
                 return G_SOURCE_CONTINUE;
         }
 
@@ -892,7 +901,7 @@ on_vt_changed (GIOChannel    *source,
 
         /* don't do anything if we're on the same VT we were before */
         if (new_vt == factory->active_vt) {
-                g_debug ("GdmLocalDisplayFactory: VT changed to the same VT, ignoring");
+                gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: VT changed to the same VT, ignoring");
                 return G_SOURCE_CONTINUE;
         }
 
@@ -901,13 +910,13 @@ on_vt_changed (GIOChannel    *source,
 
         /* don't do anything at start up */
         if (previous_vt == 0) {
-                g_debug ("GdmLocalDisplayFactory: VT is %u at startup",
-                         factory->active_vt);
+                gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: VT is %u at startup",
+                                            factory->active_vt);
                 return G_SOURCE_CONTINUE;
         }
 
-        g_debug ("GdmLocalDisplayFactory: VT changed from %u to %u",
-                 previous_vt, factory->active_vt);
+        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: VT changed from %u to %u",
+                                    previous_vt, factory->active_vt);
 
         store = gdm_display_factory_get_display_store (GDM_DISPLAY_FACTORY (factory));
 
@@ -916,11 +925,11 @@ on_vt_changed (GIOChannel    *source,
         if (gdm_get_login_window_session_id ("seat0", &login_session_id)) {
                 int ret = sd_session_get_vt (login_session_id, &login_window_vt);
                 if (ret == 0 && login_window_vt != 0) {
-                        g_debug ("GdmLocalDisplayFactory: VT of login window is %u", login_window_vt);
+                        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: VT of login window is %u", login_window_vt);
                         if (login_window_vt == previous_vt) {
                                 GdmDisplay *display;
 
-                                g_debug ("GdmLocalDisplayFactory: VT switched from login window");
+                                gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: VT switched from login window");
 
                                 display = gdm_display_store_find (store,
                                                                   lookup_by_session_id,
@@ -928,7 +937,7 @@ on_vt_changed (GIOChannel    *source,
                                 if (display != NULL)
                                         maybe_stop_greeter_in_background (factory, display);
                         } else {
-                                g_debug ("GdmLocalDisplayFactory: VT not switched from login window");
+                                gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: VT not switched from login window");
                         }
                 }
         }
@@ -951,10 +960,10 @@ on_vt_changed (GIOChannel    *source,
                         g_object_get (display, "session-registered", &registered, NULL);
 
                         if (registered) {
-                                g_debug ("GdmLocalDisplayFactory: switched to registered user session, so reaping login screen in %d seconds",
-                                         WAIT_TO_FINISH_TIMEOUT);
+                                gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: switched to registered user session, so reaping login screen in %d seconds",
+                                                            WAIT_TO_FINISH_TIMEOUT);
                                 if (factory->wait_to_finish_timeout_id != 0) {
-                                         g_debug ("GdmLocalDisplayFactory: deferring previous login screen clean up operation");
+                                         gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: deferring previous login screen clean up operation");
                                          g_source_remove (factory->wait_to_finish_timeout_id);
                                 }
 
@@ -971,11 +980,11 @@ on_vt_changed (GIOChannel    *source,
          * jump to that login screen)
          */
         if (factory->active_vt != GDM_INITIAL_VT) {
-                g_debug ("GdmLocalDisplayFactory: active VT is not initial VT, so ignoring");
+                gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: active VT is not initial VT, so ignoring");
                 return G_SOURCE_CONTINUE;
         }
 
-        g_debug ("GdmLocalDisplayFactory: creating new display on seat0 because of VT change");
+        gdm_debug (DISPLAY_FACTORY, "GdmLocalDisplayFactory: creating new display on seat0 because of VT change");
 
         ensure_display_for_seat (factory, "seat0");
 
@@ -1233,11 +1242,10 @@ handle_create_transient_display (GdmDBusLocalDisplayFactory *skeleton,
         return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
 
-static gboolean
-handle_create_user_display (GdmDBusLocalDisplayFactory *skeleton,
-                            GDBusMethodInvocation      *invocation,
-                            const char                 *user,
-                            GdmLocalDisplayFactory     *factory)
+static void
+create_user_display (GdmLocalDisplayFactory *factory,
+                     GDBusMethodInvocation  *invocation,
+                     const char             *user)
 {
         g_autoptr (GError) error = NULL;
 
@@ -1245,7 +1253,7 @@ handle_create_user_display (GdmDBusLocalDisplayFactory *skeleton,
                                                            user,
                                                            &error)) {
                 g_dbus_method_invocation_return_gerror (invocation, error);
-                return G_DBUS_METHOD_INVOCATION_HANDLED;
+                return;
         }
 
         if (!gdm_local_display_factory_create_display (factory,
@@ -1253,20 +1261,17 @@ handle_create_user_display (GdmDBusLocalDisplayFactory *skeleton,
                                                        NULL,
                                                        &error)) {
                 g_dbus_method_invocation_return_gerror (invocation, error);
-                return G_DBUS_METHOD_INVOCATION_HANDLED;
+                return;
         }
 
-        gdm_dbus_local_display_factory_complete_create_user_display (skeleton,
+        gdm_dbus_local_display_factory_complete_create_user_display (factory->skeleton,
                                                                      invocation);
-
-        return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
 
-static gboolean
-handle_destroy_user_display (GdmDBusLocalDisplayFactory *skeleton,
-                             GDBusMethodInvocation      *invocation,
-                             const char                 *user,
-                             GdmLocalDisplayFactory     *factory)
+static void
+destroy_user_display (GdmLocalDisplayFactory *factory,
+                      GDBusMethodInvocation  *invocation,
+                      const char             *user)
 {
         g_autoptr (GError) error = NULL;
 
@@ -1274,30 +1279,85 @@ handle_destroy_user_display (GdmDBusLocalDisplayFactory *skeleton,
                                                               user,
                                                               &error)) {
                 g_dbus_method_invocation_return_gerror (invocation, error);
-                return G_DBUS_METHOD_INVOCATION_HANDLED;
+                return;
         }
 
-        gdm_dbus_local_display_factory_complete_destroy_user_display (skeleton,
+        gdm_dbus_local_display_factory_complete_destroy_user_display (factory->skeleton,
                                                                       invocation);
+}
 
-        return G_DBUS_METHOD_INVOCATION_HANDLED;
+static void
+on_create_user_display_authorized (GObject      *source,
+                                   GAsyncResult *result,
+                                   gpointer      user_data)
+{
+        GDBusMethodInvocation *invocation = user_data;
+        g_autoptr (GError) error = NULL;
+        const char *user;
+
+        if (!gdm_display_factory_authorize_manage_user_displays_finish (GDM_DISPLAY_FACTORY (source),
+                                                                        result,
+                                                                        &error)) {
+                g_dbus_method_invocation_return_gerror (invocation, error);
+                return;
+        }
+
+        g_variant_get (g_dbus_method_invocation_get_parameters (invocation), "(&s)", &user);
+
+        create_user_display (GDM_LOCAL_DISPLAY_FACTORY (source), invocation, user);
 }
 
 static gboolean
-on_authorize_method (GdmDBusLocalDisplayFactory *skeleton,
-                     GDBusMethodInvocation      *invocation,
-                     GdmLocalDisplayFactory     *factory)
+handle_create_user_display (GdmDBusLocalDisplayFactory *skeleton,
+                            GDBusMethodInvocation      *invocation,
+                            const char                 *user,
+                            GdmLocalDisplayFactory     *factory)
 {
+        /* Completed once polkit has answered, which may involve the
+         * user typing a password, so don't hold up everything else */
+        gdm_display_factory_authorize_manage_user_displays (GDM_DISPLAY_FACTORY (factory),
+                                                            invocation,
+                                                            NULL,
+                                                            on_create_user_display_authorized,
+                                                            invocation);
+
+        return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
+
+static void
+on_destroy_user_display_authorized (GObject      *source,
+                                    GAsyncResult *result,
+                                    gpointer      user_data)
+{
+        GDBusMethodInvocation *invocation = user_data;
         g_autoptr (GError) error = NULL;
+        const char *user;
 
-        if (!gdm_display_factory_authorize_manage_user_displays (GDM_DISPLAY_FACTORY (factory),
-                                                                 invocation,
-                                                                 &error)) {
+        if (!gdm_display_factory_authorize_manage_user_displays_finish (GDM_DISPLAY_FACTORY (source),
+                                                                        result,
+                                                                        &error)) {
                 g_dbus_method_invocation_return_gerror (invocation, error);
-                return FALSE;
+                return;
         }
 
-        return TRUE;
+        g_variant_get (g_dbus_method_invocation_get_parameters (invocation), "(&s)", &user);
+
+        destroy_user_display (GDM_LOCAL_DISPLAY_FACTORY (source), invocation, user);
+}
+
+static gboolean
+handle_destroy_user_display (GdmDBusLocalDisplayFactory *skeleton,
+                             GDBusMethodInvocation      *invocation,
+                             const char                 *user,
+                             GdmLocalDisplayFactory     *factory)
+{
+        gdm_display_factory_authorize_manage_user_displays (GDM_DISPLAY_FACTORY (factory),
+                                                            invocation,
+                                                            NULL,
+                                                            on_destroy_user_display_authorized,
+                                                            invocation);
+
+        return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
 
 static gboolean
@@ -1330,10 +1390,6 @@ register_factory (GdmLocalDisplayFactory *factory)
                           G_CALLBACK (handle_destroy_user_display),
                           factory);
 
-        g_signal_connect (factory->skeleton, "g-authorize-method",
-                          G_CALLBACK (on_authorize_method),
-                          factory);
-
         if (!g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (factory->skeleton),
                                                factory->connection,
                                                GDM_LOCAL_DISPLAY_FACTORY_DBUS_PATH,
@@ -41,6 +41,7 @@
 #include "gdm-launch-environment.h"
 #include "gdm-local-display.h"
 #include "gdm-local-display-glue.h"
+#include "gdm-log.h"
 #include "gdm-settings-direct.h"
 #include "gdm-settings-keys.h"
 
@@ -105,7 +106,7 @@ gdm_local_display_prepare (GdmDisplay *display)
                 goto out;
         }
 
-        g_debug ("doing initial setup? %s", doing_initial_setup? "yes" : "no");
+        gdm_debug (DISPLAY_FACTORY, "doing initial setup? %s", doing_initial_setup? "yes" : "no");
 
         if (!doing_initial_setup) {
                 launch_environment = gdm_create_greeter_launch_environment (seat_id,
@@ -0,0 +1,259 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include "gdm-login-trace.h"
+
+typedef struct
+{
+        char   *name;
+        gint64  offset;
+} Phase;
+
+struct _GdmLoginTrace
+{
+        GObject  parent;
+
+        char    *id;
+        gint64   start_time;
+        GArray  *phases;
+
+        gboolean finished;
+};
+
+enum {
+        CHANGED,
+        NUMBER_OF_SIGNALS
+};
+
+static guint signals[NUMBER_OF_SIGNALS] = { 0, };
+
+G_DEFINE_TYPE (GdmLoginTrace, gdm_login_trace, G_TYPE_OBJECT)
+
+static void
+clear_phase (Phase *phase)
+{
+        g_free (phase->name);
+}
+
+GdmLoginTrace *
+gdm_login_trace_new (void)
+{
+        return g_object_new (GDM_TYPE_LOGIN_TRACE, NULL);
+}
+
+const char *
+gdm_login_trace_get_id (GdmLoginTrace *trace)
+{
+        g_return_val_if_fail (GDM_IS_LOGIN_TRACE (trace), NULL);
+
+        return trace->id;
+}
+
+gboolean
+gdm_login_trace_is_finished (GdmLoginTrace *trace)
+{
+        g_return_val_if_fail (GDM_IS_LOGIN_TRACE (trace), TRUE);
+
+        return trace->finished;
+}
+
+/**
+ * gdm_login_trace_mark:
+ *
+ * Records that the login reached @phase, timed from when the trace was
+ * created. A phase may be recorded more than once, for instance when
+ * the user mistypes their password and authentication starts over.
+ */
+void
+gdm_login_trace_mark (GdmLoginTrace *trace,
+                      const char    *phase)
+{
+        Phase entry;
+
+        g_return_if_fail (GDM_IS_LOGIN_TRACE (trace));
+        g_return_if_fail (phase != NULL);
+
+        if (trace->finished)
+                return;
+
+        entry.name = g_strdup (phase);
+        entry.offset = g_get_monotonic_time () - trace->start_time;
+        g_array_append_val (trace->phases, entry);
+
+        g_debug ("GdmLoginTrace: login %s reached %s after %.3f s",
+                 trace->id, phase, entry.offset / (double) G_USEC_PER_SEC);
+
+        g_signal_emit (trace, signals[CHANGED], 0);
+}
+
+/* GDM_LOGIN_PHASE_SESSION_OPENED_USEC for "session-opened" */
+static char *
+phase_field_name (const char *phase)
+{
+        GString *name;
+        const char *p;
+
+        name = g_string_new ("GDM_LOGIN_PHASE_");
+        for (p = phase; *p != '\0'; p++) {
+                if (g_ascii_isalnum (*p))
+                        g_string_append_c (name, g_ascii_toupper (*p));
+                else
+                        g_string_append_c (name, '_');
+        }
+        g_string_append (name, "_USEC");
+
+        return g_string_free (name, FALSE);
+}
+
+/**
+ * gdm_login_trace_finish:
+ *
+ * Writes the timeline to the journal, one GDM_LOGIN_PHASE_*_USEC field
+ * per phase, and stops recording.
+ */
+void
+gdm_login_trace_finish (GdmLoginTrace *trace,
+                        const char    *display_id)
+{
+        g_autoptr (GPtrArray) strings = NULL;
+        g_autoptr (GArray) fields = NULL;
+        GLogField field;
+        gint64 total;
+        guint i;
+
+        g_return_if_fail (GDM_IS_LOGIN_TRACE (trace));
+
+        if (trace->finished)
+                return;
+
+        trace->finished = TRUE;
+
+        total = 0;
+        if (trace->phases->len > 0)
+                total = g_array_index (trace->phases, Phase, trace->phases->len - 1).offset;
+
+        strings = g_ptr_array_new_with_free_func (g_free);
+        fields = g_array_sized_new (FALSE, FALSE, sizeof (GLogField), 4 + 2 * trace->phases->len);
+
+        g_ptr_array_add (strings, g_strdup_printf ("Login %s on display %s took %.3f s",
+                                                   trace->id,
+                                                   display_id != NULL ? display_id : "(none)",
+                                                   total / (double) G_USEC_PER_SEC));
+        field.key = "MESSAGE";
+        field.value = g_ptr_array_index (strings, strings->len - 1);
+        field.length = -1;
+        g_array_append_val (fields, field);
+
+        field.key = "GDM_LOGIN_TRACE_ID";
+        field.value = trace->id;
+        g_array_append_val (fields, field);
+
+        if (display_id != NULL) {
+                field.key = "GDM_DISPLAY_ID";
+                field.value = display_id;
+                g_array_append_val (fields, field);
+        }
+
+        g_ptr_array_add (strings, g_strdup_printf ("%" G_GINT64_FORMAT, total));
+        field.key = "GDM_LOGIN_TOTAL_USEC";
+        field.value = g_ptr_array_index (strings, strings->len - 1);
+        g_array_append_val (fields, field);
+
+        for (i = 0; i < trace->phases->len; i++) {
+                Phase *phase = &g_array_index (trace->phases, Phase, i);
+
+                g_ptr_array_add (strings, phase_field_name (phase->name));
+                field.key = g_ptr_array_index (strings, strings->len - 1);
+                g_ptr_array_add (strings, g_strdup_printf ("%" G_GINT64_FORMAT, phase->offset));
+                field.value = g_ptr_array_index (strings, strings->len - 1);
+                g_array_append_val (fields, field);
+        }
+
+        g_log_structured_array (G_LOG_LEVEL_MESSAGE,
+                                (GLogField *) fields->data,
+                                fields->len);
+}
+
+/**
+ * gdm_login_trace_to_variant:
+ *
+ * Returns: (transfer floating): the timeline as a(st), phase names
+ *   with their offset from the start of the trace in microseconds
+ */
+GVariant *
+gdm_login_trace_to_variant (GdmLoginTrace *trace)
+{
+        GVariantBuilder builder;
+        guint i;
+
+        g_return_val_if_fail (GDM_IS_LOGIN_TRACE (trace), NULL);
+
+        g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(st)"));
+        for (i = 0; i < trace->phases->len; i++) {
+                Phase *phase = &g_array_index (trace->phases, Phase, i);
+
+                g_variant_builder_add (&builder, "(st)", phase->name, (guint64) phase->offset);
+        }
+
+        return g_variant_builder_end (&builder);
+}
+
+static void
+gdm_login_trace_finalize (GObject *object)
+{
+        GdmLoginTrace *trace = GDM_LOGIN_TRACE (object);
+
+        g_free (trace->id);
+        g_array_unref (trace->phases);
+
+        G_OBJECT_CLASS (gdm_login_trace_parent_class)->finalize (object);
+}
+
+static void
+gdm_login_trace_class_init (GdmLoginTraceClass *klass)
+{
+        GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+        object_class->finalize = gdm_login_trace_finalize;
+
+        signals [CHANGED] =
+                g_signal_new ("changed",
+                              G_TYPE_FROM_CLASS (object_class),
+                              G_SIGNAL_RUN_LAST,
+                              0,
+                              NULL,
+                              NULL,
+                              g_cclosure_marshal_VOID__VOID,
+                              G_TYPE_NONE,
+                              0);
+}
+
+static void
+gdm_login_trace_init (GdmLoginTrace *trace)
+{
+        trace->id = g_uuid_string_random ();
+        trace->start_time = g_get_monotonic_time ();
+        trace->phases = g_array_new (FALSE, FALSE, sizeof (Phase));
+        g_array_set_clear_func (trace->phases, (GDestroyNotify) clear_phase);
+}
@@ -0,0 +1,42 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/* Name of the environment variable the trace id is passed down in */
+#define GDM_LOGIN_TRACE_ID_ENV "GDM_LOGIN_TRACE_ID"
+
+#define GDM_TYPE_LOGIN_TRACE (gdm_login_trace_get_type ())
+G_DECLARE_FINAL_TYPE (GdmLoginTrace, gdm_login_trace, GDM, LOGIN_TRACE, GObject)
+
+GdmLoginTrace *gdm_login_trace_new         (void);
+
+const char    *gdm_login_trace_get_id      (GdmLoginTrace *trace);
+gboolean       gdm_login_trace_is_finished (GdmLoginTrace *trace);
+
+void           gdm_login_trace_mark        (GdmLoginTrace *trace,
+                                            const char    *phase);
+void           gdm_login_trace_finish      (GdmLoginTrace *trace,
+                                            const char    *display_id);
+
+GVariant      *gdm_login_trace_to_variant  (GdmLoginTrace *trace);
+
+G_END_DECLS
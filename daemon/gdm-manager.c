@@ -38,6 +38,7 @@
 
 #include <systemd/sd-login.h>
 
+#include "gdm-child-watch.h"
 #include "gdm-common.h"
 #include "gdm-file-utils.h"
 
@@ -48,14 +49,17 @@
 #include "gdm-display-factory.h"
 #include "gdm-dynamic-user-store.h"
 #include "gdm-launch-environment.h"
+#include "gdm-log.h"
 #include "gdm-local-display.h"
 #include "gdm-local-display-factory.h"
+#include "gdm-login-trace.h"
 #include "gdm-remote-display.h"
 #include "gdm-remote-display-factory.h"
 #include "gdm-session.h"
 #include "gdm-session-record.h"
 #include "gdm-settings-direct.h"
 #include "gdm-settings-keys.h"
+#include "gdm-spawn.h"
 
 #define GDM_DBUS_PATH             "/org/gnome/DisplayManager"
 #define GDM_MANAGER_PATH          GDM_DBUS_PATH "/Manager"
@@ -132,18 +136,63 @@ G_DEFINE_TYPE_WITH_CODE (GdmManager,
                                                 manager_interface_init));
 
 #ifdef WITH_PLYMOUTH
+/* Plymouth answers right away, but a wedged one mustn't hold up the
+ * daemon forever */
+#define PLYMOUTH_TIMEOUT 5
+
+static void
+on_plymouth_exited (GPid                 pid,
+                    int                  status,
+                    const struct rusage *rusage,
+                    gpointer             user_data)
+{
+        /* Reaped and logged by the child watch, nothing else to do */
+}
+
+/* With @status NULL, doesn't wait for plymouth to finish */
+static gboolean
+run_plymouth (const char * const  *argv,
+              int                 *status,
+              GError             **error)
+{
+        GPid pid;
+        int child_status;
+
+        if (!gdm_spawn ("plymouth", argv, NULL, -1, -1, -1,
+                        GDM_SPAWN_SEARCH_PATH, NULL, NULL,
+                        &pid, error))
+                return FALSE;
+
+        if (status == NULL) {
+                gdm_child_watch_add (pid, on_plymouth_exited, NULL);
+                return TRUE;
+        }
+
+        if (!gdm_child_wait_all (&pid, &child_status, 1, PLYMOUTH_TIMEOUT)) {
+                /* Still ours to reap whenever it does exit */
+                gdm_child_watch_add (pid, on_plymouth_exited, NULL);
+                g_set_error (error, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED,
+                             "plymouth didn't exit within %d seconds", PLYMOUTH_TIMEOUT);
+                return FALSE;
+        }
+
+        *status = child_status;
+
+        return TRUE;
+}
+
 static gboolean
 plymouth_is_running (void)
 {
+        const char *argv[] = { "plymouth", "--ping", NULL };
         int      status;
         gboolean res;
         GError  *error;
 
         error = NULL;
-        res = g_spawn_command_line_sync ("plymouth --ping",
-                                         NULL, NULL, &status, &error);
+        res = run_plymouth (argv, &status, &error);
         if (! res) {
-                g_debug ("Could not ping plymouth: %s", error->message);
+                gdm_debug (MANAGER, "Could not ping plymouth: %s", error->message);
                 g_error_free (error);
                 return FALSE;
         }
@@ -154,12 +203,13 @@ plymouth_is_running (void)
 static void
 plymouth_prepare_for_transition (void)
 {
+        const char *argv[] = { "plymouth", "deactivate", NULL };
+        int      status;
         gboolean res;
         GError  *error;
 
         error = NULL;
-        res = g_spawn_command_line_sync ("plymouth deactivate",
-                                         NULL, NULL, NULL, &error);
+        res = run_plymouth (argv, &status, &error);
         if (! res) {
                 g_warning ("Could not deactivate plymouth: %s", error->message);
                 g_error_free (error);
@@ -169,11 +219,12 @@ plymouth_prepare_for_transition (void)
 static void
 plymouth_quit_with_transition (void)
 {
+        const char *argv[] = { "plymouth", "quit", "--retain-splash", NULL };
         gboolean res;
         GError  *error;
 
         error = NULL;
-        res = g_spawn_command_line_async ("plymouth quit --retain-splash", &error);
+        res = run_plymouth (argv, NULL, &error);
         if (! res) {
                 g_warning ("Could not quit plymouth: %s", error->message);
                 g_error_free (error);
@@ -183,11 +234,12 @@ plymouth_quit_with_transition (void)
 static void
 plymouth_quit_without_transition (void)
 {
+        const char *argv[] = { "plymouth", "quit", NULL };
         gboolean res;
         GError  *error;
 
         error = NULL;
-        res = g_spawn_command_line_async ("plymouth quit", &error);
+        res = run_plymouth (argv, NULL, &error);
         if (! res) {
                 g_warning ("Could not quit plymouth: %s", error->message);
                 g_error_free (error);
@@ -305,7 +357,7 @@ session_unlock (GdmManager *manager,
         GError *error = NULL;
         GVariant *reply;
 
-        g_debug ("Unlocking session %s", ssid);
+        gdm_debug (MANAGER, "Unlocking session %s", ssid);
 
         reply = g_dbus_connection_call_sync (manager->connection,
                                              "org.freedesktop.login1",
@@ -319,8 +371,8 @@ session_unlock (GdmManager *manager,
                                              NULL,
                                              &error);
         if (reply == NULL) {
-                g_debug ("GdmManager: logind 'UnlockSession' %s raised:\n %s\n\n",
-                         g_dbus_error_get_remote_error (error), error->message);
+                gdm_debug (MANAGER, "GdmManager: logind 'UnlockSession' %s raised:\n %s\n\n",
+                                    g_dbus_error_get_remote_error (error), error->message);
                 g_error_free (error);
                 return FALSE;
         }
@@ -344,34 +396,34 @@ find_session_for_user (GdmManager *manager,
                 candidate_session_id = gdm_session_get_session_id (candidate_session);
 
                 if (candidate_session == dont_count_session) {
-                        g_debug ("GdmSession: Ignoring session %s as requested",
-                                 candidate_session_id);
+                        gdm_debug (MANAGER, "GdmSession: Ignoring session %s as requested",
+                                            candidate_session_id);
                         continue;
                 }
 
                 if (!gdm_session_is_running (candidate_session)) {
-                        g_debug ("GdmSession: Ignoring session %s as it isn't running",
-                                 candidate_session_id);
+                        gdm_debug (MANAGER, "GdmSession: Ignoring session %s as it isn't running",
+                                            candidate_session_id);
                         continue;
                 }
 
                 candidate_username = gdm_session_get_username (candidate_session);
                 candidate_seat_id = gdm_session_get_display_seat_id (candidate_session);
 
-                g_debug ("GdmManager: Considering session %s on seat %s belonging to user %s",
-                         candidate_session_id,
-                         candidate_seat_id,
-                         candidate_username);
+                gdm_debug (MANAGER, "GdmManager: Considering session %s on seat %s belonging to user %s",
+                                    candidate_session_id,
+                                    candidate_seat_id,
+                                    candidate_username);
 
                 if (g_strcmp0 (candidate_username, username) == 0) {
-                        g_debug ("GdmManager: yes, found session %s", candidate_session_id);
+                        gdm_debug (MANAGER, "GdmManager: yes, found session %s", candidate_session_id);
                         return candidate_session;
                 }
 
-                g_debug ("GdmManager: no, will not use session %s", candidate_session_id);
+                gdm_debug (MANAGER, "GdmManager: no, will not use session %s", candidate_session_id);
         }
 
-        g_debug ("GdmManager: no matching sessions found");
+        gdm_debug (MANAGER, "GdmManager: no matching sessions found");
         return NULL;
 }
 
@@ -473,8 +525,8 @@ get_display_and_details_for_bus_sender (GdmManager       *self,
         ret = gdm_dbus_get_pid_for_name (sender, &pid, &error);
 
         if (!ret) {
-                g_debug ("GdmManager: Error while retrieving pid for sender: %s",
-                         error->message);
+                gdm_debug (MANAGER, "GdmManager: Error while retrieving pid for sender: %s",
+                                    error->message);
                 g_error_free (error);
                 goto out;
         }
@@ -486,8 +538,8 @@ get_display_and_details_for_bus_sender (GdmManager       *self,
         ret = gdm_dbus_get_uid_for_name (sender, &caller_uid, &error);
 
         if (!ret) {
-                g_debug ("GdmManager: Error while retrieving uid for sender: %s",
-                         error->message);
+                gdm_debug (MANAGER, "GdmManager: Error while retrieving uid for sender: %s",
+                                    error->message);
                 g_error_free (error);
                 goto out;
         }
@@ -495,9 +547,9 @@ get_display_and_details_for_bus_sender (GdmManager       *self,
         ret = gdm_find_display_session (pid, caller_uid, &session_id, &error);
 
         if (!ret) {
-                g_debug ("GdmManager: Unable to find display session for uid %d: %s",
-                         (int) caller_uid,
-                         error->message);
+                gdm_debug (MANAGER, "GdmManager: Unable to find display session for uid %d: %s",
+                                    (int) caller_uid,
+                                    error->message);
                 g_error_free (error);
                 goto out;
         }
@@ -510,16 +562,16 @@ get_display_and_details_for_bus_sender (GdmManager       *self,
                 *out_is_login_screen = is_login_session (self, session_id, &error);
 
                 if (error != NULL) {
-                        g_debug ("GdmManager: Error while checking if sender is login screen: %s",
-                                 error->message);
+                        gdm_debug (MANAGER, "GdmManager: Error while checking if sender is login screen: %s",
+                                            error->message);
                         g_error_free (error);
                         goto out;
                 }
         }
 
         if (!get_uid_for_session_id (session_id, &session_uid, &error)) {
-                g_debug ("GdmManager: Error while retrieving uid for session: %s",
-                         error->message);
+                gdm_debug (MANAGER, "GdmManager: Error while retrieving uid for session: %s",
+                                    error->message);
                 g_error_free (error);
                 goto out;
         }
@@ -529,7 +581,7 @@ get_display_and_details_for_bus_sender (GdmManager       *self,
         }
 
         if (caller_uid != session_uid) {
-                g_debug ("GdmManager: uid for sender and uid for session don't match");
+                gdm_debug (MANAGER, "GdmManager: uid for sender and uid for session don't match");
                 goto out;
         }
 
@@ -537,8 +589,8 @@ get_display_and_details_for_bus_sender (GdmManager       *self,
                 *out_seat_id = get_seat_id_for_session_id (session_id, &error);
 
                 if (error != NULL) {
-                        g_debug ("GdmManager: Error while retrieving seat id for session: %s",
-                                 error->message);
+                        gdm_debug (MANAGER, "GdmManager: Error while retrieving seat id for session: %s",
+                                            error->message);
                         g_clear_error (&error);
                 }
         }
@@ -547,8 +599,8 @@ get_display_and_details_for_bus_sender (GdmManager       *self,
                 *out_is_remote = is_remote_session (self, session_id, &error);
 
                 if (error != NULL) {
-                        g_debug ("GdmManager: Error while retrieving remoteness for session %s: %s",
-                                 session_id, error->message);
+                        gdm_debug (MANAGER, "GdmManager: Error while retrieving remoteness for session %s: %s",
+                                            session_id, error->message);
                         g_clear_error (&error);
                 }
         }
@@ -557,8 +609,8 @@ get_display_and_details_for_bus_sender (GdmManager       *self,
                 *out_tty = get_tty_for_session_id (session_id, &error);
 
                 if (error != NULL) {
-                        g_debug ("GdmManager: Error while retrieving tty for session: %s",
-                                 error->message);
+                        gdm_debug (MANAGER, "GdmManager: Error while retrieving tty for session: %s",
+                                            error->message);
                         g_clear_error (&error);
                 }
         }
@@ -603,7 +655,7 @@ switch_to_compatible_user_session (GdmManager *manager,
                 if (seat_id != NULL) {
                         res = gdm_activate_session_by_id (manager->connection, NULL, seat_id, ssid_to_activate);
                         if (! res) {
-                                g_debug ("GdmManager: unable to activate session: %s", ssid_to_activate);
+                                gdm_debug (MANAGER, "GdmManager: unable to activate session: %s", ssid_to_activate);
                                 goto out;
                         }
                 }
@@ -611,7 +663,7 @@ switch_to_compatible_user_session (GdmManager *manager,
                 res = session_unlock (manager, ssid_to_activate);
                 if (!res) {
                         /* this isn't fatal */
-                        g_debug ("GdmManager: unable to unlock session: %s", ssid_to_activate);
+                        gdm_debug (MANAGER, "GdmManager: unable to unlock session: %s", ssid_to_activate);
                 }
         } else {
                 goto out;
@@ -703,13 +755,14 @@ gdm_manager_handle_register_session (GdmDBusManager        *manager,
         GDBusConnection *connection;
         GdmDisplay      *display = NULL;
         GdmSession      *session;
+        GdmLoginTrace   *login_trace;
         g_autofree char *tty = NULL;
 
         sender = g_dbus_method_invocation_get_sender (invocation);
         connection = g_dbus_method_invocation_get_connection (invocation);
         get_display_and_details_for_bus_sender (self, connection, sender, &display, NULL, NULL, &tty, NULL, NULL, NULL, NULL);
 
-        g_debug ("GdmManager: trying to register new session on display %p", display);
+        gdm_debug (MANAGER, "GdmManager: trying to register new session on display %p", display);
 
         if (display == NULL) {
                 g_dbus_method_invocation_return_error_literal (invocation,
@@ -731,6 +784,18 @@ gdm_manager_handle_register_session (GdmDBusManager        *manager,
                 gdm_session_record (GDM_SESSION_RECORD_LOGIN, session, -1);
         }
 
+        /* The greeter registers too, but the login only completes once
+         * the user session does */
+        login_trace = gdm_display_get_login_trace (display);
+        if (session != NULL &&
+            login_trace != NULL && !gdm_login_trace_is_finished (login_trace)) {
+                g_autofree char *display_id = NULL;
+
+                gdm_display_get_id (display, &display_id, NULL);
+                gdm_login_trace_mark (login_trace, "session-registered");
+                gdm_login_trace_finish (login_trace, display_id);
+        }
+
         g_object_set (G_OBJECT (display),
                       "session-registered", TRUE,
                       NULL);
@@ -772,7 +837,7 @@ gdm_manager_handle_open_session (GdmDBusManager        *manager,
         uid_t             uid = (uid_t) -1;
         uid_t             allowed_user;
 
-        g_debug ("GdmManager: trying to open new session");
+        gdm_debug (MANAGER, "GdmManager: trying to open new session");
 
         sender = g_dbus_method_invocation_get_sender (invocation);
         connection = g_dbus_method_invocation_get_connection (invocation);
@@ -789,12 +854,12 @@ gdm_manager_handle_open_session (GdmDBusManager        *manager,
 
         if (session == NULL) {
                 session = get_user_session_for_display (display);
-                g_debug ("GdmSession: Considering session %s for username %s",
-                         gdm_session_get_session_id (session),
-                         gdm_session_get_username (session));
+                gdm_debug (MANAGER, "GdmSession: Considering session %s for username %s",
+                                    gdm_session_get_session_id (session),
+                                    gdm_session_get_username (session));
 
                 if (gdm_session_is_running (session)) {
-                        g_debug ("GdmSession: the session is running, and therefore can't be used");
+                        gdm_debug (MANAGER, "GdmSession: the session is running, and therefore can't be used");
                         g_dbus_method_invocation_return_error_literal (invocation,
                                                                        G_DBUS_ERROR,
                                                                        G_DBUS_ERROR_ACCESS_DENIED,
@@ -806,7 +871,7 @@ gdm_manager_handle_open_session (GdmDBusManager        *manager,
         allowed_user = gdm_session_get_allowed_user (session);
 
         if (uid != allowed_user) {
-                g_debug("GdmSession: Denying access to %d, only %d is allowed", uid, allowed_user);
+                gdm_debug (MANAGER, "GdmSession: Denying access to %d, only %d is allowed", uid, allowed_user);
                 g_dbus_method_invocation_return_error_literal (invocation,
                                                                G_DBUS_ERROR,
                                                                G_DBUS_ERROR_ACCESS_DENIED,
@@ -847,7 +912,7 @@ on_reauthentication_client_connected (GdmSession              *session,
                                       GPid                     pid_of_client,
                                       GdmManager              *self)
 {
-        g_debug ("GdmManager: client connected to reauthentication server");
+        gdm_debug (MANAGER, "GdmManager: client connected to reauthentication server");
 }
 
 static void
@@ -856,7 +921,7 @@ on_reauthentication_client_disconnected (GdmSession              *session,
                                          GPid                     pid_of_client,
                                          GdmManager              *self)
 {
-        g_debug ("GdmManger: client disconnected from reauthentication server");
+        gdm_debug (MANAGER, "GdmManger: client disconnected from reauthentication server");
         close_transient_session (self, session);
 }
 
@@ -868,7 +933,7 @@ on_reauthentication_client_rejected (GdmSession              *session,
 {
         GPid pid;
 
-        g_debug ("GdmManger: client with pid %ld rejected from reauthentication server", (long) pid_of_client);
+        gdm_debug (MANAGER, "GdmManger: client with pid %ld rejected from reauthentication server", (long) pid_of_client);
 
         if (gdm_session_client_is_connected (session)) {
                 /* we already have a client connected, ignore this rejected one */
@@ -904,7 +969,7 @@ static void
 on_reauthentication_cancelled (GdmSession *session,
                                GdmManager *self)
 {
-        g_debug ("GdmManager: client cancelled reauthentication request");
+        gdm_debug (MANAGER, "GdmManager: client cancelled reauthentication request");
         close_transient_session (self, session);
 }
 
@@ -913,8 +978,8 @@ on_reauthentication_conversation_started (GdmSession *session,
                                           const char *service_name,
                                           GdmManager *self)
 {
-        g_debug ("GdmManager: reauthentication service '%s' started",
-                 service_name);
+        gdm_debug (MANAGER, "GdmManager: reauthentication service '%s' started",
+                            service_name);
 }
 
 static void
@@ -922,8 +987,8 @@ on_reauthentication_conversation_stopped (GdmSession *session,
                                           const char *service_name,
                                           GdmManager *self)
 {
-        g_debug ("GdmManager: reauthentication service '%s' stopped",
-                 service_name);
+        gdm_debug (MANAGER, "GdmManager: reauthentication service '%s' stopped",
+                            service_name);
 }
 
 static void
@@ -938,13 +1003,13 @@ on_reauthentication_verification_complete (GdmSession *session,
         caller_session_id = g_object_get_data (G_OBJECT (session), "caller-session-id");
 
         if (user_session != NULL) {
-                g_debug ("GdmManager: reauthenticated user in frozen session '%s' with service '%s'",
-                         gdm_session_get_session_id (user_session), service_name);
+                gdm_debug (MANAGER, "GdmManager: reauthenticated user in frozen session '%s' with service '%s'",
+                                    gdm_session_get_session_id (user_session), service_name);
 
                 switch_to_compatible_user_session (self, user_session, FALSE);
         } else if (caller_session_id != NULL) {
-                g_debug ("GdmManager: reauthenticated user in unmanaged session '%s' with service '%s'",
-                         caller_session_id, service_name);
+                gdm_debug (MANAGER, "GdmManager: reauthenticated user in unmanaged session '%s' with service '%s'",
+                                    caller_session_id, service_name);
 
                 session_unlock (self, caller_session_id);
         }
@@ -986,9 +1051,9 @@ open_temporary_reauthentication_channel (GdmManager            *self,
                                    environment);
         g_strfreev (environment);
 
-        g_debug ("GdmSession: Created session for temporary reauthentication channel for user %d (seat %s)",
-                 (int) uid,
-                 seat_id);
+        gdm_debug (MANAGER, "GdmSession: Created session for temporary reauthentication channel for user %d (seat %s)",
+                            (int) uid,
+                            seat_id);
 
         g_object_set_data_full (G_OBJECT (session),
                                 "caller-session-id",
@@ -1083,7 +1148,7 @@ gdm_manager_handle_open_reauthentication_channel (GdmDBusManager        *manager
         gboolean          is_remote = FALSE;
         g_autofree char  *address = NULL;
 
-        g_debug ("GdmManager: trying to open reauthentication channel for user %s", username);
+        gdm_debug (MANAGER, "GdmManager: trying to open reauthentication channel for user %s", username);
 
         sender = g_dbus_method_invocation_get_sender (invocation);
         connection = g_dbus_method_invocation_get_connection (invocation);
@@ -1099,14 +1164,14 @@ gdm_manager_handle_open_reauthentication_channel (GdmDBusManager        *manager
         }
 
         if (is_login_screen) {
-                g_debug ("GdmManager: looking for login screen session for user %s", username);
+                gdm_debug (MANAGER, "GdmManager: looking for login screen session for user %s", username);
                 session = find_session_for_user (self,
                                                  username,
                                                  NULL);
                 login_session = get_user_session_for_display (display);
                 g_object_set_data (G_OBJECT (display), "reauth-pid-of-caller", GINT_TO_POINTER (pid));
         } else {
-                g_debug ("GdmManager: looking for user session on display");
+                gdm_debug (MANAGER, "GdmManager: looking for user session on display");
                 session = get_user_session_for_display (display);
         }
 
@@ -1125,7 +1190,7 @@ gdm_manager_handle_open_reauthentication_channel (GdmDBusManager        *manager
                                              invocation);
                         return TRUE;
                 } else {
-                        g_debug("GdmManager: user session is frozen; using temporary reauthentication channel");
+                        gdm_debug (MANAGER, "GdmManager: user session is frozen; using temporary reauthentication channel");
                 }
         } else if (is_login_screen) {
                 g_dbus_method_invocation_return_error_literal (invocation,
@@ -1148,6 +1213,102 @@ gdm_manager_handle_open_reauthentication_channel (GdmDBusManager        *manager
         return TRUE;
 }
 
+static void
+set_debug_categories_for_session (GHashTable *sessions,
+                                  GdmSession *session,
+                                  const char * const *names)
+{
+        if (session == NULL || !g_hash_table_add (sessions, session))
+                return;
+
+        gdm_session_set_debug_categories (session, names);
+}
+
+typedef struct
+{
+        GHashTable         *sessions;
+        const char * const *names;
+} SetDebugCategoriesData;
+
+static gboolean
+set_debug_categories_for_display (const char *id,
+                                  GdmDisplay *display,
+                                  gpointer    user_data)
+{
+        SetDebugCategoriesData *data = user_data;
+        g_autoptr (GdmLaunchEnvironment) launch_environment = NULL;
+
+        g_object_get (G_OBJECT (display), "launch-environment", &launch_environment, NULL);
+        if (launch_environment != NULL)
+                set_debug_categories_for_session (data->sessions,
+                                                  gdm_launch_environment_get_session (launch_environment),
+                                                  data->names);
+
+        set_debug_categories_for_session (data->sessions,
+                                          g_object_get_data (G_OBJECT (display), "gdm-user-session"),
+                                          data->names);
+
+        return TRUE;
+}
+
+static gboolean
+gdm_manager_handle_set_debug_categories (GdmDBusManager        *manager,
+                                         GDBusMethodInvocation *invocation,
+                                         const char * const    *names)
+{
+        GdmManager      *self = GDM_MANAGER (manager);
+        GError          *error = NULL;
+        const char      *sender;
+        uid_t            caller_uid;
+        guint            categories;
+        g_auto (GStrv)   enabled = NULL;
+        g_autoptr (GHashTable) sessions = NULL;
+        SetDebugCategoriesData data;
+        GList           *node;
+
+        sender = g_dbus_method_invocation_get_sender (invocation);
+
+        if (!gdm_dbus_get_uid_for_name (sender, &caller_uid, &error)) {
+                g_dbus_method_invocation_take_error (invocation, error);
+                return G_DBUS_METHOD_INVOCATION_HANDLED;
+        }
+
+        if (caller_uid != 0) {
+                g_dbus_method_invocation_return_error_literal (invocation,
+                                                               G_DBUS_ERROR,
+                                                               G_DBUS_ERROR_ACCESS_DENIED,
+                                                               _("Only root can change debug categories"));
+                return G_DBUS_METHOD_INVOCATION_HANDLED;
+        }
+
+        if (!gdm_log_parse_debug_categories (names, &categories, &error)) {
+                g_dbus_method_invocation_take_error (invocation, error);
+                return G_DBUS_METHOD_INVOCATION_HANDLED;
+        }
+
+        /* Updates the DebugCategories property through
+         * on_debug_categories_changed() */
+        gdm_log_set_debug_categories (categories);
+
+        enabled = gdm_log_get_debug_category_names (categories);
+
+        /* Workers spawned from now on get them from their environment,
+         * the running ones have to be told */
+        sessions = g_hash_table_new (NULL, NULL);
+        data.sessions = sessions;
+        data.names = (const char * const *) enabled;
+        gdm_display_store_foreach (self->display_store,
+                                   set_debug_categories_for_display,
+                                   &data);
+
+        for (node = self->user_sessions; node != NULL; node = node->next)
+                set_debug_categories_for_session (sessions, node->data, data.names);
+
+        gdm_dbus_manager_complete_set_debug_categories (manager, invocation);
+
+        return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
+
 static void
 manager_interface_init (GdmDBusManagerIface *interface)
 {
@@ -1155,6 +1316,7 @@ manager_interface_init (GdmDBusManagerIface *interface)
         interface->handle_register_session = gdm_manager_handle_register_session;
         interface->handle_open_session = gdm_manager_handle_open_session;
         interface->handle_open_reauthentication_channel = gdm_manager_handle_open_reauthentication_channel;
+        interface->handle_set_debug_categories = gdm_manager_handle_set_debug_categories;
 }
 
 static gboolean
@@ -1210,12 +1372,12 @@ get_timed_login_details (GdmManager *manager,
 
  out:
         if (enabled) {
-                g_debug ("GdmDisplay: Got timed login details for display: %d %s %d",
-                         enabled,
-                         username,
-                         delay);
+                gdm_debug (MANAGER, "GdmDisplay: Got timed login details for display: %d %s %d",
+                                    enabled,
+                                    username,
+                                    delay);
         } else {
-                g_debug ("GdmDisplay: Got timed login details for display: 0");
+                gdm_debug (MANAGER, "GdmDisplay: Got timed login details for display: 0");
         }
 
         if (usernamep != NULL) {
@@ -1263,7 +1425,7 @@ get_automatic_login_details (GdmManager  *manager,
                 return FALSE;
 
 out:
-        g_debug ("GdmDisplay: Got automatic login details for user: %s", username);
+        gdm_debug (MANAGER, "GdmDisplay: Got automatic login details for user: %s", username);
 
         *out_username = g_steal_pointer (&username);
 
@@ -1292,7 +1454,7 @@ set_up_automatic_login_session (GdmManager *manager,
                       "supported-session-types", supported_session_types,
                       NULL);
 
-        g_debug ("GdmManager: Starting automatic login conversation");
+        gdm_debug (MANAGER, "GdmManager: Starting automatic login conversation");
         gdm_session_start_conversation (session, "gdm-autologin");
 }
 
@@ -1514,6 +1676,7 @@ create_display_for_user_session (GdmManager *self,
                       "session-class", "user",
                       "seat-id", seat_id,
                       "session-id", session_id,
+                      "login-trace", gdm_session_get_login_trace (session),
                       NULL);
         gdm_display_store_add (self->display_store,
                                display);
@@ -1558,8 +1721,8 @@ export_initial_setup_home_dir (GdmSession *initial_setup_session)
                 return FALSE;
         }
 
-        g_debug ("Moving %s to " INITIAL_SETUP_EXPORT_DIR,
-                 g_file_peek_path (gis_home));
+        gdm_debug (MANAGER, "Moving %s to " INITIAL_SETUP_EXPORT_DIR,
+                            g_file_peek_path (gis_home));
 
         gis_export = g_file_new_for_path (INITIAL_SETUP_EXPORT_DIR);
         if (!g_file_move (gis_home, gis_export, G_FILE_COPY_OVERWRITE, NULL,
@@ -1569,8 +1732,8 @@ export_initial_setup_home_dir (GdmSession *initial_setup_session)
                 return FALSE;
         }
 
-        g_debug ("Changing ownership of " INITIAL_SETUP_EXPORT_DIR " to %u:%u",
-                 pwe->pw_uid, pwe->pw_gid);
+        gdm_debug (MANAGER, "Changing ownership of " INITIAL_SETUP_EXPORT_DIR " to %u:%u",
+                            pwe->pw_uid, pwe->pw_gid);
 
         if (!gdm_chown_recursively (gis_export, pwe->pw_uid, pwe->pw_gid, &error)) {
                 g_warning ("Failed to change ownership of " INITIAL_SETUP_EXPORT_DIR ": %s",
@@ -1591,8 +1754,9 @@ on_start_user_session (StartUserSessionOperation *operation)
         const char *session_id;
         gboolean doing_initial_setup = FALSE;
         uid_t allowed_uid;
+        g_autoptr (GdmLoginTrace) login_trace = NULL;
 
-        g_debug ("GdmManager: start or jump to session");
+        gdm_debug (MANAGER, "GdmManager: start or jump to session");
 
         /* If there's already a session running, jump to it.
          * If the only session running is the one we just opened,
@@ -1600,7 +1764,7 @@ on_start_user_session (StartUserSessionOperation *operation)
          */
         migrated = switch_to_compatible_user_session (operation->manager, operation->session, fail_if_already_switched);
 
-        g_debug ("GdmManager: migrated: %d", migrated);
+        gdm_debug (MANAGER, "GdmManager: migrated: %d", migrated);
         if (migrated) {
                 /* We don't stop the manager here because
                    when Xorg exits it switches to the VT it was
@@ -1624,7 +1788,7 @@ on_start_user_session (StartUserSessionOperation *operation)
         if (doing_initial_setup) {
                 g_autoptr(GError) error = NULL;
 
-                g_debug ("GdmManager: closing down initial setup display in background");
+                gdm_debug (MANAGER, "GdmManager: closing down initial setup display in background");
                 g_object_set (G_OBJECT (display), "status", GDM_DISPLAY_WAITING_TO_FINISH, NULL);
 
                 if (!g_file_set_contents (ALREADY_RAN_INITIAL_SETUP_ON_THIS_BOOT,
@@ -1637,7 +1801,7 @@ on_start_user_session (StartUserSessionOperation *operation)
                         g_clear_error (&error);
                 }
         } else {
-                g_debug ("GdmManager: session has its display server, reusing our server for another login screen");
+                gdm_debug (MANAGER, "GdmManager: session has its display server, reusing our server for another login screen");
         }
 
         /* The user session is going to follow the session worker
@@ -1646,6 +1810,10 @@ on_start_user_session (StartUserSessionOperation *operation)
         allowed_uid = gdm_session_get_allowed_user (operation->session);
         g_object_set_data (G_OBJECT (display), "gdm-user-session", NULL);
         g_object_set_data (G_OBJECT (operation->session), "gdm-display", NULL);
+
+        /* The next login on this display gets a timeline of its own */
+        login_trace = gdm_login_trace_new ();
+        g_object_set (G_OBJECT (display), "login-trace", login_trace, NULL);
         create_user_session_for_display (operation->manager, display, allowed_uid);
 
         /* Give the user session a new display object for bookkeeping purposes */
@@ -1722,7 +1890,7 @@ on_session_credentials_established (GdmSession *session,
 
         display = get_display_for_user_session (session);
         if (display == NULL) {
-                g_debug ("GdmManager: session has no associated display");
+                gdm_debug (MANAGER, "GdmManager: session has no associated display");
                 return;
         }
 
@@ -1760,7 +1928,7 @@ on_user_session_started (GdmSession      *session,
                          GPid             pid,
                          GdmManager      *manager)
 {
-        g_debug ("GdmManager: session started %d", pid);
+        gdm_debug (MANAGER, "GdmManager: session started %d", pid);
 }
 
 static void
@@ -1793,7 +1961,7 @@ on_session_start_failed (GdmSession *session,
                          const char *message,
                          GdmManager *manager)
 {
-        g_debug ("GdmManager: session failed to start: %s", message);
+        gdm_debug (MANAGER, "GdmManager: session failed to start: %s", message);
         remove_user_session (manager, session);
 }
 
@@ -1802,7 +1970,7 @@ on_user_session_exited (GdmSession *session,
                         int         code,
                         GdmManager *manager)
 {
-        g_debug ("GdmManager: session exited with status %d", code);
+        gdm_debug (MANAGER, "GdmManager: session exited with status %d", code);
         gdm_session_record (GDM_SESSION_RECORD_LOGOUT, session, -1);
         remove_user_session (manager, session);
 }
@@ -1812,7 +1980,7 @@ on_user_session_died (GdmSession *session,
                       int         signal_number,
                       GdmManager *manager)
 {
-        g_debug ("GdmManager: session died with signal %s", strsignal (signal_number));
+        gdm_debug (MANAGER, "GdmManager: session died with signal %s", strsignal (signal_number));
         remove_user_session (manager, session);
 }
 
@@ -1925,9 +2093,9 @@ on_session_client_ready_for_session_to_start (GdmSession      *session,
         gboolean waiting_to_start_user_session;
 
         if (client_is_ready) {
-                g_debug ("GdmManager: Will start session when ready");
+                gdm_debug (MANAGER, "GdmManager: Will start session when ready");
         } else {
-                g_debug ("GdmManager: Will start session when ready and told");
+                gdm_debug (MANAGER, "GdmManager: Will start session when ready and told");
         }
 
         waiting_to_start_user_session = GPOINTER_TO_INT (g_object_get_data (G_OBJECT (session),
@@ -1954,13 +2122,13 @@ on_session_client_connected (GdmSession      *session,
         gboolean enabled;
         gboolean allow_timed_login = FALSE;
 
-        g_debug ("GdmManager: client with pid %d connected", (int) pid_of_client);
+        gdm_debug (MANAGER, "GdmManager: client with pid %d connected", (int) pid_of_client);
 
         if (gdm_session_is_running (session)) {
                 const char *session_username;
                 session_username = gdm_session_get_username (session);
-                g_debug ("GdmManager: ignoring connection, since session already running (for user %s)",
-                         session_username);
+                gdm_debug (MANAGER, "GdmManager: ignoring connection, since session already running (for user %s)",
+                                    session_username);
                 return;
         }
 
@@ -1988,7 +2156,7 @@ on_session_client_connected (GdmSession      *session,
 
         gdm_session_set_timed_login_details (session, username, delay);
 
-        g_debug ("GdmManager: Starting automatic login conversation (for timed login)");
+        gdm_debug (MANAGER, "GdmManager: Starting automatic login conversation (for timed login)");
         gdm_session_start_conversation (session, "gdm-autologin");
 
         g_free (username);
@@ -2001,7 +2169,7 @@ on_session_client_disconnected (GdmSession   *session,
                                 GPid          pid_of_client,
                                 GdmManager   *manager)
 {
-        g_debug ("GdmManager: client with pid %d disconnected", (int) pid_of_client);
+        gdm_debug (MANAGER, "GdmManager: client with pid %d disconnected", (int) pid_of_client);
 }
 
 typedef struct
@@ -2055,7 +2223,7 @@ static void
 on_session_cancelled (GdmSession  *session,
                       GdmManager  *manager)
 {
-        g_debug ("GdmManager: Session was cancelled");
+        gdm_debug (MANAGER, "GdmManager: Session was cancelled");
         queue_session_reset (manager, session);
 }
 
@@ -2068,17 +2236,17 @@ on_session_conversation_started (GdmSession *session,
         gboolean    enabled;
         g_autofree char *username = NULL;
 
-        g_debug ("GdmManager: session conversation started for service %s on session", service_name);
+        gdm_debug (MANAGER, "GdmManager: session conversation started for service %s on session", service_name);
 
         if (g_strcmp0 (service_name, "gdm-autologin") != 0) {
-                g_debug ("GdmManager: ignoring session conversation since its not automatic login conversation");
+                gdm_debug (MANAGER, "GdmManager: ignoring session conversation since its not automatic login conversation");
                 return;
         }
 
         display = get_display_for_user_session (session);
 
         if (display == NULL) {
-                g_debug ("GdmManager: conversation has no associated display");
+                gdm_debug (MANAGER, "GdmManager: conversation has no associated display");
                 return;
         }
 
@@ -2088,7 +2256,7 @@ on_session_conversation_started (GdmSession *session,
                 return;
         }
 
-        g_debug ("GdmManager: begin auto login for user '%s'", username);
+        gdm_debug (MANAGER, "GdmManager: begin auto login for user '%s'", username);
 
         /* service_name will be "gdm-autologin"
          */
@@ -2100,7 +2268,7 @@ on_session_conversation_stopped (GdmSession *session,
                                  const char *service_name,
                                  GdmManager *manager)
 {
-        g_debug ("GdmManager: session conversation '%s' stopped", service_name);
+        gdm_debug (MANAGER, "GdmManager: session conversation '%s' stopped", service_name);
 }
 
 static void
@@ -2112,7 +2280,7 @@ on_session_reauthentication_started (GdmSession *session,
         GDBusMethodInvocation *invocation;
         gpointer               source_tag;
 
-        g_debug ("GdmManager: reauthentication started");
+        gdm_debug (MANAGER, "GdmManager: reauthentication started");
 
         source_tag = GINT_TO_POINTER (pid_of_caller);
 
@@ -2146,6 +2314,7 @@ create_user_session_for_display (GdmManager *manager,
         char       *remote_hostname = NULL;
         char       *display_seat_id = NULL;
         char       *display_id = NULL;
+        int         worker_pool_size = 0;
         g_auto (GStrv) supported_session_types = NULL;
 
         g_object_get (G_OBJECT (display),
@@ -2175,10 +2344,17 @@ create_user_session_for_display (GdmManager *manager,
                       "supported-session-types", supported_session_types,
                       NULL);
 
-        g_debug ("GdmSession: Created user session for user %d on display %s (seat %s)",
-                 (int) allowed_user,
-                 display_id,
-                 display_seat_id);
+        if (gdm_settings_direct_get_int (GDM_KEY_WORKER_POOL_SIZE, &worker_pool_size) &&
+            worker_pool_size > 0) {
+                gdm_session_set_worker_pool_size (session, worker_pool_size);
+        }
+
+        gdm_session_set_login_trace (session, gdm_display_get_login_trace (display));
+
+        gdm_debug (MANAGER, "GdmSession: Created user session for user %d on display %s (seat %s)",
+                            (int) allowed_user,
+                            display_id,
+                            display_seat_id);
 
         g_free (remote_hostname);
         g_free (display_seat_id);
@@ -2337,7 +2513,7 @@ gdm_manager_stop (GdmManager *manager)
 {
         g_return_if_fail (GDM_IS_MANAGER (manager));
 
-        g_debug ("GdmManager: GDM stopping");
+        gdm_debug (MANAGER, "GdmManager: GDM stopping");
 
         if (manager->local_factory != NULL) {
                 gdm_display_factory_stop (GDM_DISPLAY_FACTORY (manager->local_factory));
@@ -2356,9 +2532,16 @@ gdm_manager_stop (GdmManager *manager)
 void
 gdm_manager_start (GdmManager *manager)
 {
+        int reserve_size;
+
         g_return_if_fail (GDM_IS_MANAGER (manager));
 
-        g_debug ("GdmManager: GDM starting to manage displays");
+        gdm_debug (MANAGER, "GdmManager: GDM starting to manage displays");
+
+        if (gdm_settings_direct_get_int (GDM_KEY_GREETER_USER_RESERVE, &reserve_size) &&
+            reserve_size > 0) {
+                gdm_reserve_greeter_users (manager->dyn_user_store, reserve_size);
+        }
 
 #ifdef WITH_PLYMOUTH
         manager->plymouth_is_running = plymouth_is_running ();
@@ -2470,12 +2653,25 @@ gdm_manager_get_property (GObject    *object,
         }
 }
 
+static void
+on_debug_categories_changed (guint    categories,
+                             gpointer user_data)
+{
+        GdmManager    *manager = GDM_MANAGER (user_data);
+        g_auto (GStrv) names = NULL;
+
+        names = gdm_log_get_debug_category_names (categories);
+        gdm_dbus_manager_set_debug_categories (GDM_DBUS_MANAGER (manager),
+                                               (const char * const *) names);
+}
+
 static GObject *
 gdm_manager_constructor (GType                  type,
                          guint                  n_construct_properties,
                          GObjectConstructParam *construct_properties)
 {
         GdmManager      *manager;
+        g_auto (GStrv)   debug_categories = NULL;
 
         manager = GDM_MANAGER (G_OBJECT_CLASS (gdm_manager_parent_class)->constructor (type,
                                                                                        n_construct_properties,
@@ -2483,6 +2679,11 @@ gdm_manager_constructor (GType                  type,
 
         gdm_dbus_manager_set_version (GDM_DBUS_MANAGER (manager), PACKAGE_VERSION);
 
+        debug_categories = gdm_log_get_debug_category_names (gdm_log_get_debug_categories ());
+        gdm_dbus_manager_set_debug_categories (GDM_DBUS_MANAGER (manager),
+                                               (const char * const *) debug_categories);
+        gdm_log_set_debug_categories_notify (on_debug_categories_changed, manager);
+
         manager->local_factory = gdm_local_display_factory_new (manager->display_store);
 
         if (manager->remote_login_enabled) {
@@ -2535,7 +2736,11 @@ gdm_manager_class_init (GdmManagerClass *klass)
 static void
 gdm_manager_init (GdmManager *manager)
 {
-        manager->dyn_user_store = gdm_dynamic_user_store_new ();
+        int userdb_workers = 1;
+
+        gdm_settings_direct_get_int (GDM_KEY_USERDB_WORKERS, &userdb_workers);
+
+        manager->dyn_user_store = gdm_dynamic_user_store_new (CLAMP (userdb_workers, 1, 64));
         manager->display_store = gdm_display_store_new ();
         manager->user_sessions = NULL;
         manager->open_reauthentication_requests = g_hash_table_new_full (NULL,
@@ -2595,6 +2800,8 @@ gdm_manager_dispose (GObject *object)
 
         gdm_manager_stop (manager);
 
+        gdm_log_set_debug_categories_notify (NULL, NULL);
+
         g_clear_weak_pointer (&manager->automatic_login_display);
 
         g_clear_object (&manager->local_factory);
@@ -21,6 +21,7 @@
 #include "config.h"
 
 #include "gdm-common.h"
+#include "gdm-log.h"
 #include "gdm-remote-display.h"
 #include "gdm-remote-display-factory.h"
 #include "gdm-remote-display-factory-glue.h"
@@ -57,7 +58,7 @@ gdm_remote_display_factory_create_display (GdmRemoteDisplayFactory *factory,
         g_autoptr (GdmDisplay) display = NULL;
         GdmDisplayStore *store;
 
-        g_debug ("GdmRemoteDisplayFactory: Creating remote display");
+        gdm_debug (DISPLAY_FACTORY, "GdmRemoteDisplayFactory: Creating remote display");
 
         display = gdm_remote_display_new (remote_id,
                                           remote_hostname);
@@ -109,11 +110,10 @@ handle_create_remote_display (GdmDBusRemoteDisplayFactory *skeleton,
         return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
 
-static gboolean
-handle_create_user_display (GdmDBusRemoteDisplayFactory *skeleton,
-                            GDBusMethodInvocation       *invocation,
-                            const char                  *user,
-                            GdmRemoteDisplayFactory     *factory)
+static void
+create_user_display (GdmRemoteDisplayFactory *factory,
+                     GDBusMethodInvocation   *invocation,
+                     const char              *user)
 {
         g_auto (GStrv) sessions = NULL;
         g_autoptr (GError) error = NULL;
@@ -122,7 +122,7 @@ handle_create_user_display (GdmDBusRemoteDisplayFactory *skeleton,
                                                            user,
                                                            &error)) {
                 g_dbus_method_invocation_return_gerror (invocation, error);
-                return G_DBUS_METHOD_INVOCATION_HANDLED;
+                return;
         }
 
         if (!gdm_remote_display_factory_create_display (factory, user, NULL, NULL)) {
@@ -130,20 +130,17 @@ handle_create_user_display (GdmDBusRemoteDisplayFactory *skeleton,
                                                        G_DBUS_ERROR,
                                                        G_DBUS_ERROR_FAILED,
                                                        "Error creating remote display");
-                return G_DBUS_METHOD_INVOCATION_HANDLED;
+                return;
         }
 
         gdm_dbus_remote_display_factory_complete_create_user_display (factory->skeleton,
                                                                       invocation);
-
-        return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
 
-static gboolean
-handle_destroy_user_display (GdmDBusRemoteDisplayFactory *skeleton,
-                             GDBusMethodInvocation       *invocation,
-                             const char                  *user,
-                             GdmRemoteDisplayFactory     *factory)
+static void
+destroy_user_display (GdmRemoteDisplayFactory *factory,
+                      GDBusMethodInvocation   *invocation,
+                      const char              *user)
 {
         g_autoptr (GError) error = NULL;
 
@@ -151,30 +148,83 @@ handle_destroy_user_display (GdmDBusRemoteDisplayFactory *skeleton,
                                                               user,
                                                               &error)) {
                 g_dbus_method_invocation_return_gerror (invocation, error);
-                return G_DBUS_METHOD_INVOCATION_HANDLED;
+                return;
         }
 
-        gdm_dbus_remote_display_factory_complete_destroy_user_display (skeleton,
+        gdm_dbus_remote_display_factory_complete_destroy_user_display (factory->skeleton,
                                                                        invocation);
+}
 
-        return G_DBUS_METHOD_INVOCATION_HANDLED;
+static void
+on_create_user_display_authorized (GObject      *source,
+                                   GAsyncResult *result,
+                                   gpointer      user_data)
+{
+        GDBusMethodInvocation *invocation = user_data;
+        g_autoptr (GError) error = NULL;
+        const char *user;
+
+        if (!gdm_display_factory_authorize_manage_user_displays_finish (GDM_DISPLAY_FACTORY (source),
+                                                                        result,
+                                                                        &error)) {
+                g_dbus_method_invocation_return_gerror (invocation, error);
+                return;
+        }
+
+        g_variant_get (g_dbus_method_invocation_get_parameters (invocation), "(&s)", &user);
+
+        create_user_display (GDM_REMOTE_DISPLAY_FACTORY (source), invocation, user);
 }
 
 static gboolean
-on_authorize_method (GdmDBusRemoteDisplayFactory *skeleton,
-                     GDBusMethodInvocation       *invocation,
-                     GdmRemoteDisplayFactory     *factory)
+handle_create_user_display (GdmDBusRemoteDisplayFactory *skeleton,
+                            GDBusMethodInvocation       *invocation,
+                            const char                  *user,
+                            GdmRemoteDisplayFactory     *factory)
+{
+        gdm_display_factory_authorize_manage_user_displays (GDM_DISPLAY_FACTORY (factory),
+                                                            invocation,
+                                                            NULL,
+                                                            on_create_user_display_authorized,
+                                                            invocation);
+
+        return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
+
+static void
+on_destroy_user_display_authorized (GObject      *source,
+                                    GAsyncResult *result,
+                                    gpointer      user_data)
 {
+        GDBusMethodInvocation *invocation = user_data;
         g_autoptr (GError) error = NULL;
+        const char *user;
 
-        if (!gdm_display_factory_authorize_manage_user_displays (GDM_DISPLAY_FACTORY (factory),
-                                                                 invocation,
-                                                                 &error)) {
+        if (!gdm_display_factory_authorize_manage_user_displays_finish (GDM_DISPLAY_FACTORY (source),
+                                                                        result,
+                                                                        &error)) {
                 g_dbus_method_invocation_return_gerror (invocation, error);
-                return FALSE;
+                return;
         }
 
-        return TRUE;
+        g_variant_get (g_dbus_method_invocation_get_parameters (invocation), "(&s)", &user);
+
+        destroy_user_display (GDM_REMOTE_DISPLAY_FACTORY (source), invocation, user);
+}
+
+static gboolean
+handle_destroy_user_display (GdmDBusRemoteDisplayFactory *skeleton,
+                             GDBusMethodInvocation       *invocation,
+                             const char                  *user,
+                             GdmRemoteDisplayFactory     *factory)
+{
+        gdm_display_factory_authorize_manage_user_displays (GDM_DISPLAY_FACTORY (factory),
+                                                            invocation,
+                                                            NULL,
+                                                            on_destroy_user_display_authorized,
+                                                            invocation);
+
+        return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
 
 static gboolean
@@ -206,10 +256,6 @@ register_factory (GdmRemoteDisplayFactory *factory)
                           G_CALLBACK (handle_destroy_user_display),
                           factory);
 
-        g_signal_connect (factory->skeleton, "g-authorize-method",
-                          G_CALLBACK (on_authorize_method),
-                          factory);
-
         if (!g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (factory->skeleton),
                                                factory->connection,
                                                GDM_REMOTE_DISPLAY_FACTORY_DBUS_PATH,
@@ -0,0 +1,481 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gio/gio.h>
+
+#include "gdm-session-catalog.h"
+
+struct _GdmSessionCatalog
+{
+        GObject     parent;
+
+        GHashTable *sections; /* session type -> CatalogSection */
+        GHashTable *monitors; /* search directory -> GFileMonitor */
+};
+
+typedef struct
+{
+        char       *type;
+        char      **dirs;
+        GHashTable *desktops; /* session id -> GdmSessionDesktop */
+        guint       monitored : 1;
+} CatalogSection;
+
+static void     gdm_session_catalog_finalize    (GObject                *object);
+
+G_DEFINE_TYPE (GdmSessionCatalog, gdm_session_catalog, G_TYPE_OBJECT)
+
+static GdmSessionCatalog *default_catalog = NULL;
+
+static void
+gdm_session_desktop_free (GdmSessionDesktop *desktop)
+{
+        g_free (desktop->id);
+        g_free (desktop->type);
+        g_free (desktop->path);
+        g_free (desktop->exec);
+        g_free (desktop->try_exec);
+        g_free (desktop->desktop_names);
+        g_free (desktop);
+}
+
+static void
+catalog_section_free (CatalogSection *section)
+{
+        g_hash_table_unref (section->desktops);
+        g_strfreev (section->dirs);
+        g_free (section->type);
+        g_free (section);
+}
+
+static char **
+get_session_dirs_for_type (const char *type)
+{
+        GPtrArray *search_array;
+        const char * const *system_data_dirs = g_get_system_data_dirs ();
+        guint i;
+
+        static const char *x_search_dirs[] = {
+                "/etc/X11/sessions/",
+                DMCONFDIR "/Sessions/",
+                DATADIR "/gdm/BuiltInSessions/",
+                DATADIR "/xsessions/",
+        };
+
+        static const char *gdm_wayland_search_dir = DATADIR "/gdm/greeter/wayland-sessions/";
+        static const char *wayland_search_dir = DATADIR "/wayland-sessions/";
+
+        search_array = g_ptr_array_new ();
+
+        if (g_str_equal (type, "x11")) {
+                for (i = 0; system_data_dirs[i] != NULL; i++) {
+                        g_autofree char *dir = g_build_filename (system_data_dirs[i], "xsessions", NULL);
+                        g_ptr_array_add (search_array, g_canonicalize_filename (dir, "/"));
+                }
+
+                for (i = 0; i < G_N_ELEMENTS (x_search_dirs); i++)
+                        g_ptr_array_add (search_array, g_canonicalize_filename (x_search_dirs[i], "/"));
+        } else if (g_str_equal (type, "wayland")) {
+                g_ptr_array_add (search_array, g_canonicalize_filename (gdm_wayland_search_dir, "/"));
+
+                for (i = 0; system_data_dirs[i] != NULL; i++) {
+                        g_autofree char *dir = g_build_filename (system_data_dirs[i], "wayland-sessions", NULL);
+                        g_ptr_array_add (search_array, g_canonicalize_filename (dir, "/"));
+                }
+
+                g_ptr_array_add (search_array, g_canonicalize_filename (wayland_search_dir, "/"));
+        }
+
+        g_ptr_array_add (search_array, NULL);
+
+        return (char **) g_ptr_array_free (search_array, FALSE);
+}
+
+static GdmSessionDesktop *
+load_session_desktop (const char *type,
+                      const char *id,
+                      const char *path)
+{
+        g_autoptr(GKeyFile) key_file = NULL;
+        g_autoptr(GError) error = NULL;
+        g_auto(GStrv) names = NULL;
+        GdmSessionDesktop *desktop;
+
+        key_file = g_key_file_new ();
+
+        if (!g_key_file_load_from_file (key_file, path, G_KEY_FILE_NONE, &error)) {
+                if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+                        g_debug ("GdmSessionCatalog: could not load '%s': %s", path, error->message);
+                return NULL;
+        }
+
+        desktop = g_new0 (GdmSessionDesktop, 1);
+        desktop->id = g_strdup (id);
+        desktop->type = g_strdup (type);
+        desktop->path = g_strdup (path);
+
+        desktop->hidden = g_key_file_get_boolean (key_file,
+                                                  G_KEY_FILE_DESKTOP_GROUP,
+                                                  G_KEY_FILE_DESKTOP_KEY_HIDDEN,
+                                                  NULL);
+        desktop->can_run_headless = g_key_file_get_boolean (key_file,
+                                                            G_KEY_FILE_DESKTOP_GROUP,
+                                                            "X-GDM-CanRunHeadless",
+                                                            NULL);
+        desktop->try_exec = g_key_file_get_string (key_file,
+                                                   G_KEY_FILE_DESKTOP_GROUP,
+                                                   G_KEY_FILE_DESKTOP_KEY_TRY_EXEC,
+                                                   NULL);
+        desktop->exec = g_key_file_get_string (key_file,
+                                               G_KEY_FILE_DESKTOP_GROUP,
+                                               G_KEY_FILE_DESKTOP_KEY_EXEC,
+                                               NULL);
+
+        names = g_key_file_get_string_list (key_file,
+                                            G_KEY_FILE_DESKTOP_GROUP,
+                                            "DesktopNames",
+                                            NULL,
+                                            NULL);
+        if (names != NULL)
+                desktop->desktop_names = g_strjoinv (":", names);
+
+        desktop->session_registers = g_key_file_get_boolean (key_file,
+                                                             G_KEY_FILE_DESKTOP_GROUP,
+                                                             "X-GDM-SessionRegisters",
+                                                             &error);
+        if (error != NULL &&
+            !g_error_matches (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND)) {
+                g_warning ("GdmSessionCatalog: Couldn't read X-GDM-SessionRegisters from '%s': %s",
+                           path, error->message);
+        }
+
+        return desktop;
+}
+
+/* Re-resolves one session id the same way g_key_file_load_from_dirs()
+ * would: the first search directory holding a loadable file wins.
+ */
+static void
+refresh_session_desktop (CatalogSection *section,
+                         const char     *id)
+{
+        g_autofree char *filename = NULL;
+        GdmSessionDesktop *desktop = NULL;
+        int i;
+
+        filename = g_strdup_printf ("%s.desktop", id);
+
+        for (i = 0; section->dirs[i] != NULL && desktop == NULL; i++) {
+                g_autofree char *path = g_build_filename (section->dirs[i], filename, NULL);
+
+                desktop = load_session_desktop (section->type, id, path);
+        }
+
+        if (desktop != NULL) {
+                g_hash_table_replace (section->desktops, desktop->id, desktop);
+        } else {
+                g_hash_table_remove (section->desktops, id);
+        }
+}
+
+static void
+invalidate_file (GdmSessionCatalog *self,
+                 GFile             *file)
+{
+        g_autofree char *path = NULL;
+        g_autofree char *dir = NULL;
+        g_autofree char *base_name = NULL;
+        g_autofree char *id = NULL;
+        GHashTableIter iter;
+        CatalogSection *section;
+
+        if (file == NULL)
+                return;
+
+        path = g_file_get_path (file);
+
+        if (path == NULL)
+                return;
+
+        if (g_hash_table_contains (self->monitors, path)) {
+                g_debug ("GdmSessionCatalog: search directory '%s' changed, reloading", path);
+                g_hash_table_remove_all (self->sections);
+                return;
+        }
+
+        if (!g_str_has_suffix (path, ".desktop"))
+                return;
+
+        dir = g_path_get_dirname (path);
+        base_name = g_path_get_basename (path);
+        id = g_strndup (base_name, strlen (base_name) - strlen (".desktop"));
+
+        g_hash_table_iter_init (&iter, self->sections);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &section)) {
+                if (!g_strv_contains ((const char * const *) section->dirs, dir))
+                        continue;
+
+                g_debug ("GdmSessionCatalog: refreshing %s session '%s'", section->type, id);
+                refresh_session_desktop (section, id);
+        }
+}
+
+static void
+on_directory_changed (GFileMonitor      *monitor,
+                      GFile             *file,
+                      GFile             *other_file,
+                      GFileMonitorEvent  event_type,
+                      GdmSessionCatalog *self)
+{
+        switch (event_type) {
+        case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+        case G_FILE_MONITOR_EVENT_CREATED:
+        case G_FILE_MONITOR_EVENT_DELETED:
+        case G_FILE_MONITOR_EVENT_MOVED_IN:
+        case G_FILE_MONITOR_EVENT_MOVED_OUT:
+                invalidate_file (self, file);
+                break;
+        case G_FILE_MONITOR_EVENT_RENAMED:
+                invalidate_file (self, file);
+                invalidate_file (self, other_file);
+                break;
+        default:
+                break;
+        }
+}
+
+static gboolean
+monitor_directory (GdmSessionCatalog *self,
+                   const char        *path)
+{
+        g_autoptr(GFile) file = NULL;
+        g_autoptr(GError) error = NULL;
+        GFileMonitor *monitor;
+
+        if (g_hash_table_contains (self->monitors, path))
+                return TRUE;
+
+        file = g_file_new_for_path (path);
+        monitor = g_file_monitor_directory (file, G_FILE_MONITOR_WATCH_MOVES, NULL, &error);
+
+        if (monitor == NULL) {
+                g_warning ("GdmSessionCatalog: could not monitor '%s': %s",
+                           path, error->message);
+                return FALSE;
+        }
+
+        g_signal_connect_object (monitor,
+                                 "changed",
+                                 G_CALLBACK (on_directory_changed),
+                                 self,
+                                 0);
+        g_hash_table_insert (self->monitors, g_strdup (path), monitor);
+
+        return TRUE;
+}
+
+static CatalogSection *
+load_section (GdmSessionCatalog *self,
+              const char        *type)
+{
+        g_autoptr(GHashTable) ids = NULL;
+        CatalogSection *section;
+        GHashTableIter iter;
+        const char *id;
+        int i;
+
+        section = g_new0 (CatalogSection, 1);
+        section->type = g_strdup (type);
+        section->dirs = get_session_dirs_for_type (type);
+        section->desktops = g_hash_table_new_full (g_str_hash,
+                                                   g_str_equal,
+                                                   NULL,
+                                                   (GDestroyNotify) gdm_session_desktop_free);
+        section->monitored = TRUE;
+
+        ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+        for (i = 0; section->dirs[i] != NULL; i++) {
+                GDir       *dir;
+                const char *base_name;
+
+                /* Watch before reading so nothing slips in between */
+                if (!monitor_directory (self, section->dirs[i]))
+                        section->monitored = FALSE;
+
+                dir = g_dir_open (section->dirs[i], 0, NULL);
+
+                if (dir == NULL)
+                        continue;
+
+                while ((base_name = g_dir_read_name (dir)) != NULL) {
+                        if (!g_str_has_suffix (base_name, ".desktop"))
+                                continue;
+
+                        g_hash_table_add (ids, g_strndup (base_name, strlen (base_name) - strlen (".desktop")));
+                }
+
+                g_dir_close (dir);
+        }
+
+        g_hash_table_iter_init (&iter, ids);
+        while (g_hash_table_iter_next (&iter, (gpointer *) &id, NULL))
+                refresh_session_desktop (section, id);
+
+        g_debug ("GdmSessionCatalog: loaded %u %s sessions",
+                 g_hash_table_size (section->desktops), type);
+
+        g_hash_table_insert (self->sections, section->type, section);
+
+        return section;
+}
+
+static CatalogSection *
+get_section (GdmSessionCatalog *self,
+             const char        *type)
+{
+        CatalogSection *section;
+
+        section = g_hash_table_lookup (self->sections, type);
+
+        /* Without a working monitor the cache can't be trusted, so
+         * fall back to rescanning on every access.
+         */
+        if (section != NULL && !section->monitored) {
+                g_hash_table_remove (self->sections, type);
+                section = NULL;
+        }
+
+        if (section == NULL)
+                section = load_section (self, type);
+
+        return section;
+}
+
+const GdmSessionDesktop *
+gdm_session_catalog_lookup (GdmSessionCatalog  *self,
+                            const char         *id,
+                            const char * const *types)
+{
+        int i;
+
+        g_return_val_if_fail (GDM_IS_SESSION_CATALOG (self), NULL);
+        g_return_val_if_fail (id != NULL, NULL);
+
+        for (i = 0; types != NULL && types[i] != NULL; i++) {
+                CatalogSection *section;
+                GdmSessionDesktop *desktop;
+
+                section = get_section (self, types[i]);
+                desktop = g_hash_table_lookup (section->desktops, id);
+
+                if (desktop != NULL)
+                        return desktop;
+        }
+
+        return NULL;
+}
+
+static int
+compare_ids (gconstpointer a,
+             gconstpointer b)
+{
+        return g_strcmp0 (*(const char **) a, *(const char **) b);
+}
+
+char **
+gdm_session_catalog_list_ids (GdmSessionCatalog  *self,
+                              const char * const *types)
+{
+        g_autoptr(GHashTable) ids = NULL;
+        GPtrArray *array;
+        GHashTableIter iter;
+        const char *id;
+        int i;
+
+        g_return_val_if_fail (GDM_IS_SESSION_CATALOG (self), NULL);
+
+        ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+        for (i = 0; types != NULL && types[i] != NULL; i++) {
+                CatalogSection *section;
+
+                section = get_section (self, types[i]);
+
+                g_hash_table_iter_init (&iter, section->desktops);
+                while (g_hash_table_iter_next (&iter, (gpointer *) &id, NULL))
+                        g_hash_table_add (ids, g_strdup (id));
+        }
+
+        array = g_ptr_array_new ();
+
+        g_hash_table_iter_init (&iter, ids);
+        while (g_hash_table_iter_next (&iter, (gpointer *) &id, NULL))
+                g_ptr_array_add (array, g_strdup (id));
+
+        g_ptr_array_sort (array, compare_ids);
+        g_ptr_array_add (array, NULL);
+
+        return (char **) g_ptr_array_free (array, FALSE);
+}
+
+static void
+gdm_session_catalog_class_init (GdmSessionCatalogClass *klass)
+{
+        GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+        object_class->finalize = gdm_session_catalog_finalize;
+}
+
+static void
+gdm_session_catalog_init (GdmSessionCatalog *self)
+{
+        self->sections = g_hash_table_new_full (g_str_hash,
+                                                g_str_equal,
+                                                NULL,
+                                                (GDestroyNotify) catalog_section_free);
+        self->monitors = g_hash_table_new_full (g_str_hash,
+                                                g_str_equal,
+                                                g_free,
+                                                g_object_unref);
+}
+
+static void
+gdm_session_catalog_finalize (GObject *object)
+{
+        GdmSessionCatalog *self = GDM_SESSION_CATALOG (object);
+
+        g_hash_table_unref (self->monitors);
+        g_hash_table_unref (self->sections);
+
+        G_OBJECT_CLASS (gdm_session_catalog_parent_class)->finalize (object);
+}
+
+GdmSessionCatalog *
+gdm_session_catalog_get_default (void)
+{
+        if (default_catalog == NULL)
+                default_catalog = g_object_new (GDM_TYPE_SESSION_CATALOG, NULL);
+
+        return default_catalog;
+}
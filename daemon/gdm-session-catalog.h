@@ -0,0 +1,52 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define GDM_TYPE_SESSION_CATALOG (gdm_session_catalog_get_type ())
+G_DECLARE_FINAL_TYPE (GdmSessionCatalog, gdm_session_catalog, GDM, SESSION_CATALOG, GObject)
+
+/* Pre-parsed contents of one session .desktop file. Entries are owned
+ * by the catalog and may be replaced whenever the main loop runs, so
+ * callers must not hold on to them.
+ */
+typedef struct
+{
+        char     *id;
+        char     *type;
+        char     *path;
+        char     *exec;
+        char     *try_exec;
+        char     *desktop_names;
+        guint     hidden : 1;
+        guint     can_run_headless : 1;
+        guint     session_registers : 1;
+} GdmSessionDesktop;
+
+GdmSessionCatalog       *gdm_session_catalog_get_default (void);
+
+const GdmSessionDesktop *gdm_session_catalog_lookup      (GdmSessionCatalog  *catalog,
+                                                          const char         *id,
+                                                          const char * const *types);
+char                   **gdm_session_catalog_list_ids    (GdmSessionCatalog  *catalog,
+                                                          const char * const *types);
+
+G_END_DECLS
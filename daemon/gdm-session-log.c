@@ -0,0 +1,547 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_FSUID_H
+#include <sys/fsuid.h>
+#include <sys/syscall.h>
+#endif
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "gdm-log.h"
+#include "gdm-session-log.h"
+
+/* How often the size of a running session's log is looked at */
+#define SIZE_CHECK_INTERVAL 30
+
+#define COPY_BUFFER_SIZE 65536
+
+typedef void (*FileJobFunc) (GdmSessionLog *log);
+
+struct _GdmSessionLog
+{
+        char     *path;
+        guint     max_old_logs;
+        mode_t    mode;
+
+        gboolean  has_owner;
+        uid_t     uid;
+        gid_t     gid;
+
+        goffset   max_size;
+        gboolean  compress;
+
+        int       fd;
+
+        /* The file the session writes to. It's created under a fresh
+         * name, and only takes over @path once the session is running */
+        char     *current_path;
+        gboolean  installed;
+
+        guint     size_check_id;
+
+        /* Anything touching the files runs on this thread, one job at
+         * a time, as the owner of the log */
+        GThread  *job_thread;
+        gint      job_running;
+};
+
+typedef struct
+{
+        GdmSessionLog *log;
+        FileJobFunc    func;
+} FileJob;
+
+static void run_file_job    (GdmSessionLog *log,
+                             FileJobFunc    func,
+                             gboolean       wait);
+static void discard_log_job (GdmSessionLog *log);
+
+/**
+ * gdm_session_log_new:
+ * @path: the file to log to
+ * @max_old_logs: how many earlier generations of @path to keep around
+ * @mode: permissions of the log files
+ *
+ * Describes where a session's stdout and stderr go. The file itself is
+ * set up with gdm_session_log_open() before forking the session.
+ *
+ * Generations are named @path.1, @path.2 and so on, or @path.old when
+ * only one is kept.
+ */
+GdmSessionLog *
+gdm_session_log_new (const char *path,
+                     guint       max_old_logs,
+                     mode_t      mode)
+{
+        GdmSessionLog *log;
+
+        g_return_val_if_fail (path != NULL, NULL);
+
+        log = g_new0 (GdmSessionLog, 1);
+        log->path = g_strdup (path);
+        log->max_old_logs = max_old_logs;
+        log->mode = mode;
+        log->fd = -1;
+
+        return log;
+}
+
+void
+gdm_session_log_free (GdmSessionLog *log)
+{
+        if (log == NULL)
+                return;
+
+        g_clear_handle_id (&log->size_check_id, g_source_remove);
+
+        if (log->job_thread != NULL)
+                g_thread_join (g_steal_pointer (&log->job_thread));
+
+        /* The session never got to run, nothing worth keeping in there */
+        if (log->current_path != NULL && !log->installed)
+                run_file_job (log, discard_log_job, TRUE);
+
+        if (log->fd >= 0)
+                close (log->fd);
+
+        g_free (log->current_path);
+        g_free (log->path);
+        g_free (log);
+}
+
+/* Files get created and rotated as this user, so that logs in home
+ * directories end up owned by the user, and root squashing NFS servers
+ * let us write them */
+void
+gdm_session_log_set_owner (GdmSessionLog *log,
+                           uid_t          uid,
+                           gid_t          gid)
+{
+        log->has_owner = TRUE;
+        log->uid = uid;
+        log->gid = gid;
+}
+
+/* 0 means no limit */
+void
+gdm_session_log_set_max_size (GdmSessionLog *log,
+                              goffset        max_size)
+{
+        log->max_size = max_size;
+}
+
+/* gzip generations once they've been rotated out */
+void
+gdm_session_log_set_compress (GdmSessionLog *log,
+                              gboolean       compress)
+{
+        log->compress = compress;
+}
+
+/* Makes the calling thread act as the owner of the log on the file
+ * system. These are the raw system calls on purpose: unlike the libc
+ * wrappers for setgroups(), they only change the credentials of this
+ * thread, while the rest of the worker stays root. Root's supplementary
+ * groups are dropped too, they would otherwise still apply */
+static void
+set_file_system_ids (GdmSessionLog *log)
+{
+#ifdef HAVE_SYS_FSUID_H
+        if (!log->has_owner)
+                return;
+
+        syscall (SYS_setgroups, 0, NULL);
+        setfsgid (log->gid);
+        setfsuid (log->uid);
+#endif
+}
+
+static gpointer
+file_job_thread (gpointer data)
+{
+        FileJob *job = data;
+
+        set_file_system_ids (job->log);
+
+        job->func (job->log);
+
+        g_atomic_int_set (&job->log->job_running, FALSE);
+        g_free (job);
+
+        return NULL;
+}
+
+static void
+run_file_job (GdmSessionLog *log,
+              FileJobFunc    func,
+              gboolean       wait)
+{
+        FileJob *job;
+
+        if (log->job_thread != NULL)
+                g_thread_join (g_steal_pointer (&log->job_thread));
+
+        job = g_new0 (FileJob, 1);
+        job->log = log;
+        job->func = func;
+
+        g_atomic_int_set (&log->job_running, TRUE);
+        log->job_thread = g_thread_new ("gdm-session-log", file_job_thread, job);
+
+        if (wait)
+                g_thread_join (g_steal_pointer (&log->job_thread));
+}
+
+static char *
+get_generation_path (GdmSessionLog *log,
+                     guint          generation)
+{
+        if (generation == 0)
+                return g_strdup (log->path);
+
+        if (log->max_old_logs == 1)
+                return g_strdup_printf ("%s.old", log->path);
+
+        return g_strdup_printf ("%s.%u", log->path, generation);
+}
+
+static void
+compress_generation (GdmSessionLog *log,
+                     guint          generation)
+{
+        g_autofree char *path = NULL;
+        g_autofree char *compressed_path = NULL;
+        g_autoptr (GFile) source = NULL;
+        g_autoptr (GFile) target = NULL;
+        g_autoptr (GFileInputStream) input = NULL;
+        g_autoptr (GFileOutputStream) output = NULL;
+        g_autoptr (GZlibCompressor) compressor = NULL;
+        g_autoptr (GOutputStream) converter = NULL;
+        g_autoptr (GError) error = NULL;
+
+        path = get_generation_path (log, generation);
+        compressed_path = g_strdup_printf ("%s.gz", path);
+        source = g_file_new_for_path (path);
+        target = g_file_new_for_path (compressed_path);
+
+        input = g_file_read (source, NULL, &error);
+        if (input == NULL)
+                goto out;
+
+        output = g_file_replace (target, NULL, FALSE,
+                                 G_FILE_CREATE_PRIVATE | G_FILE_CREATE_REPLACE_DESTINATION,
+                                 NULL, &error);
+        if (output == NULL)
+                goto out;
+
+        compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+        converter = g_converter_output_stream_new (G_OUTPUT_STREAM (output),
+                                                   G_CONVERTER (compressor));
+
+        if (g_output_stream_splice (converter,
+                                    G_INPUT_STREAM (input),
+                                    G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                                    G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                                    NULL, &error) < 0) {
+                g_file_delete (target, NULL, NULL);
+                goto out;
+        }
+
+        g_chmod (compressed_path, log->mode);
+        g_unlink (path);
+
+        gdm_debug (WORKER, "GdmSessionLog: compressed %s", path);
+
+ out:
+        if (error != NULL)
+                g_warning ("GdmSessionLog: could not compress %s: %s", path, error->message);
+}
+
+/* Moves generations @from and up one step further, dropping the oldest.
+ * Returns TRUE if generation @from was there to be moved */
+static gboolean
+shift_generations (GdmSessionLog *log,
+                   guint          from)
+{
+        gboolean shifted = FALSE;
+        guint i;
+
+        for (i = log->max_old_logs; i > from; i--) {
+                g_autofree char *name_n = NULL;
+                g_autofree char *name_n1 = NULL;
+                g_autofree char *compressed_n = NULL;
+                g_autofree char *compressed_n1 = NULL;
+
+                name_n = get_generation_path (log, i);
+                name_n1 = get_generation_path (log, i - 1);
+                compressed_n = g_strdup_printf ("%s.gz", name_n);
+                compressed_n1 = g_strdup_printf ("%s.gz", name_n1);
+
+                g_unlink (name_n);
+                g_unlink (compressed_n);
+
+                if (i - 1 > from) {
+                        g_rename (name_n1, name_n);
+                        g_rename (compressed_n1, compressed_n);
+                } else {
+                        shifted = g_rename (name_n1, name_n) == 0;
+                        g_rename (compressed_n1, compressed_n);
+                }
+        }
+
+        return shifted;
+}
+
+/* Creates the file the session will write to, next to @path, so none
+ * of the earlier generations need to be touched before the fork */
+static void
+open_log_job (GdmSessionLog *log)
+{
+        g_autofree char *dir = NULL;
+        g_autofree char *temp_name = NULL;
+        int fd;
+
+        dir = g_path_get_dirname (log->path);
+        g_mkdir_with_parents (dir, S_IRWXU);
+
+        temp_name = g_strdup_printf ("%s.XXXXXXXX", log->path);
+
+        fd = g_mkstemp_full (temp_name, O_WRONLY | O_APPEND | O_NOFOLLOW | O_CLOEXEC, log->mode);
+
+        if (fd < 0) {
+                g_warning ("GdmSessionLog: unable to log session to '%s': %m", log->path);
+                return;
+        }
+
+        if (fchmod (fd, log->mode) < 0) {
+                g_warning ("GdmSessionLog: unable to set permissions of '%s': %m", temp_name);
+                close (fd);
+                g_unlink (temp_name);
+                return;
+        }
+
+        log->current_path = g_steal_pointer (&temp_name);
+        log->fd = fd;
+}
+
+/* Moves the previous generations out of the way and gives the running
+ * session's log its proper name */
+static void
+install_log_job (GdmSessionLog *log)
+{
+        gboolean rotated;
+
+        rotated = shift_generations (log, 0);
+        g_unlink (log->path);
+
+        if (g_rename (log->current_path, log->path) < 0) {
+                g_warning ("session log '%s' could not be put in place, logging session to '%s' instead: %m",
+                           log->path, log->current_path);
+        } else {
+                g_free (log->current_path);
+                log->current_path = g_strdup (log->path);
+        }
+
+        if (rotated && log->compress)
+                compress_generation (log, 1);
+}
+
+static void
+discard_log_job (GdmSessionLog *log)
+{
+        g_unlink (log->current_path);
+}
+
+/* Copies what the session wrote so far to generation 1 and empties the
+ * log. The session keeps writing to the same file; since it's opened
+ * with O_APPEND, it carries on at the new end. Output written between
+ * the copy and the truncation is lost, as with logrotate's copytruncate */
+static gboolean
+copy_log (GdmSessionLog *log,
+          const char    *target_path)
+{
+        struct stat log_info, source_info;
+        char buffer[COPY_BUFFER_SIZE];
+        int source_fd = -1, target_fd = -1;
+        gboolean copied = FALSE;
+
+        source_fd = g_open (log->current_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC, 0);
+        if (source_fd < 0)
+                goto out;
+
+        /* Only copy the file the session is actually writing to */
+        if (fstat (log->fd, &log_info) < 0 || fstat (source_fd, &source_info) < 0 ||
+            log_info.st_dev != source_info.st_dev || log_info.st_ino != source_info.st_ino)
+                goto out;
+
+        target_fd = g_open (target_path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, log->mode);
+        if (target_fd < 0)
+                goto out;
+
+        while (TRUE) {
+                ssize_t n_read;
+                char *data = buffer;
+
+                n_read = read (source_fd, buffer, sizeof (buffer));
+
+                if (n_read < 0 && errno == EINTR)
+                        continue;
+
+                if (n_read < 0)
+                        goto out;
+
+                if (n_read == 0)
+                        break;
+
+                while (n_read > 0) {
+                        ssize_t written;
+
+                        written = write (target_fd, data, n_read);
+
+                        if (written < 0 && errno == EINTR)
+                                continue;
+
+                        if (written < 0)
+                                goto out;
+
+                        data += written;
+                        n_read -= written;
+                }
+        }
+
+        copied = TRUE;
+
+ out:
+        if (!copied)
+                g_warning ("GdmSessionLog: could not copy '%s' to '%s': %m", log->current_path, target_path);
+
+        if (source_fd >= 0)
+                close (source_fd);
+
+        if (target_fd >= 0)
+                close (target_fd);
+
+        return copied;
+}
+
+static void
+truncate_log_job (GdmSessionLog *log)
+{
+        gboolean copied = FALSE;
+
+        if (log->max_old_logs > 0) {
+                g_autofree char *target_path = NULL;
+                g_autofree char *compressed_path = NULL;
+
+                shift_generations (log, 1);
+
+                target_path = get_generation_path (log, 1);
+                compressed_path = g_strdup_printf ("%s.gz", target_path);
+                g_unlink (target_path);
+                g_unlink (compressed_path);
+
+                copied = copy_log (log, target_path);
+        }
+
+        if (ftruncate (log->fd, 0) < 0) {
+                g_warning ("GdmSessionLog: could not truncate '%s': %m", log->current_path);
+                return;
+        }
+
+        if (copied && log->compress)
+                compress_generation (log, 1);
+}
+
+/**
+ * gdm_session_log_open:
+ *
+ * Opens a fresh log file under a temporary name. Call this before
+ * forking the session, and hand it a duplicate of the returned
+ * descriptor as stdout and stderr. Rotating the earlier generations
+ * is left to gdm_session_log_start().
+ *
+ * Returns: the descriptor, owned by @log, or -1 if the log couldn't be
+ *   opened
+ */
+int
+gdm_session_log_open (GdmSessionLog *log)
+{
+        g_return_val_if_fail (log != NULL, -1);
+        g_return_val_if_fail (log->fd < 0, log->fd);
+
+        run_file_job (log, open_log_job, TRUE);
+
+        return log->fd;
+}
+
+int
+gdm_session_log_get_fd (GdmSessionLog *log)
+{
+        return log->fd;
+}
+
+static gboolean
+on_size_check (gpointer user_data)
+{
+        GdmSessionLog *log = user_data;
+        struct stat file_info;
+
+        if (g_atomic_int_get (&log->job_running))
+                return G_SOURCE_CONTINUE;
+
+        if (fstat (log->fd, &file_info) < 0 || file_info.st_size < log->max_size)
+                return G_SOURCE_CONTINUE;
+
+        gdm_debug (WORKER, "GdmSessionLog: %s reached %" G_GOFFSET_FORMAT " bytes, truncating",
+                           log->path, (goffset) file_info.st_size);
+
+        run_file_job (log, truncate_log_job, FALSE);
+
+        return G_SOURCE_CONTINUE;
+}
+
+/**
+ * gdm_session_log_start:
+ *
+ * Call this in the parent after forking the session. The earlier
+ * generations get rotated, and the new log renamed into place, on a
+ * thread of its own. If the log has a maximum size, it's checked
+ * periodically and truncated when it gets too big, until @log is freed.
+ */
+void
+gdm_session_log_start (GdmSessionLog *log)
+{
+        g_return_if_fail (log != NULL);
+
+        if (log->fd < 0)
+                return;
+
+        log->installed = TRUE;
+        run_file_job (log, install_log_job, FALSE);
+
+        if (log->max_size > 0)
+                log->size_check_id = g_timeout_add_seconds (SIZE_CHECK_INTERVAL, on_size_check, log);
+}
@@ -0,0 +1,48 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GdmSessionLog GdmSessionLog;
+
+GdmSessionLog *gdm_session_log_new          (const char     *path,
+                                             guint           max_old_logs,
+                                             mode_t          mode);
+void           gdm_session_log_free         (GdmSessionLog  *log);
+
+void           gdm_session_log_set_owner    (GdmSessionLog  *log,
+                                             uid_t           uid,
+                                             gid_t           gid);
+void           gdm_session_log_set_max_size (GdmSessionLog  *log,
+                                             goffset         max_size);
+void           gdm_session_log_set_compress (GdmSessionLog  *log,
+                                             gboolean        compress);
+
+int            gdm_session_log_open         (GdmSessionLog  *log);
+int            gdm_session_log_get_fd       (GdmSessionLog  *log);
+
+void           gdm_session_log_start        (GdmSessionLog  *log);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GdmSessionLog, gdm_session_log_free)
+
+G_END_DECLS
@@ -32,21 +32,17 @@
 #include <pwd.h>
 #include <grp.h>
 #include <signal.h>
-#ifdef HAVE_SYS_PRCTL_H
-#include <sys/prctl.h>
-#endif
 
 #include <systemd/sd-daemon.h>
 
-#ifdef ENABLE_SYSTEMD_JOURNAL
-#include <systemd/sd-journal.h>
-#endif
-
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <glib-object.h>
 
 #include "gdm-common.h"
+#include "gdm-child-watch.h"
+#include "gdm-log.h"
+#include "gdm-spawn.h"
 
 #include "gdm-session-worker-job.h"
 
@@ -64,6 +60,7 @@ struct _GdmSessionWorkerJob
 
         char           *server_address;
         char          **environment;
+        GdmEnvironmentTemplate *environment_template;
 };
 
 enum {
@@ -84,66 +81,24 @@ static guint signals [LAST_SIGNAL] = { 0, };
 
 G_DEFINE_TYPE (GdmSessionWorkerJob, gdm_session_worker_job, G_TYPE_OBJECT)
 
-static void
-session_worker_job_setup_journal_fds (void)
-{
-#ifdef ENABLE_SYSTEMD_JOURNAL
-        if (sd_booted () > 0) {
-                const char *identifier = "gdm-session-worker";
-                int out, err;
-
-                out = sd_journal_stream_fd (identifier, LOG_INFO, FALSE);
-                if (out < 0)
-                        return;
-
-                err = sd_journal_stream_fd (identifier, LOG_WARNING, FALSE);
-                if (err < 0) {
-                        close (out);
-                        return;
-                }
-
-                VE_IGNORE_EINTR (dup2 (out, 1));
-                VE_IGNORE_EINTR (dup2 (err, 2));
-                return;
-        }
-#endif
-        return;
-}
-
-static void
-session_worker_job_child_setup (GdmSessionWorkerJob *session_worker_job)
-{
-        sigset_t mask;
-        session_worker_job_setup_journal_fds ();
-
-        /* Terminate the process when the parent dies */
-#ifdef HAVE_SYS_PRCTL_H
-        prctl (PR_SET_PDEATHSIG, SIGTERM);
-#endif
-        /*
-         * Reset signal mask to default since it was altered by the
-         * manager process
-         */
-        sigemptyset (&mask);
-        sigprocmask (SIG_SETMASK, &mask, NULL);
-}
-
 static void
 session_worker_job_child_watch (GPid                 pid,
                                 int                  status,
+                                const struct rusage *rusage,
                                 GdmSessionWorkerJob *job)
 {
-        g_debug ("GdmSessionWorkerJob: child (pid:%d) done (%s:%d)",
-                 (int) pid,
-                 WIFEXITED (status) ? "status"
-                 : WIFSIGNALED (status) ? "signal"
-                 : "unknown",
-                 WIFEXITED (status) ? WEXITSTATUS (status)
-                 : WIFSIGNALED (status) ? WTERMSIG (status)
-                 : -1);
+        gdm_debug (SESSION, "GdmSessionWorkerJob: child (pid:%d) done (%s:%d)",
+                            (int) pid,
+                            WIFEXITED (status) ? "status"
+                            : WIFSIGNALED (status) ? "signal"
+                            : "unknown",
+                            WIFEXITED (status) ? WEXITSTATUS (status)
+                            : WIFSIGNALED (status) ? WTERMSIG (status)
+                            : -1);
 
         g_spawn_close_pid (job->pid);
         job->pid = -1;
+        job->child_watch_id = 0;
 
         if (WIFEXITED (status)) {
                 int code = WEXITSTATUS (status);
@@ -154,42 +109,30 @@ session_worker_job_child_watch (GPid                 pid,
         }
 }
 
-static void
-listify_hash (const char *key,
-              const char *value,
-              GPtrArray  *env)
-{
-        char *str;
-
-        if (value == NULL)
-                value = "";
+/* Keys every job sets for itself on top of its environment template */
+static const char * const job_environment_keys[] = {
+        "GDM_SESSION_DBUS_ADDRESS",
+        "GDM_SESSION_FOR_REAUTH",
+        GDM_DEBUG_CATEGORIES_ENV,
+        NULL
+};
 
-        str = g_strdup_printf ("%s=%s", key, value);
-        g_ptr_array_add (env, str);
-}
+static GdmEnvironmentTemplate *daemon_environment_template;
 
-static void
-copy_environment_to_hash (GdmSessionWorkerJob *job,
-                          GHashTable          *hash)
+static GdmEnvironmentTemplate *
+get_daemon_environment_template (void)
 {
-        g_auto(GStrv) environment = NULL;
-        gint   i;
-
-        if (job->environment != NULL) {
-                environment = g_strdupv (job->environment);
-        } else {
-                environment = g_get_environ ();
+        /* The daemon's own environment only changes when the language
+         * configuration is reloaded, so it's rare for this to rebuild */
+        if (daemon_environment_template == NULL ||
+            !gdm_environment_template_matches (daemon_environment_template,
+                                               (const char * const *) environ)) {
+                g_clear_pointer (&daemon_environment_template, gdm_environment_template_unref);
+                daemon_environment_template = gdm_environment_template_new ((const char * const *) environ,
+                                                                            job_environment_keys);
         }
 
-        for (i = 0; environment[i]; i++) {
-                g_auto(GStrv) parts = NULL;
-
-                parts = g_strsplit (environment[i], "=", 2);
-
-                if (parts[0] != NULL && parts[1] != NULL) {
-                        g_hash_table_insert (hash, g_strdup (parts[0]), g_strdup (parts[1]));
-                }
-        }
+        return daemon_environment_template;
 }
 
 static GPtrArray *
@@ -219,29 +162,41 @@ get_job_arguments (GdmSessionWorkerJob *job,
         return g_steal_pointer (&args);
 }
 
-static GPtrArray *
-get_job_environment (GdmSessionWorkerJob *job)
+static char **
+get_job_environment (GdmSessionWorkerJob     *job,
+                     GdmEnvironmentTemplate **template)
 {
-        g_autoptr(GPtrArray) env = NULL;
-        g_autoptr(GHashTable) hash = NULL;
-
-        env = g_ptr_array_new_with_free_func (g_free);
+        GdmEnvironmentOverlay overlay[G_N_ELEMENTS (job_environment_keys) - 1];
+        gsize n_overlay = 0;
+        g_auto (GStrv) debug_categories = NULL;
+        g_autofree char *debug_categories_list = NULL;
 
-        /* create a hash table of current environment, then update keys has necessary */
-        hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
-        copy_environment_to_hash (job, hash);
+        if (job->environment_template != NULL) {
+                *template = gdm_environment_template_ref (job->environment_template);
+        } else {
+                *template = gdm_environment_template_ref (get_daemon_environment_template ());
+        }
 
-        g_hash_table_insert (hash, g_strdup ("GDM_SESSION_DBUS_ADDRESS"), g_strdup (job->server_address));
+        overlay[n_overlay].key = "GDM_SESSION_DBUS_ADDRESS";
+        overlay[n_overlay].value = job->server_address;
+        n_overlay++;
 
         if (job->for_reauth) {
-                g_hash_table_insert (hash, g_strdup ("GDM_SESSION_FOR_REAUTH"), g_strdup ("1"));
+                overlay[n_overlay].key = "GDM_SESSION_FOR_REAUTH";
+                overlay[n_overlay].value = "1";
+                n_overlay++;
         }
 
-        g_hash_table_foreach (hash, (GHFunc)listify_hash, env);
+        if (gdm_log_get_debug_categories () != 0) {
+                debug_categories = gdm_log_get_debug_category_names (gdm_log_get_debug_categories ());
+                debug_categories_list = g_strjoinv (",", debug_categories);
 
-        g_ptr_array_add (env, NULL);
+                overlay[n_overlay].key = GDM_DEBUG_CATEGORIES_ENV;
+                overlay[n_overlay].value = debug_categories_list;
+                n_overlay++;
+        }
 
-        return g_steal_pointer (&env);
+        return gdm_environment_template_build (*template, overlay, n_overlay);
 }
 
 static gboolean
@@ -250,42 +205,46 @@ gdm_session_worker_job_spawn (GdmSessionWorkerJob *session_worker_job,
 {
         g_autoptr(GError) error = NULL;
         g_autoptr(GPtrArray) args = NULL;
-        g_autoptr(GPtrArray) env = NULL;
+        g_autoptr(GdmEnvironmentTemplate) template = NULL;
+        g_autofree char **env = NULL;
         gboolean         ret;
 
-        g_debug ("GdmSessionWorkerJob: Running session_worker_job process: %s %s",
-                 name != NULL? name : "", session_worker_job->command);
+        gdm_debug (SESSION, "GdmSessionWorkerJob: Running session_worker_job process: %s %s",
+                            name != NULL? name : "", session_worker_job->command);
 
         args = get_job_arguments (session_worker_job, name);
 
         if (args == NULL) {
                 return FALSE;
         }
-        env = get_job_environment (session_worker_job);
-
-        ret = g_spawn_async_with_pipes (NULL,
-                                        (char **) args->pdata,
-                                        (char **)env->pdata,
-                                        G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_FILE_AND_ARGV_ZERO,
-                                        (GSpawnChildSetupFunc)session_worker_job_child_setup,
-                                        session_worker_job,
-                                        &session_worker_job->pid,
-                                        NULL,
-                                        NULL,
-                                        NULL,
-                                        &error);
+        env = get_job_environment (session_worker_job, &template);
+
+        /* Nothing has to run in the child, so gdm_spawn () can skip
+         * copying the daemon's address space. The worker connects its
+         * output to the journal itself, see session-worker-main.c */
+        ret = gdm_spawn ((const char *) args->pdata[0],
+                         (const char * const *) args->pdata + 1,
+                         (const char * const *) env,
+                         -1,
+                         -1,
+                         -1,
+                         GDM_SPAWN_SEARCH_PATH | GDM_SPAWN_RESET_SIGNAL_MASK,
+                         NULL,
+                         NULL,
+                         &session_worker_job->pid,
+                         &error);
 
         if (! ret) {
                 g_warning ("Could not start command '%s': %s",
                            session_worker_job->command,
                            error->message);
         } else {
-                g_debug ("GdmSessionWorkerJob: : SessionWorkerJob on pid %d", (int)session_worker_job->pid);
-        }
+                gdm_debug (SESSION, "GdmSessionWorkerJob: : SessionWorkerJob on pid %d", (int)session_worker_job->pid);
 
-        session_worker_job->child_watch_id = g_child_watch_add (session_worker_job->pid,
-                                                                (GChildWatchFunc)session_worker_job_child_watch,
-                                                                session_worker_job);
+                session_worker_job->child_watch_id = gdm_child_watch_add (session_worker_job->pid,
+                                                                          (GdmChildWatchFunc) session_worker_job_child_watch,
+                                                                          session_worker_job);
+        }
 
         return ret;
 }
@@ -304,7 +263,7 @@ gdm_session_worker_job_start (GdmSessionWorkerJob *session_worker_job,
 
         g_return_val_if_fail (GDM_IS_SESSION_WORKER_JOB (session_worker_job), FALSE);
 
-        g_debug ("GdmSessionWorkerJob: Starting worker...");
+        gdm_debug (SESSION, "GdmSessionWorkerJob: Starting worker...");
 
         res = gdm_session_worker_job_spawn (session_worker_job, name);
 
@@ -316,11 +275,11 @@ handle_session_worker_job_death (GdmSessionWorkerJob *session_worker_job)
 {
         int exit_status;
 
-        g_debug ("GdmSessionWorkerJob: Waiting on process %d", session_worker_job->pid);
+        gdm_debug (SESSION, "GdmSessionWorkerJob: Waiting on process %d", session_worker_job->pid);
         exit_status = gdm_wait_on_and_disown_pid (session_worker_job->pid, 5);
 
         if (WIFEXITED (exit_status) && (WEXITSTATUS (exit_status) != 0)) {
-                g_debug ("GdmSessionWorkerJob: Wait on child process failed");
+                gdm_debug (SESSION, "GdmSessionWorkerJob: Wait on child process failed");
         } else {
                 /* exited normally */
         }
@@ -328,7 +287,7 @@ handle_session_worker_job_death (GdmSessionWorkerJob *session_worker_job)
         g_spawn_close_pid (session_worker_job->pid);
         session_worker_job->pid = -1;
 
-        g_debug ("GdmSessionWorkerJob: SessionWorkerJob died");
+        gdm_debug (SESSION, "GdmSessionWorkerJob: SessionWorkerJob died");
 }
 
 void
@@ -347,6 +306,57 @@ gdm_session_worker_job_stop_now (GdmSessionWorkerJob *session_worker_job)
         handle_session_worker_job_death (session_worker_job);
 }
 
+/* Stops every job in @jobs and waits for all of them together, so a
+ * worker that is slow to exit delays the others by at most one timeout
+ */
+void
+gdm_session_worker_job_stop_all_now (GPtrArray *jobs)
+{
+        g_autoptr(GArray) pids = NULL;
+        g_autofree int *statuses = NULL;
+        guint i;
+
+        pids = g_array_new (FALSE, FALSE, sizeof (GPid));
+
+        for (i = 0; i < jobs->len; i++) {
+                GdmSessionWorkerJob *session_worker_job = g_ptr_array_index (jobs, i);
+
+                g_return_if_fail (GDM_IS_SESSION_WORKER_JOB (session_worker_job));
+
+                if (session_worker_job->pid <= 1) {
+                        continue;
+                }
+
+                /* remove watch source before we can wait on child */
+                g_clear_handle_id (&session_worker_job->child_watch_id, g_source_remove);
+
+                gdm_session_worker_job_stop (session_worker_job);
+                g_array_append_val (pids, session_worker_job->pid);
+        }
+
+        if (pids->len == 0) {
+                return;
+        }
+
+        gdm_debug (SESSION, "GdmSessionWorkerJob: Waiting on %u processes", pids->len);
+
+        statuses = g_new0 (int, pids->len);
+        gdm_child_wait_all ((const GPid *) pids->data, statuses, pids->len, 5);
+
+        for (i = 0; i < jobs->len; i++) {
+                GdmSessionWorkerJob *session_worker_job = g_ptr_array_index (jobs, i);
+
+                if (session_worker_job->pid <= 1) {
+                        continue;
+                }
+
+                g_spawn_close_pid (session_worker_job->pid);
+                session_worker_job->pid = -1;
+        }
+
+        gdm_debug (SESSION, "GdmSessionWorkerJob: SessionWorkerJobs died");
+}
+
 void
 gdm_session_worker_job_stop (GdmSessionWorkerJob *session_worker_job)
 {
@@ -358,7 +368,7 @@ gdm_session_worker_job_stop (GdmSessionWorkerJob *session_worker_job)
                 return;
         }
 
-        g_debug ("GdmSessionWorkerJob: Stopping job pid:%d", session_worker_job->pid);
+        gdm_debug (SESSION, "GdmSessionWorkerJob: Stopping job pid:%d", session_worker_job->pid);
 
         res = gdm_signal_pid (session_worker_job->pid, SIGTERM);
 
@@ -399,7 +409,41 @@ gdm_session_worker_job_set_environment (GdmSessionWorkerJob *session_worker_job,
 {
         g_return_if_fail (GDM_IS_SESSION_WORKER_JOB (session_worker_job));
 
+        g_strfreev (session_worker_job->environment);
         session_worker_job->environment = g_strdupv ((char **) environment);
+
+        g_clear_pointer (&session_worker_job->environment_template, gdm_environment_template_unref);
+        if (environment != NULL) {
+                session_worker_job->environment_template = gdm_environment_template_new (environment,
+                                                                                         job_environment_keys);
+        }
+}
+
+/**
+ * gdm_session_worker_job_new_environment_template:
+ * @environment: environment for session workers
+ *
+ * Prepares @environment once, so that any number of jobs can be given
+ * it with gdm_session_worker_job_set_environment_template().
+ */
+GdmEnvironmentTemplate *
+gdm_session_worker_job_new_environment_template (const char * const *environment)
+{
+        return gdm_environment_template_new (environment, job_environment_keys);
+}
+
+void
+gdm_session_worker_job_set_environment_template (GdmSessionWorkerJob    *session_worker_job,
+                                                 GdmEnvironmentTemplate *template)
+{
+        g_return_if_fail (GDM_IS_SESSION_WORKER_JOB (session_worker_job));
+
+        g_clear_pointer (&session_worker_job->environment, g_strfreev);
+        g_clear_pointer (&session_worker_job->environment_template, gdm_environment_template_unref);
+
+        if (template != NULL) {
+                session_worker_job->environment_template = gdm_environment_template_ref (template);
+        }
 }
 
 static void
@@ -416,6 +460,8 @@ gdm_session_worker_job_finalize (GObject *object)
 
         g_free (session_worker_job->command);
         g_free (session_worker_job->server_address);
+        g_strfreev (session_worker_job->environment);
+        g_clear_pointer (&session_worker_job->environment_template, gdm_environment_template_unref);
 
         G_OBJECT_CLASS (gdm_session_worker_job_parent_class)->finalize (object);
 }
@@ -24,6 +24,8 @@
 
 #include <glib-object.h>
 
+#include "gdm-environment-template.h"
+
 G_BEGIN_DECLS
 
 #define GDM_TYPE_SESSION_WORKER_JOB (gdm_session_worker_job_get_type ())
@@ -36,10 +38,14 @@ void                    gdm_session_worker_job_set_for_reauth (GdmSessionWorkerJ
                                                                gboolean             for_reauth);
 void                    gdm_session_worker_job_set_environment    (GdmSessionWorkerJob *session_worker_job,
                                                                    const char * const  *environment);
+GdmEnvironmentTemplate *gdm_session_worker_job_new_environment_template (const char * const *environment);
+void                    gdm_session_worker_job_set_environment_template (GdmSessionWorkerJob    *session_worker_job,
+                                                                         GdmEnvironmentTemplate *template);
 gboolean                gdm_session_worker_job_start              (GdmSessionWorkerJob *session_worker_job,
                                                                    const char          *name);
 void                    gdm_session_worker_job_stop               (GdmSessionWorkerJob *session_worker_job);
 void                    gdm_session_worker_job_stop_now           (GdmSessionWorkerJob *session_worker_job);
+void                    gdm_session_worker_job_stop_all_now       (GPtrArray           *jobs);
 
 GPid                    gdm_session_worker_job_get_pid            (GdmSessionWorkerJob *session_worker_job);
 
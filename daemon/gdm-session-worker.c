@@ -64,6 +64,8 @@
 #endif /* HAVE_SELINUX */
 
 #include "gdm-common.h"
+#include "gdm-child-watch.h"
+#include "gdm-spawn.h"
 #include "gdm-log.h"
 
 #ifdef SUPPORTS_PAM_EXTENSIONS
@@ -84,12 +86,16 @@
 #endif
 
 #include "gdm-session-settings.h"
+#include "gdm-session-log.h"
+#include "gdm-settings-direct.h"
+#include "gdm-settings-keys.h"
 
 #define GDM_SESSION_DBUS_PATH         "/org/gnome/DisplayManager/Session"
 #define GDM_SESSION_DBUS_NAME         "org.gnome.DisplayManager.Session"
 #define GDM_SESSION_DBUS_ERROR_CANCEL "org.gnome.DisplayManager.Session.Error.Cancel"
 
 #define GDM_WORKER_DBUS_PATH "/org/gnome/DisplayManager/Worker"
+#define GDM_WORKER_DBUS_INTERFACE "org.gnome.DisplayManager.Worker"
 
 #ifndef GDM_PASSWD_AUXILLARY_BUFFER_SIZE
 #define GDM_PASSWD_AUXILLARY_BUFFER_SIZE 1024
@@ -107,7 +113,6 @@
 #define GDM_SESSION_LOG_FILENAME "session.log"
 #endif
 
-#define MAX_FILE_SIZE     65536
 #define MAX_LOGS          5
 
 #define RELEASE_DISPLAY_SIGNAL (SIGRTMAX)
@@ -133,6 +138,7 @@ struct _GdmSessionWorker
 
         GPid              child_pid;
         guint             child_watch_id;
+        GdmSessionLog    *session_log;
 
         /* from Setup */
         char             *service;
@@ -160,11 +166,18 @@ struct _GdmSessionWorker
         guint32           display_is_initial : 1;
         guint32           seat0_has_vts : 1;
         guint             state_change_idle_id;
+        GdmSessionWorkerState target_state;
         GdmSessionDisplayMode display_mode;
 
         char                 *server_address;
         GDBusConnection      *connection;
         GdmDBusWorkerManager *manager;
+        guint                 connection_filter_id;
+
+        /* protects query_cancellable, which is cancelled from the
+         * connection's message filter thread */
+        GMutex                query_lock;
+        GCancellable         *query_cancellable;
 
         GHashTable         *reauthentication_requests;
 
@@ -216,186 +229,6 @@ G_DEFINE_TYPE_WITH_CODE (GdmSessionWorker,
                          G_IMPLEMENT_INTERFACE (GDM_DBUS_TYPE_WORKER,
                                                 worker_interface_init))
 
-/* adapted from glib script_execute */
-static void
-script_execute (const gchar *file,
-                char       **argv,
-                char       **envp,
-                gboolean     search_path)
-{
-        /* Count the arguments.  */
-        int argc = 0;
-
-        while (argv[argc]) {
-                ++argc;
-        }
-
-        /* Construct an argument list for the shell.  */
-        {
-                char **new_argv;
-
-                new_argv = g_new0 (gchar*, argc + 2); /* /bin/sh and NULL */
-
-                new_argv[0] = (char *) "/bin/sh";
-                new_argv[1] = (char *) file;
-                while (argc > 0) {
-                        new_argv[argc + 1] = argv[argc];
-                        --argc;
-                }
-
-                /* Execute the shell. */
-                if (envp) {
-                        execve (new_argv[0], new_argv, envp);
-                } else {
-                        execv (new_argv[0], new_argv);
-                }
-
-                g_free (new_argv);
-        }
-}
-
-static char *
-my_strchrnul (const char *str, char c)
-{
-        char *p = (char*) str;
-        while (*p && (*p != c)) {
-                ++p;
-        }
-
-        return p;
-}
-
-/* adapted from glib g_execute */
-static gint
-gdm_session_execute (const char *file,
-                     char      **argv,
-                     char      **envp,
-                     gboolean    search_path)
-{
-        if (*file == '\0') {
-                /* We check the simple case first. */
-                errno = ENOENT;
-                return -1;
-        }
-
-        if (!search_path || strchr (file, '/') != NULL) {
-                /* Don't search when it contains a slash. */
-                if (envp) {
-                        execve (file, argv, envp);
-                } else {
-                        execv (file, argv);
-                }
-
-                if (errno == ENOEXEC) {
-                        script_execute (file, argv, envp, FALSE);
-                }
-        } else {
-                gboolean got_eacces = 0;
-                const char *path, *p;
-                char *name, *freeme;
-                gsize len;
-                gsize pathlen;
-
-                path = g_getenv ("PATH");
-                if (path == NULL) {
-                        /* There is no `PATH' in the environment.  The default
-                         * search path in libc is the current directory followed by
-                         * the path `confstr' returns for `_CS_PATH'.
-                         */
-
-                        /* In GLib we put . last, for security, and don't use the
-                         * unportable confstr(); UNIX98 does not actually specify
-                         * what to search if PATH is unset. POSIX may, dunno.
-                         */
-
-                        path = "/bin:/usr/bin:.";
-                }
-
-                len = strlen (file) + 1;
-                pathlen = strlen (path);
-                freeme = name = g_malloc (pathlen + len + 1);
-
-                /* Copy the file name at the top, including '\0'  */
-                memcpy (name + pathlen + 1, file, len);
-                name = name + pathlen;
-                /* And add the slash before the filename  */
-                *name = '/';
-
-                p = path;
-                do {
-                        char *startp;
-
-                        path = p;
-                        p = my_strchrnul (path, ':');
-
-                        if (p == path) {
-                                /* Two adjacent colons, or a colon at the beginning or the end
-                                 * of `PATH' means to search the current directory.
-                                 */
-                                startp = name + 1;
-                        } else {
-                                startp = memcpy (name - (p - path), path, p - path);
-                        }
-
-                        /* Try to execute this name.  If it works, execv will not return.  */
-                        if (envp) {
-                                execve (startp, argv, envp);
-                        } else {
-                                execv (startp, argv);
-                        }
-
-                        if (errno == ENOEXEC) {
-                                script_execute (startp, argv, envp, search_path);
-                        }
-
-                        switch (errno) {
-                        case EACCES:
-                                /* Record the we got a `Permission denied' error.  If we end
-                                 * up finding no executable we can use, we want to diagnose
-                                 * that we did find one but were denied access.
-                                 */
-                                got_eacces = TRUE;
-
-                                /* FALL THRU */
-
-                        case ENOENT:
-#ifdef ESTALE
-                        case ESTALE:
-#endif
-#ifdef ENOTDIR
-                        case ENOTDIR:
-#endif
-                                /* Those errors indicate the file is missing or not executable
-                                 * by us, in which case we want to just try the next path
-                                 * directory.
-                                 */
-                                break;
-
-                        default:
-                                /* Some other error means we found an executable file, but
-                                 * something went wrong executing it; return the error to our
-                                 * caller.
-                                 */
-                                g_free (freeme);
-                                return -1;
-                        }
-                } while (*p++ != '\0');
-
-                /* We tried every element and none of them worked.  */
-                if (got_eacces) {
-                        /* At least one failure was due to permissions, so report that
-                         * error.
-                         */
-                        errno = EACCES;
-                }
-
-                g_free (freeme);
-        }
-
-        /* Return the error from the last attempt (probably ENOENT).  */
-        return -1;
-}
-
 /*
  * This function is called with username set to NULL to update the
  * auditor username value.
@@ -411,8 +244,8 @@ gdm_session_worker_get_username (GdmSessionWorker  *worker,
         if (pam_get_item (worker->pam_handle, PAM_USER, &item) == PAM_SUCCESS) {
                 if (username != NULL) {
                         *username = g_strdup ((char *) item);
-                        g_debug ("GdmSessionWorker: username is '%s'",
-                                 *username != NULL ? *username : "<unset>");
+                        gdm_debug (WORKER, "GdmSessionWorker: username is '%s'",
+                                           *username != NULL ? *username : "<unset>");
                 }
 
                 if (worker->auditor != NULL) {
@@ -435,7 +268,7 @@ attempt_to_load_user_settings (GdmSessionWorker *worker,
         if (gdm_session_settings_is_loaded (worker->user_settings))
                 return;
 
-        g_debug ("GdmSessionWorker: attempting to load user settings");
+        gdm_debug (WORKER, "GdmSessionWorker: attempting to load user settings");
         gdm_session_settings_load (worker->user_settings,
                                    username);
 }
@@ -448,9 +281,9 @@ gdm_session_worker_update_username (GdmSessionWorker *worker)
 
         res = gdm_session_worker_get_username (worker, &username);
         if (res) {
-                g_debug ("GdmSessionWorker: old-username='%s' new-username='%s'",
-                         worker->username != NULL ? worker->username : "<unset>",
-                         username != NULL ? username : "<unset>");
+                gdm_debug (WORKER, "GdmSessionWorker: old-username='%s' new-username='%s'",
+                                   worker->username != NULL ? worker->username : "<unset>",
+                                   username != NULL ? username : "<unset>");
 
 
                 gdm_session_auditor_set_username (worker->auditor, worker->username);
@@ -460,7 +293,7 @@ gdm_session_worker_update_username (GdmSessionWorker *worker)
                      (strcmp (worker->username, username) == 0)))
                         return;
 
-                g_debug ("GdmSessionWorker: setting username to '%s'", username);
+                gdm_debug (WORKER, "GdmSessionWorker: setting username to '%s'", username);
 
                 g_free (worker->username);
                 worker->username = g_steal_pointer (&username);
@@ -480,17 +313,98 @@ gdm_session_worker_update_username (GdmSessionWorker *worker)
         }
 }
 
+static void
+on_query_ready (GObject      *source_object,
+                GAsyncResult *result,
+                gpointer      user_data)
+{
+        GAsyncResult **result_out = user_data;
+
+        *result_out = g_object_ref (result);
+}
+
+static gboolean
+on_query_cancelled (GCancellable *cancellable,
+                    gpointer      user_data)
+{
+        /* Nothing to do, this source is only here to wake up the
+         * nested main context as soon as the query gets cancelled */
+        return G_SOURCE_REMOVE;
+}
+
+/* PAM calls into the conversation function synchronously, so queries
+ * to the user are made with async calls dispatched from a private main
+ * context that we iterate until the reply comes in or the query is
+ * cancelled with CancelQuery.
+ */
+static GMainContext *
+gdm_session_worker_begin_query (GdmSessionWorker *worker)
+{
+        GMainContext *context;
+
+        context = g_main_context_new ();
+        g_main_context_push_thread_default (context);
+
+        g_mutex_lock (&worker->query_lock);
+        g_clear_object (&worker->query_cancellable);
+        worker->query_cancellable = g_cancellable_new ();
+        g_mutex_unlock (&worker->query_lock);
+
+        return context;
+}
+
+static void
+gdm_session_worker_wait_for_query (GdmSessionWorker  *worker,
+                                   GMainContext      *context,
+                                   GAsyncResult     **result)
+{
+        g_autoptr(GSource) cancelled_source = NULL;
+
+        cancelled_source = g_cancellable_source_new (worker->query_cancellable);
+        g_source_set_callback (cancelled_source,
+                               (GSourceFunc) on_query_cancelled,
+                               NULL, NULL);
+        g_source_attach (cancelled_source, context);
+
+        while (*result == NULL) {
+                g_main_context_iteration (context, TRUE);
+        }
+
+        g_source_destroy (cancelled_source);
+
+        if (g_cancellable_is_cancelled (worker->query_cancellable)) {
+                gdm_debug (WORKER, "GdmSessionWorker: query was cancelled");
+                worker->cancelled = TRUE;
+        }
+
+        g_mutex_lock (&worker->query_lock);
+        g_clear_object (&worker->query_cancellable);
+        g_mutex_unlock (&worker->query_lock);
+
+        g_main_context_pop_thread_default (context);
+}
+
 static gboolean
 gdm_session_worker_ask_question (GdmSessionWorker *worker,
                                  const char       *question,
                                  char            **answerp)
 {
-        return gdm_dbus_worker_manager_call_info_query_sync (worker->manager,
-                                                             worker->service,
-                                                             question,
-                                                             answerp,
-                                                             NULL,
-                                                             NULL);
+        g_autoptr(GMainContext) context = NULL;
+        g_autoptr(GAsyncResult) result = NULL;
+
+        context = gdm_session_worker_begin_query (worker);
+        gdm_dbus_worker_manager_call_info_query (worker->manager,
+                                                 worker->service,
+                                                 question,
+                                                 worker->query_cancellable,
+                                                 on_query_ready,
+                                                 &result);
+        gdm_session_worker_wait_for_query (worker, context, &result);
+
+        return gdm_dbus_worker_manager_call_info_query_finish (worker->manager,
+                                                               answerp,
+                                                               result,
+                                                               NULL);
 }
 
 static gboolean
@@ -498,34 +412,51 @@ gdm_session_worker_ask_for_secret (GdmSessionWorker *worker,
                                    const char       *question,
                                    char            **answerp)
 {
-        return gdm_dbus_worker_manager_call_secret_info_query_sync (worker->manager,
-                                                                    worker->service,
-                                                                    question,
-                                                                    answerp,
-                                                                    NULL,
-                                                                    NULL);
+        g_autoptr(GMainContext) context = NULL;
+        g_autoptr(GAsyncResult) result = NULL;
+
+        context = gdm_session_worker_begin_query (worker);
+        gdm_dbus_worker_manager_call_secret_info_query (worker->manager,
+                                                        worker->service,
+                                                        question,
+                                                        worker->query_cancellable,
+                                                        on_query_ready,
+                                                        &result);
+        gdm_session_worker_wait_for_query (worker, context, &result);
+
+        return gdm_dbus_worker_manager_call_secret_info_query_finish (worker->manager,
+                                                                      answerp,
+                                                                      result,
+                                                                      NULL);
 }
 
+/* Informational messages don't need an answer, so we don't wait for
+ * the reply; messages on the connection are still delivered in order.
+ */
 static gboolean
 gdm_session_worker_report_info (GdmSessionWorker *worker,
                                 const char       *info)
 {
-        return gdm_dbus_worker_manager_call_info_sync (worker->manager,
-                                                       worker->service,
-                                                       info,
-                                                       NULL,
-                                                       NULL);
+        gdm_dbus_worker_manager_call_info (worker->manager,
+                                           worker->service,
+                                           info,
+                                           NULL,
+                                           NULL,
+                                           NULL);
+        return TRUE;
 }
 
 static gboolean
 gdm_session_worker_report_problem (GdmSessionWorker *worker,
                                    const char       *problem)
 {
-        return gdm_dbus_worker_manager_call_problem_sync (worker->manager,
-                                                          worker->service,
-                                                          problem,
-                                                          NULL,
-                                                          NULL);
+        gdm_dbus_worker_manager_call_problem (worker->manager,
+                                              worker->service,
+                                              problem,
+                                              NULL,
+                                              NULL,
+                                              NULL);
+        return TRUE;
 }
 
 #ifdef SUPPORTS_PAM_EXTENSIONS
@@ -536,12 +467,14 @@ gdm_session_worker_ask_list_of_choices (GdmSessionWorker *worker,
                                         char            **answerp)
 {
         g_autoptr(GVariant) choices_as_variant = NULL;
+        g_autoptr(GMainContext) context = NULL;
+        g_autoptr(GAsyncResult) result = NULL;
         g_autoptr(GError) error = NULL;
         GVariantBuilder builder;
         gboolean res;
         size_t i;
 
-        g_debug ("GdmSessionWorker: presenting user with list of choices:");
+        gdm_debug (WORKER, "GdmSessionWorker: presenting user with list of choices:");
 
         g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{ss}"));
 
@@ -551,25 +484,32 @@ gdm_session_worker_ask_list_of_choices (GdmSessionWorker *worker,
                         g_variant_builder_clear (&builder);
                         return FALSE;
                 }
-                g_debug ("GdmSessionWorker:        choices['%s'] = \"%s\"", list->items[i].key, list->items[i].text);
+                gdm_debug (WORKER, "GdmSessionWorker:        choices['%s'] = \"%s\"", list->items[i].key, list->items[i].text);
                 g_variant_builder_add (&builder, "{ss}", list->items[i].key, list->items[i].text);
         }
-        g_debug ("GdmSessionWorker: (and waiting for reply)");
+        gdm_debug (WORKER, "GdmSessionWorker: (and waiting for reply)");
 
         choices_as_variant = g_variant_builder_end (&builder);
 
-        res = gdm_dbus_worker_manager_call_choice_list_query_sync (worker->manager,
-                                                                    worker->service,
-                                                                    prompt_message,
-                                                                    choices_as_variant,
-                                                                    answerp,
-                                                                    NULL,
-                                                                    &error);
+        context = gdm_session_worker_begin_query (worker);
+        gdm_dbus_worker_manager_call_choice_list_query (worker->manager,
+                                                        worker->service,
+                                                        prompt_message,
+                                                        choices_as_variant,
+                                                        worker->query_cancellable,
+                                                        on_query_ready,
+                                                        &result);
+        gdm_session_worker_wait_for_query (worker, context, &result);
+
+        res = gdm_dbus_worker_manager_call_choice_list_query_finish (worker->manager,
+                                                                     answerp,
+                                                                     result,
+                                                                     &error);
 
         if (! res) {
-                g_debug ("GdmSessionWorker: list request failed: %s", error->message);
+                gdm_debug (WORKER, "GdmSessionWorker: list request failed: %s", error->message);
         } else {
-                g_debug ("GdmSessionWorker: user selected '%s'", *answerp);
+                gdm_debug (WORKER, "GdmSessionWorker: user selected '%s'", *answerp);
         }
 
         return res;
@@ -590,11 +530,13 @@ gdm_session_worker_process_custom_json_protocol (GdmSessionWorker            *wo
 {
         g_autoptr(GError) error = NULL;
         g_autoptr(JsonParser) parser = NULL;
+        g_autoptr(GMainContext) context = NULL;
+        g_autoptr(GAsyncResult) result = NULL;
         g_autofree char *json_reply = NULL;
 
-        g_debug ("GdmSessionWorker: sending custom JSON protocol request: %s v%d",
-                 request->protocol_name, request->version);
-        g_debug ("GdmSessionWorker: (and waiting for reply)");
+        gdm_debug (WORKER, "GdmSessionWorker: sending custom JSON protocol request: %s v%d",
+                           request->protocol_name, request->version);
+        gdm_debug (WORKER, "GdmSessionWorker: (and waiting for reply)");
 
         if (!request->json) {
                 g_warning ("GdmSessionWorker: custom JSON request is not valid");
@@ -608,14 +550,21 @@ gdm_session_worker_process_custom_json_protocol (GdmSessionWorker            *wo
                 return FALSE;
         }
 
-        if (!gdm_dbus_worker_manager_call_custom_json_request_sync (worker->manager,
-                                                                    worker->service,
-                                                                    request->protocol_name,
-                                                                    request->version,
-                                                                    request->json,
-                                                                    &response->json,
-                                                                    NULL,
-                                                                    &error)) {
+        context = gdm_session_worker_begin_query (worker);
+        gdm_dbus_worker_manager_call_custom_json_request (worker->manager,
+                                                          worker->service,
+                                                          request->protocol_name,
+                                                          request->version,
+                                                          request->json,
+                                                          worker->query_cancellable,
+                                                          on_query_ready,
+                                                          &result);
+        gdm_session_worker_wait_for_query (worker, context, &result);
+
+        if (!gdm_dbus_worker_manager_call_custom_json_request_finish (worker->manager,
+                                                                      &response->json,
+                                                                      result,
+                                                                      &error)) {
                 g_warning ("GdmSessionWorker: custom JSON request failed: %s",
                            error->message);
                 return FALSE;
@@ -656,7 +605,7 @@ gdm_session_worker_process_extended_pam_message (GdmSessionWorker          *work
                 GdmPamExtensionChoiceListRequest *list_request = (GdmPamExtensionChoiceListRequest *) extended_message;
                 GdmPamExtensionChoiceListResponse *list_response = malloc (GDM_PAM_EXTENSION_CHOICE_LIST_RESPONSE_SIZE);
 
-                g_debug ("GdmSessionWorker: received extended pam message '%s'", GDM_PAM_EXTENSION_CHOICE_LIST);
+                gdm_debug (PAM, "GdmSessionWorker: received extended pam message '%s'", GDM_PAM_EXTENSION_CHOICE_LIST);
 
                 GDM_PAM_EXTENSION_CHOICE_LIST_RESPONSE_INIT (list_response);
 
@@ -673,7 +622,7 @@ gdm_session_worker_process_extended_pam_message (GdmSessionWorker          *work
                 GdmPamExtensionJSONProtocol *json_request = (GdmPamExtensionJSONProtocol *) extended_message;
                 g_autofree GdmPamExtensionJSONProtocol *json_response = malloc (GDM_PAM_EXTENSION_CUSTOM_JSON_SIZE);
 
-                g_debug ("GdmSessionWorker: received extended pam message '%s'", GDM_PAM_EXTENSION_CUSTOM_JSON);
+                gdm_debug (PAM, "GdmSessionWorker: received extended pam message '%s'", GDM_PAM_EXTENSION_CUSTOM_JSON);
 
                 GDM_PAM_EXTENSION_CUSTOM_JSON_RESPONSE_INIT (json_response,
                                                               json_request->protocol_name,
@@ -686,7 +635,7 @@ gdm_session_worker_process_extended_pam_message (GdmSessionWorker          *work
                 *response = GDM_PAM_EXTENSION_MESSAGE_TO_PAM_REPLY (g_steal_pointer (&json_response));
                 return TRUE;
         } else {
-                g_debug ("GdmSessionWorker: received extended pam message of unknown type %u", (unsigned int) extended_message->type);
+                gdm_debug (PAM, "GdmSessionWorker: received extended pam message of unknown type %u", (unsigned int) extended_message->type);
                 return FALSE;
 
         }
@@ -744,8 +693,8 @@ gdm_session_worker_process_pam_message (GdmSessionWorker          *worker,
                 return gdm_session_worker_process_extended_pam_message (worker, query, response);
 #endif
 
-        g_debug ("GdmSessionWorker: received pam message of type %u with payload '%s'",
-                 query->msg_style, query->msg);
+        gdm_debug (PAM, "GdmSessionWorker: received pam message of type %u with payload '%s'",
+                        query->msg_style, query->msg);
 
         utf8_msg = convert_to_utf8 (query->msg);
 
@@ -795,7 +744,7 @@ gdm_session_worker_process_pam_message (GdmSessionWorker          *worker,
 
                 memset (user_answer, '\0', strlen (user_answer));
 
-                g_debug ("GdmSessionWorker: trying to get updated username");
+                gdm_debug (WORKER, "GdmSessionWorker: trying to get updated username");
 
                 res = TRUE;
         }
@@ -874,7 +823,7 @@ gdm_session_worker_pam_new_messages_handler (int                        number_o
         int                  return_value;
         int                  i;
 
-        g_debug ("GdmSessionWorker: %d new messages received from PAM\n", number_of_messages);
+        gdm_debug (PAM, "GdmSessionWorker: %d new messages received from PAM\n", number_of_messages);
 
         return_value = PAM_CONV_ERR;
 
@@ -929,9 +878,9 @@ gdm_session_worker_pam_new_messages_handler (int                        number_o
                 *responses = replies;
         }
 
-        g_debug ("GdmSessionWorker: PAM conversation returning %d: %s",
-                 return_value,
-                 pam_strerror (worker->pam_handle, return_value));
+        gdm_debug (PAM, "GdmSessionWorker: PAM conversation returning %d: %s",
+                        return_value,
+                        pam_strerror (worker->pam_handle, return_value));
 
         return return_value;
 }
@@ -1001,7 +950,7 @@ handle_terminal_vt_switches (GdmSessionWorker *worker,
         setmode_request.acqsig = ACQUIRE_DISPLAY_SIGNAL;
 
         if (ioctl (tty_fd, VT_SETMODE, &setmode_request) < 0) {
-                g_debug ("GdmSessionWorker: couldn't manage VTs manually: %m");
+                gdm_debug (WORKER, "GdmSessionWorker: couldn't manage VTs manually: %m");
                 succeeded = FALSE;
         }
 
@@ -1021,7 +970,7 @@ fix_terminal_vt_mode (GdmSessionWorker  *worker,
         gboolean succeeded = TRUE;
 
         if (ioctl (tty_fd, VT_GETMODE, &getmode_reply) < 0) {
-                g_debug ("GdmSessionWorker: couldn't query VT mode: %m");
+                gdm_debug (WORKER, "GdmSessionWorker: couldn't query VT mode: %m");
                 succeeded = FALSE;
         }
 
@@ -1030,7 +979,7 @@ fix_terminal_vt_mode (GdmSessionWorker  *worker,
         }
 
         if (ioctl (tty_fd, KDGETMODE, &kernel_display_mode) < 0) {
-                g_debug ("GdmSessionWorker: couldn't query kernel display mode: %m");
+                gdm_debug (WORKER, "GdmSessionWorker: couldn't query kernel display mode: %m");
                 succeeded = FALSE;
         }
 
@@ -1049,8 +998,8 @@ out:
                 return;
         }
 
-        g_debug ("GdmSessionWorker: VT mode did %sneed to be fixed",
-                 mode_fixed? "" : "not ");
+        gdm_debug (WORKER, "GdmSessionWorker: VT mode did %sneed to be fixed",
+                           mode_fixed? "" : "not ");
 }
 
 static void
@@ -1062,7 +1011,7 @@ jump_to_vt (GdmSessionWorker  *worker,
         int active_vt = -1;
         struct vt_stat vt_state = { 0 };
 
-        g_debug ("GdmSessionWorker: jumping to VT %d", vt_number);
+        gdm_debug (WORKER, "GdmSessionWorker: jumping to VT %d", vt_number);
         active_vt_tty_fd = open ("/dev/tty0", O_RDWR | O_NOCTTY);
 
         if (worker->session_tty_fd != -1) {
@@ -1077,9 +1026,9 @@ jump_to_vt (GdmSessionWorker  *worker,
 
                 handle_terminal_vt_switches (worker, fd);
 
-                g_debug ("GdmSessionWorker: first setting graphics mode to prevent flicker");
+                gdm_debug (WORKER, "GdmSessionWorker: first setting graphics mode to prevent flicker");
                 if (ioctl (fd, KDSETMODE, KD_GRAPHICS) < 0) {
-                        g_debug ("GdmSessionWorker: couldn't set graphics mode: %m");
+                        gdm_debug (WORKER, "GdmSessionWorker: couldn't set graphics mode: %m");
                 }
         } else {
                 fd = active_vt_tty_fd;
@@ -1094,18 +1043,18 @@ jump_to_vt (GdmSessionWorker  *worker,
         fix_terminal_vt_mode (worker, active_vt_tty_fd);
 
         if (ioctl (fd, VT_GETSTATE, &vt_state) < 0) {
-                g_debug ("GdmSessionWorker: couldn't get current VT: %m");
+                gdm_debug (WORKER, "GdmSessionWorker: couldn't get current VT: %m");
         } else {
                 active_vt = vt_state.v_active;
         }
 
         if (active_vt != vt_number) {
                 if (ioctl (fd, VT_ACTIVATE, vt_number) < 0) {
-                        g_debug ("GdmSessionWorker: couldn't initiate jump to VT %d: %m",
-                                 vt_number);
+                        gdm_debug (WORKER, "GdmSessionWorker: couldn't initiate jump to VT %d: %m",
+                                           vt_number);
                 } else if (ioctl (fd, VT_WAITACTIVE, vt_number) < 0) {
-                        g_debug ("GdmSessionWorker: couldn't finalize jump to VT %d: %m",
-                                 vt_number);
+                        gdm_debug (WORKER, "GdmSessionWorker: couldn't finalize jump to VT %d: %m",
+                                           vt_number);
                 }
         }
 
@@ -1127,7 +1076,7 @@ static void
 gdm_session_worker_uninitialize_pam (GdmSessionWorker *worker,
                                      int               status)
 {
-        g_debug ("GdmSessionWorker: uninitializing PAM");
+        gdm_debug (PAM, "GdmSessionWorker: uninitializing PAM");
 
         if (worker->pam_handle == NULL)
                 return;
@@ -1152,7 +1101,7 @@ gdm_session_worker_uninitialize_pam (GdmSessionWorker *worker,
 
         gdm_session_worker_stop_auditor (worker);
 
-        g_debug ("GdmSessionWorker: state NONE");
+        gdm_debug (WORKER, "GdmSessionWorker: state NONE");
         gdm_session_worker_set_state (worker, GDM_SESSION_WORKER_STATE_NONE);
 }
 
@@ -1174,10 +1123,10 @@ gdm_session_worker_initialize_pam (GdmSessionWorker   *worker,
         g_assert (service != NULL);
         g_assert (worker->pam_handle == NULL);
 
-        g_debug ("GdmSessionWorker: initializing PAM; service=%s username=%s seat=%s",
-                 service ? service : "(null)",
-                 username ? username : "(null)",
-                 seat_id ? seat_id : "(null)");
+        gdm_debug (PAM, "GdmSessionWorker: initializing PAM; service=%s username=%s seat=%s",
+                        service ? service : "(null)",
+                        username ? username : "(null)",
+                        seat_id ? seat_id : "(null)");
 
 #ifdef SUPPORTS_PAM_EXTENSIONS
         if (extensions != NULL) {
@@ -1194,7 +1143,7 @@ gdm_session_worker_initialize_pam (GdmSessionWorker   *worker,
                                 &pam_conversation,
                                 &worker->pam_handle);
         if (error_code != PAM_SUCCESS) {
-                g_debug ("GdmSessionWorker: could not initialize PAM: (error code %d)", error_code);
+                gdm_debug (PAM, "GdmSessionWorker: could not initialize PAM: (error code %d)", error_code);
                 /* we don't use pam_strerror here because it requires a valid
                  * pam handle, and if pam_start fails pam_handle is undefined
                  */
@@ -1211,7 +1160,7 @@ gdm_session_worker_initialize_pam (GdmSessionWorker   *worker,
                 error_code = pam_set_item (worker->pam_handle, PAM_USER_PROMPT, _("Username:"));
 
                 if (error_code != PAM_SUCCESS) {
-                        g_debug ("GdmSessionWorker: error informing authentication system of preferred username prompt: %s",
+                        gdm_debug (PAM, "GdmSessionWorker: error informing authentication system of preferred username prompt: %s",
                                 pam_strerror (worker->pam_handle, error_code));
                         g_set_error_literal (error,
                                              GDM_SESSION_WORKER_ERROR,
@@ -1226,14 +1175,14 @@ gdm_session_worker_initialize_pam (GdmSessionWorker   *worker,
                 if (hostname != NULL && hostname[0] != '\0') {
                         error_code = pam_set_item (worker->pam_handle, PAM_RHOST, hostname);
 
-                        g_debug ("error informing authentication system of user's hostname %s: %s",
-                                 hostname,
-                                 pam_strerror (worker->pam_handle, error_code));
+                        gdm_debug (PAM, "error informing authentication system of user's hostname %s: %s",
+                                        hostname,
+                                        pam_strerror (worker->pam_handle, error_code));
                 } else {
                         error_code = pam_set_item (worker->pam_handle, PAM_RHOST, "0.0.0.0");
 
-                        g_debug ("error informing authentication system user is remote but has indeterminate hostname: %s",
-                                 pam_strerror (worker->pam_handle, error_code));
+                        gdm_debug (PAM, "error informing authentication system user is remote but has indeterminate hostname: %s",
+                                        pam_strerror (worker->pam_handle, error_code));
                 }
 
                 if (error_code != PAM_SUCCESS) {
@@ -1257,7 +1206,7 @@ gdm_session_worker_initialize_pam (GdmSessionWorker   *worker,
                 gdm_session_worker_set_environment_variable (worker, "XDG_SESSION_CLASS", "greeter");
         }
 
-        g_debug ("GdmSessionWorker: state SETUP_COMPLETE");
+        gdm_debug (WORKER, "GdmSessionWorker: state SETUP_COMPLETE");
         gdm_session_worker_set_state (worker, GDM_SESSION_WORKER_STATE_SETUP_COMPLETE);
 
         if (g_strcmp0 (seat_id, "seat0") == 0 && worker->seat0_has_vts) {
@@ -1287,7 +1236,7 @@ gdm_session_worker_authenticate_user (GdmSessionWorker *worker,
         int error_code;
         int authentication_flags;
 
-        g_debug ("GdmSessionWorker: authenticating user %s", worker->username);
+        gdm_debug (WORKER, "GdmSessionWorker: authenticating user %s", worker->username);
 
         authentication_flags = 0;
 
@@ -1299,7 +1248,7 @@ gdm_session_worker_authenticate_user (GdmSessionWorker *worker,
         error_code = pam_authenticate (worker->pam_handle, authentication_flags);
 
         if (error_code == PAM_AUTHINFO_UNAVAIL) {
-                g_debug ("GdmSessionWorker: authentication service unavailable");
+                gdm_debug (WORKER, "GdmSessionWorker: authentication service unavailable");
 
                 g_set_error_literal (error,
                                      GDM_SESSION_WORKER_ERROR,
@@ -1308,7 +1257,7 @@ gdm_session_worker_authenticate_user (GdmSessionWorker *worker,
                 goto out;
 #ifdef PAM_MODULE_UNKNOWN
         } else if (error_code == PAM_MODULE_UNKNOWN) {
-                g_debug ("GdmSessionWorker: authentication module unavailable");
+                gdm_debug (WORKER, "GdmSessionWorker: authentication module unavailable");
 
                 g_set_error_literal (error,
                                      GDM_SESSION_WORKER_ERROR,
@@ -1317,14 +1266,14 @@ gdm_session_worker_authenticate_user (GdmSessionWorker *worker,
                 goto out;
 #endif
         } else if (error_code == PAM_MAXTRIES) {
-                g_debug ("GdmSessionWorker: authentication service had too many retries");
+                gdm_debug (WORKER, "GdmSessionWorker: authentication service had too many retries");
                 g_set_error_literal (error,
                                      GDM_SESSION_WORKER_ERROR,
                                      GDM_SESSION_WORKER_ERROR_TOO_MANY_RETRIES,
                                      get_friendly_error_message (worker, error_code));
                 goto out;
         } else if (error_code != PAM_SUCCESS) {
-                g_debug ("GdmSessionWorker: authentication returned %d: %s", error_code, pam_strerror (worker->pam_handle, error_code));
+                gdm_debug (PAM, "GdmSessionWorker: authentication returned %d: %s", error_code, pam_strerror (worker->pam_handle, error_code));
 
                 /*
                  * Do not display a different message for user unknown versus
@@ -1341,7 +1290,7 @@ gdm_session_worker_authenticate_user (GdmSessionWorker *worker,
                 goto out;
         }
 
-        g_debug ("GdmSessionWorker: state AUTHENTICATED");
+        gdm_debug (WORKER, "GdmSessionWorker: state AUTHENTICATED");
         gdm_session_worker_set_state (worker, GDM_SESSION_WORKER_STATE_AUTHENTICATED);
 
  out:
@@ -1361,8 +1310,8 @@ gdm_session_worker_authorize_user (GdmSessionWorker *worker,
         int error_code;
         int authentication_flags;
 
-        g_debug ("GdmSessionWorker: determining if authenticated user (password required:%d) is authorized to session",
-                 password_is_required);
+        gdm_debug (WORKER, "GdmSessionWorker: determining if authenticated user (password required:%d) is authorized to session",
+                           password_is_required);
 
         authentication_flags = 0;
 
@@ -1377,7 +1326,7 @@ gdm_session_worker_authorize_user (GdmSessionWorker *worker,
         /* it's possible that the user needs to change their password or pin code
          */
         if (error_code == PAM_NEW_AUTHTOK_REQD && !worker->is_program_session) {
-                g_debug ("GdmSessionWorker: authenticated user requires new auth token");
+                gdm_debug (WORKER, "GdmSessionWorker: authenticated user requires new auth token");
                 error_code = pam_chauthtok (worker->pam_handle, PAM_CHANGE_EXPIRED_AUTHTOK);
 
                 gdm_session_worker_get_username (worker, NULL);
@@ -1397,8 +1346,8 @@ gdm_session_worker_authorize_user (GdmSessionWorker *worker,
         }
 
         if (error_code != PAM_SUCCESS) {
-                g_debug ("GdmSessionWorker: user is not authorized to log in: %s",
-                         pam_strerror (worker->pam_handle, error_code));
+                gdm_debug (PAM, "GdmSessionWorker: user is not authorized to log in: %s",
+                                pam_strerror (worker->pam_handle, error_code));
                 g_set_error_literal (error,
                                      GDM_SESSION_WORKER_ERROR,
                                      GDM_SESSION_WORKER_ERROR_AUTHORIZING,
@@ -1406,7 +1355,7 @@ gdm_session_worker_authorize_user (GdmSessionWorker *worker,
                 goto out;
         }
 
-        g_debug ("GdmSessionWorker: state AUTHORIZED");
+        gdm_debug (WORKER, "GdmSessionWorker: state AUTHORIZED");
         gdm_session_worker_set_state (worker, GDM_SESSION_WORKER_STATE_AUTHORIZED);
 
  out:
@@ -1441,7 +1390,7 @@ gdm_session_worker_set_environment_variable (GdmSessionWorker *worker,
                            environment_entry,
                            pam_strerror (worker->pam_handle, error_code));
         }
-        g_debug ("GdmSessionWorker: Set PAM environment variable: '%s'", environment_entry);
+        gdm_debug (PAM, "GdmSessionWorker: Set PAM environment variable: '%s'", environment_entry);
 }
 
 static char *
@@ -1551,7 +1500,7 @@ _lookup_passwd_info (const char *username,
         errno = 0;
 #endif /* !HAVE_POSIX_GETPWNAM_R */
         if (errno == EINTR) {
-                g_debug ("%s", g_strerror (errno));
+                gdm_debug (WORKER, "%s", g_strerror (errno));
                 goto again;
         } else if (errno != 0) {
                 g_warning ("%s", g_strerror (errno));
@@ -1623,7 +1572,7 @@ gdm_session_worker_accredit_user (GdmSessionWorker  *worker,
         ret = FALSE;
 
         if (worker->username == NULL) {
-                g_debug ("GdmSessionWorker: Username not set");
+                gdm_debug (WORKER, "GdmSessionWorker: Username not set");
                 error_code = PAM_USER_UNKNOWN;
                 g_set_error (error,
                              GDM_SESSION_WORKER_ERROR,
@@ -1640,7 +1589,7 @@ gdm_session_worker_accredit_user (GdmSessionWorker  *worker,
                                    &home,
                                    &shell);
         if (! res) {
-                g_debug ("GdmSessionWorker: Unable to lookup account info");
+                gdm_debug (WORKER, "GdmSessionWorker: Unable to lookup account info");
                 error_code = PAM_AUTHINFO_UNAVAIL;
                 g_set_error (error,
                              GDM_SESSION_WORKER_ERROR,
@@ -1668,7 +1617,7 @@ gdm_session_worker_accredit_user (GdmSessionWorker  *worker,
         }
 
         if (! _change_user (worker, uid, gid)) {
-                g_debug ("GdmSessionWorker: Unable to change to user");
+                gdm_debug (WORKER, "GdmSessionWorker: Unable to change to user");
                 error_code = PAM_SYSTEM_ERR;
                 g_set_error_literal (error, GDM_SESSION_WORKER_ERROR,
                                      GDM_SESSION_WORKER_ERROR_GIVING_CREDENTIALS,
@@ -1699,7 +1648,7 @@ gdm_session_worker_accredit_user (GdmSessionWorker  *worker,
 
  out:
         if (ret) {
-                g_debug ("GdmSessionWorker: state ACCREDITED");
+                gdm_debug (WORKER, "GdmSessionWorker: state ACCREDITED");
                 ret = TRUE;
 
                 gdm_session_worker_get_username (worker, NULL);
@@ -1733,16 +1682,16 @@ wait_until_dbus_signal_emission_to_manager_finishes (GdmSessionWorker *worker)
                                                    &error);
 
         if (peer_proxy == NULL) {
-                g_debug ("GdmSessionWorker: could not create peer proxy to daemon: %s",
-                         error->message);
+                gdm_debug (WORKER, "GdmSessionWorker: could not create peer proxy to daemon: %s",
+                                   error->message);
                 return;
         }
 
         pinged = gdm_dbus_peer_call_ping_sync (peer_proxy, NULL, &error);
 
         if (!pinged) {
-                g_debug ("GdmSessionWorker: could not ping daemon: %s",
-                         error->message);
+                gdm_debug (WORKER, "GdmSessionWorker: could not ping daemon: %s",
+                                   error->message);
                 return;
         }
 }
@@ -1764,23 +1713,25 @@ jump_back_to_initial_vt (GdmSessionWorker *worker)
 }
 
 static void
-session_worker_child_watch (GPid              pid,
-                            int               status,
-                            GdmSessionWorker *worker)
-{
-        g_debug ("GdmSessionWorker: child (pid:%d) done (%s:%d)",
-                 (int) pid,
-                 WIFEXITED (status) ? "status"
-                 : WIFSIGNALED (status) ? "signal"
-                 : "unknown",
-                 WIFEXITED (status) ? WEXITSTATUS (status)
-                 : WIFSIGNALED (status) ? WTERMSIG (status)
-                 : -1);
+session_worker_child_watch (GPid                 pid,
+                            int                  status,
+                            const struct rusage *rusage,
+                            GdmSessionWorker    *worker)
+{
+        gdm_debug (WORKER, "GdmSessionWorker: child (pid:%d) done (%s:%d)",
+                           (int) pid,
+                           WIFEXITED (status) ? "status"
+                           : WIFSIGNALED (status) ? "signal"
+                           : "unknown",
+                           WIFEXITED (status) ? WEXITSTATUS (status)
+                           : WIFSIGNALED (status) ? WTERMSIG (status)
+                           : -1);
 
         gdm_session_worker_uninitialize_pam (worker, PAM_SUCCESS);
 
         worker->child_pid = -1;
         worker->child_watch_id = 0;
+        g_clear_pointer (&worker->session_log, gdm_session_log_free);
 
         gdm_dbus_worker_emit_session_exited (GDM_DBUS_WORKER (worker),
                                              worker->service,
@@ -1815,10 +1766,10 @@ session_worker_child_watch (GPid              pid,
 static void
 gdm_session_worker_watch_child (GdmSessionWorker *worker)
 {
-        g_debug ("GdmSession worker: watching pid %d", worker->child_pid);
-        worker->child_watch_id = g_child_watch_add (worker->child_pid,
-                                                    (GChildWatchFunc)session_worker_child_watch,
-                                                    worker);
+        gdm_debug (WORKER, "GdmSession worker: watching pid %d", worker->child_pid);
+        worker->child_watch_id = gdm_child_watch_add (worker->child_pid,
+                                                      (GdmChildWatchFunc) session_worker_child_watch,
+                                                      worker);
 
 }
 
@@ -1834,74 +1785,52 @@ _is_loggable_file (const char* filename)
         return S_ISREG (file_info.st_mode) && g_access (filename, R_OK | W_OK) == 0;
 }
 
-static void
-rotate_logs (const char *path,
-             guint       n_copies)
+static GdmSessionLog *
+create_session_log (GdmSessionWorker *worker)
 {
-        int i;
-
-        for (i = n_copies - 1; i > 0; i--) {
-                g_autofree char *name_n = NULL;
-                g_autofree char *name_n1 = NULL;
-
-                name_n = g_strdup_printf ("%s.%d", path, i);
-                if (i > 1) {
-                        name_n1 = g_strdup_printf ("%s.%d", path, i - 1);
-                } else {
-                        name_n1 = g_strdup (path);
-                }
-
-                g_unlink (name_n);
-                g_rename (name_n1, name_n);
-        }
+        g_autoptr (GdmSessionLog) session_log = NULL;
+        int max_size = 0;
+        gboolean compress = FALSE;
 
-        g_unlink (path);
-}
-
-static int
-_open_program_session_log (const char *filename)
-{
-        int   fd;
-
-        rotate_logs (filename, MAX_LOGS);
-
-        fd = g_open (filename, O_WRONLY | O_APPEND | O_CREAT, 0600);
-
-        if (fd < 0) {
-                g_autofree char *temp_name = NULL;
-
-                temp_name = g_strdup_printf ("%s.XXXXXXXX", filename);
+        if (worker->is_program_session) {
+                session_log = gdm_session_log_new (worker->log_file, MAX_LOGS - 1, 0644);
+        } else {
+#ifdef HAVE_SYS_FSUID_H
+                g_autofree char *home_dir = NULL;
+                g_autofree char *cache_dir = NULL;
+                g_autofree char *filename = NULL;
 
-                fd = g_mkstemp (temp_name);
+                home_dir = gdm_session_worker_get_environment_variable (worker, "HOME");
+                if (home_dir == NULL || home_dir[0] == '\0')
+                        return NULL;
 
-                if (fd < 0) {
-                        goto out;
+                cache_dir = gdm_session_worker_get_environment_variable (worker, "XDG_CACHE_HOME");
+                if (cache_dir == NULL || cache_dir[0] == '\0') {
+                        g_free (cache_dir);
+                        cache_dir = g_build_filename (home_dir, ".cache", NULL);
                 }
 
-                g_warning ("session log '%s' is not appendable, logging session to '%s' instead.\n", filename,
-                           temp_name);
-        } else {
-                if (ftruncate (fd, 0) < 0) {
-                        close (fd);
-                        fd = -1;
-                        goto out;
-                }
-        }
+                filename = g_build_filename (cache_dir, "gdm", GDM_SESSION_LOG_FILENAME, NULL);
 
-        if (fchmod (fd, 0644) < 0) {
-                close (fd);
-                fd = -1;
-                goto out;
+                session_log = gdm_session_log_new (filename, 1, 0600);
+                gdm_session_log_set_owner (session_log, worker->uid, worker->gid);
+#else
+                /* Without setfsuid() the log can only be opened safely by
+                 * the session itself, after dropping privileges */
+                return NULL;
+#endif
         }
 
+        gdm_settings_direct_get_int (GDM_KEY_SESSION_LOG_MAX_SIZE, &max_size);
+        gdm_settings_direct_get_boolean (GDM_KEY_SESSION_LOG_COMPRESS, &compress);
 
-out:
-        if (fd < 0) {
-                g_warning ("unable to log program session");
-                fd = g_open ("/dev/null", O_RDWR);
-        }
+        gdm_session_log_set_max_size (session_log, (goffset) MAX (max_size, 0) * 1024);
+        gdm_session_log_set_compress (session_log, compress);
 
-        return fd;
+        if (gdm_session_log_open (session_log) < 0)
+                return NULL;
+
+        return g_steal_pointer (&session_log);
 }
 
 static int
@@ -1962,16 +1891,18 @@ gdm_session_worker_start_session (GdmSessionWorker  *worker,
                                   GError           **error)
 {
         struct passwd *passwd_entry;
+        g_autoptr (GdmSessionLog) session_log = NULL;
+        gboolean has_journald = FALSE;
         pid_t session_pid;
         int   error_code;
 
         gdm_get_pwent_for_name (worker->username, &passwd_entry);
         if (worker->is_program_session) {
-                g_debug ("GdmSessionWorker: opening session for program '%s'",
-                         worker->arguments[0]);
+                gdm_debug (WORKER, "GdmSessionWorker: opening session for program '%s'",
+                                   worker->arguments[0]);
         } else {
-                g_debug ("GdmSessionWorker: opening user session with program '%s'",
-                         worker->arguments[0]);
+                gdm_debug (WORKER, "GdmSessionWorker: opening user session with program '%s'",
+                                   worker->arguments[0]);
         }
 
         error_code = PAM_SUCCESS;
@@ -1985,6 +1916,14 @@ gdm_session_worker_start_session (GdmSessionWorker  *worker,
                 }
         }
 
+#ifdef ENABLE_SYSTEMD_JOURNAL
+        has_journald = sd_booted() > 0;
+#endif
+        /* Rotate and open the log here rather than in the child, so that
+         * user logs are handled with the user's file system credentials */
+        if (!has_journald)
+                session_log = create_session_log (worker);
+
         session_pid = fork ();
 
         if (session_pid < 0) {
@@ -2000,7 +1939,7 @@ gdm_session_worker_start_session (GdmSessionWorker  *worker,
                 g_autofree char  *home_dir = NULL;
                 const char * const * environment;
                 int    stdin_fd = -1, stdout_fd = -1, stderr_fd = -1;
-                gboolean has_journald = FALSE, needs_controlling_terminal = FALSE;
+                gboolean needs_controlling_terminal = FALSE;
                 /* Leak the TTY into the session as stdin so that it stays open
                  * without any races. */
                 if (worker->session_tty_fd > 0) {
@@ -2014,17 +1953,17 @@ gdm_session_worker_start_session (GdmSessionWorker  *worker,
                         close (stdin_fd);
                 }
 
-#ifdef ENABLE_SYSTEMD_JOURNAL
-                has_journald = sd_booted() > 0;
-#endif
-                if (!has_journald && worker->is_program_session) {
-                        stdout_fd = _open_program_session_log (worker->log_file);
+                if (session_log != NULL) {
+                        stdout_fd = dup (gdm_session_log_get_fd (session_log));
+                        stderr_fd = dup (stdout_fd);
+                } else if (!has_journald && worker->is_program_session) {
+                        stdout_fd = open ("/dev/null", O_RDWR);
                         stderr_fd = dup (stdout_fd);
                 }
 
                 if (setsid () < 0) {
-                        g_debug ("GdmSessionWorker: could not set pid '%u' as leader of new session and process group: %s",
-                                 (guint) getpid (), g_strerror (errno));
+                        gdm_debug (WORKER, "GdmSessionWorker: could not set pid '%u' as leader of new session and process group: %s",
+                                           (guint) getpid (), g_strerror (errno));
                         _exit (EXIT_FAILURE);
                 }
 
@@ -2032,19 +1971,19 @@ gdm_session_worker_start_session (GdmSessionWorker  *worker,
                  */
                 if (needs_controlling_terminal) {
                         if (ioctl (STDIN_FILENO, TIOCSCTTY, 0) < 0) {
-                                g_debug ("GdmSessionWorker: could not take control of tty: %m");
+                                gdm_debug (WORKER, "GdmSessionWorker: could not take control of tty: %m");
                         }
                 }
 
 #ifdef HAVE_LOGINCAP
                 if (setusercontext (NULL, passwd_entry, passwd_entry->pw_uid, LOGIN_SETALL) < 0) {
-                        g_debug ("GdmSessionWorker: setusercontext() failed for user %s: %s",
-                                 passwd_entry->pw_name, g_strerror (errno));
+                        gdm_debug (WORKER, "GdmSessionWorker: setusercontext() failed for user %s: %s",
+                                           passwd_entry->pw_name, g_strerror (errno));
                         _exit (EXIT_FAILURE);
                 }
 #else
                 if (setuid (worker->uid) < 0) {
-                        g_debug ("GdmSessionWorker: could not reset uid: %s", g_strerror (errno));
+                        gdm_debug (WORKER, "GdmSessionWorker: could not reset uid: %s", g_strerror (errno));
                         _exit (EXIT_FAILURE);
                 }
 #endif
@@ -2074,7 +2013,7 @@ gdm_session_worker_start_session (GdmSessionWorker  *worker,
                         gdm_clear_close_on_exec_flag (stderr_fd);
                 }
 #endif
-                if (!has_journald && !worker->is_program_session) {
+                if (!has_journald && !worker->is_program_session && session_log == NULL) {
                         if (home_dir != NULL && home_dir[0] != '\0') {
                                 g_autofree char *cache_dir = NULL;
                                 g_autofree char *log_dir = NULL;
@@ -2120,16 +2059,15 @@ gdm_session_worker_start_session (GdmSessionWorker  *worker,
 
                 (void) pam_end (worker->pam_handle, PAM_SUCCESS | PAM_DATA_SILENT);
 
-                gdm_session_execute (worker->arguments[0],
-                                     worker->arguments,
-                                     (char **)
-                                     environment,
-                                     TRUE);
+                gdm_spawn_exec (worker->arguments[0],
+                                worker->arguments,
+                                (char **)
+                                environment);
 
                 gdm_log_init ();
-                g_debug ("GdmSessionWorker: child '%s' could not be started: %s",
-                         worker->arguments[0],
-                         g_strerror (errno));
+                gdm_debug (WORKER, "GdmSessionWorker: child '%s' could not be started: %s",
+                                   worker->arguments[0],
+                                   g_strerror (errno));
 
                 _exit (EXIT_FAILURE);
         }
@@ -2148,10 +2086,15 @@ gdm_session_worker_start_session (GdmSessionWorker  *worker,
 
         worker->child_pid = session_pid;
 
-        g_debug ("GdmSessionWorker: session opened creating reply...");
+        if (session_log != NULL) {
+                gdm_session_log_start (session_log);
+                worker->session_log = g_steal_pointer (&session_log);
+        }
+
+        gdm_debug (WORKER, "GdmSessionWorker: session opened creating reply...");
         g_assert (sizeof (GPid) <= sizeof (int));
 
-        g_debug ("GdmSessionWorker: state SESSION_STARTED");
+        gdm_debug (WORKER, "GdmSessionWorker: state SESSION_STARTED");
         gdm_session_worker_set_state (worker, GDM_SESSION_WORKER_STATE_SESSION_STARTED);
 
         gdm_session_worker_watch_child (worker);
@@ -2183,7 +2126,7 @@ set_up_for_new_vt (GdmSessionWorker *worker)
         initial_vt_fd = open (tty_string, O_RDWR | O_NOCTTY);
 
         if (initial_vt_fd < 0) {
-                g_debug ("GdmSessionWorker: couldn't open console of initial fd: %m");
+                gdm_debug (WORKER, "GdmSessionWorker: couldn't open console of initial fd: %m");
                 return FALSE;
         }
 
@@ -2195,7 +2138,7 @@ set_up_for_new_vt (GdmSessionWorker *worker)
                  * have /dev/tty1 open above, so might as well use it.
                  */
                 if (ioctl (initial_vt_fd, VT_OPENQRY, &session_vt) < 0) {
-                        g_debug ("GdmSessionWorker: couldn't open new VT: %m");
+                        gdm_debug (WORKER, "GdmSessionWorker: couldn't open new VT: %m");
                         goto fail;
                 }
         }
@@ -2271,7 +2214,7 @@ gdm_session_worker_open_session (GdmSessionWorker  *worker,
                 goto out;
         }
 
-        g_debug ("GdmSessionWorker: state SESSION_OPENED");
+        gdm_debug (WORKER, "GdmSessionWorker: state SESSION_OPENED");
         gdm_session_worker_set_state (worker, GDM_SESSION_WORKER_STATE_SESSION_OPENED);
 
         session_id = gdm_session_worker_get_environment_variable (worker, "XDG_SESSION_ID");
@@ -2279,6 +2222,7 @@ gdm_session_worker_open_session (GdmSessionWorker  *worker,
         if (session_id != NULL) {
                 g_free (worker->session_id);
                 worker->session_id = g_steal_pointer (&session_id);
+                gdm_log_set_context (GDM_LOG_FIELD_SESSION_ID, worker->session_id);
         }
 
  out:
@@ -2370,13 +2314,45 @@ gdm_session_worker_handle_set_environment_variable (GdmDBusWorker         *objec
         return TRUE;
 }
 
+static gboolean
+gdm_session_worker_handle_set_environment (GdmDBusWorker         *object,
+                                           GDBusMethodInvocation *invocation,
+                                           GVariant              *environment)
+{
+        GdmSessionWorker *worker = GDM_SESSION_WORKER (object);
+        GVariantIter iter;
+        const char *key;
+        const char *value;
+
+        gdm_debug (WORKER, "GdmSessionWorker: setting %" G_GSIZE_FORMAT " environment variables",
+                           g_variant_n_children (environment));
+
+        g_variant_iter_init (&iter, environment);
+        while (g_variant_iter_next (&iter, "{&s&s}", &key, &value))
+                gdm_session_worker_set_environment_variable (worker, key, value);
+
+        gdm_dbus_worker_complete_set_environment (object, invocation);
+        return TRUE;
+}
+
+static gboolean
+gdm_session_worker_handle_cancel_query (GdmDBusWorker         *object,
+                                        GDBusMethodInvocation *invocation)
+{
+        /* Any pending query has already been cancelled from
+         * on_connection_message(), by the time we get here */
+        gdm_debug (WORKER, "GdmSessionWorker: query cancellation requested");
+        gdm_dbus_worker_complete_cancel_query (object, invocation);
+        return TRUE;
+}
+
 static gboolean
 gdm_session_worker_handle_set_session_name (GdmDBusWorker         *object,
                                             GDBusMethodInvocation *invocation,
                                             const char            *session_name)
 {
         GdmSessionWorker *worker = GDM_SESSION_WORKER (object);
-        g_debug ("GdmSessionWorker: session name set to %s", session_name);
+        gdm_debug (WORKER, "GdmSessionWorker: session name set to %s", session_name);
         if (worker->user_settings != NULL)
                 gdm_session_settings_set_session_name (worker->user_settings,
                                                        session_name);
@@ -2390,19 +2366,37 @@ gdm_session_worker_handle_set_session_display_mode (GdmDBusWorker         *objec
                                                     const char            *str)
 {
         GdmSessionWorker *worker = GDM_SESSION_WORKER (object);
-        g_debug ("GdmSessionWorker: session display mode set to %s", str);
+        gdm_debug (WORKER, "GdmSessionWorker: session display mode set to %s", str);
         worker->display_mode = gdm_session_display_mode_from_string (str);
         gdm_dbus_worker_complete_set_session_display_mode (object, invocation);
         return TRUE;
 }
 
+static gboolean
+gdm_session_worker_handle_set_debug_categories (GdmDBusWorker         *object,
+                                                GDBusMethodInvocation *invocation,
+                                                const char * const    *names)
+{
+        GError *error = NULL;
+        guint categories;
+
+        if (!gdm_log_parse_debug_categories (names, &categories, &error)) {
+                g_dbus_method_invocation_take_error (invocation, error);
+                return TRUE;
+        }
+
+        gdm_log_set_debug_categories (categories);
+        gdm_dbus_worker_complete_set_debug_categories (object, invocation);
+        return TRUE;
+}
+
 static gboolean
 gdm_session_worker_handle_set_language_name (GdmDBusWorker         *object,
                                              GDBusMethodInvocation *invocation,
                                              const char            *language_name)
 {
         GdmSessionWorker *worker = GDM_SESSION_WORKER (object);
-        g_debug ("GdmSessionWorker: language name set to %s", language_name);
+        gdm_debug (WORKER, "GdmSessionWorker: language name set to %s", language_name);
         if (worker->user_settings != NULL)
                 gdm_session_settings_set_language_name (worker->user_settings,
                                                         language_name);
@@ -2417,7 +2411,7 @@ on_saved_language_name_read (GdmSessionWorker *worker)
 
         language_name = gdm_session_settings_get_language_name (worker->user_settings);
 
-        g_debug ("GdmSessionWorker: Saved language is %s", language_name);
+        gdm_debug (WORKER, "GdmSessionWorker: Saved language is %s", language_name);
         gdm_dbus_worker_emit_saved_language_name_read (GDM_DBUS_WORKER (worker),
                                                        language_name);
 }
@@ -2429,7 +2423,7 @@ on_saved_session_name_read (GdmSessionWorker *worker)
 
         session_name = gdm_session_settings_get_session_name (worker->user_settings);
 
-        g_debug ("GdmSessionWorker: Saved session is %s", session_name);
+        gdm_debug (WORKER, "GdmSessionWorker: Saved session is %s", session_name);
         gdm_dbus_worker_emit_saved_session_name_read (GDM_DBUS_WORKER (worker),
                                                       session_name);
 }
@@ -2441,12 +2435,42 @@ on_saved_session_type_read (GdmSessionWorker *worker)
 
         session_type = gdm_session_settings_get_session_type (worker->user_settings);
 
-        g_debug ("GdmSessionWorker: Saved session type is %s", session_type);
+        gdm_debug (WORKER, "GdmSessionWorker: Saved session type is %s", session_type);
         gdm_dbus_worker_emit_saved_session_type_read (GDM_DBUS_WORKER (worker),
                                                       session_type);
 }
 
 
+static const char *
+get_state_nick (GdmSessionWorkerState state)
+{
+        GEnumClass *enum_class;
+        GEnumValue *enum_value;
+
+        enum_class = g_type_class_ref (GDM_TYPE_SESSION_WORKER_STATE);
+        enum_value = g_enum_get_value (enum_class, state);
+        g_type_class_unref (enum_class);
+
+        return enum_value != NULL? enum_value->value_nick : NULL;
+}
+
+/* Completes the pending RunToState request, or queues the next stage */
+static void
+advance_to_target_state (GdmSessionWorker *worker)
+{
+        gdm_dbus_worker_emit_state_reached (GDM_DBUS_WORKER (worker),
+                                            get_state_nick (worker->state));
+
+        if (worker->state < worker->target_state) {
+                queue_state_change (worker);
+                return;
+        }
+
+        gdm_dbus_worker_complete_run_to_state (GDM_DBUS_WORKER (worker), worker->pending_invocation);
+        worker->pending_invocation = NULL;
+        worker->target_state = GDM_SESSION_WORKER_STATE_NONE;
+}
+
 static void
 do_setup (GdmSessionWorker *worker)
 {
@@ -2488,17 +2512,19 @@ do_authenticate (GdmSessionWorker *worker)
                  * a valid username for the system
                  */
                 if (!worker->is_program_session) {
-                        g_debug ("GdmSessionWorker: trying to get updated username");
+                        gdm_debug (WORKER, "GdmSessionWorker: trying to get updated username");
                         gdm_session_worker_update_username (worker);
                 }
 
-                gdm_dbus_worker_complete_authenticate (GDM_DBUS_WORKER (worker), worker->pending_invocation);
-        } else {
-                g_debug ("GdmSessionWorker: Unable to verify user");
-                g_dbus_method_invocation_take_error (worker->pending_invocation,
-                                                     g_steal_pointer (&error));
+                advance_to_target_state (worker);
+                return;
         }
+
+        gdm_debug (WORKER, "GdmSessionWorker: Unable to verify user");
+        g_dbus_method_invocation_take_error (worker->pending_invocation,
+                                             g_steal_pointer (&error));
         worker->pending_invocation = NULL;
+        worker->target_state = GDM_SESSION_WORKER_STATE_NONE;
 }
 
 static void
@@ -2513,12 +2539,14 @@ do_authorize (GdmSessionWorker *worker)
                                                  worker->password_is_required,
                                                  &error);
         if (res) {
-                gdm_dbus_worker_complete_authorize (GDM_DBUS_WORKER (worker), worker->pending_invocation);
-        } else {
-                g_dbus_method_invocation_take_error (worker->pending_invocation,
-                                                     g_steal_pointer (&error));
+                advance_to_target_state (worker);
+                return;
         }
+
+        g_dbus_method_invocation_take_error (worker->pending_invocation,
+                                             g_steal_pointer (&error));
         worker->pending_invocation = NULL;
+        worker->target_state = GDM_SESSION_WORKER_STATE_NONE;
 }
 
 static void
@@ -2532,12 +2560,14 @@ do_accredit (GdmSessionWorker *worker)
         res = gdm_session_worker_accredit_user (worker, &error);
 
         if (res) {
-                gdm_dbus_worker_complete_establish_credentials (GDM_DBUS_WORKER (worker), worker->pending_invocation);
-        } else {
-                g_dbus_method_invocation_take_error (worker->pending_invocation,
-                                                     g_steal_pointer (&error));
+                advance_to_target_state (worker);
+                return;
         }
+
+        g_dbus_method_invocation_take_error (worker->pending_invocation,
+                                             g_steal_pointer (&error));
         worker->pending_invocation = NULL;
+        worker->target_state = GDM_SESSION_WORKER_STATE_NONE;
 }
 
 static void
@@ -2545,7 +2575,7 @@ save_account_details_now (GdmSessionWorker *worker)
 {
         g_assert (worker->state == GDM_SESSION_WORKER_STATE_ACCREDITED);
 
-        g_debug ("GdmSessionWorker: saving account details for user %s", worker->username);
+        gdm_debug (WORKER, "GdmSessionWorker: saving account details for user %s", worker->username);
 
         gdm_session_worker_set_state (worker, GDM_SESSION_WORKER_STATE_ACCOUNT_DETAILS_SAVED);
         if (worker->user_settings != NULL) {
@@ -2579,8 +2609,8 @@ on_settings_is_loaded_changed (GdmSessionSettings *user_settings,
                                               worker);
 
         if (worker->state == GDM_SESSION_WORKER_STATE_NONE) {
-                g_debug ("GdmSessionWorker: queuing setup for user: %s %s",
-                         worker->username, worker->display_device);
+                gdm_debug (WORKER, "GdmSessionWorker: queuing setup for user: %s %s",
+                                   worker->username, worker->display_device);
                 queue_state_change (worker);
         } else if (worker->state == GDM_SESSION_WORKER_STATE_ACCREDITED) {
                 save_account_details_now (worker);
@@ -2603,8 +2633,8 @@ do_save_account_details_when_ready (GdmSessionWorker *worker)
                                   "notify::is-loaded",
                                   G_CALLBACK (on_settings_is_loaded_changed),
                                   worker);
-                g_debug ("GdmSessionWorker: user %s, not fully loaded yet, will save account details later",
-                         worker->username);
+                gdm_debug (WORKER, "GdmSessionWorker: user %s, not fully loaded yet, will save account details later",
+                                   worker->username);
                 gdm_session_settings_load (worker->user_settings,
                                            worker->username);
                 return;
@@ -2699,8 +2729,8 @@ state_change_idle (GdmSessionWorker *worker)
         int new_state;
 
         new_state = worker->state + 1;
-        g_debug ("GdmSessionWorker: attempting to change state to %s",
-                 get_state_name (new_state));
+        gdm_debug (WORKER, "GdmSessionWorker: attempting to change state to %s",
+                           get_state_name (new_state));
 
         worker->state_change_idle_id = 0;
 
@@ -2782,36 +2812,53 @@ validate_and_queue_state_change (GdmSessionWorker      *worker,
 }
 
 static gboolean
-gdm_session_worker_handle_authenticate (GdmDBusWorker         *object,
-                                        GDBusMethodInvocation *invocation)
+gdm_session_worker_handle_run_to_state (GdmDBusWorker         *object,
+                                        GDBusMethodInvocation *invocation,
+                                        const char            *state)
 {
         GdmSessionWorker *worker = GDM_SESSION_WORKER (object);
-        validate_and_queue_state_change (worker, invocation, GDM_SESSION_WORKER_STATE_AUTHENTICATED);
-        return TRUE;
-}
+        GEnumClass *enum_class;
+        GEnumValue *enum_value;
+        int target_state;
+
+        enum_class = g_type_class_ref (GDM_TYPE_SESSION_WORKER_STATE);
+        enum_value = g_enum_get_value_by_nick (enum_class, state);
+        target_state = enum_value != NULL? enum_value->value : GDM_SESSION_WORKER_STATE_NONE;
+        g_type_class_unref (enum_class);
+
+        /* Only the PAM verification stages can be chained; opening the
+         * session has to wait until the daemon has reacted to the
+         * credentials being established.
+         */
+        if (target_state <= worker->state ||
+            target_state > GDM_SESSION_WORKER_STATE_ACCREDITED) {
+                g_dbus_method_invocation_return_error (invocation,
+                                                       GDM_SESSION_WORKER_ERROR,
+                                                       GDM_SESSION_WORKER_ERROR_WRONG_STATE,
+                                                       "Cannot run to state %s from state %s",
+                                                       state,
+                                                       get_state_name (worker->state));
+                return TRUE;
+        }
 
-static gboolean
-gdm_session_worker_handle_authorize (GdmDBusWorker         *object,
-                                     GDBusMethodInvocation *invocation)
-{
-        GdmSessionWorker *worker = GDM_SESSION_WORKER (object);
-        validate_and_queue_state_change (worker, invocation, GDM_SESSION_WORKER_STATE_AUTHORIZED);
-        return TRUE;
-}
+        gdm_debug (WORKER, "GdmSessionWorker: running to state %s", get_state_name (target_state));
 
-static gboolean
-gdm_session_worker_handle_establish_credentials (GdmDBusWorker         *object,
-                                                 GDBusMethodInvocation *invocation)
-{
-        GdmSessionWorker *worker = GDM_SESSION_WORKER (object);
-        validate_and_queue_state_change (worker, invocation, GDM_SESSION_WORKER_STATE_ACCREDITED);
+        if (!validate_state_change (worker, invocation, worker->state + 1)) {
+                return TRUE;
+        }
 
-        if (!worker->is_reauth_session) {
-                worker->cred_flags = PAM_ESTABLISH_CRED;
-        } else {
-                worker->cred_flags = PAM_REINITIALIZE_CRED;
+        if (target_state == GDM_SESSION_WORKER_STATE_ACCREDITED) {
+                if (!worker->is_reauth_session) {
+                        worker->cred_flags = PAM_ESTABLISH_CRED;
+                } else {
+                        worker->cred_flags = PAM_REINITIALIZE_CRED;
+                }
         }
 
+        worker->target_state = target_state;
+        worker->pending_invocation = invocation;
+        queue_state_change (worker);
+
         return TRUE;
 }
 
@@ -2880,6 +2927,7 @@ gdm_session_worker_handle_initialize (GdmDBusWorker         *object,
                         worker->display_device = g_variant_dup_string (value, NULL);
                 } else if (g_strcmp0 (key, "seat-id") == 0) {
                         worker->display_seat_id = g_variant_dup_string (value, NULL);
+                        gdm_log_set_context (GDM_LOG_FIELD_SEAT, worker->display_seat_id);
                 } else if (g_strcmp0 (key, "hostname") == 0) {
                         worker->hostname = g_variant_dup_string (value, NULL);
                 } else if (g_strcmp0 (key, "display-is-local") == 0) {
@@ -2948,7 +2996,7 @@ gdm_session_worker_handle_start_program (GdmDBusWorker         *object,
                 return TRUE;
         }
 
-        g_debug ("GdmSessionWorker: start program: %s", text);
+        gdm_debug (WORKER, "GdmSessionWorker: start program: %s", text);
 
         g_clear_pointer (&worker->arguments, g_strfreev);
         if (! g_shell_parse_argv (text, NULL, &worker->arguments, &parse_error)) {
@@ -2969,7 +3017,7 @@ on_reauthentication_client_connected (GdmSession              *session,
                                       GPid                     pid_of_client,
                                       ReauthenticationRequest *request)
 {
-        g_debug ("GdmSessionWorker: client connected to reauthentication server");
+        gdm_debug (WORKER, "GdmSessionWorker: client connected to reauthentication server");
 }
 
 static void
@@ -2980,7 +3028,7 @@ on_reauthentication_client_disconnected (GdmSession              *session,
 {
         GdmSessionWorker *worker;
 
-        g_debug ("GdmSessionWorker: client disconnected from reauthentication server");
+        gdm_debug (WORKER, "GdmSessionWorker: client disconnected from reauthentication server");
 
         worker = request->worker;
         g_hash_table_remove (worker->reauthentication_requests,
@@ -2991,7 +3039,7 @@ static void
 on_reauthentication_cancelled (GdmSession              *session,
                                ReauthenticationRequest *request)
 {
-        g_debug ("GdmSessionWorker: client cancelled reauthentication request");
+        gdm_debug (WORKER, "GdmSessionWorker: client cancelled reauthentication request");
         gdm_session_reset (session);
 }
 
@@ -3000,8 +3048,8 @@ on_reauthentication_conversation_started (GdmSession              *session,
                                           const char              *service_name,
                                           ReauthenticationRequest *request)
 {
-        g_debug ("GdmSessionWorker: reauthentication service '%s' started",
-                 service_name);
+        gdm_debug (WORKER, "GdmSessionWorker: reauthentication service '%s' started",
+                           service_name);
 }
 
 static void
@@ -3009,8 +3057,8 @@ on_reauthentication_conversation_stopped (GdmSession              *session,
                                           const char              *service_name,
                                           ReauthenticationRequest *request)
 {
-        g_debug ("GdmSessionWorker: reauthentication service '%s' stopped",
-                 service_name);
+        gdm_debug (WORKER, "GdmSessionWorker: reauthentication service '%s' stopped",
+                           service_name);
 }
 
 static void
@@ -3022,10 +3070,10 @@ on_reauthentication_verification_complete (GdmSession              *session,
 
         worker = request->worker;
 
-        g_debug ("GdmSessionWorker: pid %d reauthenticated user %d with service '%s'",
-                 (int) request->pid_of_caller,
-                 (int) request->uid_of_caller,
-                 service_name);
+        gdm_debug (WORKER, "GdmSessionWorker: pid %d reauthenticated user %d with service '%s'",
+                           (int) request->pid_of_caller,
+                           (int) request->uid_of_caller,
+                           service_name);
         gdm_session_reset (session);
 
         gdm_dbus_worker_emit_reauthenticated (GDM_DBUS_WORKER (worker), service_name, request->pid_of_caller);
@@ -3108,7 +3156,7 @@ gdm_session_worker_handle_start_reauthentication (GdmDBusWorker         *object,
                 return TRUE;
         }
 
-        g_debug ("GdmSessionWorker: start reauthentication");
+        gdm_debug (WORKER, "GdmSessionWorker: start reauthentication");
 
         request = reauthentication_request_new (worker, pid_of_caller, uid_of_caller, invocation);
         g_hash_table_replace (worker->reauthentication_requests,
@@ -3117,6 +3165,32 @@ gdm_session_worker_handle_start_reauthentication (GdmDBusWorker         *object,
         return TRUE;
 }
 
+/* Runs in the GDBus worker thread, so CancelQuery gets noticed even
+ * while the main thread is blocked in the PAM conversation */
+static GDBusMessage *
+on_connection_message (GDBusConnection *connection,
+                       GDBusMessage    *message,
+                       gboolean         incoming,
+                       gpointer         user_data)
+{
+        GdmSessionWorker *worker = user_data;
+
+        if (!incoming ||
+            g_dbus_message_get_message_type (message) != G_DBUS_MESSAGE_TYPE_METHOD_CALL ||
+            g_strcmp0 (g_dbus_message_get_interface (message), GDM_WORKER_DBUS_INTERFACE) != 0 ||
+            g_strcmp0 (g_dbus_message_get_member (message), "CancelQuery") != 0) {
+                return message;
+        }
+
+        g_mutex_lock (&worker->query_lock);
+        if (worker->query_cancellable != NULL) {
+                g_cancellable_cancel (worker->query_cancellable);
+        }
+        g_mutex_unlock (&worker->query_lock);
+
+        return message;
+}
+
 static GObject *
 gdm_session_worker_constructor (GType                  type,
                                 guint                  n_construct_properties,
@@ -3129,7 +3203,7 @@ gdm_session_worker_constructor (GType                  type,
                                                                                                     n_construct_properties,
                                                                                                     construct_properties));
 
-        g_debug ("GdmSessionWorker: connecting to address: %s", worker->server_address);
+        gdm_debug (WORKER, "GdmSessionWorker: connecting to address: %s", worker->server_address);
 
         worker->connection = g_dbus_connection_new_for_address_sync (worker->server_address,
                                                                      G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
@@ -3141,6 +3215,11 @@ gdm_session_worker_constructor (GType                  type,
                 exit (EXIT_FAILURE);
         }
 
+        worker->connection_filter_id = g_dbus_connection_add_filter (worker->connection,
+                                                                     on_connection_message,
+                                                                     worker,
+                                                                     NULL);
+
         worker->manager = GDM_DBUS_WORKER_MANAGER (gdm_dbus_worker_manager_proxy_new_sync (worker->connection,
                                                                                            G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
                                                                                            NULL, /* dbus name */
@@ -3176,15 +3255,16 @@ static void
 worker_interface_init (GdmDBusWorkerIface *interface)
 {
         interface->handle_initialize = gdm_session_worker_handle_initialize;
-        interface->handle_authenticate = gdm_session_worker_handle_authenticate;
-        interface->handle_authorize = gdm_session_worker_handle_authorize;
-        interface->handle_establish_credentials = gdm_session_worker_handle_establish_credentials;
+        interface->handle_run_to_state = gdm_session_worker_handle_run_to_state;
         interface->handle_open = gdm_session_worker_handle_open;
         interface->handle_set_language_name = gdm_session_worker_handle_set_language_name;
         interface->handle_set_session_name = gdm_session_worker_handle_set_session_name;
         interface->handle_set_session_display_mode = gdm_session_worker_handle_set_session_display_mode;
         interface->handle_set_environment_variable = gdm_session_worker_handle_set_environment_variable;
+        interface->handle_set_environment = gdm_session_worker_handle_set_environment;
         interface->handle_start_program = gdm_session_worker_handle_start_program;
+        interface->handle_cancel_query = gdm_session_worker_handle_cancel_query;
+        interface->handle_set_debug_categories = gdm_session_worker_handle_set_debug_categories;
         interface->handle_start_reauthentication = gdm_session_worker_handle_start_reauthentication;
 }
 
@@ -3258,6 +3338,7 @@ gdm_session_worker_init (GdmSessionWorker *worker)
                                                                    NULL,
                                                                    (GDestroyNotify)
                                                                    reauthentication_request_free);
+        g_mutex_init (&worker->query_lock);
 }
 
 static void
@@ -3275,10 +3356,14 @@ gdm_session_worker_finalize (GObject *object)
         g_clear_handle_id (&worker->child_watch_id, g_source_remove);
 
         if (worker->child_pid > 0) {
+                int status;
+
                 gdm_signal_pid (worker->child_pid, SIGTERM);
-                gdm_wait_on_pid (worker->child_pid);
+                gdm_child_wait_all (&worker->child_pid, &status, 1, 0);
         }
 
+        g_clear_pointer (&worker->session_log, gdm_session_log_free);
+
         if (worker->pam_handle != NULL) {
                 gdm_session_worker_uninitialize_pam (worker, PAM_SUCCESS);
         }
@@ -3297,6 +3382,13 @@ gdm_session_worker_finalize (GObject *object)
 
         g_hash_table_unref (worker->reauthentication_requests);
 
+        if (worker->connection_filter_id != 0) {
+                g_dbus_connection_remove_filter (worker->connection,
+                                                 worker->connection_filter_id);
+        }
+        g_clear_object (&worker->query_cancellable);
+        g_mutex_clear (&worker->query_lock);
+
         G_OBJECT_CLASS (gdm_session_worker_parent_class)->finalize (object);
 }
 
@@ -48,7 +48,9 @@
 #include <systemd/sd-login.h>
 
 #include "gdm-session.h"
+#include "gdm-session-catalog.h"
 #include "gdm-session-glue.h"
+#include "gdm-login-trace.h"
 #include "gdm-dbus-util.h"
 
 #include "gdm-session.h"
@@ -57,6 +59,7 @@
 #include "gdm-session-worker-job.h"
 #include "gdm-session-worker-glue.h"
 #include "gdm-common.h"
+#include "gdm-log.h"
 
 #include "gdm-settings-direct.h"
 #include "gdm-settings-keys.h"
@@ -66,6 +69,9 @@
 
 #define GDM_WORKER_DBUS_PATH "/org/gnome/DisplayManager/Worker"
 
+/* Seconds to wait before replacing an idle worker that died */
+#define WORKER_POOL_RESPAWN_DELAY 1
+
 typedef struct
 {
         GdmSession            *session;
@@ -79,11 +85,22 @@ typedef struct
         GdmDBusWorker         *worker_proxy;
         GCancellable          *worker_cancellable;
         char                  *session_id;
+        guint                  n_worker_messages;
         guint32                is_stopping : 1;
+        guint32                is_authenticated : 1;
 
         GPid                   reauth_pid_of_caller;
 } GdmSessionConversation;
 
+typedef struct
+{
+        GdmSession            *session;
+        GdmSessionWorkerJob   *job;
+        GPid                   worker_pid;
+        GDBusConnection       *connection;
+        GdmDBusWorkerManager  *worker_manager_interface;
+} GdmSessionIdleWorker;
+
 struct _GdmSession
 {
         GObject              parent;
@@ -104,6 +121,7 @@ struct _GdmSession
         GdmSessionConversation *session_conversation;
 
         char                 **conversation_environment;
+        GdmEnvironmentTemplate *conversation_environment_template;
 
         GdmDBusUserVerifier   *user_verifier_interface;
         GHashTable            *user_verifier_extensions;
@@ -112,8 +130,14 @@ struct _GdmSession
         GList               *pending_worker_connections;
         GList               *outside_connections;
 
+        GQueue              *idle_workers;
+        guint                worker_pool_size;
+        guint                worker_pool_refill_id;
+
         GPid                 session_pid;
 
+        GdmLoginTrace       *login_trace;
+
         /* object lifetime scope */
         char                *session_type;
         char                *display_hostname;
@@ -127,7 +151,7 @@ struct _GdmSession
 
         char                *fallback_session_name;
 
-        GDBusServer         *worker_server;
+        guint                worker_route_id;
         GDBusServer         *outside_server;
         GHashTable          *environment;
 
@@ -186,6 +210,15 @@ static void update_session_type (GdmSession *self);
 static void set_session_type (GdmSession *self,
                               const char *session_type);
 static void close_conversation (GdmSessionConversation *conversation);
+static void queue_worker_pool_refill (GdmSession *self);
+static gboolean refill_worker_pool_idle (GdmSession *self);
+static void verify_conversation (GdmSession *self,
+                                 const char *service_name);
+static void free_idle_worker (GdmSessionIdleWorker *idle_worker);
+static void attach_worker_connection (GdmSession             *self,
+                                      GdmSessionConversation *conversation,
+                                      GDBusConnection        *connection,
+                                      GdmDBusWorkerManager   *worker_manager_interface);
 
 static guint signals [LAST_SIGNAL] = { 0, };
 
@@ -238,75 +271,45 @@ report_and_stop_conversation (GdmSession *self,
 }
 
 static void
-on_authenticate_cb (GdmDBusWorker *proxy,
-                    GAsyncResult  *res,
-                    gpointer       user_data)
+mark_login_phase (GdmSession *self,
+                  const char *phase)
 {
-        GdmSessionConversation *conversation = user_data;
-        GdmSession *self;
-        char *service_name;
-
-        g_autoptr(GError) error = NULL;
-        gboolean worked;
-
-        worked = gdm_dbus_worker_call_authenticate_finish (proxy, res, &error);
-
-        if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CLOSED) ||
-            g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
-                return;
-
-        self = conversation->session;
-        service_name = conversation->service_name;
-
-        if (worked) {
-                gdm_session_authorize (self, service_name);
-        } else {
-                if (!g_error_matches (error,
-                                      GDM_SESSION_WORKER_ERROR,
-                                      GDM_SESSION_WORKER_ERROR_SERVICE_UNAVAILABLE)) {
-                        g_signal_emit (self,
-                                       signals[AUTHENTICATION_FAILED],
-                                       0,
-                                       service_name,
-                                       conversation->worker_pid);
-                }
-
-                report_and_stop_conversation (self, service_name, error);
-        }
+        if (self->login_trace != NULL)
+                gdm_login_trace_mark (self->login_trace, phase);
 }
 
 static void
-on_authorize_cb (GdmDBusWorker *proxy,
-                 GAsyncResult  *res,
-                 gpointer       user_data)
+handle_credentials_established (GdmSession             *self,
+                                GdmSessionConversation *conversation)
 {
-        GdmSessionConversation *conversation = user_data;
-        GdmSession *self;
-        char *service_name;
-
-        g_autoptr(GError) error = NULL;
-        gboolean worked;
-
-        worked = gdm_dbus_worker_call_authorize_finish (proxy, res, &error);
+        const char *service_name = conversation->service_name;
 
-        if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CLOSED) ||
-            g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
-                return;
-
-        self = conversation->session;
-        service_name = conversation->service_name;
+        g_signal_emit (self,
+                       signals[CREDENTIALS_ESTABLISHED],
+                       0,
+                       service_name,
+                       conversation->worker_pid);
 
-        if (worked) {
-                gdm_session_accredit (self, service_name);
-        } else {
-                report_and_stop_conversation (self, service_name, error);
+        switch (self->verification_mode) {
+        case GDM_SESSION_VERIFICATION_MODE_LOGIN:
+                gdm_session_open_session (self, service_name);
+                break;
+        case GDM_SESSION_VERIFICATION_MODE_REAUTHENTICATE:
+                if (self->user_verifier_interface != NULL) {
+                        gdm_dbus_user_verifier_emit_verification_complete (self->user_verifier_interface,
+                                                                           service_name);
+                        g_signal_emit (self, signals[VERIFICATION_COMPLETE], 0, service_name);
+                }
+                break;
+        default:
+                break;
         }
 }
 
 static void
-on_establish_credentials_cb (GdmDBusWorker *proxy,
-                             GAsyncResult  *res,
-                             gpointer       user_data)
+on_run_to_state_cb (GdmDBusWorker *proxy,
+                    GAsyncResult  *res,
+                    gpointer       user_data)
 {
         GdmSessionConversation *conversation = user_data;
         GdmSession *self;
@@ -315,7 +318,7 @@ on_establish_credentials_cb (GdmDBusWorker *proxy,
         g_autoptr(GError) error = NULL;
         gboolean worked;
 
-        worked = gdm_dbus_worker_call_establish_credentials_finish (proxy, res, &error);
+        worked = gdm_dbus_worker_call_run_to_state_finish (proxy, res, &error);
 
         if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CLOSED) ||
             g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
@@ -325,27 +328,21 @@ on_establish_credentials_cb (GdmDBusWorker *proxy,
         service_name = g_strdup (conversation->service_name);
 
         if (worked) {
-                g_signal_emit (self,
-                               signals[CREDENTIALS_ESTABLISHED],
-                               0,
-                               service_name,
-                               conversation->worker_pid);
-
-                switch (self->verification_mode) {
-                case GDM_SESSION_VERIFICATION_MODE_LOGIN:
-                        gdm_session_open_session (self, service_name);
-                        break;
-                case GDM_SESSION_VERIFICATION_MODE_REAUTHENTICATE:
-                        if (self->user_verifier_interface != NULL) {
-                                gdm_dbus_user_verifier_emit_verification_complete (self->user_verifier_interface,
-                                                                                   service_name);
-                                g_signal_emit (self, signals[VERIFICATION_COMPLETE], 0, service_name);
-                        }
-                        break;
-                default:
-                        break;
-                }
+                handle_credentials_established (self, conversation);
         } else {
+                /* StateReached signals arrive before the reply, so we
+                 * know how far the worker got before failing */
+                if (!conversation->is_authenticated &&
+                    !g_error_matches (error,
+                                      GDM_SESSION_WORKER_ERROR,
+                                      GDM_SESSION_WORKER_ERROR_SERVICE_UNAVAILABLE)) {
+                        g_signal_emit (self,
+                                       signals[AUTHENTICATION_FAILED],
+                                       0,
+                                       service_name,
+                                       conversation->worker_pid);
+                }
+
                 report_and_stop_conversation (self, service_name, error);
         }
 
@@ -364,60 +361,6 @@ supports_session_type (GdmSession *self,
                                 session_type);
 }
 
-static char **
-get_system_session_dirs (GdmSession *self,
-                         const char *type)
-{
-        GArray *search_array = NULL;
-        char **search_dirs;
-        int i, j;
-        const gchar * const *system_data_dirs = g_get_system_data_dirs ();
-
-        static const char *x_search_dirs[] = {
-                "/etc/X11/sessions/",
-                DMCONFDIR "/Sessions/",
-                DATADIR "/gdm/BuiltInSessions/",
-                DATADIR "/xsessions/",
-        };
-
-        static const char *gdm_wayland_search_dir = DATADIR "/gdm/greeter/wayland-sessions/";
-        static const char *wayland_search_dir = DATADIR "/wayland-sessions/";
-
-        search_array = g_array_new (TRUE, TRUE, sizeof (char *));
-
-        for (j = 0; self->supported_session_types[j] != NULL; j++) {
-                const char *supported_type = self->supported_session_types[j];
-
-                if (g_str_equal (supported_type, "x11") &&
-                    (type == NULL || g_str_equal (type, supported_type))) {
-                        for (i = 0; system_data_dirs[i]; i++) {
-                                gchar *dir = g_build_filename (system_data_dirs[i], "xsessions", NULL);
-                                g_array_append_val (search_array, dir);
-                        }
-
-                        g_array_append_vals (search_array, x_search_dirs, G_N_ELEMENTS (x_search_dirs));
-                }
-
-                if (g_str_equal (supported_type, "wayland") &&
-                    (type == NULL || g_str_equal (type, supported_type))) {
-                        g_array_append_val (search_array, gdm_wayland_search_dir);
-
-                        for (i = 0; system_data_dirs[i]; i++) {
-                                gchar *dir = g_build_filename (system_data_dirs[i], "wayland-sessions", NULL);
-                                g_array_append_val (search_array, dir);
-                        }
-
-                        g_array_append_val (search_array, wayland_search_dir);
-                }
-        }
-
-        search_dirs = g_strdupv ((char **) search_array->data);
-
-        g_array_free (search_array, TRUE);
-
-        return search_dirs;
-}
-
 static gboolean
 is_prog_in_path (const char *prog)
 {
@@ -430,43 +373,6 @@ is_prog_in_path (const char *prog)
         return ret;
 }
 
-static GKeyFile *
-load_key_file_for_file (GdmSession   *self,
-                        const char   *file,
-                        const char   *type,
-                        char        **full_path)
-{
-        GKeyFile   *key_file;
-        GError     *error = NULL;
-        gboolean    res;
-        char      **search_dirs;
-
-        key_file = g_key_file_new ();
-
-        search_dirs = get_system_session_dirs (self, type);
-
-        error = NULL;
-        res = g_key_file_load_from_dirs (key_file,
-                                         file,
-                                         (const char **) search_dirs,
-                                         full_path,
-                                         G_KEY_FILE_NONE,
-                                         &error);
-        if (! res) {
-                g_debug ("GdmSession: File '%s' not found in search dirs", file);
-                if (error != NULL) {
-                        g_debug ("GdmSession: %s", error->message);
-                        g_error_free (error);
-                }
-                g_key_file_free (key_file);
-                key_file = NULL;
-        }
-
-        g_strfreev (search_dirs);
-
-        return key_file;
-}
-
 static gboolean
 is_wayland_headless (GdmSession *self)
 {
@@ -474,113 +380,77 @@ is_wayland_headless (GdmSession *self)
                           !self->display_is_local;
 }
 
+static const GdmSessionDesktop *
+lookup_session_desktop (GdmSession *self,
+                        const char *name,
+                        const char *type)
+{
+        const char *types[] = { type, NULL };
+
+        if (type == NULL)
+                return gdm_session_catalog_lookup (gdm_session_catalog_get_default (),
+                                                   name,
+                                                   (const char * const *) self->supported_session_types);
+
+        if (!supports_session_type (self, type))
+                return NULL;
+
+        return gdm_session_catalog_lookup (gdm_session_catalog_get_default (), name, types);
+}
+
 static gboolean
-get_session_command_for_file (GdmSession  *self,
-                              const char  *file,
+get_session_command_for_name (GdmSession  *self,
+                              const char  *name,
                               const char  *type,
                               char       **command)
 {
-        GKeyFile   *key_file;
-        GError     *error;
-        char       *exec;
-        gboolean    ret;
-        gboolean    res;
+        const GdmSessionDesktop *desktop;
 
-        exec = NULL;
-        ret = FALSE;
         if (command != NULL) {
                 *command = NULL;
         }
 
         if (!supports_session_type (self, type)) {
-                g_debug ("GdmSession: ignoring %s session command request for file '%s'",
-                         type, file);
-                goto out;
+                gdm_debug (SESSION, "GdmSession: ignoring %s session command request for session '%s'",
+                                    type, name);
+                return FALSE;
         }
 
-        g_debug ("GdmSession: getting session command for file '%s'", file);
-        key_file = load_key_file_for_file (self, file, type, NULL);
-        if (key_file == NULL) {
-                goto out;
+        gdm_debug (SESSION, "GdmSession: getting session command for session '%s'", name);
+        desktop = lookup_session_desktop (self, name, type);
+        if (desktop == NULL) {
+                gdm_debug (SESSION, "GdmSession: Session '%s' not found in search dirs", name);
+                return FALSE;
         }
 
-        error = NULL;
-        res = g_key_file_get_boolean (key_file,
-                                      G_KEY_FILE_DESKTOP_GROUP,
-                                      G_KEY_FILE_DESKTOP_KEY_HIDDEN,
-                                      &error);
-        if (error == NULL && res) {
-                g_debug ("GdmSession: Session %s is marked as hidden", file);
-                goto out;
+        if (desktop->hidden) {
+                gdm_debug (SESSION, "GdmSession: Session %s is marked as hidden", name);
+                return FALSE;
         }
 
-        if (is_wayland_headless (self)) {
-                gboolean can_run_headless;
-
-                can_run_headless = g_key_file_get_boolean (key_file,
-                                                           G_KEY_FILE_DESKTOP_GROUP,
-                                                           "X-GDM-CanRunHeadless",
-                                                           NULL);
-                if (!can_run_headless && is_wayland_headless (self)) {
-                        g_debug ("GdmSession: Session %s is not headless capable", file);
-                        goto out;
-                }
+        if (is_wayland_headless (self) && !desktop->can_run_headless) {
+                gdm_debug (SESSION, "GdmSession: Session %s is not headless capable", name);
+                return FALSE;
         }
 
-        exec = g_key_file_get_string (key_file,
-                                      G_KEY_FILE_DESKTOP_GROUP,
-                                      G_KEY_FILE_DESKTOP_KEY_TRY_EXEC,
-                                      NULL);
-        if (exec != NULL) {
-                res = is_prog_in_path (exec);
-                g_free (exec);
-                exec = NULL;
-
-                if (! res) {
-                        g_debug ("GdmSession: Command not found: %s",
-                                 G_KEY_FILE_DESKTOP_KEY_TRY_EXEC);
-                        goto out;
-                }
+        if (desktop->try_exec != NULL && !is_prog_in_path (desktop->try_exec)) {
+                gdm_debug (SESSION, "GdmSession: Command not found: %s",
+                                    G_KEY_FILE_DESKTOP_KEY_TRY_EXEC);
+                return FALSE;
         }
 
-        error = NULL;
-        exec = g_key_file_get_string (key_file,
-                                      G_KEY_FILE_DESKTOP_GROUP,
-                                      G_KEY_FILE_DESKTOP_KEY_EXEC,
-                                      &error);
-        if (error != NULL) {
-                g_debug ("GdmSession: %s key not found: %s",
-                         G_KEY_FILE_DESKTOP_KEY_EXEC,
-                         error->message);
-                g_error_free (error);
-                goto out;
+        if (desktop->exec == NULL) {
+                gdm_debug (SESSION, "GdmSession: %s key not found in '%s'",
+                                    G_KEY_FILE_DESKTOP_KEY_EXEC,
+                                    desktop->path);
+                return FALSE;
         }
 
         if (command != NULL) {
-                *command = g_strdup (exec);
+                *command = g_strdup (desktop->exec);
         }
-        ret = TRUE;
-
-out:
-        g_free (exec);
-
-        return ret;
-}
-
-static gboolean
-get_session_command_for_name (GdmSession  *self,
-                              const char  *name,
-                              const char  *type,
-                              char       **command)
-{
-        gboolean res;
-        char    *filename;
-
-        filename = g_strdup_printf ("%s.desktop", name);
-        res = get_session_command_for_file (self, filename, type, command);
-        g_free (filename);
 
-        return res;
+        return TRUE;
 }
 
 static const char *
@@ -606,12 +476,10 @@ static const char *
 get_fallback_session_name (GdmSession *self)
 {
         gboolean        res;
-        char          **search_dirs;
+        char          **ids;
         int             i;
         g_autofree char *configured_fallback = NULL;
         char           *name;
-        GSequence      *sessions;
-        GSequenceIter  *session;
 
         if (self->fallback_session_name != NULL) {
                 /* verify that the cached version still exists */
@@ -634,58 +502,24 @@ get_fallback_session_name (GdmSession *self)
         }
         g_free (name);
 
-        sessions = g_sequence_new (g_free);
-
-        search_dirs = get_system_session_dirs (self, NULL);
-        for (i = 0; search_dirs[i] != NULL; i++) {
-                GDir       *dir;
-                const char *base_name;
+        ids = gdm_session_catalog_list_ids (gdm_session_catalog_get_default (),
+                                            (const char * const *) self->supported_session_types);
 
-                dir = g_dir_open (search_dirs[i], 0, NULL);
-
-                if (dir == NULL) {
-                        continue;
+        name = NULL;
+        for (i = 0; ids[i] != NULL; i++) {
+                if (get_session_command_for_name (self, ids[i], NULL, NULL)) {
+                        name = ids[i];
+                        break;
                 }
-
-                do {
-                        base_name = g_dir_read_name (dir);
-
-                        if (base_name == NULL) {
-                                break;
-                        }
-
-                        if (!g_str_has_suffix (base_name, ".desktop")) {
-                                continue;
-                        }
-
-                        if (get_session_command_for_file (self, base_name, NULL, NULL)) {
-                                name = g_strndup (base_name, strlen (base_name) - strlen (".desktop"));
-                                g_sequence_insert_sorted (sessions, name, (GCompareDataFunc) g_strcmp0, NULL);
-                        }
-                } while (base_name != NULL);
-
-                g_dir_close (dir);
         }
-        g_strfreev (search_dirs);
 
-        name = NULL;
-        session = g_sequence_get_begin_iter (sessions);
-
-        if (g_sequence_iter_is_end (session))
+        if (name == NULL)
                 g_error ("GdmSession: no session desktop files installed, aborting...");
 
-        do {
-               name = g_sequence_get (session);
-               if (name) {
-                       break;
-               }
-               session = g_sequence_iter_next (session);
-        } while (!g_sequence_iter_is_end (session));
-
         g_free (self->fallback_session_name);
         self->fallback_session_name = g_strdup (name);
 
-        g_sequence_free (sessions);
+        g_strfreev (ids);
 
  out:
         return self->fallback_session_name;
@@ -722,10 +556,10 @@ gdm_session_select_user (GdmSession *self,
         g_return_if_fail (GDM_IS_SESSION (self));
         g_return_if_fail (text != NULL);
 
-        g_debug ("GdmSession: selecting user '%s' for session '%s' (%p)",
-                 text,
-                 gdm_session_get_session_id (self),
-                 self);
+        gdm_debug (SESSION, "GdmSession: selecting user '%s' for session '%s' (%p)",
+                            text,
+                            gdm_session_get_session_id (self),
+                            self);
 
         g_free (self->selected_user);
         self->selected_user = g_strdup (text);
@@ -747,7 +581,7 @@ cancel_pending_query (GdmSessionConversation *conversation)
                 return;
         }
 
-        g_debug ("GdmSession: Cancelling pending query");
+        gdm_debug (SESSION, "GdmSession: Cancelling pending query");
 
         g_dbus_method_invocation_return_dbus_error (conversation->pending_invocation,
                                                     GDM_SESSION_DBUS_ERROR_CANCEL,
@@ -784,7 +618,7 @@ gdm_session_handle_choice_list_query (GdmDBusWorkerManager  *worker_manager_inte
         GdmSessionConversation *conversation;
         GdmDBusUserVerifierChoiceList *choice_list_interface = NULL;
 
-        g_debug ("GdmSession: choice query for service '%s'", service_name);
+        gdm_debug (SESSION, "GdmSession: choice query for service '%s'", service_name);
 
         if (self->user_verifier_extensions != NULL)
                 choice_list_interface = g_hash_table_lookup (self->user_verifier_extensions,
@@ -801,7 +635,7 @@ gdm_session_handle_choice_list_query (GdmDBusWorkerManager  *worker_manager_inte
         if (conversation != NULL) {
                 set_pending_query (conversation, invocation);
 
-                g_debug ("GdmSession: emitting choice query '%s'", prompt_message);
+                gdm_debug (SESSION, "GdmSession: emitting choice query '%s'", prompt_message);
                 gdm_dbus_user_verifier_choice_list_emit_choice_query (choice_list_interface,
                                                                       service_name,
                                                                       prompt_message,
@@ -823,7 +657,7 @@ gdm_session_handle_custom_json_request (GdmDBusWorkerManager  *worker_manager_in
         GdmSessionConversation *conversation;
         GdmDBusUserVerifierCustomJSON *custom_json_interface = NULL;
 
-        g_debug ("GdmSession: custom JSON request for service '%s'", service_name);
+        gdm_debug (SESSION, "GdmSession: custom JSON request for service '%s'", service_name);
 
         if (self->user_verifier_extensions != NULL) {
                 custom_json_interface =
@@ -933,6 +767,21 @@ worker_on_cancel_pending_query (GdmDBusWorker          *worker,
         cancel_pending_query (conversation);
 }
 
+static void
+worker_on_state_reached (GdmDBusWorker          *worker,
+                         const char             *state,
+                         GdmSessionConversation *conversation)
+{
+        gdm_debug (SESSION, "GdmSession: conversation %s reached state %s",
+                            conversation->service_name, state);
+
+        mark_login_phase (conversation->session, state);
+
+        if (g_strcmp0 (state, "authenticated") == 0) {
+                conversation->is_authenticated = TRUE;
+        }
+}
+
 static gboolean
 gdm_session_handle_problem (GdmDBusWorkerManager  *worker_manager_interface,
                             GDBusMethodInvocation *invocation,
@@ -984,6 +833,8 @@ on_opened (GdmDBusWorker *worker,
 
                 g_set_str (&self->session_opened, session_id);
 
+                mark_login_phase (self, "session-opened");
+
                 if (self->user_verifier_interface != NULL) {
                         gdm_dbus_user_verifier_emit_verification_complete (self->user_verifier_interface,
                                                                            service_name);
@@ -996,14 +847,14 @@ on_opened (GdmDBusWorker *worker,
                                                               session_id);
                 }
 
-                g_debug ("GdmSession: Emitting 'session-opened' signal");
+                gdm_debug (SESSION, "GdmSession: Emitting 'session-opened' signal");
                 g_signal_emit (self, signals[SESSION_OPENED], 0, service_name, session_id);
 
                 self->is_opened = TRUE;
         } else {
                 report_and_stop_conversation (self, service_name, error);
 
-                g_debug ("GdmSession: Emitting 'session-start-failed' signal");
+                gdm_debug (SESSION, "GdmSession: Emitting 'session-start-failed' signal");
                 g_signal_emit (self, signals[SESSION_OPENED_FAILED], 0, service_name, error->message);
         }
 }
@@ -1015,9 +866,9 @@ worker_on_username_changed (GdmDBusWorker          *worker,
 {
         GdmSession *self = conversation->session;
 
-        g_debug ("GdmSession: changing username from '%s' to '%s'",
-                 self->selected_user != NULL ? self->selected_user : "<unset>",
-                 (strlen (username)) ? username : "<unset>");
+        gdm_debug (SESSION, "GdmSession: changing username from '%s' to '%s'",
+                            self->selected_user != NULL ? self->selected_user : "<unset>",
+                            (strlen (username)) ? username : "<unset>");
 
         gdm_session_select_user (self, (strlen (username) > 0) ? g_strdup (username) : NULL);
         gdm_session_defaults_changed (self);
@@ -1034,11 +885,11 @@ worker_on_session_exited (GdmDBusWorker          *worker,
         self->session_conversation = NULL;
 
         if (WIFEXITED (status)) {
-                g_debug ("GdmSession: Emitting 'session-exited' signal with exit code '%d'",
+                gdm_debug (SESSION, "GdmSession: Emitting 'session-exited' signal with exit code '%d'",
                   WEXITSTATUS (status));
                 g_signal_emit (self, signals[SESSION_EXITED], 0, WEXITSTATUS (status));
         } else if (WIFSIGNALED (status)) {
-                g_debug ("GdmSession: Emitting 'session-died' signal with signal number '%d'",
+                gdm_debug (SESSION, "GdmSession: Emitting 'session-died' signal with signal number '%d'",
                   WTERMSIG (status));
                 g_signal_emit (self, signals[SESSION_DIED], 0, WTERMSIG (status));
         }
@@ -1069,7 +920,7 @@ on_reauthentication_started_cb (GdmDBusWorker *worker,
 
         if (worked) {
                 GPid pid_of_caller = conversation->reauth_pid_of_caller;
-                g_debug ("GdmSession: Emitting 'reauthentication-started' signal for caller pid '%d'", pid_of_caller);
+                gdm_debug (SESSION, "GdmSession: Emitting 'reauthentication-started' signal for caller pid '%d'", pid_of_caller);
                 g_signal_emit (self, signals[REAUTHENTICATION_STARTED], 0, pid_of_caller, address);
         }
 
@@ -1083,7 +934,7 @@ worker_on_reauthenticated (GdmDBusWorker          *worker,
                            GdmSessionConversation *conversation)
 {
         GdmSession *self = conversation->session;
-        g_debug ("GdmSession: Emitting 'reauthenticated' signal ");
+        gdm_debug (SESSION, "GdmSession: Emitting 'reauthenticated' signal ");
         g_signal_emit (self, signals[REAUTHENTICATED], 0, service_name, reauth_pid);
 }
 
@@ -1114,7 +965,7 @@ worker_on_saved_session_name_read (GdmDBusWorker          *worker,
 
         if (! get_session_command_for_name (self, session_name, self->saved_session_type, NULL)) {
                 /* ignore sessions that don't exist */
-                g_debug ("GdmSession: not using invalid .dmrc session: %s", session_name);
+                gdm_debug (SESSION, "GdmSession: not using invalid .dmrc session: %s", session_name);
                 g_free (self->saved_session);
                 self->saved_session = NULL;
                 update_session_type (self);
@@ -1169,27 +1020,44 @@ find_conversation_by_pid (GdmSession *self,
         return NULL;
 }
 
+static GdmSessionIdleWorker *
+find_idle_worker_by_pid (GdmSession *self,
+                         GPid        pid)
+{
+        GList *node;
+
+        for (node = self->idle_workers->head; node != NULL; node = node->next) {
+                GdmSessionIdleWorker *idle_worker = node->data;
+
+                if (idle_worker->worker_pid == pid) {
+                        return idle_worker;
+                }
+        }
+
+        return NULL;
+}
+
 static gboolean
-allow_worker_function (GDBusAuthObserver *observer,
-                       GIOStream         *stream,
-                       GCredentials      *credentials,
-                       GdmSession        *self)
+is_worker_of_session (GCredentials *credentials,
+                      GdmSession   *self)
 {
         uid_t connecting_user;
+        GPid pid;
 
         connecting_user = g_credentials_get_unix_user (credentials, NULL);
 
-        if (connecting_user == 0) {
-                return TRUE;
+        if (connecting_user != 0 && connecting_user != self->allowed_user) {
+                return FALSE;
         }
 
-        if (connecting_user == self->allowed_user) {
-                return TRUE;
-        }
+        pid = (GPid) g_credentials_get_unix_pid (credentials, NULL);
 
-        g_debug ("GdmSession: User not allowed");
+        if (pid <= 0) {
+                return FALSE;
+        }
 
-        return FALSE;
+        return find_conversation_by_pid (self, pid) != NULL ||
+               find_idle_worker_by_pid (self, pid) != NULL;
 }
 
 
@@ -1219,13 +1087,13 @@ register_worker (GdmDBusWorkerManager  *worker_manager_interface,
         GCredentials *credentials;
         GPid pid;
 
-        g_debug ("GdmSession: Authenticating new connection");
+        gdm_debug (SESSION, "GdmSession: Authenticating new connection");
 
         connection = g_dbus_method_invocation_get_connection (invocation);
         connection_node = g_list_find (self->pending_worker_connections, connection);
 
         if (connection_node == NULL) {
-                g_debug ("GdmSession: Ignoring connection that we aren't tracking");
+                gdm_debug (SESSION, "GdmSession: Ignoring connection that we aren't tracking");
                 return FALSE;
         }
 
@@ -1250,6 +1118,22 @@ register_worker (GdmDBusWorkerManager  *worker_manager_interface,
         conversation = find_conversation_by_pid (self, (GPid) pid);
 
         if (conversation == NULL) {
+                GdmSessionIdleWorker *idle_worker;
+
+                idle_worker = find_idle_worker_by_pid (self, (GPid) pid);
+
+                if (idle_worker != NULL) {
+                        gdm_debug (SESSION, "GdmSession: Idle worker (pid:%d) connected", (int) pid);
+
+                        g_dbus_method_invocation_return_value (invocation, NULL);
+
+                        /* keep the reference we stole from the pending
+                         * connections list until a conversation claims it */
+                        idle_worker->connection = connection;
+                        idle_worker->worker_manager_interface = g_object_ref (worker_manager_interface);
+                        return TRUE;
+                }
+
                 g_warning ("GdmSession: New worker connection is from unknown source");
 
                 g_dbus_method_invocation_return_error_literal (invocation, G_DBUS_ERROR,
@@ -1261,13 +1145,24 @@ register_worker (GdmDBusWorkerManager  *worker_manager_interface,
 
         g_dbus_method_invocation_return_value (invocation, NULL);
 
+        attach_worker_connection (self, conversation, connection, worker_manager_interface);
+
+        return TRUE;
+}
+
+static void
+attach_worker_connection (GdmSession             *self,
+                          GdmSessionConversation *conversation,
+                          GDBusConnection        *connection,
+                          GdmDBusWorkerManager   *worker_manager_interface)
+{
         conversation->worker_proxy = gdm_dbus_worker_proxy_new_sync (connection,
                                                                      G_DBUS_PROXY_FLAGS_NONE,
                                                                      NULL,
                                                                      GDM_WORKER_DBUS_PATH,
                                                                      NULL, NULL);
-        /* drop the reference we stole from the pending connections list
-         * since the proxy owns the connection now */
+        /* drop the reference we were handed since the proxy owns the
+         * connection now */
         g_object_unref (connection);
 
         g_dbus_proxy_set_default_timeout (G_DBUS_PROXY (conversation->worker_proxy), G_MAXINT);
@@ -1295,11 +1190,14 @@ register_worker (GdmDBusWorkerManager  *worker_manager_interface,
         g_signal_connect (conversation->worker_proxy,
                           "cancel-pending-query",
                           G_CALLBACK (worker_on_cancel_pending_query), conversation);
+        g_signal_connect (conversation->worker_proxy,
+                          "state-reached",
+                          G_CALLBACK (worker_on_state_reached), conversation);
 
         conversation->worker_manager_interface = g_object_ref (worker_manager_interface);
-        g_debug ("GdmSession: worker connection is %p", connection);
+        gdm_debug (SESSION, "GdmSession: worker connection is %p", connection);
 
-        g_debug ("GdmSession: Emitting conversation-started signal");
+        gdm_debug (SESSION, "GdmSession: Emitting conversation-started signal");
         g_signal_emit (self, signals[CONVERSATION_STARTED], 0, conversation->service_name);
 
         if (self->user_verifier_interface != NULL) {
@@ -1319,9 +1217,7 @@ register_worker (GdmDBusWorkerManager  *worker_manager_interface,
                 }
         }
 
-        g_debug ("GdmSession: Conversation started");
-
-        return TRUE;
+        gdm_debug (SESSION, "GdmSession: Conversation started");
 }
 
 static void
@@ -1406,13 +1302,12 @@ unexport_worker_manager_interface (GdmSession           *self,
                                               self);
 }
 
-static gboolean
-handle_connection_from_worker (GDBusServer      *server,
-                               GDBusConnection  *connection,
+static void
+handle_connection_from_worker (GDBusConnection  *connection,
                                GdmSession       *self)
 {
 
-        g_debug ("GdmSession: Handling new connection from worker");
+        gdm_debug (SESSION, "GdmSession: Handling new connection from worker");
 
         /* add to the list of pending connections.  We won't be able to
          * associate it with a specific worker conversation until we have
@@ -1429,8 +1324,6 @@ handle_connection_from_worker (GDBusServer      *server,
                                  0);
 
         export_worker_manager_interface (self, connection);
-
-        return TRUE;
 }
 
 static GdmSessionConversation *
@@ -1464,7 +1357,7 @@ gdm_session_handle_client_select_choice (GdmDBusUserVerifierChoiceList    *choic
                                          const char                       *answer,
                                          GdmSession                       *self)
 {
-        g_debug ("GdmSession: user selected choice '%s'", answer);
+        gdm_debug (SESSION, "GdmSession: user selected choice '%s'", answer);
         gdm_dbus_user_verifier_choice_list_complete_select_choice (choice_list_interface, invocation);
         gdm_session_answer_query (self, service_name, answer);
         return TRUE;
@@ -1503,7 +1396,7 @@ gdm_session_handle_client_custom_json_reply (GdmDBusUserVerifierCustomJSON *cust
         g_autoptr(GError) error = NULL;
         g_autoptr(JsonParser) parser = NULL;
 
-        g_debug ("GdmSession: user replied with custom JSON");
+        gdm_debug (SESSION, "GdmSession: user replied with custom JSON");
 
         parser = json_parser_new_immutable ();
         if (!json_parser_load_from_data (parser, json, -1, &error)) {
@@ -1534,7 +1427,7 @@ gdm_session_handle_client_custom_json_report_error (GdmDBusUserVerifierCustomJSO
                                                     const char                    *message,
                                                     GdmSession                    *self)
 {
-        g_debug ("GdmSession: user reported custom JSON error: %s", message);
+        gdm_debug (SESSION, "GdmSession: user reported custom JSON error: %s", message);
 
         gdm_dbus_user_verifier_custom_json_complete_report_error (custom_json_interface, invocation);
         gdm_session_report_error (self, service_name, G_DBUS_ERROR_ACCESS_DENIED, message);
@@ -1668,9 +1561,9 @@ gdm_session_handle_client_select_session (GdmDBusGreeter         *greeter_interf
                 const char *username;
 
                 username = gdm_session_get_username (self);
-                g_debug ("GdmSession: refusing to select session %s since it's already running (for user %s)",
-                         session,
-                         username);
+                gdm_debug (SESSION, "GdmSession: refusing to select session %s since it's already running (for user %s)",
+                                    session,
+                                    username);
                 g_dbus_method_invocation_return_error (invocation,
                                                        G_DBUS_ERROR,
                                                        G_DBUS_ERROR_INVALID_ARGS,
@@ -1697,10 +1590,10 @@ gdm_session_handle_client_select_user (GdmDBusGreeter        *greeter_interface,
                 const char *session_username;
 
                 session_username = gdm_session_get_username (self);
-                g_debug ("GdmSession: refusing to select user %s, since session (%p) already running (for user %s)",
-                          username,
-                          self,
-                          session_username);
+                gdm_debug (SESSION, "GdmSession: refusing to select user %s, since session (%p) already running (for user %s)",
+                                     username,
+                                     self,
+                                     session_username);
                 g_dbus_method_invocation_return_error (invocation,
                                                        G_DBUS_ERROR,
                                                        G_DBUS_ERROR_INVALID_ARGS,
@@ -1713,7 +1606,7 @@ gdm_session_handle_client_select_user (GdmDBusGreeter        *greeter_interface,
                 gdm_dbus_greeter_complete_select_user (greeter_interface,
                                                        invocation);
         }
-        g_debug ("GdmSession: client selected user '%s' on session (%p)", username, self);
+        gdm_debug (SESSION, "GdmSession: client selected user '%s' on session (%p)", username, self);
         gdm_session_select_user (self, username);
         return TRUE;
 }
@@ -1729,9 +1622,9 @@ gdm_session_handle_client_start_session_when_ready (GdmDBusGreeter        *greet
                 const char *username;
 
                 username = gdm_session_get_username (self);
-                g_debug ("GdmSession: refusing to start session (%p), since it's already running (for user %s)",
-                         self,
-                         username);
+                gdm_debug (SESSION, "GdmSession: refusing to start session (%p), since it's already running (for user %s)",
+                                    self,
+                                    username);
                 g_dbus_method_invocation_return_error (invocation,
                                                        G_DBUS_ERROR,
                                                        G_DBUS_ERROR_INVALID_ARGS,
@@ -1761,9 +1654,9 @@ gdm_session_handle_get_timed_login_details (GdmDBusGreeter        *greeter_inter
                 const char *username;
 
                 username = gdm_session_get_username (self);
-                g_debug ("GdmSession: refusing to give timed login details, session (%p) already running (for user %s)",
-                         self,
-                         username);
+                gdm_debug (SESSION, "GdmSession: refusing to give timed login details, session (%p) already running (for user %s)",
+                                    self,
+                                    username);
                 g_dbus_method_invocation_return_error (invocation,
                                                        G_DBUS_ERROR,
                                                        G_DBUS_ERROR_INVALID_ARGS,
@@ -1819,10 +1712,10 @@ gdm_session_handle_client_begin_auto_login (GdmDBusGreeter        *greeter_inter
 
         if (gdm_session_is_running (self)) {
                 session_username = gdm_session_get_username (self);
-                g_debug ("GdmSession: refusing auto login operation, session (%p) already running for user %s (%s requested)",
-                         self,
-                         session_username,
-                         username);
+                gdm_debug (SESSION, "GdmSession: refusing auto login operation, session (%p) already running for user %s (%s requested)",
+                                    self,
+                                    session_username,
+                                    username);
                 g_dbus_method_invocation_return_error (invocation,
                                                        G_DBUS_ERROR,
                                                        G_DBUS_ERROR_INVALID_ARGS,
@@ -1836,10 +1729,10 @@ gdm_session_handle_client_begin_auto_login (GdmDBusGreeter        *greeter_inter
                                                             invocation);
         }
 
-        g_debug ("GdmSession: client requesting automatic login for user '%s' on session '%s' (%p)",
-                 username,
-                 gdm_session_get_session_id (self),
-                 self);
+        gdm_debug (SESSION, "GdmSession: client requesting automatic login for user '%s' on session '%s' (%p)",
+                            username,
+                            gdm_session_get_session_id (self),
+                            self);
 
         gdm_session_setup_for_user (self, "gdm-autologin", username);
 
@@ -1935,7 +1828,7 @@ on_outside_connection_closed (GDBusConnection *connection,
         GCredentials *credentials;
         GPid          pid_of_client;
 
-        g_debug ("GdmSession: external connection closed");
+        gdm_debug (SESSION, "GdmSession: external connection closed");
 
         self->outside_connections = g_list_remove (self->outside_connections,
                                                    connection);
@@ -1961,7 +1854,7 @@ handle_connection_from_outside (GDBusServer      *server,
         GCredentials *credentials;
         GPid          pid_of_client;
 
-        g_debug ("GdmSession: Handling new connection from outside");
+        gdm_debug (SESSION, "GdmSession: Handling new connection from outside");
 
         self->outside_connections = g_list_prepend (self->outside_connections,
                                                     g_object_ref (connection));
@@ -1993,39 +1886,26 @@ handle_connection_from_outside (GDBusServer      *server,
 static void
 setup_worker_server (GdmSession *self)
 {
-        GDBusAuthObserver *observer;
-        GDBusServer *server;
-        GError *error = NULL;
-
-        g_debug ("GdmSession: Creating D-Bus server for worker for session");
+        g_autoptr(GError) error = NULL;
 
-        observer = g_dbus_auth_observer_new ();
-        g_signal_connect_object (observer,
-                                 "authorize-authenticated-peer",
-                                 G_CALLBACK (allow_worker_function),
-                                 self,
-                                 0);
+        gdm_debug (SESSION, "GdmSession: Registering with the shared D-Bus server for workers");
 
-        server = gdm_dbus_setup_private_server (observer, &error);
-        g_object_unref (observer);
+        /* Workers are told which session they belong to by the pid
+         * they were spawned with, so they can all share one server */
+        self->worker_route_id = gdm_dbus_add_shared_server_route (self->allowed_user,
+                                                                  (GdmDBusServerMatchFunc) is_worker_of_session,
+                                                                  (GdmDBusServerConnectionFunc) handle_connection_from_worker,
+                                                                  self,
+                                                                  &error);
 
-        if (server == NULL) {
+        if (self->worker_route_id == 0) {
                 g_warning ("Cannot create worker D-Bus server for the session: %s",
                            error->message);
                 return;
         }
 
-        g_signal_connect_object (server,
-                                 "new-connection",
-                                 G_CALLBACK (handle_connection_from_worker),
-                                 self,
-                                 0);
-        self->worker_server = server;
-
-        g_dbus_server_start (server);
-
-        g_debug ("GdmSession: D-Bus server for workers listening on %s",
-        g_dbus_server_get_client_address (self->worker_server));
+        gdm_debug (SESSION, "GdmSession: D-Bus server for workers listening on %s",
+                            gdm_dbus_get_shared_server_address ());
 }
 
 static gboolean
@@ -2042,7 +1922,7 @@ allow_user_function (GDBusAuthObserver *observer,
                 return TRUE;
         }
 
-        g_debug ("GdmSession: User not allowed");
+        gdm_debug (SESSION, "GdmSession: User not allowed");
 
         pid_of_client = g_credentials_get_unix_pid (credentials, NULL);
         g_signal_emit (G_OBJECT (self),
@@ -2063,9 +1943,9 @@ setup_outside_server (GdmSession *self)
         GDBusServer *server;
         GError *error = NULL;
 
-         g_debug ("GdmSession: Creating D-Bus server for greeters and such for session %s (%p)",
-                  gdm_session_get_session_id (self),
-                  self);
+         gdm_debug (SESSION, "GdmSession: Creating D-Bus server for greeters and such for session %s (%p)",
+                             gdm_session_get_session_id (self),
+                             self);
 
         observer = g_dbus_auth_observer_new ();
         g_signal_connect_object (observer,
@@ -2092,7 +1972,7 @@ setup_outside_server (GdmSession *self)
 
         g_dbus_server_start (server);
 
-        g_debug ("GdmSession: D-Bus server for greeters listening on %s",
+        gdm_debug (SESSION, "GdmSession: D-Bus server for greeters listening on %s",
         g_dbus_server_get_client_address (self->outside_server));
 }
 
@@ -2135,6 +2015,9 @@ free_conversation (GdmSessionConversation *conversation)
                 g_signal_handlers_disconnect_by_func (conversation->worker_proxy,
                                                       G_CALLBACK (worker_on_cancel_pending_query),
                                                       conversation);
+                g_signal_handlers_disconnect_by_func (conversation->worker_proxy,
+                                                      G_CALLBACK (worker_on_state_reached),
+                                                      conversation);
                 g_clear_object (&conversation->worker_proxy);
         }
         g_clear_object (&conversation->session);
@@ -2155,15 +2038,15 @@ load_lang_config_file (GdmSession *self)
         GRegex        *re;
 
         if (!g_file_test (config_file, G_FILE_TEST_EXISTS)) {
-                g_debug ("Cannot access '%s'", config_file);
+                gdm_debug (SESSION, "Cannot access '%s'", config_file);
                 return;
         }
 
         error = NULL;
         if (!g_file_get_contents (config_file, &contents, &length, &error)) {
-                g_debug ("Failed to parse '%s': %s",
-                         LANG_CONFIG_FILE,
-                         (error && error->message) ? error->message : "(null)");
+                gdm_debug (SESSION, "Failed to parse '%s': %s",
+                                    LANG_CONFIG_FILE,
+                                    (error && error->message) ? error->message : "(null)");
                 g_error_free (error);
                 return;
         }
@@ -2251,17 +2134,16 @@ gdm_session_init (GdmSession *self)
                                                                       NULL,
                                                                       (GDestroyNotify)
                                                                       unexport_and_free_user_verifier_extension);
+        self->idle_workers = g_queue_new ();
 
         load_lang_config_file (self);
-        setup_worker_server (self);
-        setup_outside_server (self);
 }
 
 static void
 worker_started (GdmSessionWorkerJob    *job,
                 GdmSessionConversation *conversation)
 {
-        g_debug ("GdmSession: Worker job started");
+        gdm_debug (SESSION, "GdmSession: Worker job started");
 
 }
 
@@ -2272,7 +2154,7 @@ worker_exited (GdmSessionWorkerJob    *job,
 {
         GdmSession *self = conversation->session;
 
-        g_debug ("GdmSession: Worker job exited: %d", code);
+        gdm_debug (SESSION, "GdmSession: Worker job exited: %d", code);
 
         g_hash_table_steal (self->conversations, conversation->service_name);
 
@@ -2282,7 +2164,7 @@ worker_exited (GdmSessionWorkerJob    *job,
                 self->session_conversation = NULL;
         }
 
-        g_debug ("GdmSession: Emitting conversation-stopped signal");
+        gdm_debug (SESSION, "GdmSession: Emitting conversation-stopped signal");
         g_signal_emit (self, signals[CONVERSATION_STOPPED], 0, conversation->service_name);
         if (self->user_verifier_interface != NULL) {
                 gdm_dbus_user_verifier_emit_conversation_stopped (self->user_verifier_interface,
@@ -2313,7 +2195,7 @@ worker_died (GdmSessionWorkerJob    *job,
         g_object_ref (conversation->job);
         if (self->session_conversation == conversation) {
                 if (self->session_pid != -1) {
-                        g_debug ("GdmSession: Sending SIGTERM to session pid %d", self->session_pid);
+                        gdm_debug (SESSION, "GdmSession: Sending SIGTERM to session pid %d", self->session_pid);
                         gdm_signal_pid (self->session_pid, SIGTERM);
                 }
 
@@ -2321,7 +2203,7 @@ worker_died (GdmSessionWorkerJob    *job,
                 self->session_conversation = NULL;
         }
 
-        g_debug ("GdmSession: Emitting conversation-stopped signal");
+        gdm_debug (SESSION, "GdmSession: Emitting conversation-stopped signal");
         g_signal_emit (self, signals[CONVERSATION_STOPPED], 0, conversation->service_name);
         if (self->user_verifier_interface != NULL) {
                 gdm_dbus_user_verifier_emit_conversation_stopped (self->user_verifier_interface,
@@ -2337,29 +2219,28 @@ worker_died (GdmSessionWorkerJob    *job,
         free_conversation (conversation);
 }
 
-static GdmSessionConversation *
-start_conversation (GdmSession *self,
-                    const char *service_name)
+static GdmSessionWorkerJob *
+create_worker_job (GdmSession *self)
 {
-        GdmSessionConversation *conversation;
-        char                   *job_name;
+        GdmSessionWorkerJob *job;
 
-        conversation = g_new0 (GdmSessionConversation, 1);
-        conversation->session = g_object_ref (self);
-        conversation->service_name = g_strdup (service_name);
-        conversation->worker_pid = -1;
-        conversation->job = gdm_session_worker_job_new ();
-        gdm_session_worker_job_set_server_address (conversation->job,
-                                                   g_dbus_server_get_client_address (self->worker_server));
-        gdm_session_worker_job_set_for_reauth (conversation->job,
+        job = gdm_session_worker_job_new ();
+        gdm_session_worker_job_set_server_address (job,
+                                                   gdm_dbus_get_shared_server_address ());
+        gdm_session_worker_job_set_for_reauth (job,
                                                self->verification_mode == GDM_SESSION_VERIFICATION_MODE_REAUTHENTICATE);
 
-        if (self->conversation_environment != NULL) {
-                gdm_session_worker_job_set_environment (conversation->job,
-                                                        (const char * const *)
-                                                        self->conversation_environment);
-
+        if (self->conversation_environment_template != NULL) {
+                gdm_session_worker_job_set_environment_template (job,
+                                                                 self->conversation_environment_template);
         }
+
+        return job;
+}
+
+static void
+connect_conversation_job (GdmSessionConversation *conversation)
+{
         g_signal_connect (conversation->job,
                           "started",
                           G_CALLBACK (worker_started),
@@ -2372,6 +2253,21 @@ start_conversation (GdmSession *self,
                           "died",
                           G_CALLBACK (worker_died),
                           conversation);
+}
+
+static GdmSessionConversation *
+start_conversation (GdmSession *self,
+                    const char *service_name)
+{
+        GdmSessionConversation *conversation;
+        char                   *job_name;
+
+        conversation = g_new0 (GdmSessionConversation, 1);
+        conversation->session = g_object_ref (self);
+        conversation->service_name = g_strdup (service_name);
+        conversation->worker_pid = -1;
+        conversation->job = create_worker_job (self);
+        connect_conversation_job (conversation);
 
         job_name = g_strdup_printf ("gdm-session-worker [pam/%s]", service_name);
         if (!gdm_session_worker_job_start (conversation->job, job_name)) {
@@ -2389,6 +2285,242 @@ start_conversation (GdmSession *self,
         return conversation;
 }
 
+static void
+on_idle_worker_job_ended (GdmSessionWorkerJob  *job,
+                          int                   code_or_signal,
+                          GdmSessionIdleWorker *idle_worker)
+{
+        GdmSession *self = idle_worker->session;
+
+        gdm_debug (SESSION, "GdmSession: Idle worker (pid:%d) went away", (int) idle_worker->worker_pid);
+
+        g_queue_remove (self->idle_workers, idle_worker);
+        free_idle_worker (idle_worker);
+
+        /* Replace it, but not in a tight loop if workers keep dying
+         * straight away */
+        if (self->worker_pool_refill_id == 0 &&
+            g_queue_get_length (self->idle_workers) < self->worker_pool_size) {
+                self->worker_pool_refill_id = g_timeout_add_seconds (WORKER_POOL_RESPAWN_DELAY,
+                                                                     (GSourceFunc) refill_worker_pool_idle,
+                                                                     self);
+        }
+}
+
+static void
+free_idle_worker (GdmSessionIdleWorker *idle_worker)
+{
+        GdmSession *self = idle_worker->session;
+
+        if (idle_worker->worker_manager_interface != NULL) {
+                unexport_worker_manager_interface (self, idle_worker->worker_manager_interface);
+                g_clear_object (&idle_worker->worker_manager_interface);
+        }
+
+        if (idle_worker->connection != NULL) {
+                g_dbus_connection_close_sync (idle_worker->connection, NULL, NULL);
+                g_clear_object (&idle_worker->connection);
+        }
+
+        if (idle_worker->job != NULL) {
+                g_signal_handlers_disconnect_by_func (idle_worker->job,
+                                                      G_CALLBACK (on_idle_worker_job_ended),
+                                                      idle_worker);
+                gdm_session_worker_job_stop (idle_worker->job);
+                g_clear_object (&idle_worker->job);
+        }
+
+        g_free (idle_worker);
+}
+
+static gboolean
+spawn_idle_worker (GdmSession *self)
+{
+        GdmSessionIdleWorker *idle_worker;
+
+        idle_worker = g_new0 (GdmSessionIdleWorker, 1);
+        idle_worker->session = self;
+        idle_worker->worker_pid = -1;
+        idle_worker->job = create_worker_job (self);
+
+        if (!gdm_session_worker_job_start (idle_worker->job, "gdm-session-worker [pam/idle]")) {
+                g_clear_object (&idle_worker->job);
+                g_free (idle_worker);
+                return FALSE;
+        }
+
+        idle_worker->worker_pid = gdm_session_worker_job_get_pid (idle_worker->job);
+
+        g_signal_connect (idle_worker->job,
+                          "exited",
+                          G_CALLBACK (on_idle_worker_job_ended),
+                          idle_worker);
+        g_signal_connect (idle_worker->job,
+                          "died",
+                          G_CALLBACK (on_idle_worker_job_ended),
+                          idle_worker);
+
+        gdm_debug (SESSION, "GdmSession: Started idle worker (pid:%d)", (int) idle_worker->worker_pid);
+
+        g_queue_push_tail (self->idle_workers, idle_worker);
+
+        return TRUE;
+}
+
+static gboolean
+refill_worker_pool_idle (GdmSession *self)
+{
+        self->worker_pool_refill_id = 0;
+
+        while (g_queue_get_length (self->idle_workers) < self->worker_pool_size) {
+                if (!spawn_idle_worker (self)) {
+                        break;
+                }
+        }
+
+        return G_SOURCE_REMOVE;
+}
+
+static void
+queue_worker_pool_refill (GdmSession *self)
+{
+        if (self->worker_pool_refill_id != 0) {
+                return;
+        }
+
+        if (g_queue_get_length (self->idle_workers) >= self->worker_pool_size) {
+                return;
+        }
+
+        self->worker_pool_refill_id = g_idle_add ((GSourceFunc) refill_worker_pool_idle, self);
+}
+
+static void
+drain_worker_pool (GdmSession *self)
+{
+        GdmSessionIdleWorker *idle_worker;
+
+        g_clear_handle_id (&self->worker_pool_refill_id, g_source_remove);
+
+        while ((idle_worker = g_queue_pop_head (self->idle_workers)) != NULL) {
+                free_idle_worker (idle_worker);
+        }
+}
+
+static GdmSessionConversation *
+start_conversation_with_idle_worker (GdmSession           *self,
+                                     const char           *service_name,
+                                     GdmSessionIdleWorker *idle_worker)
+{
+        GdmSessionConversation *conversation;
+
+        g_signal_handlers_disconnect_by_func (idle_worker->job,
+                                              G_CALLBACK (on_idle_worker_job_ended),
+                                              idle_worker);
+
+        conversation = g_new0 (GdmSessionConversation, 1);
+        conversation->session = g_object_ref (self);
+        conversation->service_name = g_strdup (service_name);
+        conversation->worker_pid = idle_worker->worker_pid;
+        conversation->job = g_steal_pointer (&idle_worker->job);
+        connect_conversation_job (conversation);
+
+        return conversation;
+}
+
+void
+gdm_session_set_worker_pool_size (GdmSession *self,
+                                  guint       worker_pool_size)
+{
+        g_return_if_fail (GDM_IS_SESSION (self));
+
+        gdm_debug (SESSION, "GdmSession: keeping %u idle workers", worker_pool_size);
+
+        self->worker_pool_size = worker_pool_size;
+
+        while (g_queue_get_length (self->idle_workers) > self->worker_pool_size) {
+                free_idle_worker (g_queue_pop_tail (self->idle_workers));
+        }
+
+        queue_worker_pool_refill (self);
+}
+
+/**
+ * gdm_session_set_debug_categories:
+ * @names: the categories to enable in the session's workers
+ *
+ * Passes a change of debug categories on to every worker of the
+ * session, including the idle ones waiting for a conversation.
+ */
+void
+gdm_session_set_debug_categories (GdmSession         *self,
+                                  const char * const *names)
+{
+        GHashTableIter iter;
+        gpointer key, value;
+        GList *node;
+
+        g_return_if_fail (GDM_IS_SESSION (self));
+
+        g_hash_table_iter_init (&iter, self->conversations);
+        while (g_hash_table_iter_next (&iter, &key, &value)) {
+                GdmSessionConversation *conversation = value;
+
+                if (conversation->worker_proxy == NULL)
+                        continue;
+
+                conversation->n_worker_messages++;
+                gdm_dbus_worker_call_set_debug_categories (conversation->worker_proxy,
+                                                           names,
+                                                           NULL,
+                                                           NULL,
+                                                           NULL);
+        }
+
+        for (node = self->idle_workers->head; node != NULL; node = node->next) {
+                GdmSessionIdleWorker *idle_worker = node->data;
+
+                if (idle_worker->connection == NULL)
+                        continue;
+
+                g_dbus_connection_call (idle_worker->connection,
+                                        NULL,
+                                        GDM_WORKER_DBUS_PATH,
+                                        "org.gnome.DisplayManager.Worker",
+                                        "SetDebugCategories",
+                                        g_variant_new ("(^as)", names),
+                                        NULL,
+                                        G_DBUS_CALL_FLAGS_NONE,
+                                        -1,
+                                        NULL,
+                                        NULL,
+                                        NULL);
+        }
+}
+
+/**
+ * gdm_session_set_login_trace:
+ *
+ * Makes the session record how far the login got into @login_trace,
+ * and pass the trace id on to the session in GDM_LOGIN_TRACE_ID.
+ */
+void
+gdm_session_set_login_trace (GdmSession    *self,
+                             GdmLoginTrace *login_trace)
+{
+        g_return_if_fail (GDM_IS_SESSION (self));
+
+        g_set_object (&self->login_trace, login_trace);
+}
+
+GdmLoginTrace *
+gdm_session_get_login_trace (GdmSession *self)
+{
+        g_return_val_if_fail (GDM_IS_SESSION (self), NULL);
+
+        return self->login_trace;
+}
+
 static void
 close_conversation (GdmSessionConversation *conversation)
 {
@@ -2416,15 +2548,6 @@ stop_conversation (GdmSessionConversation *conversation)
         gdm_session_worker_job_stop (conversation->job);
 }
 
-static void
-stop_conversation_now (GdmSessionConversation *conversation)
-{
-        close_conversation (conversation);
-
-        gdm_session_worker_job_stop_now (conversation->job);
-        g_clear_object (&conversation->job);
-}
-
 void
 gdm_session_set_supported_session_types (GdmSession         *self,
                                          const char * const *supported_session_types)
@@ -2449,6 +2572,7 @@ gdm_session_start_conversation (GdmSession *self,
                                 const char *service_name)
 {
         GdmSessionConversation *conversation;
+        GdmSessionIdleWorker   *idle_worker;
 
         g_return_val_if_fail (GDM_IS_SESSION (self), FALSE);
         g_return_val_if_fail (service_name != NULL, FALSE);
@@ -2461,18 +2585,46 @@ gdm_session_start_conversation (GdmSession *self,
                         g_warning ("GdmSession: conversation %s started more than once", service_name);
                         return FALSE;
                 }
-                g_debug ("GdmSession: stopping old conversation %s", service_name);
+                gdm_debug (SESSION, "GdmSession: stopping old conversation %s", service_name);
                 gdm_session_worker_job_stop_now (conversation->job);
                 g_object_unref (conversation->job);
                 conversation->job = NULL;
         }
 
-        g_debug ("GdmSession: starting conversation %s for session (%p)", service_name, self);
+        gdm_debug (SESSION, "GdmSession: starting conversation %s for session (%p)", service_name, self);
+
+        mark_login_phase (self, "conversation-started");
 
-        conversation = start_conversation (self, service_name);
+        idle_worker = g_queue_pop_head (self->idle_workers);
+
+        if (idle_worker != NULL) {
+                gdm_debug (SESSION, "GdmSession: using idle worker (pid:%d) for conversation %s",
+                                    (int) idle_worker->worker_pid, service_name);
+                conversation = start_conversation_with_idle_worker (self, service_name, idle_worker);
+        } else {
+                if (self->worker_pool_size > 0)
+                        gdm_debug (SESSION, "GdmSession: no idle worker for conversation %s", service_name);
+                conversation = start_conversation (self, service_name);
+        }
 
         g_hash_table_insert (self->conversations,
                              g_strdup (service_name), conversation);
+
+        if (idle_worker != NULL) {
+                /* The worker already said Hello, so the conversation can
+                 * start right away instead of waiting for it to connect */
+                if (idle_worker->connection != NULL) {
+                        attach_worker_connection (self,
+                                                  conversation,
+                                                  g_steal_pointer (&idle_worker->connection),
+                                                  idle_worker->worker_manager_interface);
+                        g_clear_object (&idle_worker->worker_manager_interface);
+                }
+                free_idle_worker (idle_worker);
+        }
+
+        queue_worker_pool_refill (self);
+
         return TRUE;
 }
 
@@ -2485,7 +2637,7 @@ gdm_session_stop_conversation (GdmSession *self,
         g_return_if_fail (GDM_IS_SESSION (self));
         g_return_if_fail (service_name != NULL);
 
-        g_debug ("GdmSession: stopping conversation %s", service_name);
+        gdm_debug (SESSION, "GdmSession: stopping conversation %s", service_name);
 
         conversation = find_conversation_by_name (self, service_name);
 
@@ -2526,7 +2678,7 @@ on_initialization_complete_cb (GdmDBusWorker *proxy,
                                0,
                                service_name);
 
-                gdm_session_authenticate (self, service_name);
+                verify_conversation (self, service_name);
                 g_variant_unref (ret);
 
         } else {
@@ -2581,10 +2733,11 @@ initialize (GdmSession *self,
         if (self->display_seat_id != NULL)
                 g_variant_builder_add_parsed (&details, "{'seat-id', <%s>}", self->display_seat_id);
 
-        g_debug ("GdmSession: Beginning initialization");
+        gdm_debug (SESSION, "GdmSession: Beginning initialization");
 
         conversation = find_conversation_by_name (self, service_name);
         if (conversation != NULL) {
+                conversation->n_worker_messages++;
                 gdm_dbus_worker_call_initialize (conversation->worker_proxy,
                                                  g_variant_builder_end (&details),
 
@@ -2623,10 +2776,10 @@ gdm_session_setup_for_user (GdmSession *self,
 
         update_session_type (self);
 
-        g_debug ("GdmSession: Set up service %s for username %s on session (%p)",
-                 service_name,
-                 username,
-                 self);
+        gdm_debug (SESSION, "GdmSession: Set up service %s for username %s on session (%p)",
+                            service_name,
+                            username,
+                            self);
         gdm_session_select_user (self, username);
 
         self->is_program_session = FALSE;
@@ -2648,80 +2801,46 @@ gdm_session_setup_for_program (GdmSession *self,
         initialize (self, service_name, username, log_file);
 }
 
-void
-gdm_session_authenticate (GdmSession *self,
-                          const char *service_name)
+static void
+verify_conversation (GdmSession *self,
+                     const char *service_name)
 {
         GdmSessionConversation *conversation;
 
-        g_return_if_fail (GDM_IS_SESSION (self));
-        g_return_if_fail (service_name != NULL);
-
         conversation = find_conversation_by_name (self, service_name);
         if (conversation != NULL) {
-                gdm_dbus_worker_call_authenticate (conversation->worker_proxy,
+                /* Authenticate, authorize and establish credentials in
+                 * one request rather than one round trip per stage */
+                conversation->is_authenticated = FALSE;
+                conversation->n_worker_messages++;
+                gdm_dbus_worker_call_run_to_state (conversation->worker_proxy,
+                                                   "accredited",
                                                    conversation->worker_cancellable,
-                                                   (GAsyncReadyCallback) on_authenticate_cb,
+                                                   (GAsyncReadyCallback) on_run_to_state_cb,
                                                    conversation);
         }
 }
 
-void
-gdm_session_authorize (GdmSession *self,
-                       const char *service_name)
-{
-        GdmSessionConversation *conversation;
-
-        g_return_if_fail (GDM_IS_SESSION (self));
-        g_return_if_fail (service_name != NULL);
-
-        conversation = find_conversation_by_name (self, service_name);
-        if (conversation != NULL) {
-                gdm_dbus_worker_call_authorize (conversation->worker_proxy,
-                                                conversation->worker_cancellable,
-                                                (GAsyncReadyCallback) on_authorize_cb,
-                                                conversation);
-        }
-}
-
-void
-gdm_session_accredit (GdmSession *self,
-                      const char *service_name)
-{
-        GdmSessionConversation *conversation;
-
-        g_return_if_fail (GDM_IS_SESSION (self));
-        g_return_if_fail (service_name != NULL);
-
-        conversation = find_conversation_by_name (self, service_name);
-        if (conversation != NULL) {
-                gdm_dbus_worker_call_establish_credentials (conversation->worker_proxy,
-                                                            conversation->worker_cancellable,
-                                                            (GAsyncReadyCallback) on_establish_credentials_cb,
-                                                            conversation);
-        }
-
-}
-
-static void
-send_environment_variable (const char             *key,
-                           const char             *value,
-                           GdmSessionConversation *conversation)
-{
-        gdm_dbus_worker_call_set_environment_variable (conversation->worker_proxy,
-                                                       key, value,
-                                                       conversation->worker_cancellable,
-                                                       NULL, NULL);
-}
-
 static void
 send_environment (GdmSession             *self,
                   GdmSessionConversation *conversation)
 {
+        GVariantBuilder environment;
+        GHashTableIter iter;
+        gpointer key, value;
 
-        g_hash_table_foreach (self->environment,
-                              (GHFunc) send_environment_variable,
-                              conversation);
+        g_variant_builder_init (&environment, G_VARIANT_TYPE ("a{ss}"));
+
+        g_hash_table_iter_init (&iter, self->environment);
+        while (g_hash_table_iter_next (&iter, &key, &value)) {
+                g_variant_builder_add (&environment, "{ss}", key, value);
+        }
+
+        conversation->n_worker_messages++;
+        gdm_dbus_worker_call_set_environment (conversation->worker_proxy,
+                                              g_variant_builder_end (&environment),
+                                              conversation->worker_cancellable,
+                                              NULL, NULL);
 }
 
 void
@@ -2773,28 +2892,17 @@ get_session_command (GdmSession *self)
 static gchar *
 get_session_desktop_names (GdmSession *self)
 {
-        gchar *filename;
-        GKeyFile *keyfile;
-        gchar *desktop_names = NULL;
-
-        filename = g_strdup_printf ("%s.desktop", get_session_name (self));
-        g_debug ("GdmSession: getting desktop names for file '%s'", filename);
-        keyfile = load_key_file_for_file (self, filename, NULL, NULL);
-        if (keyfile != NULL) {
-              gchar **names;
-
-              names = g_key_file_get_string_list (keyfile, G_KEY_FILE_DESKTOP_GROUP,
-                                                  "DesktopNames", NULL, NULL);
-              if (names != NULL) {
-                      desktop_names = g_strjoinv (":", names);
+        const GdmSessionDesktop *desktop;
+        const char *session_name;
 
-                      g_strfreev (names);
-              }
+        session_name = get_session_name (self);
+        gdm_debug (SESSION, "GdmSession: getting desktop names for session '%s'", session_name);
+        desktop = lookup_session_desktop (self, session_name, NULL);
+        if (desktop == NULL) {
+                return NULL;
         }
 
-        g_key_file_free (keyfile);
-        g_free (filename);
-        return desktop_names;
+        return g_strdup (desktop->desktop_names);
 }
 
 void
@@ -2844,6 +2952,13 @@ set_up_session_environment (GdmSession *self)
         gdm_session_set_environment_variable (self,
                                               "GDMSESSION",
                                               get_session_name (self));
+
+        if (self->login_trace != NULL) {
+                gdm_session_set_environment_variable (self,
+                                                      GDM_LOGIN_TRACE_ID_ENV,
+                                                      gdm_login_trace_get_id (self->login_trace));
+        }
+
         gdm_session_set_environment_variable (self,
                                               "DESKTOP_SESSION",
                                               get_session_name (self));
@@ -2887,6 +3002,7 @@ send_display_mode (GdmSession *self,
         GdmSessionDisplayMode mode;
 
         mode = gdm_session_get_display_mode (self);
+        conversation->n_worker_messages++;
         gdm_dbus_worker_call_set_session_display_mode (conversation->worker_proxy,
                                                        gdm_session_display_mode_to_string (mode),
                                                        conversation->worker_cancellable,
@@ -2894,8 +3010,7 @@ send_display_mode (GdmSession *self,
 }
 
 static void
-send_session_type (GdmSession *self,
-                   GdmSessionConversation *conversation)
+set_up_session_type (GdmSession *self)
 {
         const char *session_type = "wayland";
 
@@ -2903,11 +3018,9 @@ send_session_type (GdmSession *self,
                 session_type = self->session_type;
         }
 
-        gdm_dbus_worker_call_set_environment_variable (conversation->worker_proxy,
-                                                       "XDG_SESSION_TYPE",
-                                                       session_type,
-                                                       conversation->worker_cancellable,
-                                                       NULL, NULL);
+        gdm_session_set_environment_variable (self,
+                                              "XDG_SESSION_TYPE",
+                                              session_type);
 }
 
 void
@@ -2923,8 +3036,13 @@ gdm_session_open_session (GdmSession *self,
 
         if (conversation != NULL) {
                 send_display_mode (self, conversation);
-                send_session_type (self, conversation);
 
+                /* pam_systemd reads the session type at open time, so it
+                 * goes out with the rest of the environment now */
+                set_up_session_type (self);
+                send_environment (self, conversation);
+
+                conversation->n_worker_messages++;
                 gdm_dbus_worker_call_open (conversation->worker_proxy,
                                            conversation->worker_cancellable,
                                            (GAsyncReadyCallback) on_opened, conversation);
@@ -2936,6 +3054,7 @@ stop_all_other_conversations (GdmSession             *self,
                               GdmSessionConversation *conversation_to_keep,
                               gboolean                now)
 {
+        g_autoptr(GPtrArray) jobs_to_stop = NULL;
         GHashTableIter iter;
         gpointer key, value;
 
@@ -2943,11 +3062,13 @@ stop_all_other_conversations (GdmSession             *self,
                 return;
         }
 
+        jobs_to_stop = g_ptr_array_new_with_free_func (g_object_unref);
+
         if (conversation_to_keep == NULL) {
-                g_debug ("GdmSession: Stopping all conversations");
+                gdm_debug (SESSION, "GdmSession: Stopping all conversations");
         } else {
-                g_debug ("GdmSession: Stopping all conversations except for %s",
-                         conversation_to_keep->service_name);
+                gdm_debug (SESSION, "GdmSession: Stopping all conversations except for %s",
+                                    conversation_to_keep->service_name);
         }
 
         g_hash_table_iter_init (&iter, self->conversations);
@@ -2963,13 +3084,20 @@ stop_all_other_conversations (GdmSession             *self,
                         }
                 } else {
                         if (now) {
-                                stop_conversation_now (conversation);
+                                /* the jobs are stopped together below so
+                                 * that their exit timeouts overlap */
+                                close_conversation (conversation);
+                                if (conversation->job != NULL) {
+                                        g_ptr_array_add (jobs_to_stop, g_steal_pointer (&conversation->job));
+                                }
                         } else {
                                 stop_conversation (conversation);
                         }
                 }
         }
 
+        gdm_session_worker_job_stop_all_now (jobs_to_stop);
+
         if (now) {
                 g_hash_table_remove_all (self->conversations);
 
@@ -3015,12 +3143,17 @@ on_start_program_cb (GdmDBusWorker *worker,
                 self->session_pid = pid;
                 self->session_conversation = conversation;
 
-                g_debug ("GdmSession: Emitting 'session-started' signal with pid '%d'", pid);
+                gdm_debug (SESSION, "GdmSession: conversation '%s' used %u worker messages",
+                                    service_name, conversation->n_worker_messages);
+
+                mark_login_phase (self, "session-started");
+
+                gdm_debug (SESSION, "GdmSession: Emitting 'session-started' signal with pid '%d'", pid);
                 g_signal_emit (self, signals[SESSION_STARTED], 0, service_name, pid);
         } else {
                 gdm_session_stop_conversation (self, service_name);
 
-                g_debug ("GdmSession: Emitting 'session-start-failed' signal");
+                gdm_debug (SESSION, "GdmSession: Emitting 'session-start-failed' signal");
                 g_signal_emit (self, signals[SESSION_START_FAILED], 0, service_name, error->message);
         }
 }
@@ -3048,6 +3181,9 @@ gdm_session_start_session (GdmSession *self,
 
         stop_all_other_conversations (self, conversation, FALSE);
 
+        /* No more conversations will be started once the session is running */
+        gdm_session_set_worker_pool_size (self, 0);
+
         command = get_session_command (self);
 
         if (g_strcmp0 (self->session_type, "wayland") == 0) {
@@ -3062,6 +3198,7 @@ gdm_session_start_session (GdmSession *self,
         set_up_session_environment (self);
         send_environment (self, conversation);
 
+        conversation->n_worker_messages++;
         gdm_dbus_worker_call_start_program (conversation->worker_proxy,
                                             program,
                                             conversation->worker_cancellable,
@@ -3140,7 +3277,8 @@ gdm_session_close (GdmSession *self)
 
         g_return_if_fail (GDM_IS_SESSION (self));
 
-        g_debug ("GdmSession: Closing session");
+        gdm_debug (SESSION, "GdmSession: Closing session");
+        drain_worker_pool (self);
         do_reset (self);
 
         g_list_free_full (self->outside_connections, g_object_unref);
@@ -3187,8 +3325,27 @@ gdm_session_report_error (GdmSession *self,
 void
 gdm_session_cancel  (GdmSession *self)
 {
+        GHashTableIter iter;
+        gpointer key, value;
+
         g_return_if_fail (GDM_IS_SESSION (self));
 
+        /* Unblock workers waiting on the user to answer a question, so
+         * they don't sit in the PAM conversation until they are stopped */
+        g_hash_table_iter_init (&iter, self->conversations);
+        while (g_hash_table_iter_next (&iter, &key, &value)) {
+                GdmSessionConversation *conversation = value;
+
+                if (conversation->worker_proxy == NULL) {
+                        continue;
+                }
+
+                conversation->n_worker_messages++;
+                gdm_dbus_worker_call_cancel_query (conversation->worker_proxy,
+                                                   conversation->worker_cancellable,
+                                                   NULL, NULL);
+        }
+
         g_signal_emit (G_OBJECT (self), signals [CANCELLED], 0);
 }
 
@@ -3212,7 +3369,7 @@ gdm_session_set_timed_login_details (GdmSession *self,
         g_return_if_fail (GDM_IS_SESSION (self));
         g_return_if_fail (username != NULL);
 
-        g_debug ("GdmSession: timed login details %s %d", username, delay);
+        gdm_debug (SESSION, "GdmSession: timed login details %s %d", username, delay);
         g_set_str (&self->timed_login_username, username);
         self->timed_login_delay = delay;
 }
@@ -3279,12 +3436,13 @@ gdm_session_start_reauthentication (GdmSession *self,
 
         conversation = self->session_conversation;
 
-        g_debug ("GdmSession: starting reauthentication for session %s for client with pid %d",
-                 conversation->session_id,
-                 (int) uid_of_caller);
+        gdm_debug (SESSION, "GdmSession: starting reauthentication for session %s for client with pid %d",
+                            conversation->session_id,
+                            (int) uid_of_caller);
 
         conversation->reauth_pid_of_caller = pid_of_caller;
 
+        conversation->n_worker_messages++;
         gdm_dbus_worker_call_start_reauthentication (conversation->worker_proxy,
                                                      (int) pid_of_caller,
                                                      (int) uid_of_caller,
@@ -3298,6 +3456,16 @@ gdm_session_get_server_address (GdmSession *self)
 {
         g_return_val_if_fail (GDM_IS_SESSION (self), NULL);
 
+        /* Most sessions never get a greeter or other outside client
+         * connecting, so only listen once somebody asks where to */
+        if (self->outside_server == NULL) {
+                setup_outside_server (self);
+
+                if (self->outside_server == NULL) {
+                        return NULL;
+                }
+        }
+
         return g_dbus_server_get_client_address (self->outside_server);
 }
 
@@ -3359,39 +3527,24 @@ gdm_session_get_conversation_session_id (GdmSession *self,
         return conversation->session_id;
 }
 
-static char *
-get_session_filename (GdmSession *self)
-{
-        return g_strdup_printf ("%s.desktop", get_session_name (self));
-}
-
 static gboolean
 gdm_session_is_wayland_session (GdmSession *self)
 {
-        GKeyFile   *key_file;
+        const GdmSessionDesktop *desktop;
+        const char *session_name;
         gboolean    is_wayland_session = FALSE;
-        char            *filename;
-        g_autofree char *full_path = NULL;
 
         g_return_val_if_fail (self != NULL, FALSE);
         g_return_val_if_fail (GDM_IS_SESSION (self), FALSE);
 
-        filename = get_session_filename (self);
-
-        key_file = load_key_file_for_file (self, filename, NULL, &full_path);
-
-        if (key_file == NULL) {
-                goto out;
-        }
+        session_name = get_session_name (self);
+        desktop = lookup_session_desktop (self, session_name, NULL);
 
-        if (full_path != NULL && strstr (full_path, "/wayland-sessions/") != NULL) {
+        if (desktop != NULL && g_str_equal (desktop->type, "wayland")) {
                 is_wayland_session = TRUE;
         }
-        g_debug ("GdmSession: checking if file '%s' is wayland session: %s", filename, is_wayland_session? "yes" : "no");
+        gdm_debug (SESSION, "GdmSession: checking if session '%s' is wayland session: %s", session_name, is_wayland_session? "yes" : "no");
 
-out:
-        g_clear_pointer (&key_file, g_key_file_free);
-        g_free (filename);
         return is_wayland_session;
 }
 
@@ -3413,30 +3566,21 @@ update_session_type (GdmSession *self)
 gboolean
 gdm_session_session_registers (GdmSession *self)
 {
-        g_autoptr(GError) error = NULL;
-        g_autoptr(GKeyFile) key_file = NULL;
+        const GdmSessionDesktop *desktop;
+        const char *session_name;
         gboolean session_registers = FALSE;
-        g_autofree char *filename = NULL;
 
         g_return_val_if_fail (GDM_IS_SESSION (self), FALSE);
 
-        filename = get_session_filename (self);
-
-        key_file = load_key_file_for_file (self, filename, NULL, NULL);
+        session_name = get_session_name (self);
+        desktop = lookup_session_desktop (self, session_name, NULL);
 
-        session_registers = g_key_file_get_boolean (key_file,
-                                                    G_KEY_FILE_DESKTOP_GROUP,
-                                                    "X-GDM-SessionRegisters",
-                                                    &error);
-        if (!session_registers &&
-            error != NULL &&
-            !g_error_matches (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND)) {
-                g_warning ("GdmSession: Couldn't read session file '%s'", filename);
-                return FALSE;
+        if (desktop != NULL) {
+                session_registers = desktop->session_registers;
         }
 
-        g_debug ("GdmSession: '%s' %s self", filename,
-                 session_registers ? "registers" : "does not register");
+        gdm_debug (SESSION, "GdmSession: '%s' %s self", session_name,
+                            session_registers ? "registers" : "does not register");
 
         return session_registers;
 }
@@ -3446,10 +3590,10 @@ gdm_session_get_display_mode (GdmSession *self)
 {
         g_return_val_if_fail (GDM_IS_SESSION (self), GDM_SESSION_DISPLAY_MODE_NEW_VT);
 
-        g_debug ("GdmSession: type %s, program? %s, seat %s",
-                 self->session_type,
-                 self->is_program_session? "yes" : "no",
-                 self->display_seat_id);
+        gdm_debug (SESSION, "GdmSession: type %s, program? %s, seat %s",
+                            self->session_type,
+                            self->is_program_session? "yes" : "no",
+                            self->display_seat_id);
 
         if (g_strcmp0 (self->display_seat_id, "seat0") != 0) {
                 return GDM_SESSION_DISPLAY_MODE_LOGIND_MANAGED;
@@ -3489,7 +3633,7 @@ gdm_session_select_session (GdmSession *self,
         g_return_if_fail (GDM_IS_SESSION (self));
         g_return_if_fail (text != NULL);
 
-        g_debug ("GdmSession: selecting session '%s'", text);
+        gdm_debug (SESSION, "GdmSession: selecting session '%s'", text);
 
         g_free (self->selected_session);
         self->selected_session = g_strdup (text);
@@ -3503,6 +3647,7 @@ gdm_session_select_session (GdmSession *self,
                 conversation = (GdmSessionConversation *) value;
 
                 if (conversation->worker_proxy != NULL) {
+                        conversation->n_worker_messages++;
                         gdm_dbus_worker_call_set_session_name (conversation->worker_proxy,
                                                                get_session_name (self),
                                                                conversation->worker_cancellable,
@@ -3523,7 +3668,7 @@ static void
 set_display_device (GdmSession *self,
                     const char *name)
 {
-        g_debug ("GdmSession: Setting display device: %s", name);
+        gdm_debug (SESSION, "GdmSession: Setting display device: %s", name);
         g_free (self->display_device);
         self->display_device = g_strdup (name);
 }
@@ -3570,6 +3715,12 @@ set_conversation_environment (GdmSession  *self,
 {
         g_strfreev (self->conversation_environment);
         self->conversation_environment = g_strdupv (environment);
+
+        g_clear_pointer (&self->conversation_environment_template, gdm_environment_template_unref);
+        if (environment != NULL) {
+                self->conversation_environment_template =
+                        gdm_session_worker_job_new_environment_template ((const char * const *) environment);
+        }
 }
 
 static void
@@ -3578,7 +3729,7 @@ set_session_type (GdmSession *self,
 {
 
         if (g_strcmp0 (self->session_type, session_type) != 0) {
-                g_debug ("GdmSession: setting session to type '%s'", session_type? session_type : "");
+                gdm_debug (SESSION, "GdmSession: setting session to type '%s'", session_type? session_type : "");
                 g_free (self->session_type);
                 self->session_type = g_strdup (session_type);
         }
@@ -3699,7 +3850,12 @@ gdm_session_dispose (GObject *object)
 
         self = GDM_SESSION (object);
 
-        g_debug ("GdmSession: Disposing session");
+        gdm_debug (SESSION, "GdmSession: Disposing session");
+
+        if (self->worker_route_id != 0) {
+                gdm_dbus_remove_shared_server_route (self->worker_route_id);
+                self->worker_route_id = 0;
+        }
 
         gdm_session_close (self);
 
@@ -3712,6 +3868,7 @@ gdm_session_dispose (GObject *object)
         g_clear_pointer (&self->user_verifier_extensions,
                          g_hash_table_unref);
         g_clear_object (&self->greeter_interface);
+        g_clear_object (&self->login_trace);
 
         g_free (self->display_hostname);
         self->display_hostname = NULL;
@@ -3724,11 +3881,8 @@ gdm_session_dispose (GObject *object)
 
         g_strfreev (self->conversation_environment);
         self->conversation_environment = NULL;
+        g_clear_pointer (&self->conversation_environment_template, gdm_environment_template_unref);
 
-        if (self->worker_server != NULL) {
-                g_dbus_server_stop (self->worker_server);
-                g_clear_object (&self->worker_server);
-        }
 
         if (self->outside_server != NULL) {
                 g_dbus_server_stop (self->outside_server);
@@ -3759,6 +3913,8 @@ gdm_session_finalize (GObject *object)
 
         g_free (self->fallback_session_name);
 
+        g_queue_free (self->idle_workers);
+
         parent_class = G_OBJECT_CLASS (gdm_session_parent_class);
 
         if (parent_class->finalize != NULL)
@@ -3775,6 +3931,10 @@ gdm_session_constructor (GType                  type,
         self = GDM_SESSION (G_OBJECT_CLASS (gdm_session_parent_class)->constructor (type,
                                                                                     n_construct_properties,
                                                                                     construct_properties));
+
+        /* needs allowed-user to be set */
+        setup_worker_server (self);
+
         return G_OBJECT (self);
 }
 
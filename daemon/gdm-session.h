@@ -25,6 +25,8 @@
 #include <gio/gio.h>
 #include <sys/types.h>
 
+#include "gdm-login-trace.h"
+
 G_BEGIN_DECLS
 
 #define GDM_TYPE_SESSION (gdm_session_get_type ())
@@ -71,6 +73,13 @@ const char       *gdm_session_get_display_seat_id         (GdmSession     *sessi
 const char       *gdm_session_get_session_id              (GdmSession     *session);
 gboolean          gdm_session_session_registers           (GdmSession     *session);
 GdmSessionDisplayMode gdm_session_get_display_mode  (GdmSession     *session);
+void              gdm_session_set_worker_pool_size        (GdmSession *session,
+                                                           guint       worker_pool_size);
+void              gdm_session_set_debug_categories        (GdmSession         *session,
+                                                           const char * const *names);
+void              gdm_session_set_login_trace             (GdmSession    *session,
+                                                           GdmLoginTrace *login_trace);
+GdmLoginTrace    *gdm_session_get_login_trace             (GdmSession    *session);
 gboolean          gdm_session_start_conversation          (GdmSession *session,
                                                            const char *service_name);
 void              gdm_session_stop_conversation           (GdmSession *session,
@@ -93,12 +102,6 @@ void              gdm_session_send_environment            (GdmSession *self,
                                                            const char *service_name);
 void              gdm_session_reset                       (GdmSession *session);
 void              gdm_session_cancel                      (GdmSession *session);
-void              gdm_session_authenticate                (GdmSession *session,
-                                                           const char *service_name);
-void              gdm_session_authorize                   (GdmSession *session,
-                                                           const char *service_name);
-void              gdm_session_accredit                    (GdmSession *session,
-                                                           const char *service_name);
 void              gdm_session_open_session                (GdmSession *session,
                                                            const char *service_name);
 void              gdm_session_start_session               (GdmSession *session,
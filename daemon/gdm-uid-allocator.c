@@ -0,0 +1,294 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "gdm-uid-allocator.h"
+
+/* How long a UID found to be taken by the check function is trusted
+ * before it gets looked up again */
+#define TAKEN_CACHE_TIMEOUT (5 * G_USEC_PER_SEC * 60)
+
+/* How many stale UIDs get looked up again per allocation */
+#define REFRESH_BATCH_SIZE 8
+
+#define BITS_PER_WORD 64
+
+struct _GdmUidAllocator
+{
+        uid_t     min;
+        gsize     count;
+        gsize     n_words;
+
+        /* UIDs handed out by us, or held back with _reserve().
+         * Padding bits past the end of the range are always set */
+        guint64  *reserved;
+
+        /* UIDs the check function reported as taken, and when each of
+         * them was last looked up */
+        guint64  *taken;
+        gint64   *taken_at;
+        gsize     refresh_next;
+
+        gsize     next;
+
+        GdmUidAllocatorCheckFunc check_func;
+        gpointer  user_data;
+};
+
+static inline void
+set_bit (guint64 *bitmap,
+         gsize    index)
+{
+        bitmap[index / BITS_PER_WORD] |= G_GUINT64_CONSTANT (1) << (index % BITS_PER_WORD);
+}
+
+static inline void
+clear_bit (guint64 *bitmap,
+           gsize    index)
+{
+        bitmap[index / BITS_PER_WORD] &= ~(G_GUINT64_CONSTANT (1) << (index % BITS_PER_WORD));
+}
+
+static inline gboolean
+test_bit (const guint64 *bitmap,
+          gsize          index)
+{
+        return (bitmap[index / BITS_PER_WORD] >> (index % BITS_PER_WORD)) & 1;
+}
+
+static gboolean
+uid_to_index (GdmUidAllocator *allocator,
+              uid_t            uid,
+              gsize           *index)
+{
+        if (uid < allocator->min || (gsize) (uid - allocator->min) >= allocator->count)
+                return FALSE;
+
+        *index = uid - allocator->min;
+        return TRUE;
+}
+
+/* Finds the first index that is neither reserved nor known to be taken,
+ * going around the range once starting at @start */
+static gboolean
+find_first_free (GdmUidAllocator *allocator,
+                 gsize            start,
+                 gsize           *ret_index)
+{
+        gsize start_word = start / BITS_PER_WORD;
+        guint64 below_start = (G_GUINT64_CONSTANT (1) << (start % BITS_PER_WORD)) - 1;
+        gsize i;
+
+        for (i = 0; i <= allocator->n_words; i++) {
+                gsize word = (start_word + i) % allocator->n_words;
+                guint64 used;
+
+                used = allocator->reserved[word] | allocator->taken[word];
+
+                if (i == 0)
+                        used |= below_start;
+                else if (i == allocator->n_words)
+                        used |= ~below_start;
+
+                if (used != G_MAXUINT64) {
+                        *ret_index = word * BITS_PER_WORD + __builtin_ctzll (~used);
+                        return TRUE;
+                }
+        }
+
+        return FALSE;
+}
+
+/* Looks up again the UIDs marked as taken that were last checked before
+ * @checked_before, carrying on from where the previous call stopped.
+ * Returns the number of lookups, which is at most @max_lookups */
+static gsize
+refresh_taken (GdmUidAllocator *allocator,
+               gint64           checked_before,
+               gint64           now,
+               gsize            max_lookups,
+               gboolean        *freed)
+{
+        gsize index = allocator->refresh_next;
+        gsize lookups = 0;
+        gsize seen = 0;
+
+        while (seen < allocator->count && lookups < max_lookups) {
+                guint64 word;
+                gsize skip;
+
+                word = allocator->taken[index / BITS_PER_WORD] >> (index % BITS_PER_WORD);
+
+                if (word == 0) {
+                        skip = BITS_PER_WORD - index % BITS_PER_WORD;
+                } else if ((word & 1) == 0) {
+                        skip = __builtin_ctzll (word);
+                } else {
+                        skip = 1;
+
+                        if (allocator->taken_at[index] < checked_before) {
+                                lookups++;
+
+                                if (allocator->check_func (allocator->min + index, allocator->user_data)) {
+                                        allocator->taken_at[index] = now;
+                                } else {
+                                        clear_bit (allocator->taken, index);
+                                        *freed = TRUE;
+                                }
+                        }
+                }
+
+                skip = MIN (skip, allocator->count - index);
+                seen += skip;
+                index += skip;
+                if (index == allocator->count)
+                        index = 0;
+        }
+
+        allocator->refresh_next = index;
+
+        return lookups;
+}
+
+GdmUidAllocator *
+gdm_uid_allocator_new (uid_t                    min,
+                       uid_t                    max,
+                       GdmUidAllocatorCheckFunc check_func,
+                       gpointer                 user_data)
+{
+        GdmUidAllocator *allocator;
+        gsize i;
+
+        g_return_val_if_fail (min <= max, NULL);
+
+        allocator = g_new0 (GdmUidAllocator, 1);
+        allocator->min = min;
+        allocator->count = (gsize) (max - min) + 1;
+        allocator->n_words = (allocator->count + BITS_PER_WORD - 1) / BITS_PER_WORD;
+        allocator->reserved = g_new0 (guint64, allocator->n_words);
+        allocator->taken = g_new0 (guint64, allocator->n_words);
+        allocator->taken_at = g_new0 (gint64, allocator->count);
+        allocator->check_func = check_func;
+        allocator->user_data = user_data;
+
+        for (i = allocator->count; i < allocator->n_words * BITS_PER_WORD; i++)
+                set_bit (allocator->reserved, i);
+
+        return allocator;
+}
+
+void
+gdm_uid_allocator_free (GdmUidAllocator *allocator)
+{
+        if (allocator == NULL)
+                return;
+
+        g_free (allocator->reserved);
+        g_free (allocator->taken);
+        g_free (allocator->taken_at);
+        g_free (allocator);
+}
+
+/**
+ * gdm_uid_allocator_allocate:
+ *
+ * Hands out the next UID, going round robin through the range, that
+ * isn't reserved and that the check function doesn't report as taken.
+ * Only the chosen candidate and UIDs not yet known to be taken are
+ * passed to the check function, so in the common case it's called once.
+ *
+ * UIDs known to be taken are looked up again once they are older than
+ * TAKEN_CACHE_TIMEOUT, a few per call, so the cache never gets dropped
+ * as a whole.
+ */
+gboolean
+gdm_uid_allocator_allocate (GdmUidAllocator *allocator,
+                            uid_t           *ret_uid)
+{
+        gint64 now = g_get_monotonic_time ();
+        gboolean freed = FALSE;
+        gsize index;
+
+        if (allocator->check_func != NULL)
+                refresh_taken (allocator, now - TAKEN_CACHE_TIMEOUT, now,
+                               REFRESH_BATCH_SIZE, &freed);
+
+        while (TRUE) {
+                while (find_first_free (allocator, allocator->next, &index)) {
+                        uid_t uid = allocator->min + index;
+
+                        if (allocator->check_func != NULL &&
+                            allocator->check_func (uid, allocator->user_data)) {
+                                set_bit (allocator->taken, index);
+                                allocator->taken_at[index] = now;
+                                continue;
+                        }
+
+                        set_bit (allocator->reserved, index);
+                        allocator->next = (index + 1) % allocator->count;
+                        *ret_uid = uid;
+                        return TRUE;
+                }
+
+                if (allocator->check_func == NULL)
+                        return FALSE;
+
+                /* Accounts may have gone away since we last looked. Check
+                 * in batches and stop at the first batch that frees a UID */
+                freed = FALSE;
+                while (!freed &&
+                       refresh_taken (allocator, now, now, REFRESH_BATCH_SIZE, &freed) > 0);
+
+                if (!freed)
+                        return FALSE;
+        }
+}
+
+void
+gdm_uid_allocator_reserve (GdmUidAllocator *allocator,
+                           uid_t            uid)
+{
+        gsize index;
+
+        if (uid_to_index (allocator, uid, &index))
+                set_bit (allocator->reserved, index);
+}
+
+void
+gdm_uid_allocator_release (GdmUidAllocator *allocator,
+                           uid_t            uid)
+{
+        gsize index;
+
+        if (uid_to_index (allocator, uid, &index))
+                clear_bit (allocator->reserved, index);
+}
+
+gboolean
+gdm_uid_allocator_is_reserved (GdmUidAllocator *allocator,
+                               uid_t            uid)
+{
+        gsize index;
+
+        if (!uid_to_index (allocator, uid, &index))
+                return FALSE;
+
+        return test_bit (allocator->reserved, index);
+}
@@ -0,0 +1,50 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Returns TRUE if @uid is already used by someone outside the allocator,
+ * for instance an account known to NSS */
+typedef gboolean (*GdmUidAllocatorCheckFunc) (uid_t    uid,
+                                              gpointer user_data);
+
+typedef struct _GdmUidAllocator GdmUidAllocator;
+
+GdmUidAllocator *gdm_uid_allocator_new              (uid_t                     min,
+                                                     uid_t                     max,
+                                                     GdmUidAllocatorCheckFunc  check_func,
+                                                     gpointer                  user_data);
+void             gdm_uid_allocator_free             (GdmUidAllocator          *allocator);
+
+gboolean         gdm_uid_allocator_allocate         (GdmUidAllocator          *allocator,
+                                                     uid_t                    *ret_uid);
+void             gdm_uid_allocator_reserve          (GdmUidAllocator          *allocator,
+                                                     uid_t                     uid);
+void             gdm_uid_allocator_release          (GdmUidAllocator          *allocator,
+                                                     uid_t                     uid);
+gboolean         gdm_uid_allocator_is_reserved      (GdmUidAllocator          *allocator,
+                                                     uid_t                     uid);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GdmUidAllocator, gdm_uid_allocator_free)
+
+G_END_DECLS
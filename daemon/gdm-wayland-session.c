@@ -26,6 +26,7 @@
 #include "gdm-settings-direct.h"
 #include "gdm-settings-keys.h"
 #include "gdm-log.h"
+#include "gdm-login-trace.h"
 
 #include "gdm-manager-glue.h"
 
@@ -56,6 +57,8 @@ typedef struct
 
         guint         register_display_id;
 
+        gint64        start_time;
+
         GMainLoop    *main_loop;
 
         guint32       debug_enabled : 1;
@@ -407,6 +410,8 @@ static gboolean
 register_session (State *state)
 {
         g_autoptr(GError) error = NULL;
+        g_autofree char *elapsed = NULL;
+        const char *login_trace_id;
 
         if (!gdm_dbus_manager_call_register_session_sync (state->display_manager_proxy,
                                                           state->cancellable,
@@ -415,6 +420,18 @@ register_session (State *state)
                 return FALSE;
         }
 
+        /* The daemon logs the rest of the timeline under the same id */
+        login_trace_id = g_getenv (GDM_LOGIN_TRACE_ID_ENV);
+        if (login_trace_id != NULL) {
+                elapsed = g_strdup_printf ("%" G_GINT64_FORMAT,
+                                           g_get_monotonic_time () - state->start_time);
+                g_log_structured (G_LOG_DOMAIN, G_LOG_LEVEL_MESSAGE,
+                                  "GDM_LOGIN_TRACE_ID", login_trace_id,
+                                  "GDM_LOGIN_HELPER_USEC", elapsed,
+                                  "MESSAGE", "gdm-wayland-session: registered session for login %s after %s µs",
+                                  login_trace_id, elapsed);
+        }
+
         return TRUE;
 }
 
@@ -509,6 +526,8 @@ main (int    argc,
         setlocale (LC_ALL, "");
 
         gdm_log_init ();
+        gdm_log_set_context (GDM_LOG_FIELD_SEAT, g_getenv ("XDG_SEAT"));
+        gdm_log_set_context (GDM_LOG_FIELD_SESSION_ID, g_getenv ("XDG_SESSION_ID"));
 
         context = g_option_context_new (_("GNOME Display Manager Wayland Session Launcher"));
         g_option_context_add_main_entries (context, entries, NULL);
@@ -523,11 +542,15 @@ main (int    argc,
         }
 
         init_state (&state);
+        state->start_time = g_get_monotonic_time ();
 
         state->session_command = args[0];
 
-        state->settings = gdm_settings_new ();
-        ret = gdm_settings_direct_init (state->settings, DATADIR "/gdm/gdm.schemas", "/");
+        ret = gdm_settings_direct_init_from_snapshot (GDM_SETTINGS_SNAPSHOT);
+        if (!ret) {
+                state->settings = gdm_settings_new ();
+                ret = gdm_settings_direct_init (state->settings);
+        }
 
         if (!ret) {
                 g_printerr ("Unable to initialize settings\n");
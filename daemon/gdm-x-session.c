@@ -26,6 +26,7 @@
 #include "gdm-settings-direct.h"
 #include "gdm-settings-keys.h"
 #include "gdm-log.h"
+#include "gdm-login-trace.h"
 
 #include "gdm-manager-glue.h"
 
@@ -65,6 +66,8 @@ typedef struct
 
         guint         register_display_id;
 
+        gint64        start_time;
+
         GMainLoop    *main_loop;
 
         guint32       debug_enabled : 1;
@@ -314,6 +317,7 @@ spawn_x_server (State        *state,
         }
 
         state->display_name = g_strdup_printf (":%s", display_number);
+        gdm_log_set_context (GDM_LOG_FIELD_DISPLAY, state->display_name);
         g_clear_pointer (&display_number, g_free);
 
         state->auth_file = g_strdup (auth_file);
@@ -780,6 +784,8 @@ static gboolean
 register_session (State *state)
 {
         g_autoptr(GError) error = NULL;
+        g_autofree char *elapsed = NULL;
+        const char *login_trace_id;
 
         if (!gdm_dbus_manager_call_register_session_sync (state->display_manager_proxy,
                                                           state->cancellable,
@@ -788,6 +794,18 @@ register_session (State *state)
                 return FALSE;
         }
 
+        /* The daemon logs the rest of the timeline under the same id */
+        login_trace_id = g_getenv (GDM_LOGIN_TRACE_ID_ENV);
+        if (login_trace_id != NULL) {
+                elapsed = g_strdup_printf ("%" G_GINT64_FORMAT,
+                                           g_get_monotonic_time () - state->start_time);
+                g_log_structured (G_LOG_DOMAIN, G_LOG_LEVEL_MESSAGE,
+                                  "GDM_LOGIN_TRACE_ID", login_trace_id,
+                                  "GDM_LOGIN_HELPER_USEC", elapsed,
+                                  "MESSAGE", "gdm-x-session: registered session for login %s after %s µs",
+                                  login_trace_id, elapsed);
+        }
+
         return TRUE;
 }
 
@@ -828,6 +846,8 @@ main (int    argc,
         setlocale (LC_ALL, "");
 
         gdm_log_init ();
+        gdm_log_set_context (GDM_LOG_FIELD_SEAT, g_getenv ("XDG_SEAT"));
+        gdm_log_set_context (GDM_LOG_FIELD_SESSION_ID, g_getenv ("XDG_SESSION_ID"));
 
         if (argc != 2) {
                 g_warning ("gdm-x-session takes exactly one argument (the session)");
@@ -836,11 +856,15 @@ main (int    argc,
         }
 
         init_state (&state);
+        state->start_time = g_get_monotonic_time ();
 
         state->session_command = argv[1];
 
-        state->settings = gdm_settings_new ();
-        ret = gdm_settings_direct_init (state->settings, DATADIR "/gdm/gdm.schemas", "/");
+        ret = gdm_settings_direct_init_from_snapshot (GDM_SETTINGS_SNAPSHOT);
+        if (!ret) {
+                state->settings = gdm_settings_new ();
+                ret = gdm_settings_direct_init (state->settings);
+        }
 
         if (!ret) {
                 g_printerr ("Unable to initialize settings\n");
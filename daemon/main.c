@@ -43,6 +43,7 @@
 #include "gdm-manager.h"
 #include "gdm-log.h"
 #include "gdm-common.h"
+#include "gdm-profile.h"
 #include "gdm-file-utils.h"
 
 #include "gdm-settings.h"
@@ -194,6 +195,16 @@ is_debug_set (void)
         return debug;
 }
 
+/* Puts anything still waiting for the batched save on disk */
+static void
+flush_settings (void)
+{
+        g_autoptr (GError) error = NULL;
+
+        if (!gdm_settings_flush (settings, &error))
+                g_warning ("Unable to save settings: %s", error->message);
+}
+
 /* SIGUSR1 is used by the X server to tell us that we're ready, so
  * block it. We'll unblock it in the worker thread in gdm-server.c
  */
@@ -267,7 +278,7 @@ main (int    argc,
         gdm_log_init ();
 
         settings = gdm_settings_new ();
-        if (! gdm_settings_direct_init (settings, DATADIR "/gdm/gdm.schemas", "/")) {
+        if (! gdm_settings_direct_init (settings)) {
                 g_warning ("Unable to initialize settings");
                 return EXIT_FAILURE;
         }
@@ -276,6 +287,11 @@ main (int    argc,
 
         gdm_daemon_ensure_dirs ();
 
+        /* Lets the helpers skip reading the configuration themselves.
+         * Those that still do should find the same values in the files */
+        flush_settings ();
+        gdm_settings_direct_publish (GDM_SETTINGS_SNAPSHOT);
+
         /* Connect to the bus, own the name and start the manager */
         bus_reconnect ();
 
@@ -290,6 +306,7 @@ main (int    argc,
         g_unix_signal_add (SIGTERM, on_shutdown_signal_cb, main_loop);
         g_unix_signal_add (SIGINT, on_shutdown_signal_cb, main_loop);
         g_unix_signal_add (SIGHUP, on_sighup_cb, NULL);
+        gdm_profile_install_dump_handler ();
 
         if (do_timed_exit) {
                 g_timeout_add_seconds (30, (GSourceFunc) timed_exit_cb, main_loop);
@@ -300,6 +317,10 @@ main (int    argc,
         g_debug ("GDM finished, cleaning up...");
 
         g_clear_object (&manager);
+
+        /* Settings direct keeps its own reference, so the settings
+         * aren't necessarily finalized, and saved, here */
+        flush_settings ();
         g_clear_object (&settings);
 
         gdm_settings_direct_shutdown ();
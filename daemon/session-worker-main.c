@@ -32,12 +32,18 @@
 #include <signal.h>
 #include <locale.h>
 
+#ifdef ENABLE_SYSTEMD_JOURNAL
+#include <systemd/sd-daemon.h>
+#include <systemd/sd-journal.h>
+#endif
+
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <glib-object.h>
 
 #include "gdm-common.h"
 #include "gdm-log.h"
+#include "gdm-profile.h"
 #include "gdm-session-worker.h"
 
 #include "gdm-settings.h"
@@ -102,6 +108,34 @@ on_sighup_cb (int signal_number)
         _exit (EXIT_SUCCESS);
 }
 
+/* Opened here rather than by the daemon, so that journald attributes
+ * the output to the worker's pid instead of the daemon's */
+static void
+setup_journal_fds (void)
+{
+#ifdef ENABLE_SYSTEMD_JOURNAL
+        if (sd_booted () > 0) {
+                const char *identifier = "gdm-session-worker";
+                int out, err;
+
+                out = sd_journal_stream_fd (identifier, LOG_INFO, FALSE);
+                if (out < 0)
+                        return;
+
+                err = sd_journal_stream_fd (identifier, LOG_WARNING, FALSE);
+                if (err < 0) {
+                        close (out);
+                        return;
+                }
+
+                VE_IGNORE_EINTR (dup2 (out, STDOUT_FILENO));
+                VE_IGNORE_EINTR (dup2 (err, STDERR_FILENO));
+                close (out);
+                close (err);
+        }
+#endif
+}
+
 int
 main (int    argc,
       char **argv)
@@ -115,6 +149,8 @@ main (int    argc,
                 { NULL }
         };
 
+        setup_journal_fds ();
+
         signal (SIGTERM, on_sigterm_cb);
         signal (SIGHUP, on_sighup_cb);
 
@@ -132,15 +168,19 @@ main (int    argc,
 
         gdm_log_init ();
 
-        settings = gdm_settings_new ();
-        if (settings == NULL) {
-                g_warning ("Unable to initialize settings");
-                exit (EXIT_FAILURE);
-        }
-
-        if (! gdm_settings_direct_init (settings, DATADIR "/gdm/gdm.schemas", "/")) {
-                g_warning ("Unable to initialize settings");
-                exit (EXIT_FAILURE);
+        /* Workers are started for every login attempt, so use the values
+         * the daemon already resolved rather than parsing the files again */
+        if (!gdm_settings_direct_init_from_snapshot (GDM_SETTINGS_SNAPSHOT)) {
+                settings = gdm_settings_new ();
+                if (settings == NULL) {
+                        g_warning ("Unable to initialize settings");
+                        exit (EXIT_FAILURE);
+                }
+
+                if (! gdm_settings_direct_init (settings)) {
+                        g_warning ("Unable to initialize settings");
+                        exit (EXIT_FAILURE);
+                }
         }
 
         gdm_log_set_debug (is_debug_set ());
@@ -163,6 +203,7 @@ main (int    argc,
                           main_loop);
 
         g_unix_signal_add (SIGUSR1, on_sigusr1_cb, NULL);
+        gdm_profile_install_dump_handler ();
 
         g_main_loop_run (main_loop);
 
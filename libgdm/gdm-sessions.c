@@ -34,6 +34,7 @@
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <glib/gstdio.h>
+#include <gio/gio.h>
 
 #include <systemd/sd-login.h>
 
@@ -46,8 +47,36 @@ typedef struct _GdmSessionFile {
         char    *translated_comment;
 } GdmSessionFile;
 
+typedef struct _GdmSessionsWatch {
+        guint                  id;
+        GdmSessionsChangedFunc func;
+        gpointer               user_data;
+        GDestroyNotify         notify;
+} GdmSessionsWatch;
+
+/* Every usable session file, keyed by id */
 static GHashTable *gdm_available_sessions_map;
 
+/* The subset of gdm_available_sessions_map left after dropping sessions
+ * with duplicate names, and its ids sorted by name. Both are rebuilt
+ * lazily after the available sessions change.
+ */
+static GHashTable *gdm_visible_sessions_map;
+static char      **gdm_visible_session_ids;
+static gboolean    gdm_visible_sessions_are_stale = TRUE;
+
+/* Search directories, most important first */
+static char      **gdm_session_dirs;
+static GPtrArray  *gdm_session_dir_monitors;
+
+/* Thread default when the monitors were set up; their events and the
+ * change notifications are dispatched there */
+static GMainContext *gdm_sessions_context;
+
+static GList      *gdm_sessions_watches;
+static guint       gdm_sessions_next_watch_id = 1;
+static GSource    *gdm_sessions_changed_source;
+
 static gboolean gdm_sessions_map_is_initialized = FALSE;
 
 static void
@@ -170,13 +199,19 @@ key_file_is_relevant (GKeyFile     *key_file)
         return TRUE;
 }
 
-static void
-load_session_file (const char              *id,
-                   const char              *path)
+/* Returns %TRUE if the file at @path decides what @id resolves to:
+ * either a usable session, or a hidden one that masks files with the
+ * same id further down the search path.
+ */
+static gboolean
+load_session_file (const char      *id,
+                   const char      *path,
+                   GdmSessionFile **session_out)
 {
         GKeyFile          *key_file;
         GError            *error;
         gboolean           res;
+        gboolean           decided = FALSE;
         GdmSessionFile    *session;
 
         key_file = g_key_file_new ();
@@ -185,7 +220,8 @@ load_session_file (const char              *id,
         res = g_key_file_load_from_file (key_file, path, 0, &error);
 
         if (!res) {
-                g_debug ("Failed to load \"%s\": %s\n", path, error->message);
+                if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+                        g_debug ("Failed to load \"%s\": %s\n", path, error->message);
                 g_error_free (error);
                 goto out;
         }
@@ -200,9 +236,10 @@ load_session_file (const char              *id,
                 goto out;
         }
 
+        decided = TRUE;
+
         if (!key_file_is_relevant (key_file)) {
                 g_debug ("\"%s\" is hidden, contains non-executable TryExec program, or is otherwise not capable of being used\n", path);
-                g_hash_table_remove (gdm_available_sessions_map, id);
                 goto out;
         }
 
@@ -214,66 +251,241 @@ load_session_file (const char              *id,
         session->translated_name = g_key_file_get_locale_string (key_file, G_KEY_FILE_DESKTOP_GROUP, "Name", NULL, NULL);
         session->translated_comment = g_key_file_get_locale_string (key_file, G_KEY_FILE_DESKTOP_GROUP, "Comment", NULL, NULL);
 
-        g_hash_table_insert (gdm_available_sessions_map,
-                             g_strdup (id),
-                             session);
+        *session_out = session;
  out:
         g_key_file_free (key_file);
+
+        return decided;
 }
 
-static gboolean
-remove_duplicate_sessions (gpointer key,
-                           gpointer value,
-                           gpointer user_data)
+static void
+invalidate_visible_sessions (void)
 {
-        gboolean already_known;
-        GHashTable *names_seen_before;
-        GdmSessionFile *session;
+        /* the visible map doesn't own its entries, so it has to be
+         * emptied before any of them can be freed */
+        g_hash_table_remove_all (gdm_visible_sessions_map);
+        g_clear_pointer (&gdm_visible_session_ids, g_strfreev);
+        gdm_visible_sessions_are_stale = TRUE;
+}
+
+static void
+refresh_session (const char *id)
+{
+        g_autofree char *filename = NULL;
+        GdmSessionFile *session = NULL;
+        int i;
+
+        filename = g_strdup_printf ("%s.desktop", id);
+
+        invalidate_visible_sessions ();
 
-        names_seen_before = (GHashTable *) user_data;
-        session = (GdmSessionFile *) value;
-        already_known = !g_hash_table_add (names_seen_before, session->translated_name);
+        for (i = 0; gdm_session_dirs[i] != NULL; i++) {
+                g_autofree char *full_path = NULL;
+
+                full_path = g_build_filename (gdm_session_dirs[i], filename, NULL);
 
-        if (already_known)
-                g_debug ("GdmSession: Removing %s (%s) as we already have a session by this name",
-                         session->id,
-                         session->path);
+                if (load_session_file (id, full_path, &session))
+                        break;
+        }
 
-        return already_known;
+        if (session != NULL) {
+                g_hash_table_replace (gdm_available_sessions_map,
+                                      g_strdup (id),
+                                      session);
+        } else {
+                g_hash_table_remove (gdm_available_sessions_map, id);
+        }
 }
 
 static void
-collect_sessions_from_directory (const char *dirname)
+collect_session_ids_from_directory (const char *dirname,
+                                    GHashTable *ids)
 {
         g_autoptr (GDir) dir = NULL;
         const char *filename;
 
-        /* FIXME: add file monitor to directory */
-
         dir = g_dir_open (dirname, 0, NULL);
         if (dir == NULL)
                 return;
 
         while ((filename = g_dir_read_name (dir))) {
-                g_autofree char *id = NULL;
-                g_autofree char *full_path = NULL;
-
                 if (!g_str_has_suffix (filename, ".desktop"))
                         continue;
 
-                id = g_strndup (filename, strlen (filename) - strlen (".desktop"));
-                full_path = g_build_filename (dirname, filename, NULL);
+                g_hash_table_add (ids, g_strndup (filename, strlen (filename) - strlen (".desktop")));
+        }
+}
+
+static void
+emit_sessions_changed (void)
+{
+        g_autoptr(GArray) watch_ids = NULL;
+        GList *node;
+        guint i;
+
+        /* Callbacks are free to add or remove watches, so walk a copy
+         * of the ids and look each one up again before calling it */
+        watch_ids = g_array_new (FALSE, FALSE, sizeof (guint));
+        for (node = gdm_sessions_watches; node != NULL; node = node->next) {
+                GdmSessionsWatch *watch = node->data;
 
-                load_session_file (id, full_path);
+                g_array_append_val (watch_ids, watch->id);
+        }
+
+        for (i = 0; i < watch_ids->len; i++) {
+                for (node = gdm_sessions_watches; node != NULL; node = node->next) {
+                        GdmSessionsWatch *watch = node->data;
+
+                        if (watch->id == g_array_index (watch_ids, guint, i)) {
+                                watch->func (watch->user_data);
+                                break;
+                        }
+                }
         }
 }
 
+static gboolean
+on_sessions_changed_idle (gpointer user_data)
+{
+        g_clear_pointer (&gdm_sessions_changed_source, g_source_unref);
+
+        emit_sessions_changed ();
+
+        return G_SOURCE_REMOVE;
+}
+
 static void
-collect_sessions (void)
+queue_sessions_changed (void)
+{
+        /* Package installs touch several files in a row, so coalesce
+         * them into one notification */
+        if (gdm_sessions_changed_source != NULL)
+                return;
+
+        gdm_sessions_changed_source = g_idle_source_new ();
+        g_source_set_callback (gdm_sessions_changed_source, on_sessions_changed_idle, NULL, NULL);
+        g_source_attach (gdm_sessions_changed_source, gdm_sessions_context);
+}
+
+static void collect_sessions (void);
+
+static void
+handle_session_file_changed (GFile *file)
+{
+        g_autofree char *path = NULL;
+        g_autofree char *dirname = NULL;
+        g_autofree char *filename = NULL;
+        g_autofree char *id = NULL;
+
+        if (file == NULL)
+                return;
+
+        path = g_file_get_path (file);
+
+        if (path == NULL)
+                return;
+
+        if (g_strv_contains ((const char * const *) gdm_session_dirs, path)) {
+                g_debug ("GdmSession: search directory %s changed, rereading all sessions", path);
+
+                invalidate_visible_sessions ();
+                g_hash_table_remove_all (gdm_available_sessions_map);
+                collect_sessions ();
+                queue_sessions_changed ();
+                return;
+        }
+
+        if (!g_str_has_suffix (path, ".desktop"))
+                return;
+
+        dirname = g_path_get_dirname (path);
+
+        if (!g_strv_contains ((const char * const *) gdm_session_dirs, dirname))
+                return;
+
+        filename = g_path_get_basename (path);
+        id = g_strndup (filename, strlen (filename) - strlen (".desktop"));
+
+        g_debug ("GdmSession: session file %s changed", path);
+
+        refresh_session (id);
+        queue_sessions_changed ();
+}
+
+static void
+on_session_dir_changed (GFileMonitor      *monitor,
+                        GFile             *file,
+                        GFile             *other_file,
+                        GFileMonitorEvent  event_type,
+                        gpointer           user_data)
+{
+        switch (event_type) {
+        case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+        case G_FILE_MONITOR_EVENT_CREATED:
+        case G_FILE_MONITOR_EVENT_DELETED:
+        case G_FILE_MONITOR_EVENT_MOVED_IN:
+        case G_FILE_MONITOR_EVENT_MOVED_OUT:
+                handle_session_file_changed (file);
+                break;
+        case G_FILE_MONITOR_EVENT_RENAMED:
+                handle_session_file_changed (file);
+                handle_session_file_changed (other_file);
+                break;
+        default:
+                break;
+        }
+}
+
+static void
+monitor_session_dirs (void)
+{
+        int i;
+
+        gdm_sessions_context = g_main_context_ref_thread_default ();
+        gdm_session_dir_monitors = g_ptr_array_new_with_free_func (g_object_unref);
+
+        for (i = 0; gdm_session_dirs[i] != NULL; i++) {
+                g_autoptr(GFile) dir = NULL;
+                g_autoptr(GError) error = NULL;
+                GFileMonitor *monitor;
+
+                dir = g_file_new_for_path (gdm_session_dirs[i]);
+                monitor = g_file_monitor_directory (dir, G_FILE_MONITOR_WATCH_MOVES, NULL, &error);
+
+                if (monitor == NULL) {
+                        g_debug ("GdmSession: could not monitor %s: %s",
+                                 gdm_session_dirs[i], error->message);
+                        continue;
+                }
+
+                g_signal_connect (monitor,
+                                  "changed",
+                                  G_CALLBACK (on_session_dir_changed),
+                                  NULL);
+                g_ptr_array_add (gdm_session_dir_monitors, monitor);
+        }
+}
+
+static void
+add_session_dir (GPtrArray  *dirs_search_array,
+                 const char *dirname)
+{
+        char *session_dir;
+
+        session_dir = g_canonicalize_filename (dirname, "/");
+
+        if (g_ptr_array_find_with_equal_func (dirs_search_array, session_dir, g_str_equal, NULL)) {
+                g_free (session_dir);
+                return;
+        }
+
+        g_ptr_array_add (dirs_search_array, session_dir);
+}
+
+static char **
+get_session_dirs (void)
 {
-        g_autoptr(GHashTable) names_seen_before = NULL;
-        g_autoptr(GPtrArray) dirs_search_array = NULL;
-        gchar      *session_dir = NULL;
+        GPtrArray  *dirs_search_array = NULL;
         int         i;
         const gchar *supported_session_types_env = NULL;
         g_auto (GStrv) supported_session_types = NULL;
@@ -284,8 +496,7 @@ collect_sessions (void)
                 supported_session_types = g_strsplit (supported_session_types_env, ":", -1);
         }
 
-        names_seen_before = g_hash_table_new (g_str_hash, g_str_equal);
-        dirs_search_array = g_ptr_array_new_with_free_func (g_free);
+        dirs_search_array = g_ptr_array_new ();
 
         const char *xorg_search_dirs[] = {
                 "/etc/X11/sessions/",
@@ -295,51 +506,131 @@ collect_sessions (void)
 
         if (!supported_session_types || g_strv_contains ((const char * const *) supported_session_types, "x11")) {
                 for (i = 0; i < G_N_ELEMENTS (xorg_search_dirs); i++) {
-                        g_ptr_array_add (dirs_search_array, g_strdup (xorg_search_dirs[i]));
+                        add_session_dir (dirs_search_array, xorg_search_dirs[i]);
                 }
 
                 for (i = 0; system_data_dirs[i]; i++) {
-                        session_dir = g_build_filename (system_data_dirs[i], "xsessions", NULL);
-                        g_ptr_array_add (dirs_search_array, session_dir);
+                        g_autofree char *session_dir = g_build_filename (system_data_dirs[i], "xsessions", NULL);
+                        add_session_dir (dirs_search_array, session_dir);
                 }
         }
 
         if (!supported_session_types  || g_strv_contains ((const char * const *) supported_session_types, "wayland")) {
                 for (i = 0; system_data_dirs[i]; i++) {
-                        session_dir = g_build_filename (system_data_dirs[i], "wayland-sessions", NULL);
-                        g_ptr_array_add (dirs_search_array, session_dir);
+                        g_autofree char *session_dir = g_build_filename (system_data_dirs[i], "wayland-sessions", NULL);
+                        add_session_dir (dirs_search_array, session_dir);
                 }
         }
 
+        g_ptr_array_add (dirs_search_array, NULL);
+
+        return (char **) g_ptr_array_free (dirs_search_array, FALSE);
+}
+
+static void
+collect_sessions (void)
+{
+        g_autoptr(GHashTable) ids = NULL;
+        GHashTableIter iter;
+        const char *id;
+        int i;
+
         if (gdm_available_sessions_map == NULL) {
                 gdm_available_sessions_map = g_hash_table_new_full (g_str_hash, g_str_equal,
                                                                     g_free, (GDestroyNotify)gdm_session_file_free);
+                gdm_visible_sessions_map = g_hash_table_new (g_str_hash, g_str_equal);
+        }
+
+        if (gdm_session_dirs == NULL) {
+                gdm_session_dirs = get_session_dirs ();
+
+                /* Watch before reading so nothing slips in between */
+                monitor_session_dirs ();
         }
 
-        for (i = dirs_search_array->len - 1; i >= 0; i--) {
-                collect_sessions_from_directory (g_ptr_array_index (dirs_search_array, i));
+        ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+        for (i = 0; gdm_session_dirs[i] != NULL; i++) {
+                collect_session_ids_from_directory (gdm_session_dirs[i], ids);
         }
 
-        g_hash_table_foreach_remove (gdm_available_sessions_map,
-                                     remove_duplicate_sessions,
-                                     names_seen_before);
+        g_hash_table_iter_init (&iter, ids);
+        while (g_hash_table_iter_next (&iter, (gpointer *) &id, NULL)) {
+                refresh_session (id);
+        }
 }
 
 static gint
-compare_session_ids (gconstpointer  a,
-                     gconstpointer  b)
+compare_sessions (gconstpointer  a,
+                  gconstpointer  b)
 {
-        GdmSessionFile *session_a, *session_b;
-        session_a = (GdmSessionFile *) g_hash_table_lookup (gdm_available_sessions_map, a);
-        session_b = (GdmSessionFile *) g_hash_table_lookup (gdm_available_sessions_map, b);
+        const GdmSessionFile *session_a = *(const GdmSessionFile **) a;
+        const GdmSessionFile *session_b = *(const GdmSessionFile **) b;
+        gint ret;
+
+        ret = g_strcmp0 (session_a->translated_name, session_b->translated_name);
+
+        if (ret != 0)
+                return ret;
+
+        return g_strcmp0 (session_a->id, session_b->id);
+}
 
-        if (session_a == NULL)
-                return -1;
+static void
+update_visible_sessions (void)
+{
+        g_autoptr(GPtrArray) sessions = NULL;
+        GPtrArray *ids;
+        GHashTableIter iter;
+        GdmSessionFile *session;
+        GdmSessionFile *previous = NULL;
+        guint i;
+
+        if (!gdm_visible_sessions_are_stale)
+                return;
+
+        sessions = g_ptr_array_new ();
+        g_hash_table_iter_init (&iter, gdm_available_sessions_map);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &session)) {
+                g_ptr_array_add (sessions, session);
+        }
+
+        /* Sorting by name puts sessions with the same name next to
+         * each other, so duplicates can be dropped in one pass */
+        g_ptr_array_sort (sessions, compare_sessions);
+
+        ids = g_ptr_array_new ();
+        for (i = 0; i < sessions->len; i++) {
+                session = g_ptr_array_index (sessions, i);
+
+                if (previous != NULL &&
+                    g_strcmp0 (previous->translated_name, session->translated_name) == 0) {
+                        g_debug ("GdmSession: Removing %s (%s) as we already have a session by this name",
+                                 session->id,
+                                 session->path);
+                        continue;
+                }
+
+                g_hash_table_insert (gdm_visible_sessions_map, session->id, session);
+                g_ptr_array_add (ids, g_strdup (session->id));
+                previous = session;
+        }
+        g_ptr_array_add (ids, NULL);
+
+        gdm_visible_session_ids = (char **) g_ptr_array_free (ids, FALSE);
+        gdm_visible_sessions_are_stale = FALSE;
+}
+
+static void
+ensure_sessions (void)
+{
+        if (!gdm_sessions_map_is_initialized) {
+                collect_sessions ();
 
-        if (session_b == NULL)
-                return 1;
+                gdm_sessions_map_is_initialized = TRUE;
+        }
 
-        return g_strcmp0 (session_a->translated_name, session_b->translated_name);
+        update_visible_sessions ();
 }
 
 /**
@@ -348,35 +639,17 @@ compare_session_ids (gconstpointer  a,
  * Reads /usr/share/xsessions and other relevant places for possible sessions
  * to log into and returns the complete list.
  *
+ * The search directories are watched after the first call, so later calls
+ * reflect sessions that were installed or removed in the meantime.
+ *
  * Returns: (transfer full): a %NULL terminated list of session ids
  */
 char **
 gdm_get_session_ids (void)
 {
-        GHashTableIter iter;
-        gpointer key, value;
-        GPtrArray *array;
-
-        if (!gdm_sessions_map_is_initialized) {
-                collect_sessions ();
-
-                gdm_sessions_map_is_initialized = TRUE;
-        }
-
-        array = g_ptr_array_new ();
-        g_hash_table_iter_init (&iter, gdm_available_sessions_map);
-        while (g_hash_table_iter_next (&iter, &key, &value)) {
-                GdmSessionFile *session;
+        ensure_sessions ();
 
-                session = (GdmSessionFile *) value;
-
-                g_ptr_array_add (array, g_strdup (session->id));
-        }
-        g_ptr_array_add (array, NULL);
-
-        g_ptr_array_sort (array, compare_session_ids);
-
-        return (char **) g_ptr_array_free (array, FALSE);
+        return g_strdupv (gdm_visible_session_ids);
 }
 
 /**
@@ -395,13 +668,9 @@ gdm_get_session_name_and_description (const char  *id,
         GdmSessionFile *session;
         char *name;
 
-        if (!gdm_sessions_map_is_initialized) {
-                collect_sessions ();
-
-                gdm_sessions_map_is_initialized = TRUE;
-        }
+        ensure_sessions ();
 
-        session = (GdmSessionFile *) g_hash_table_lookup (gdm_available_sessions_map,
+        session = (GdmSessionFile *) g_hash_table_lookup (gdm_visible_sessions_map,
                                                           id);
 
         if (session == NULL) {
@@ -416,3 +685,66 @@ gdm_get_session_name_and_description (const char  *id,
 
         return name;
 }
+
+/**
+ * gdm_watch_sessions:
+ * @func: (scope notified): function to call when the list of sessions changes
+ * @user_data: (closure): data to pass to @func
+ * @notify: (nullable): function to free @user_data when the watch is removed
+ *
+ * Arranges for @func to be called from the main context that was the
+ * thread default when sessions were first read, whenever a session is
+ * installed, removed or changed. Call gdm_get_session_ids() again from
+ * @func to get the new list.
+ *
+ * Returns: an id to pass to gdm_unwatch_sessions()
+ */
+guint
+gdm_watch_sessions (GdmSessionsChangedFunc func,
+                    gpointer               user_data,
+                    GDestroyNotify         notify)
+{
+        GdmSessionsWatch *watch;
+
+        g_return_val_if_fail (func != NULL, 0);
+
+        ensure_sessions ();
+
+        watch = g_new0 (GdmSessionsWatch, 1);
+        watch->id = gdm_sessions_next_watch_id++;
+        watch->func = func;
+        watch->user_data = user_data;
+        watch->notify = notify;
+
+        gdm_sessions_watches = g_list_append (gdm_sessions_watches, watch);
+
+        return watch->id;
+}
+
+/**
+ * gdm_unwatch_sessions:
+ * @watch_id: an id returned by gdm_watch_sessions()
+ *
+ * Stops calling the function registered with gdm_watch_sessions().
+ */
+void
+gdm_unwatch_sessions (guint watch_id)
+{
+        GList *node;
+
+        for (node = gdm_sessions_watches; node != NULL; node = node->next) {
+                GdmSessionsWatch *watch = node->data;
+
+                if (watch->id != watch_id)
+                        continue;
+
+                gdm_sessions_watches = g_list_delete_link (gdm_sessions_watches, node);
+
+                if (watch->notify != NULL)
+                        watch->notify (watch->user_data);
+                g_free (watch);
+                return;
+        }
+
+        g_warning ("GdmSession: no session watch with id %u", watch_id);
+}
@@ -28,10 +28,23 @@
 
 G_BEGIN_DECLS
 
+/**
+ * GdmSessionsChangedFunc:
+ * @user_data: data passed to gdm_watch_sessions()
+ *
+ * Called when the list of available sessions changes.
+ */
+typedef void (* GdmSessionsChangedFunc) (gpointer user_data);
+
 char **                gdm_get_session_ids (void);
 char *                 gdm_get_session_name_and_description (const char  *id,
                                                              char       **description);
 
+guint                  gdm_watch_sessions   (GdmSessionsChangedFunc  func,
+                                             gpointer                user_data,
+                                             GDestroyNotify          notify);
+void                   gdm_unwatch_sessions (guint                   watch_id);
+
 G_END_DECLS
 
 #endif /* __GDM_SESSION_H */
@@ -24,6 +24,8 @@
 #include <glib-object.h>
 
 #include "s-common.h"
+#include "s-file-utils.h"
+#include "s-settings.h"
 
 static gboolean no_fork = FALSE;
 static gboolean verbose = FALSE;
@@ -55,6 +57,8 @@ main (int argc, char **argv)
         }
 
         r = srunner_create (suite_common ());
+        srunner_add_suite (r, suite_file_utils ());
+        srunner_add_suite (r, suite_settings ());
 
         if (no_fork) {
                 srunner_set_fork_status (r, CK_NOFORK);
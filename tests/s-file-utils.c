@@ -0,0 +1,178 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <check.h>
+
+#include "gdm-file-utils.h"
+#include "s-file-utils.h"
+
+static char *test_dir;
+
+static void
+setup (void)
+{
+        test_dir = g_dir_make_tmp ("s-file-utils-XXXXXX", NULL);
+        ck_assert (test_dir != NULL);
+}
+
+static void
+teardown (void)
+{
+        g_rmdir (test_dir);
+        g_clear_pointer (&test_dir, g_free);
+}
+
+static void
+write_file (int         dir_fd,
+            const char *name)
+{
+        int fd;
+
+        fd = openat (dir_fd, name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        ck_assert (fd >= 0);
+        ck_assert (write (fd, "data", 4) == 4);
+        close (fd);
+}
+
+START_TEST (test_rm_recursively_at_tree)
+{
+        g_autoptr (GError) error = NULL;
+        g_autofree char *outside = NULL;
+        g_autofree char *tree = NULL;
+        guint64 reclaimed = 0;
+        int fd, sub_fd;
+
+        outside = g_build_filename (test_dir, "outside", NULL);
+        ck_assert (g_file_set_contents (outside, "keep", -1, NULL));
+
+        tree = g_build_filename (test_dir, "tree", NULL);
+        ck_assert (g_mkdir (tree, 0700) == 0);
+
+        fd = open (tree, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        ck_assert (fd >= 0);
+        write_file (fd, "a");
+        write_file (fd, "b");
+        ck_assert (mkdirat (fd, "empty", 0700) == 0);
+        ck_assert (mkdirat (fd, "sub", 0700) == 0);
+        ck_assert (symlinkat (outside, fd, "link") == 0);
+        ck_assert (symlinkat (test_dir, fd, "dir-link") == 0);
+
+        sub_fd = openat (fd, "sub", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        ck_assert (sub_fd >= 0);
+        write_file (sub_fd, "c");
+        ck_assert (mkdirat (sub_fd, "subsub", 0700) == 0);
+        close (sub_fd);
+        close (fd);
+
+        ck_assert (gdm_rm_recursively_at (AT_FDCWD, tree, &reclaimed, &error));
+        ck_assert (error == NULL);
+        ck_assert (reclaimed > 0);
+
+        /* Symlinks are removed, not followed */
+        ck_assert (!g_file_test (tree, G_FILE_TEST_EXISTS));
+        ck_assert (g_file_test (outside, G_FILE_TEST_IS_REGULAR));
+        ck_assert (g_file_test (test_dir, G_FILE_TEST_IS_DIR));
+
+        g_unlink (outside);
+}
+END_TEST
+
+START_TEST (test_rm_recursively_at_deep)
+{
+        g_autoptr (GError) error = NULL;
+        g_autofree char *tree = NULL;
+        struct rlimit old_limit, limit;
+        int fd;
+        guint i;
+
+        tree = g_build_filename (test_dir, "deep", NULL);
+        ck_assert (g_mkdir (tree, 0700) == 0);
+
+        fd = open (tree, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        ck_assert (fd >= 0);
+
+        for (i = 0; i < 2000; i++) {
+                int child_fd;
+
+                write_file (fd, "file");
+                ck_assert (mkdirat (fd, "d", 0700) == 0);
+
+                child_fd = openat (fd, "d", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                ck_assert (child_fd >= 0);
+                close (fd);
+                fd = child_fd;
+        }
+        close (fd);
+
+        /* Far deeper than there are descriptors to hold one per level */
+        ck_assert (getrlimit (RLIMIT_NOFILE, &old_limit) == 0);
+        limit = old_limit;
+        limit.rlim_cur = 64;
+        ck_assert (setrlimit (RLIMIT_NOFILE, &limit) == 0);
+
+        ck_assert (gdm_rm_recursively_at (AT_FDCWD, tree, NULL, &error));
+
+        ck_assert (setrlimit (RLIMIT_NOFILE, &old_limit) == 0);
+
+        ck_assert (error == NULL);
+        ck_assert (!g_file_test (tree, G_FILE_TEST_EXISTS));
+}
+END_TEST
+
+START_TEST (test_rm_recursively_at_single)
+{
+        g_autoptr (GError) error = NULL;
+        g_autofree char *file = NULL;
+        g_autofree char *missing = NULL;
+
+        file = g_build_filename (test_dir, "file", NULL);
+        ck_assert (g_file_set_contents (file, "data", -1, NULL));
+
+        ck_assert (gdm_rm_recursively_at (AT_FDCWD, file, NULL, &error));
+        ck_assert (!g_file_test (file, G_FILE_TEST_EXISTS));
+
+        /* Already gone is fine */
+        missing = g_build_filename (test_dir, "missing", NULL);
+        ck_assert (gdm_rm_recursively_at (AT_FDCWD, missing, NULL, &error));
+        ck_assert (error == NULL);
+}
+END_TEST
+
+Suite *
+suite_file_utils (void)
+{
+        Suite *s;
+        TCase *tc_core;
+
+        s = suite_create ("gdm-file-utils");
+        tc_core = tcase_create ("core");
+
+        tcase_add_checked_fixture (tc_core, setup, teardown);
+        tcase_add_test (tc_core, test_rm_recursively_at_tree);
+        tcase_add_test (tc_core, test_rm_recursively_at_deep);
+        tcase_add_test (tc_core, test_rm_recursively_at_single);
+        suite_add_tcase (s, tc_core);
+
+        return s;
+}
@@ -0,0 +1,329 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <check.h>
+
+#include "gdm-settings-desktop-backend.h"
+#include "gdm-settings-direct.h"
+#include "gdm-settings-keys.h"
+#include "s-settings.h"
+
+static void
+setup (void)
+{
+}
+
+static void
+teardown (void)
+{
+}
+
+START_TEST (test_settings_table_keys)
+{
+        g_autoptr (GHashTable) keys = NULL;
+        guint i;
+
+        keys = g_hash_table_new (g_str_hash, g_str_equal);
+
+        for (i = 0; i < GDM_SETTING_COUNT; i++) {
+                const GdmSettingInfo *info = &gdm_settings_table[i];
+                const char *slash;
+
+                ck_assert (info->key != NULL);
+
+                /* Looked up as group/name in the key files */
+                slash = strchr (info->key, '/');
+                ck_assert (slash != NULL);
+                ck_assert (slash != info->key);
+                ck_assert (slash[1] != '\0');
+
+                ck_assert (g_hash_table_add (keys, (gpointer) info->key));
+
+                ck_assert (info->type == GDM_SETTING_TYPE_BOOLEAN ||
+                           info->type == GDM_SETTING_TYPE_INT ||
+                           info->type == GDM_SETTING_TYPE_STRING);
+
+                if (info->type == GDM_SETTING_TYPE_STRING)
+                        ck_assert (info->default_value.string != NULL);
+        }
+}
+END_TEST
+
+START_TEST (test_settings_table_defaults)
+{
+        const GdmSettingInfo *info;
+
+        info = &gdm_settings_table[GDM_KEY_TIMED_LOGIN_DELAY];
+        ck_assert_str_eq (info->key, "daemon/TimedLoginDelay");
+        ck_assert (info->type == GDM_SETTING_TYPE_INT);
+        ck_assert_int_eq (info->default_value.integer, 30);
+
+        info = &gdm_settings_table[GDM_KEY_FALLBACK_SESSION];
+        ck_assert_str_eq (info->key, "daemon/FallbackSession");
+        ck_assert (info->type == GDM_SETTING_TYPE_STRING);
+        ck_assert_str_eq (info->default_value.string, "gnome");
+
+        info = &gdm_settings_table[GDM_KEY_AUTO_LOGIN_USER];
+        ck_assert (info->type == GDM_SETTING_TYPE_STRING);
+        ck_assert_str_eq (info->default_value.string, "");
+
+        info = &gdm_settings_table[GDM_KEY_INITIAL_SETUP_ENABLE];
+        ck_assert_str_eq (info->key, "daemon/InitialSetupEnable");
+        ck_assert (info->type == GDM_SETTING_TYPE_BOOLEAN);
+        ck_assert (info->default_value.boolean);
+
+        info = &gdm_settings_table[GDM_KEY_AUTO_LOGIN_ENABLE];
+        ck_assert (info->type == GDM_SETTING_TYPE_BOOLEAN);
+        ck_assert (!info->default_value.boolean);
+}
+END_TEST
+
+/* Every setting, set to something other than its default. Only the
+ * first @n_values are included, and the first one has the wrong type
+ * if @wrong_type */
+static GVariant *
+build_snapshot_values (guint    n_values,
+                       gboolean wrong_type)
+{
+        GVariantBuilder builder;
+        guint i;
+
+        g_variant_builder_init (&builder, G_VARIANT_TYPE ("av"));
+
+        for (i = 0; i < n_values; i++) {
+                const GdmSettingInfo *info = &gdm_settings_table[i];
+                g_autofree char *string = NULL;
+
+                if (i == 0 && wrong_type) {
+                        if (info->type == GDM_SETTING_TYPE_STRING)
+                                g_variant_builder_add (&builder, "v", g_variant_new_int32 (0));
+                        else
+                                g_variant_builder_add (&builder, "v", g_variant_new_string ("wrong"));
+                        continue;
+                }
+
+                switch (info->type) {
+                case GDM_SETTING_TYPE_BOOLEAN:
+                        g_variant_builder_add (&builder, "v", g_variant_new_boolean (!info->default_value.boolean));
+                        break;
+                case GDM_SETTING_TYPE_INT:
+                        g_variant_builder_add (&builder, "v", g_variant_new_int32 (info->default_value.integer + 1));
+                        break;
+                case GDM_SETTING_TYPE_STRING:
+                        string = g_strdup_printf ("value-%u", i);
+                        g_variant_builder_add (&builder, "v", g_variant_new_string (string));
+                        break;
+                default:
+                        g_assert_not_reached ();
+                }
+        }
+
+        return g_variant_builder_end (&builder);
+}
+
+static char *
+write_snapshot (const char *checksum,
+                GVariant   *values)
+{
+        g_autoptr (GVariant) snapshot = NULL;
+        g_autoptr (GError) error = NULL;
+        char *path = NULL;
+        int fd;
+
+        snapshot = g_variant_ref_sink (g_variant_new ("(s@av)", checksum, values));
+
+        fd = g_file_open_tmp ("s-settings-XXXXXX.snapshot", &path, &error);
+        ck_assert (fd >= 0);
+        close (fd);
+
+        ck_assert (g_file_set_contents (path,
+                                        g_variant_get_data (snapshot),
+                                        g_variant_get_size (snapshot),
+                                        &error));
+
+        return path;
+}
+
+START_TEST (test_settings_snapshot_round_trip)
+{
+        g_autofree char *path = NULL;
+        g_autofree char *published_path = NULL;
+        g_autofree char *contents = NULL;
+        g_autofree char *published_contents = NULL;
+        gsize length, published_length;
+        guint i;
+        int fd;
+
+        path = write_snapshot (GDM_SETTINGS_TABLE_CHECKSUM,
+                               build_snapshot_values (GDM_SETTING_COUNT, FALSE));
+
+        ck_assert (gdm_settings_direct_init_from_snapshot (path));
+
+        for (i = 0; i < GDM_SETTING_COUNT; i++) {
+                const GdmSettingInfo *info = &gdm_settings_table[i];
+                g_autofree char *expected = NULL;
+                g_autofree char *string = NULL;
+                gboolean boolean;
+                int integer;
+
+                switch (info->type) {
+                case GDM_SETTING_TYPE_BOOLEAN:
+                        ck_assert (gdm_settings_direct_get_boolean (i, &boolean));
+                        ck_assert (boolean == !info->default_value.boolean);
+                        break;
+                case GDM_SETTING_TYPE_INT:
+                        ck_assert (gdm_settings_direct_get_int (i, &integer));
+                        ck_assert_int_eq (integer, info->default_value.integer + 1);
+                        break;
+                case GDM_SETTING_TYPE_STRING:
+                        expected = g_strdup_printf ("value-%u", i);
+                        ck_assert (gdm_settings_direct_get_string (i, &string));
+                        ck_assert_str_eq (string, expected);
+                        break;
+                default:
+                        g_assert_not_reached ();
+                }
+        }
+
+        /* Publishing what was loaded gives back the same snapshot */
+        fd = g_file_open_tmp ("s-settings-XXXXXX.snapshot", &published_path, NULL);
+        ck_assert (fd >= 0);
+        close (fd);
+
+        gdm_settings_direct_publish (published_path);
+        gdm_settings_direct_shutdown ();
+
+        ck_assert (g_file_get_contents (path, &contents, &length, NULL));
+        ck_assert (g_file_get_contents (published_path, &published_contents, &published_length, NULL));
+        ck_assert_int_eq (length, published_length);
+        ck_assert (memcmp (contents, published_contents, length) == 0);
+
+        g_unlink (path);
+        g_unlink (published_path);
+}
+END_TEST
+
+START_TEST (test_settings_snapshot_rejected)
+{
+        g_autofree char *other_build = NULL;
+        g_autofree char *short_values = NULL;
+        g_autofree char *wrong_type = NULL;
+
+        ck_assert (!gdm_settings_direct_init_from_snapshot ("/nonexistent/settings.snapshot"));
+
+        other_build = write_snapshot ("0000000000000000",
+                                      build_snapshot_values (GDM_SETTING_COUNT, FALSE));
+        ck_assert (!gdm_settings_direct_init_from_snapshot (other_build));
+        g_unlink (other_build);
+
+        short_values = write_snapshot (GDM_SETTINGS_TABLE_CHECKSUM,
+                                       build_snapshot_values (GDM_SETTING_COUNT - 1, FALSE));
+        ck_assert (!gdm_settings_direct_init_from_snapshot (short_values));
+        g_unlink (short_values);
+
+        wrong_type = write_snapshot (GDM_SETTINGS_TABLE_CHECKSUM,
+                                     build_snapshot_values (GDM_SETTING_COUNT, TRUE));
+        ck_assert (!gdm_settings_direct_init_from_snapshot (wrong_type));
+        g_unlink (wrong_type);
+}
+END_TEST
+
+START_TEST (test_settings_merge_on_save)
+{
+        g_autoptr (GdmSettingsBackend) backend = NULL;
+        g_autoptr (GKeyFile) key_file = NULL;
+        g_autoptr (GError) error = NULL;
+        g_autofree char *dir = NULL;
+        g_autofree char *path = NULL;
+        g_autofree char *lock = NULL;
+        g_autofree char *value = NULL;
+
+        dir = g_dir_make_tmp ("s-settings-XXXXXX", &error);
+        ck_assert (dir != NULL);
+
+        path = g_build_filename (dir, "custom.conf", NULL);
+        lock = g_build_filename (dir, "settings.lock", NULL);
+        gdm_settings_desktop_backend_set_lock_file (lock);
+
+        ck_assert (g_file_set_contents (path, "[daemon]\nTimedLoginDelay=15\n", -1, &error));
+
+        backend = gdm_settings_desktop_backend_new (path);
+        ck_assert (gdm_settings_backend_set_value (backend, "daemon/AutomaticLogin", "alice", &error));
+        ck_assert (gdm_settings_backend_set_value (backend, "daemon/TimedLoginDelay", "25", &error));
+
+        /* Someone else edits the file before our changes get saved */
+        ck_assert (g_file_set_contents (path,
+                                        "[daemon]\n"
+                                        "TimedLoginDelay=20\n"
+                                        "FallbackSession=kde\n",
+                                        -1, &error));
+
+        ck_assert (gdm_settings_desktop_backend_flush (GDM_SETTINGS_DESKTOP_BACKEND (backend), &error));
+
+        /* Their edit is kept, ours go on top of it */
+        key_file = g_key_file_new ();
+        ck_assert (g_key_file_load_from_file (key_file, path, G_KEY_FILE_NONE, &error));
+
+        value = g_key_file_get_value (key_file, "daemon", "AutomaticLogin", NULL);
+        ck_assert_str_eq (value, "alice");
+        g_clear_pointer (&value, g_free);
+
+        value = g_key_file_get_value (key_file, "daemon", "TimedLoginDelay", NULL);
+        ck_assert_str_eq (value, "25");
+        g_clear_pointer (&value, g_free);
+
+        value = g_key_file_get_value (key_file, "daemon", "FallbackSession", NULL);
+        ck_assert_str_eq (value, "kde");
+        g_clear_pointer (&value, g_free);
+
+        /* And the backend picked it up too */
+        ck_assert (gdm_settings_backend_get_value (backend, "daemon/FallbackSession", &value, &error));
+        ck_assert_str_eq (value, "kde");
+
+        g_clear_object (&backend);
+        gdm_settings_desktop_backend_set_lock_file (NULL);
+
+        g_unlink (path);
+        g_unlink (lock);
+        g_rmdir (dir);
+}
+END_TEST
+
+Suite *
+suite_settings (void)
+{
+        Suite *s;
+        TCase *tc_core;
+
+        s = suite_create ("gdm-settings");
+        tc_core = tcase_create ("core");
+
+        tcase_add_checked_fixture (tc_core, setup, teardown);
+        tcase_add_test (tc_core, test_settings_table_keys);
+        tcase_add_test (tc_core, test_settings_table_defaults);
+        tcase_add_test (tc_core, test_settings_snapshot_round_trip);
+        tcase_add_test (tc_core, test_settings_snapshot_rejected);
+        tcase_add_test (tc_core, test_settings_merge_on_save);
+        suite_add_tcase (s, tc_core);
+
+        return s;
+}
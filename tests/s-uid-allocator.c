@@ -0,0 +1,195 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: nil; c-basic-offset: 8 -*-
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <glib.h>
+#include <check.h>
+
+#include "gdm-uid-allocator.h"
+#include "s-uid-allocator.h"
+
+#define UID_MIN 1000
+
+/* UIDs the fake user database reports as taken, indexed from UID_MIN */
+static gboolean taken[256];
+static guint    n_checks;
+
+static gboolean
+is_taken (uid_t    uid,
+          gpointer user_data)
+{
+        n_checks++;
+
+        return uid >= UID_MIN && uid - UID_MIN < G_N_ELEMENTS (taken) && taken[uid - UID_MIN];
+}
+
+static void
+setup (void)
+{
+        memset (taken, 0, sizeof (taken));
+        n_checks = 0;
+}
+
+static void
+teardown (void)
+{
+}
+
+START_TEST (test_allocate_whole_range)
+{
+        g_autoptr (GdmUidAllocator) allocator = NULL;
+        uid_t uid;
+        guint i;
+
+        /* Not a multiple of the bitmap word size, the padding must
+         * never be handed out */
+        allocator = gdm_uid_allocator_new (UID_MIN, UID_MIN + 69, NULL, NULL);
+
+        for (i = 0; i < 70; i++) {
+                ck_assert (gdm_uid_allocator_allocate (allocator, &uid));
+                ck_assert_int_eq (uid, UID_MIN + i);
+                ck_assert (gdm_uid_allocator_is_reserved (allocator, uid));
+        }
+
+        ck_assert (!gdm_uid_allocator_allocate (allocator, &uid));
+}
+END_TEST
+
+START_TEST (test_release_and_reuse)
+{
+        g_autoptr (GdmUidAllocator) allocator = NULL;
+        uid_t uid;
+        guint i;
+
+        allocator = gdm_uid_allocator_new (UID_MIN, UID_MIN + 127, NULL, NULL);
+
+        for (i = 0; i < 128; i++)
+                ck_assert (gdm_uid_allocator_allocate (allocator, &uid));
+
+        gdm_uid_allocator_release (allocator, UID_MIN + 42);
+        ck_assert (!gdm_uid_allocator_is_reserved (allocator, UID_MIN + 42));
+
+        ck_assert (gdm_uid_allocator_allocate (allocator, &uid));
+        ck_assert_int_eq (uid, UID_MIN + 42);
+        ck_assert (!gdm_uid_allocator_allocate (allocator, &uid));
+}
+END_TEST
+
+START_TEST (test_round_robin)
+{
+        g_autoptr (GdmUidAllocator) allocator = NULL;
+        uid_t uid;
+
+        allocator = gdm_uid_allocator_new (UID_MIN, UID_MIN + 9, NULL, NULL);
+
+        ck_assert (gdm_uid_allocator_allocate (allocator, &uid));
+        ck_assert_int_eq (uid, UID_MIN);
+        gdm_uid_allocator_release (allocator, uid);
+
+        /* A released UID isn't handed out again right away */
+        ck_assert (gdm_uid_allocator_allocate (allocator, &uid));
+        ck_assert_int_eq (uid, UID_MIN + 1);
+
+        /* Held back UIDs are skipped */
+        gdm_uid_allocator_reserve (allocator, UID_MIN + 2);
+        ck_assert (gdm_uid_allocator_allocate (allocator, &uid));
+        ck_assert_int_eq (uid, UID_MIN + 3);
+}
+END_TEST
+
+START_TEST (test_out_of_range)
+{
+        g_autoptr (GdmUidAllocator) allocator = NULL;
+
+        allocator = gdm_uid_allocator_new (UID_MIN, UID_MIN + 9, NULL, NULL);
+
+        gdm_uid_allocator_reserve (allocator, UID_MIN - 1);
+        gdm_uid_allocator_reserve (allocator, UID_MIN + 10);
+
+        ck_assert (!gdm_uid_allocator_is_reserved (allocator, UID_MIN - 1));
+        ck_assert (!gdm_uid_allocator_is_reserved (allocator, UID_MIN + 10));
+        ck_assert (!gdm_uid_allocator_is_reserved (allocator, UID_MIN));
+}
+END_TEST
+
+START_TEST (test_skip_taken)
+{
+        g_autoptr (GdmUidAllocator) allocator = NULL;
+        uid_t uid;
+
+        allocator = gdm_uid_allocator_new (UID_MIN, UID_MIN + 9, is_taken, NULL);
+
+        taken[0] = taken[1] = taken[3] = TRUE;
+
+        ck_assert (gdm_uid_allocator_allocate (allocator, &uid));
+        ck_assert_int_eq (uid, UID_MIN + 2);
+        ck_assert_int_eq (n_checks, 3);
+
+        /* Known to be taken, so not looked up again */
+        n_checks = 0;
+        ck_assert (gdm_uid_allocator_allocate (allocator, &uid));
+        ck_assert_int_eq (uid, UID_MIN + 4);
+        ck_assert_int_eq (n_checks, 2);
+
+        ck_assert (!gdm_uid_allocator_is_reserved (allocator, UID_MIN + 3));
+}
+END_TEST
+
+START_TEST (test_taken_becomes_free)
+{
+        g_autoptr (GdmUidAllocator) allocator = NULL;
+        uid_t uid;
+        guint i;
+
+        allocator = gdm_uid_allocator_new (UID_MIN, UID_MIN + 9, is_taken, NULL);
+
+        for (i = 0; i < 10; i++)
+                taken[i] = TRUE;
+
+        ck_assert (!gdm_uid_allocator_allocate (allocator, &uid));
+
+        /* The account went away. Make sure the lookups it was marked
+         * taken at are in the past, so that they get refreshed */
+        taken[5] = FALSE;
+        g_usleep (1000);
+
+        ck_assert (gdm_uid_allocator_allocate (allocator, &uid));
+        ck_assert_int_eq (uid, UID_MIN + 5);
+}
+END_TEST
+
+Suite *
+suite_uid_allocator (void)
+{
+        Suite *s;
+        TCase *tc_core;
+
+        s = suite_create ("gdm-uid-allocator");
+        tc_core = tcase_create ("core");
+
+        tcase_add_checked_fixture (tc_core, setup, teardown);
+        tcase_add_test (tc_core, test_allocate_whole_range);
+        tcase_add_test (tc_core, test_release_and_reuse);
+        tcase_add_test (tc_core, test_round_robin);
+        tcase_add_test (tc_core, test_out_of_range);
+        tcase_add_test (tc_core, test_skip_taken);
+        tcase_add_test (tc_core, test_taken_becomes_free);
+        suite_add_tcase (s, tc_core);
+
+        return s;
+}
@@ -20,9 +20,13 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <locale.h>
 #include <stdlib.h>
 #include <sysexits.h>
+#include <unistd.h>
+#include <sys/file.h>
 
 #include <glib.h>
 
@@ -32,7 +36,10 @@ main (int argc, char *argv[])
         g_autoptr(GKeyFile) key_file = NULL;
         g_autoptr(GError) error = NULL;
         gchar *group, *key, *value;
+        g_autofree char *contents = NULL;
+        gsize length;
         gboolean saved_okay;
+        int lock_fd;
 
         if (argc < 5 || g_strcmp0(argv[1], "set") != 0) {
                 g_printerr("gdm-runtime-config: command format should be " \
@@ -47,6 +54,16 @@ main (int argc, char *argv[])
 
         setlocale (LC_ALL, "");
 
+        g_mkdir_with_parents (GDM_RUN_DIR, 0711);
+
+        /* The daemon takes the same lock before it writes the file, so
+         * neither of us overwrites the other's changes */
+        lock_fd = open (GDM_SETTINGS_LOCK_FILE, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+        if (lock_fd >= 0) {
+                while (flock (lock_fd, LOCK_EX) < 0 && errno == EINTR)
+                        continue;
+        }
+
         key_file = g_key_file_new ();
 
         /* Just load the runtime conf file and ignore the error.  A new file
@@ -61,9 +78,16 @@ main (int argc, char *argv[])
 
         g_key_file_set_value (key_file, group, key, value);
 
-        g_mkdir_with_parents (GDM_RUN_DIR, 0711);
+        contents = g_key_file_to_data (key_file, &length, NULL);
+        saved_okay = g_file_set_contents_full (GDM_RUNTIME_CONF,
+                                               contents,
+                                               length,
+                                               G_FILE_SET_CONTENTS_CONSISTENT | G_FILE_SET_CONTENTS_DURABLE,
+                                               0644,
+                                               &error);
 
-        saved_okay = g_key_file_save_to_file (key_file, GDM_RUNTIME_CONF, &error);
+        if (lock_fd >= 0)
+                close (lock_fd);
 
         if (!saved_okay) {
                 g_printerr ("gdm-runtime-config: unable to set '%s' in '%s' group to '%s': %s\n",